@@ -6237,6 +6237,8 @@ class ArmoryMainWindow(QMainWindow):
 
             LOGINFO('New Block! : %d', TheBDM.getTopBlockHeight())
 
+            # Rebuilt on every block, blocks that don't touch a wallet still
+            # change the confirmation counts
             self.createCombinedLedger()
             self.blkReceived  = RightNow()
             self.writeSetting('LastBlkRecvTime', self.blkReceived)
@@ -105,6 +105,7 @@ from txjsonrpc.auth import wrapResource
 from txjsonrpc.web import jsonrpc
 
 from armoryengine.ALL import *
+from armoryengine.Block import PyBlock
 from armoryengine.Decorators import EmailOutput, catchErrsForJSON
 from armoryengine.PyBtcWalletRecovery import *
 from jasvet import readSigBlock, verifySignature
@@ -3110,18 +3111,21 @@ class Armory_Daemon(object):
                # Here's where we actually execute the new-block calls, because
                # this code is guaranteed to execute AFTER the TheBDM has processed
                # the new block data.
-               # We walk through headers by block height in case the new block
-               # didn't extend the main chain (this won't run), or there was a
-               # reorg with multiple blocks and we only want to process the new
-               # blocks on the main chain, not the invalid ones
-               prevTopBlock = TheBDM.getTopBlockHeight() - newBlocks
-               for blknum in range(newBlocks):
-                  cppHeader = TheBDM.bdv().getHeaderByHeight(prevTopBlock + blknum)
-                  pyHeader = PyBlockHeader().unserialize(cppHeader.serialize())
-
-                  cppBlock = TheBDM.bdv().getMainBlockFromDB(blknum)
-                  pyTxList = [PyTx().unserialize(cppBlock.getSerializedTx(i)) for
-                                 i in range(cppBlock.getNumTx())]
+               # We walk through the new blocks by height, so the invalid ones
+               # of a reorg are skipped, and run the functions on the header
+               # and every tx in the block. The effects sent with the
+               # notification don't do, they only hold the txs touching the
+               # wallets and only for the most recent blocks of a catch up
+               topBlock = TheBDM.getTopBlockHeight()
+               for height in range(topBlock + 1 - newBlocks, topBlock + 1):
+                  rawBlock = TheBDM.bdv().getSerializedMainBlock(height)
+                  if len(rawBlock) == 0:
+                     LOGERROR('New block %d not found', height)
+                     continue
+
+                  pyBlock = PyBlock().unserialize(rawBlock)
+                  pyHeader = pyBlock.blockHeader
+                  pyTxList = pyBlock.blockData.txList
                   for funcKey in self.newBlockFunctions:
                      for blockFunc in self.newBlockFunctions[funcKey]:
                         blockFunc(pyHeader, pyTxList)
@@ -30,6 +30,7 @@ REFRESH_ACTION = 'refresh'
 STOPPED_ACTION = 'stopped'
 WARNING_ACTION = 'warning'
 SCAN_ACTION = 'StartedWalletScan'
+LEDGER_DELTA_ACTION = 'ledgerDelta'
 
 def newTheBDM(isOffline=False):
    global TheBDM
@@ -63,8 +64,12 @@ class PySide_CallBack(Cpp.BDM_CallBack):
             arglist = castArg
          elif action == Cpp.BDMAction_NewBlock:
             act = NEW_BLOCK_ACTION
-            castArg = Cpp.BtcUtils_cast_to_int(arg)
-            arglist.append(castArg)
+            # [new block count, BlockEffects per new block]
+            # The notification lives on the BDM thread's stack, copy the
+            # effects out of it, listeners may run after this returns
+            castArg = Cpp.BtcUtils_cast_to_NewBlockNotification(arg)
+            arglist.append(castArg.newBlockCount_)
+            arglist.append(tuple(castArg.getEffects()))
             TheBDM.topBlockHeight = block
          elif action == Cpp.BDMAction_Refresh:
             act = REFRESH_ACTION
@@ -80,6 +85,21 @@ class PySide_CallBack(Cpp.BDM_CallBack):
             act = SCAN_ACTION
             argstr = Cpp.BtcUtils_cast_to_string_vec(arg)
             arglist.append(argstr)
+         elif action == Cpp.BDMAction_LedgerDelta:
+            # Only listeners that asked for the deltas get them, the others
+            # fetch the ledgers anew on newBlock/newZC/refresh
+            listenerList = TheBDM.getLedgerDeltaListenerList()
+            if len(listenerList) == 0:
+               return
+            castArg = Cpp.BtcUtils_cast_to_LedgerChangeSetVector(arg)
+            for ledgerDeltaListener in listenerList:
+               ledgerDeltaListener(LEDGER_DELTA_ACTION, castArg)
+            return
+         elif action == Cpp.BDMAction_ScanStats:
+            # Throughput of a running scan stage, only logged
+            argstr = Cpp.BtcUtils_cast_to_string(arg)
+            LOGINFO('Scan stats: %s', argstr.strip())
+            return
             
          listenerList = TheBDM.getListenerList()
          for cppNotificationListener in listenerList:
@@ -188,12 +208,18 @@ class BlockDataManager(object):
       
       self.topBlockHeight = 0
       self.cppNotificationListenerList = []
+      self.ledgerDeltaListenerList = []
    
    
    #############################################################################
    @ActLikeASingletonBDM
    def getListenerList(self):
       return self.cppNotificationListenerList
+
+   #############################################################################
+   @ActLikeASingletonBDM
+   def getLedgerDeltaListenerList(self):
+      return self.ledgerDeltaListenerList
          
    
    #############################################################################
@@ -243,6 +269,17 @@ class BlockDataManager(object):
    def unregisterCppNotification(self, cppNotificationListener):
       if cppNotificationListener in self.cppNotificationListenerList:
          self.cppNotificationListenerList.remove(cppNotificationListener)
+
+   #############################################################################
+   @ActLikeASingletonBDM
+   def registerLedgerDeltaListener(self, ledgerDeltaListener):
+      self.ledgerDeltaListenerList.append(ledgerDeltaListener)
+
+   #############################################################################
+   @ActLikeASingletonBDM
+   def unregisterLedgerDeltaListener(self, ledgerDeltaListener):
+      if ledgerDeltaListener in self.ledgerDeltaListenerList:
+         self.ledgerDeltaListenerList.remove(ledgerDeltaListener)
    
    #############################################################################
    @ActLikeASingletonBDM
@@ -303,6 +340,9 @@ class BlockDataManager(object):
          
       if CLI_OPTIONS.clearMempool:
          mode += 4
+
+      if CLI_OPTIONS.restartScan:
+         mode += 8
       return mode
       
    #############################################################################
@@ -8,8 +8,12 @@
 #include "BDM_mainthread.h"
 #include "BlockUtils.h"
 #include "BlockDataViewer.h"
+#include "ThreadPool.h"
 
 #include <ctime>
+#include <chrono>
+#include <mutex>
+#include <algorithm>
 #include <unistd.h>
 #include "pthread.h"
 
@@ -45,7 +49,7 @@ void BDM_Inject::notify()
    pthread_mutex_unlock(&pimpl->notifierLock);
 }
 
-void BDM_Inject::wait(unsigned ms)
+bool BDM_Inject::wait(unsigned ms)
 {
 #ifdef _WIN32_
    ULONGLONG abstime = GetTickCount64();
@@ -60,6 +64,7 @@ void BDM_Inject::wait(unsigned ms)
       if (latertime >= abstime)
          break;
    }
+   const bool notified = pimpl->wantsToRun;
    if (pimpl->wantsToRun)
       run();
    pimpl->wantsToRun=false;
@@ -83,6 +88,7 @@ void BDM_Inject::wait(unsigned ms)
       if (latertime.tv_sec >= abstime.tv_sec && latertime.tv_usec >= abstime.tv_usec)
          break;
    }
+   const bool notified = pimpl->wantsToRun;
    if (pimpl->wantsToRun)
       run();
    pimpl->wantsToRun=false;
@@ -90,6 +96,7 @@ void BDM_Inject::wait(unsigned ms)
    pthread_mutex_unlock(&pimpl->notifierLock);
 #endif
 
+   return notified;
 }
 
 void BDM_Inject::waitRun()
@@ -111,12 +118,187 @@ void BDM_Inject::setFailureFlag()
    pimpl->failure = true;
 }
 
+struct BDM_WorkScheduler::BDM_WorkSchedulerImpl
+{
+   //latency samples kept per queue for the percentiles
+   static const size_t sampleCount_ = 1024;
+
+   struct WorkQueue
+   {
+      bool pending_ = false;
+      uint64_t postedAt_ = 0;
+
+      BDM_WorkLatency counters_;
+      vector<uint64_t> samples_;
+      size_t nextSample_ = 0;
+      uint64_t max_ = 0;
+   };
+
+   mutable mutex lock_;
+   WorkQueue queues_[BDMWork_Count];
+};
+
+namespace
+{
+double latencyPercentile(const vector<uint64_t>& sorted, double pct)
+{
+   if (sorted.empty())
+      return 0.0;
+
+   //nearest rank
+   size_t rank = (size_t)ceil(pct * sorted.size());
+   if (rank > 0)
+      rank--;
+
+   return sorted[min(rank, sorted.size() - 1)] / 1000.0;
+}
+}
+
+BDM_WorkScheduler::BDM_WorkScheduler()
+{
+   pimpl = new BDM_WorkSchedulerImpl;
+}
+
+BDM_WorkScheduler::~BDM_WorkScheduler()
+{
+   delete pimpl;
+}
+
+uint64_t BDM_WorkScheduler::now()
+{
+   return chrono::duration_cast<chrono::microseconds>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool BDM_WorkScheduler::post(BDMWork type)
+{
+   return post(type, now());
+}
+
+bool BDM_WorkScheduler::post(BDMWork type, uint64_t postedAt)
+{
+   if (type >= BDMWork_Count)
+      throw runtime_error("invalid BDM work type");
+
+   unique_lock<mutex> lock(pimpl->lock_);
+   auto& queue = pimpl->queues_[type];
+
+   queue.counters_.posted_++;
+   if (queue.pending_)
+   {
+      //keep the original post time, the request has been waiting since then
+      queue.counters_.coalesced_++;
+      return false;
+   }
+
+   queue.pending_ = true;
+   queue.postedAt_ = postedAt;
+   return true;
+}
+
+bool BDM_WorkScheduler::next(BDMWork &type)
+{
+   return next(type, now());
+}
+
+bool BDM_WorkScheduler::next(BDMWork &type, uint64_t dispatchedAt)
+{
+   unique_lock<mutex> lock(pimpl->lock_);
+
+   for (int i = 0; i < BDMWork_Count; i++)
+   {
+      auto& queue = pimpl->queues_[i];
+      if (!queue.pending_)
+         continue;
+
+      queue.pending_ = false;
+
+      uint64_t waited = 0;
+      if (dispatchedAt > queue.postedAt_)
+         waited = dispatchedAt - queue.postedAt_;
+
+      if (queue.samples_.size() < BDM_WorkSchedulerImpl::sampleCount_)
+         queue.samples_.push_back(waited);
+      else
+         queue.samples_[queue.nextSample_] = waited;
+      queue.nextSample_ = 
+         (queue.nextSample_ + 1) % BDM_WorkSchedulerImpl::sampleCount_;
+
+      queue.max_ = max(queue.max_, waited);
+      queue.counters_.dispatched_++;
+
+      type = (BDMWork)i;
+      return true;
+   }
+
+   return false;
+}
+
+bool BDM_WorkScheduler::isPending(BDMWork type) const
+{
+   if (type >= BDMWork_Count)
+      return false;
+
+   unique_lock<mutex> lock(pimpl->lock_);
+   return pimpl->queues_[type].pending_;
+}
+
+bool BDM_WorkScheduler::hasPendingWork() const
+{
+   unique_lock<mutex> lock(pimpl->lock_);
+   for (const auto& queue : pimpl->queues_)
+   {
+      if (queue.pending_)
+         return true;
+   }
+
+   return false;
+}
+
+BDM_WorkLatency BDM_WorkScheduler::getLatency(BDMWork type) const
+{
+   if (type >= BDMWork_Count)
+      throw runtime_error("invalid BDM work type");
+
+   vector<uint64_t> sorted;
+   BDM_WorkLatency latency;
+
+   {
+      unique_lock<mutex> lock(pimpl->lock_);
+      const auto& queue = pimpl->queues_[type];
+
+      latency = queue.counters_;
+      latency.max_ = queue.max_ / 1000.0;
+      sorted = queue.samples_;
+   }
+
+   sort(sorted.begin(), sorted.end());
+   latency.p50_ = latencyPercentile(sorted, 0.50);
+   latency.p90_ = latencyPercentile(sorted, 0.90);
+   latency.p99_ = latencyPercentile(sorted, 0.99);
+
+   return latency;
+}
+
+void BDM_WorkScheduler::resetLatency()
+{
+   unique_lock<mutex> lock(pimpl->lock_);
+   for (auto& queue : pimpl->queues_)
+   {
+      queue.counters_ = BDM_WorkLatency();
+      queue.samples_.clear();
+      queue.nextSample_ = 0;
+      queue.max_ = 0;
+   }
+}
+
 struct BlockDataManagerThread::BlockDataManagerThreadImpl
 {
    BlockDataManager_LevelDB *bdm=nullptr;
    BlockDataViewer *bdv = nullptr;
    BDM_CallBack *callback=nullptr;
    BDM_Inject *inject=nullptr;
+   BDM_WorkScheduler scheduler;
    pthread_t tID=0;
    int mode=0;
    volatile bool run=false;
@@ -203,6 +385,21 @@ bool BlockDataManagerThread::requestShutdown()
    return false;
 }
 
+BDM_WorkLatency BlockDataManagerThread::getWorkLatency(BDMWork type) const
+{
+   return pimpl->scheduler.getLatency(type);
+}
+
+string BlockDataManagerThread::getScanTelemetry() const
+{
+   return pimpl->bdm->getScanTelemetry().dump();
+}
+
+string BlockDataManagerThread::getThreadPoolStats() const
+{
+   return ThreadPool::getGlobal().dump();
+}
+
 namespace
 {
 class OnFinish
@@ -230,8 +427,25 @@ try
    BDM_CallBack *const callback = pimpl->callback;
 
    OnFinish onFinish(
-      [callback] () { callback->run(BDMAction_Exited, nullptr); }
+      [bdm, callback] () 
+      { 
+         bdm->getScanTelemetry().setCallback(nullptr);
+         callback->run(BDMAction_Exited, nullptr); 
+      }
    );
+
+   //report running stages from the thread running them, scans can take 
+   //hours and the totals are otherwise only logged on exit
+   const unsigned statsInterval = bdm->config().scanStatsIntervalMs;
+   if (statsInterval != 0)
+   {
+      bdm->getScanTelemetry().setCallback(
+         [callback](const ScanStageStats& stats)->void
+         {
+            string statsStr = ScanTelemetry::format(stats);
+            callback->run(BDMAction_ScanStats, &statsStr);
+         }, statsInterval);
+   }
    
    {
       tuple<BDMPhase, double, unsigned, unsigned> lastvalues;
@@ -285,6 +499,11 @@ try
 
          unsigned mode = pimpl->mode & 0x00000003;
          bool clearZc = pimpl->mode & 0x00000004;
+         bool restartScan = pimpl->mode & 0x00000008;
+
+         //interrupted rescans and rebuilds resume by default
+         if (restartScan)
+            bdm->discardScanCheckpoint();
 
          if (mode == 0) bdm->doInitialSyncOnLoad(loadProgress);
          else if (mode == 1) bdm->doInitialSyncOnLoad_Rescan(loadProgress);
@@ -340,89 +559,193 @@ try
    
    //push 'bdm is ready' to Python
    callback->run(BDMAction_Ready, nullptr, bdm->getTopBlockHeight());
+
+   //consumers fetch full history on ready, deltas start from there
+   uint64_t notifiedVersion = bdv->getChangeFeedVersion();
+   const auto notifyLedgerChanges = [&](void)->void
+   {
+      vector<LedgerChangeSet> changes = 
+         bdv->getChangesSince(notifiedVersion);
+      if (changes.empty())
+         return;
+
+      notifiedVersion = changes.back().version_;
+      callback->run(BDMAction_LedgerDelta, &changes, 
+         bdm->getTopBlockHeight());
+   };
    
+   BDM_WorkScheduler& scheduler = pimpl->scheduler;
+
+   //queue up the work flagged since the last pass, as of when it was asked
+   //for. New blocks come without a flag of their own, they are read when a 
+   //block shows up past the last parsed position or when the thread was 
+   //notified, and wait from then on. The first pass reads what came in 
+   //while loading
+   bool notified = true;
+   const auto postFlagged = [&](BDMWork type)->void
+   {
+      uint64_t requestedAt = bdm->takeWorkRequest(type);
+      if (requestedAt == 0)
+         requestedAt = BDM_WorkScheduler::now();
+      scheduler.post(type, requestedAt);
+   };
+
+   const auto pollWork = [&](void)->void
+   {
+      if (notified || bdm->hasNewBlkData())
+         scheduler.post(BDMWork_NewBlock);
+      notified = false;
+
+      if (bdv->getZCflag())
+         postFlagged(BDMWork_ZC);
+
+      if (bdm->sideScanFlag_ || bdm->getScrAddrFilter()->hasPendingMerge())
+         postFlagged(BDMWork_Merge);
+
+      if (bdv->refresh_ != BDV_dontRefresh)
+         postFlagged(BDMWork_Refresh);
+   };
+
    while(pimpl->run)
    {
-      bdm->getScrAddrFilter()->checkForMerge();
+      pollWork();
 
-      if (bdm->sideScanFlag_ == true)
+      BDMWork work;
+      while (pimpl->run && scheduler.next(work))
       {
-         bdm->sideScanFlag_ = false;
-
-         bool doScan = bdm->startSideScan(rescanProgress);
-         
-         vector<string> wltIDs = bdm->getNextWalletIDToScan();
-         if (wltIDs.size() && doScan)
+         switch (work)
+         {
+         case BDMWork_NewBlock:
          {
-            callback->run(BDMAction_StartedWalletScan, &wltIDs);
+            const uint32_t prevTopBlk = bdm->readBlkFileUpdate();
+            if(prevTopBlk > 0)
+            {
+               bdv->scanWallets(prevTopBlk);
+
+               //notify Python that new blocks have been parsed, with what
+               //they did to the wallets so it doesn't have to fetch them
+               const uint32_t topBlk = bdm->blockchain().top().getBlockHeight();
+               NewBlockNotification newBlocks;
+               newBlocks.newBlockCount_ = topBlk + 1 - prevTopBlk;
+               newBlocks.effects_ = bdv->getBlockEffects(prevTopBlk, topBlk);
+               callback->run(BDMAction_NewBlock, &newBlocks,
+                  bdm->getTopBlockHeight()
+               );
+               notifyLedgerChanges();
+            }
+            break;
          }
-      }
 
-      if (bdm->criticalError_.size())
-      {
-         throw runtime_error(bdm->criticalError_.c_str());
-      }
-
-      if(bdv->getZCflag())
-      {
-         bdv->flagRescanZC(false);
-         if (bdv->parseNewZeroConfTx() == true)
+         case BDMWork_ZC:
          {
-            set<BinaryData> newZCTxHash = bdv->getNewZCTxHash();
-            bdv->scanWallets();
+            //requests stamped since the poll are served here, drop their
+            //stamp along with the flag
+            bdv->flagRescanZC(false);
+            bdm->takeWorkRequest(BDMWork_ZC);
+            if (bdv->parseNewZeroConfTx() == true)
+            {
+               set<BinaryData> newZCTxHash = bdv->getNewZCTxHash();
+               bdv->scanWallets();
+
+               vector<LedgerEntry> newZCLedgers;
+
+               for (const auto& txHash : newZCTxHash)
+               {
+                  auto& le_w = bdv->getTxLedgerByHash_FromWallets(txHash);
+                  if (le_w.getTxTime() != 0)
+                     newZCLedgers.push_back(le_w);
+
+                  auto& le_lb = bdv->getTxLedgerByHash_FromLockboxes(txHash);
+                  if (le_lb.getTxTime() != 0)
+                     newZCLedgers.push_back(le_lb);
+               }
+
+               LOGINFO << newZCLedgers.size() << " new ZC Txn";
+               //notify ZC
+               callback->run(BDMAction_ZC, &newZCLedgers);
+               notifyLedgerChanges();
+            }
+            break;
+         }
 
-            vector<LedgerEntry> newZCLedgers;
+         case BDMWork_Merge:
+         {
+            bdm->takeWorkRequest(BDMWork_Merge);
+            bdm->getScrAddrFilter()->checkForMerge();
 
-            for (const auto& txHash : newZCTxHash)
+            if (bdm->sideScanFlag_ == true)
             {
-               auto& le_w = bdv->getTxLedgerByHash_FromWallets(txHash);
-               if (le_w.getTxTime() != 0)
-                  newZCLedgers.push_back(le_w);
+               bdm->sideScanFlag_ = false;
 
-               auto& le_lb = bdv->getTxLedgerByHash_FromLockboxes(txHash);
-               if (le_lb.getTxTime() != 0)
-                  newZCLedgers.push_back(le_lb);
+               bool doScan = bdm->startSideScan(rescanProgress);
+         
+               vector<string> wltIDs = bdm->getNextWalletIDToScan();
+               if (wltIDs.size() && doScan)
+               {
+                  callback->run(BDMAction_StartedWalletScan, &wltIDs);
+               }
             }
-
-            LOGINFO << newZCLedgers.size() << " new ZC Txn";
-            //notify ZC
-            callback->run(BDMAction_ZC, &newZCLedgers);
+            break;
          }
-      }
 
-      if (bdv->refresh_ != BDV_dontRefresh)
-      {
-         unique_lock<mutex> lock(bdv->refreshLock_);
+         case BDMWork_Refresh:
+         {
+            unique_lock<mutex> lock(bdv->refreshLock_);
 
-         BDV_refresh refresh = bdv->refresh_;
-         bdv->refresh_ = BDV_dontRefresh;
-         bdv->scanWallets(UINT32_MAX, UINT32_MAX, refresh);
+            BDV_refresh refresh = bdv->refresh_;
+            bdv->refresh_ = BDV_dontRefresh;
+            bdm->takeWorkRequest(BDMWork_Refresh);
+            bdv->scanWallets(UINT32_MAX, UINT32_MAX, refresh);
          
-         vector<BinaryData> refreshIDVec;
-         for (const auto& refreshID : bdv->refreshIDSet_)
-            refreshIDVec.push_back(refreshID);
+            vector<BinaryData> refreshIDVec;
+            for (const auto& refreshID : bdv->refreshIDSet_)
+               refreshIDVec.push_back(refreshID);
+
+            bdv->refreshIDSet_.clear();
+            callback->run(BDMAction_Refresh, &refreshIDVec);
+            notifyLedgerChanges();
+            break;
+         }
 
-         bdv->refreshIDSet_.clear();
-         callback->run(BDMAction_Refresh, &refreshIDVec);
-      }
+         default:
+            break;
+         }
 
-      const uint32_t prevTopBlk = bdm->readBlkFileUpdate();
-      if(prevTopBlk > 0)
-      {
-         bdv->scanWallets(prevTopBlk);
-
-         //notify Python that new blocks have been parsed
-         int nNewBlocks = bdm->blockchain().top().getBlockHeight() + 1
-            - prevTopBlk;
-         callback->run(BDMAction_NewBlock, &nNewBlocks,
-            bdm->getTopBlockHeight()
-         );
+         if (bdm->criticalError_.size())
+         {
+            throw runtime_error(bdm->criticalError_.c_str());
+         }
+
+         //poll again after every other job, so that new blocks and ZC
+         //don't sit behind the rest of the queue
+         if (work != BDMWork_NewBlock)
+            pollWork();
       }
       
 #ifndef _DEBUG_REPLAY_BLOCKS
-      pimpl->inject->wait(1000);
+      notified = pimpl->inject->wait(1000);
 #endif
    }
+
+   static const char* workNames[BDMWork_Count] = 
+      { "new block", "ZC", "merge", "refresh" };
+
+   for (int i = 0; i < BDMWork_Count; i++)
+   {
+      const BDM_WorkLatency latency = scheduler.getLatency((BDMWork)i);
+      if (latency.dispatched_ == 0)
+         continue;
+
+      LOGINFO << "BDM " << workNames[i] << " queue: " 
+         << latency.dispatched_ << " dispatched, "
+         << latency.coalesced_ << " coalesced, wait p50 " 
+         << latency.p50_ << "ms, p99 " << latency.p99_ << "ms, max "
+         << latency.max_ << "ms";
+   }
+
+   LOGINFO << "BDM scan telemetry:\n"
+      << bdm->getScanTelemetry().dump();
+   LOGINFO << "BDM thread pool: " << ThreadPool::getGlobal().dump();
 }
 catch (std::exception &e)
 {
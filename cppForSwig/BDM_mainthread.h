@@ -61,8 +61,8 @@ public:
    void notify();
    
    // Block for 'ms' milliseconds or until someone
-   // notify()es me
-   void wait(unsigned ms);
+   // notify()es me. True if I was notified
+   bool wait(unsigned ms);
    
    // once notify() is called, only returns on your
    // thread after run() is called
@@ -72,6 +72,61 @@ public:
    void setFailureFlag();
 };
 
+// queue wait times of one BDMWork queue, in milliseconds. Percentiles
+// cover the most recent dispatches only
+
+struct BDM_WorkLatency
+{
+   unsigned posted_ = 0;
+   unsigned coalesced_ = 0;
+   unsigned dispatched_ = 0;
+
+   double p50_ = 0.0;
+   double p90_ = 0.0;
+   double p99_ = 0.0;
+   double max_ = 0.0;
+};
+
+// Decides what the BDM thread works on next. Each BDMWork type is a
+// queue holding at most one pending item: posting a type that is already
+// pending coalesces into it and keeps the original post time, so a burst
+// of ZC or refresh requests costs a single pass. next() always hands out
+// the highest priority pending type, which bounds how long a new block
+// waits to the one job already running.
+//
+// Timestamps are in microseconds on a monotonic clock. The overloads
+// taking a timestamp let tests replay event streams on a simulated clock
+
+class BDM_WorkScheduler
+{
+   struct BDM_WorkSchedulerImpl;
+   BDM_WorkSchedulerImpl *pimpl;
+
+public:
+   BDM_WorkScheduler();
+   ~BDM_WorkScheduler();
+
+   static uint64_t now(void);
+
+   // returns false if the work type was already pending
+   bool post(BDMWork type);
+   bool post(BDMWork type, uint64_t postedAt);
+
+   // pops the highest priority pending work type. Returns false when
+   // all queues are empty
+   bool next(BDMWork &type);
+   bool next(BDMWork &type, uint64_t dispatchedAt);
+
+   bool isPending(BDMWork type) const;
+   bool hasPendingWork(void) const;
+
+   BDM_WorkLatency getLatency(BDMWork type) const;
+   void resetLatency(void);
+
+private:
+   BDM_WorkScheduler(const BDM_WorkScheduler&);
+};
+
 class BlockDataManager_LevelDB;
 class BlockDataViewer;
 
@@ -98,6 +153,15 @@ public:
    // return true if the caller is should wait on callback notification
    bool requestShutdown();
 
+   // queue wait times of the BDM thread's work since it started
+   BDM_WorkLatency getWorkLatency(BDMWork type) const;
+
+   // throughput of the header load, import and scan phases, one line per phase
+   string getScanTelemetry() const;
+
+   // worker pool counts, queue depths and utilization, one line
+   string getThreadPoolStats() const;
+
 private:
    static void* thrun(void *);
    void run();
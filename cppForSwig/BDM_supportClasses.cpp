@@ -9,7 +9,7 @@
 #include "BlockUtils.h"
 #include "txio.h"
 #include "ReorgUpdater.h"
-#include <thread>
+#include "ThreadPool.h"
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -21,20 +21,28 @@ void ScrAddrFilter::getScrAddrCurrentSyncState()
    LMDBEnv::Transaction tx;
    lmdb_->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
 
+   uint32_t watermark = lmdb_->getScanWatermark();
+   uint32_t generation = lmdb_->getScanGeneration();
    for (auto scrAddrPair : scrAddrMap_)
-      getScrAddrCurrentSyncState(scrAddrPair.first);
+      getScrAddrCurrentSyncState(scrAddrPair.first, watermark, generation);
+
+   //The scrAddrs tracked now may not be the ones tracked when the watermark
+   //was written. Move on to a new generation, the first commit rewrites the
+   //SSHs of the scrAddrs registered now
+   if (ownsScanWatermark_)
+      scanGeneration_ = generation + 1;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 void ScrAddrFilter::getScrAddrCurrentSyncState(
-   BinaryData const & scrAddr)
+   BinaryData const & scrAddr, uint32_t watermark, uint32_t generation)
 {
    //grab SSH for scrAddr
    StoredScriptHistory ssh;
    lmdb_->getStoredScriptHistorySummary(ssh, scrAddr);
 
    //update scrAddrData lowest scanned block
-   setScrAddrLastScanned(scrAddr, ssh.alreadyScannedUpToBlk_);
+   setScrAddrLastScanned(scrAddr, ssh.getScannedUpTo(watermark, generation));
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -51,7 +59,9 @@ void ScrAddrFilter::setSSHLastScanned(uint32_t height)
       if (!ssh.isInitialized())
          ssh.uniqueKey_ = scrAddrPair.first;
 
+      //behind the watermark until the main scan picks them up
       ssh.alreadyScannedUpToBlk_ = height;
+      ssh.followsScanWatermark_ = false;
 
       lmdb_->putStoredScriptHistory(ssh);
    }
@@ -99,9 +109,10 @@ bool ScrAddrFilter::registerAddressBatch(
          {
             for (auto& sa : batch.second)
                scrAddrDataForSideScan_.scrAddrsToMerge_.insert({ sa, 0 });
-            mergeFlag_ = true;
+            mergeFlag_.store(true, memory_order_release);
          }
          mergeLock_.store(0, memory_order_release);
+         flagForMerge();
 
          for (auto& batch : wltNAddrMap)
          {
@@ -114,41 +125,61 @@ bool ScrAddrFilter::registerAddressBatch(
          return false;
       }
 
-      //check DB for the scrAddr's SSH
-      StoredScriptHistory ssh;
-         
+      //false: fresh addresses, skip DB scan
+      //true: wipe existing history then rescan from block 0
+      bool doScan = !areNew;
+
+      while (sideScanLock_.fetch_or(1, memory_order_acquire));
+
+      if (doScan && isScanning_ && child_->acceptsJoins_)
+      {
+         //a side scan is running, have it pick up these scrAddrs at its next
+         //block boundary rather than queuing yet another pass from block 0
+         for (auto& batch : wltNAddrMap)
+         {
+            auto& saVec = child_->joinQueue_[batch.first];
+            saVec.insert(saVec.end(), batch.second.begin(), batch.second.end());
+         }
+
+         child_->joinFlag_.store(true, memory_order_release);
+         sideScanLock_.store(0, memory_order_release);
+
+         return false;
+      }
+
+      //coalesce with a pending side scan of the same kind if there is one,
+      //otherwise queue a new one at the end of the chain
+      ScrAddrFilter* sca = nullptr;
       ScrAddrFilter* topChild = this;
       while (topChild->child_)
+      {
          topChild = topChild->child_.get();
 
-      topChild->child_ = shared_ptr<ScrAddrFilter>(copy());
-      ScrAddrFilter* sca = topChild->child_.get();
+         if (topChild == child_.get() && isScanning_)
+            continue;
 
-      sca->setRoot(this);
-        
-      if (!areNew)
+         if (topChild->doScan_ == doScan)
+            sca = topChild;
+      }
+
+      if (sca == nullptr)
       {
-         //mark existing history for wipe and rescan from block 0
-         sca->doScan_ = true;
+         topChild->child_ = shared_ptr<ScrAddrFilter>(copy());
+         sca = topChild->child_.get();
 
-         for (auto& batch : wltNAddrMap)
-         {
-            for (const auto& scrAddr : batch.second)
-               sca->regScrAddrForScan(scrAddr, 0);
-         }
+         sca->setRoot(this);
+         sca->doScan_ = doScan;
       }
-      else
+        
+      for (auto& batch : wltNAddrMap)
       {
-         //mark addresses as fresh to skip DB scan
-         sca->doScan_ = false;
-         for (auto& batch : wltNAddrMap)
-         {
-            for (const auto& scrAddr : batch.second)
-               sca->regScrAddrForScan(scrAddr, 0);
-         }
+         for (const auto& scrAddr : batch.second)
+            sca->regScrAddrForScan(scrAddr, 0);
       }
 
       sca->buildSideScanData(wltNAddrMap);
+      sideScanLock_.store(0, memory_order_release);
+
       flagForScanThread();
 
       return false;
@@ -170,7 +201,18 @@ bool ScrAddrFilter::registerAddressBatch(
 ///////////////////////////////////////////////////////////////////////////////
 void ScrAddrFilter::scanScrAddrThread()
 {
-   //Only one wallet at a time         
+   /***
+   All wallets coalesced into this SCA are scanned in a single pass. 
+   
+   ScrAddrs registered while the pass is running cannot simply be added to 
+   the filter on the fly: they would miss the spends of UTxOs they received 
+   before that point. Instead the pass yields at the next block boundary, 
+   the newcomers are caught up alone from block 0 to the yield block, then 
+   the pass resumes past it with everyone. The catch up only pulls the 
+   blocks matching the newcomers' filters, the blocks already scanned for 
+   the others aren't processed again.
+   ***/
+
    uint32_t endBlock = currentTopBlockHeight();
    vector<string> wltIDs = scrAddrDataForSideScan_.getWalletIDString();
 
@@ -190,16 +232,76 @@ void ScrAddrFilter::scanScrAddrThread()
    }
    else
    {
-      //wipe SSH
       vector<BinaryData> saVec;
       for (const auto& scrAddrPair : scrAddrMap_)
          saVec.push_back(scrAddrPair.first);
+
+      //wipe SSH
       wipeScrAddrsSSH(saVec);
-      saVec.clear();
 
-      //scan from 0
-      topScannedBlockHash =
-         applyBlockRangeToDB(0, endBlock, wltIDs);
+      uint32_t startBlock = 0;
+      while (1)
+      {
+         //scan from where the pass left off, 0 at first
+         if (startBlock <= currentTopBlockHeight())
+         {
+            topScannedBlockHash =
+               applyBlockRangeToDB(startBlock, currentTopBlockHeight(), wltIDs);
+         }
+
+         //pick up scrAddrs that were registered during the scan
+         while (root_->sideScanLock_.fetch_or(1, memory_order_acquire));
+
+         if (joinQueue_.size() == 0)
+         {
+            //close the pass, later registrations go to the next one
+            acceptsJoins_ = false;
+            root_->sideScanLock_.store(0, memory_order_release);
+            break;
+         }
+
+         saVec.clear();
+         for (auto& batch : joinQueue_)
+         {
+            for (auto& scrAddr : batch.second)
+            {
+               if (scrAddrMap_.find(scrAddr) == scrAddrMap_.end())
+                  saVec.push_back(scrAddr);
+            }
+
+            auto& wltAddrVec = scrAddrDataForSideScan_.wltNAddrMap_[batch.first];
+            wltAddrVec.insert(wltAddrVec.end(), 
+               batch.second.begin(), batch.second.end());
+         }
+
+         joinQueue_.clear();
+         joinFlag_.store(false, memory_order_release);
+         root_->sideScanLock_.store(0, memory_order_release);
+
+         wltIDs = scrAddrDataForSideScan_.getWalletIDString();
+
+         //the pass committed everything up to the block it yielded at
+         startBlock = blockchain().getHeaderByHash(
+            topScannedBlockHash).getBlockHeight() + 1;
+
+         if (saVec.size() == 0)
+            continue;
+
+         LOGINFO << saVec.size() << " scrAddrs joined the side scan, "
+            "resuming at block " << startBlock;
+
+         //catch the newcomers up on their own, the resumed pass needs their
+         //UTxOs from before the yield to see them spent
+         wipeScrAddrsSSH(saVec);
+
+         shared_ptr<ScrAddrFilter> catchUp(copy());
+         for (const auto& scrAddr : saVec)
+            catchUp->regScrAddrForScan(scrAddr, 0);
+         catchUp->applyBlockRangeToDB(0, startBlock - 1, wltIDs);
+
+         for (const auto& scrAddr : saVec)
+            scrAddrMap_.insert(make_pair(scrAddr, 0));
+      }
    }
 
    for (auto& batch : scrAddrDataForSideScan_.wltNAddrMap_)
@@ -209,18 +311,10 @@ void ScrAddrFilter::scanScrAddrThread()
          //merge with main ScrAddrScanData object
          merge(topScannedBlockHash);
 
-         vector<BinaryData> addressVec;
-         addressVec.reserve(scrAddrMap_.size());
-
-         //notify the wallets that the scrAddr are ready
-         for (auto& scrAddrPair : scrAddrMap_)
-         {
-            addressVec.push_back(scrAddrPair.first);
-         }
-
-         if (!scrAddrMap_.empty())
+         //notify the wallets that their scrAddr are ready
+         if (!batch.second.empty())
          {
-            batch.first->prepareScrAddrForMerge(addressVec, !((bool)doScan_),
+            batch.first->prepareScrAddrForMerge(batch.second, !((bool)doScan_),
                topScannedBlockHash);
 
             //notify the bdv that it needs to refresh through the wallet
@@ -233,12 +327,16 @@ void ScrAddrFilter::scanScrAddrThread()
    if (root_ != nullptr)
    {
       ScrAddrFilter* root = root_;
+
+      while (root->sideScanLock_.fetch_or(1, memory_order_acquire));
+
       shared_ptr<ScrAddrFilter> newChild = child_;
       root->child_ = newChild;
-
       root->isScanning_ = false;
+      
+      root->sideScanLock_.store(0, memory_order_release);
 
-      if (root->child_)
+      if (newChild)
          root->flagForScanThread();
    }
 
@@ -252,8 +350,8 @@ void ScrAddrFilter::scanScrAddrMapInNewThread()
    auto scanMethod = [this](void)->void
    { this->scanScrAddrThread(); };
 
-   thread scanThread(scanMethod);
-   scanThread.detach();
+   //side scans yield to the main scan's commits, nothing waits on them
+   ThreadPool::getGlobal().submit(scanMethod, TaskPriority_Low);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -275,17 +373,18 @@ void ScrAddrFilter::merge(const BinaryData& lastScannedBlkHash)
          scrAddrMap_.begin(), scrAddrMap_.end());
 
       //set mergeFlag
-      root_->mergeFlag_ = true;
+      root_->mergeFlag_.store(true, memory_order_release);
 
       //release merge lock
       root_->mergeLock_.store(0, memory_order_release);
+      root_->flagForMerge();
    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 void ScrAddrFilter::checkForMerge()
 {
-   if (mergeFlag_ == true)
+   if (mergeFlag_.load(memory_order_acquire))
    {
       /***
       We're about to add a set of newly registered scrAddrs to the BDM's
@@ -334,7 +433,15 @@ void ScrAddrFilter::checkForMerge()
       scrAddrMap_.insert(sca->scrAddrMap_.begin(), sca->scrAddrMap_.end());
       scrAddrDataForSideScan_.scrAddrsToMerge_.clear();
 
-      mergeFlag_ = false;
+      if (utxoSet_ != nullptr)
+      {
+         vector<BinaryData> saVec;
+         for (auto& scrAddrPair : sca->scrAddrMap_)
+            saVec.push_back(scrAddrPair.first);
+         utxoSet_->addScrAddrs(saVec);
+      }
+
+      mergeFlag_.store(false, memory_order_release);
 
       //release lock
       mergeLock_.store(0, memory_order_release);
@@ -363,6 +470,20 @@ uint32_t ScrAddrFilter::scanFrom() const
    return lowestBlock;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+void ScrAddrFilter::unregisterScrAddr(BinaryData& scrAddrIn)
+{
+   scrAddrMap_.erase(scrAddrIn);
+
+   //its SSH stops following the watermark from the next commit on
+   if (ownsScanWatermark_ && scanGeneration_ != UINT32_MAX)
+      ++scanGeneration_;
+
+   //the set would keep tracking its UTxOs
+   if (utxoSet_ != nullptr)
+      utxoSet_->invalidate();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 void ScrAddrFilter::clear()
 {
@@ -376,19 +497,25 @@ void ScrAddrFilter::clear()
 bool ScrAddrFilter::startSideScan(
    function<void(const vector<string>&, double prog, unsigned time)> progress)
 {
+   while (sideScanLock_.fetch_or(1, memory_order_acquire));
+
    ScrAddrFilter* sca = child_.get();
 
-   if (sca != nullptr && !isScanning_)
+   if (sca == nullptr || isScanning_)
    {
-      isScanning_ = true;
-      sca->scanThreadProgressCallback_ = progress;
-      sca->scanScrAddrMapInNewThread();
-
-      if (sca->doScan_ != false)
-         return true;
+      sideScanLock_.store(0, memory_order_release);
+      return false;
    }
 
-   return false;
+   isScanning_ = true;
+   bool doScan = sca->doScan_;
+   sca->acceptsJoins_ = doScan;
+   sideScanLock_.store(0, memory_order_release);
+
+   sca->scanThreadProgressCallback_ = progress;
+   sca->scanScrAddrMapInNewThread();
+
+   return doScan;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -400,16 +527,26 @@ void ScrAddrFilter::buildSideScanData(
       scrAddrDataForSideScan_.startScanFrom_ = 
       min(scrAddrDataForSideScan_.startScanFrom_, scrAddrPair.second);
 
-   scrAddrDataForSideScan_.wltNAddrMap_ = wltNAddrMap;
+   //wallets may be coalesced into a pending side scan, append to their
+   //existing address list
+   for (auto& batch : wltNAddrMap)
+   {
+      auto& saVec = scrAddrDataForSideScan_.wltNAddrMap_[batch.first];
+      saVec.insert(saVec.end(), batch.second.begin(), batch.second.end());
+   }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 const vector<string> ScrAddrFilter::getNextWalletIDToScan(void)
 {
+   vector<string> wltIDs;
+
+   while (sideScanLock_.fetch_or(1, memory_order_acquire));
    if (child_.get() != nullptr)
-      return child_->scrAddrDataForSideScan_.getWalletIDString();
+      wltIDs = child_->scrAddrDataForSideScan_.getWalletIDString();
+   sideScanLock_.store(0, memory_order_release);
    
-   return vector<string>();
+   return wltIDs;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -430,6 +567,7 @@ BinaryData ZeroConfContainer::getNewZCkey()
 Tx ZeroConfContainer::getTxByHash(const BinaryData& txHash) const
 {
    Tx rt;
+   unique_lock<mutex> lock(txMapMutex_);
    const auto keyIter = txHashToDBKey_.find(txHash);
 
    if (keyIter == txHashToDBKey_.end())
@@ -440,6 +578,7 @@ Tx ZeroConfContainer::getTxByHash(const BinaryData& txHash) const
 ///////////////////////////////////////////////////////////////////////////////
 bool ZeroConfContainer::hasTxByHash(const BinaryData& txHash) const
 {
+   unique_lock<mutex> lock(txMapMutex_);
    return (txHashToDBKey_.find(txHash) != txHashToDBKey_.end());
 }
 
@@ -492,7 +631,10 @@ map<BinaryData, vector<BinaryData>> ZeroConfContainer::purge(
    map<BinaryData, Tx>           txMap;
    map<HashString, map<BinaryData, TxIOPair> >  txioMap;
    keyToSpentScrAddr_.clear();
-   txOutsSpentByZC_.clear();
+   {
+      unique_lock<mutex> txMapLock(txMapMutex_);
+      txOutsSpentByZC_.clear();
+   }
 
    LMDBEnv::Transaction tx;
    db_->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
@@ -524,6 +666,9 @@ map<BinaryData, vector<BinaryData>> ZeroConfContainer::purge(
             txHashToDBKey[txHash] = ZCkey;
             txMap[ZCPair.first] = ZCPair.second;
 
+            //the parse results change with the new top block, save them all
+            parsedZC_[ZCPair.first] = newTxIO;
+
             for (const auto& scrAddrTxio : newTxIO)
             {
                auto& txioPair = txioMap[scrAddrTxio.first];
@@ -547,9 +692,8 @@ map<BinaryData, vector<BinaryData>> ZeroConfContainer::purge(
    auto delFromDB = [&, this](void)->void
    { this->updateZCinDB(keysToWrite, keysToDelete); };
 
-   //run in dedicated thread to make sure we can get a RW tx
-   thread delFromDBthread(delFromDB);
-   delFromDBthread.join();
+   //run in a pool worker to make sure we can get a RW tx
+   ThreadPool::getGlobal().submit(delFromDB, TaskPriority_High).get();
 
    //intersect with current container map
    for (const auto& saMapPair : txioMap_)
@@ -577,9 +721,12 @@ map<BinaryData, vector<BinaryData>> ZeroConfContainer::purge(
    }
 
    //copy new containers over
-   txHashToDBKey_ = txHashToDBKey;
-   txMap_ = txMap;
-   txioMap_ = txioMap;
+   {
+      unique_lock<mutex> txMapLock(txMapMutex_);
+      txHashToDBKey_ = txHashToDBKey;
+      txMap_ = txMap;
+      txioMap_ = txioMap;
+   }
 
    //now purge newTxioMap_
    for (auto& newSaTxioPair : newTxioMap_)
@@ -670,10 +817,12 @@ bool ZeroConfContainer::parseNewZC(function<bool(const BinaryData&)> filter,
                );
             if (!newTxIO.empty())
             {
+               unique_lock<mutex> txMapLock(txMapMutex_);
                txHashToDBKey_[txHash] = newZCPair.first;
                txMap_[newZCPair.first] = newZCPair.second;
                
                keysToWrite.push_back(newZCPair.first);
+               parsedZC_[newZCPair.first] = newTxIO;
 
                for (const auto& saTxio : newTxIO)
                {
@@ -693,12 +842,11 @@ bool ZeroConfContainer::parseNewZC(function<bool(const BinaryData&)> filter,
 
       if (updateDb)
       {
-         //write ZC in the new thread to guaranty we can get a RW tx
+         //write ZC in a pool worker to guaranty we can get a RW tx
          auto writeNewZC = [&, this](void)->void
          { this->updateZCinDB(keysToWrite, keysToDelete); };
 
-         thread writeNewZCthread(writeNewZC);
-         writeNewZCthread.join();
+         ThreadPool::getGlobal().submit(writeNewZC, TaskPriority_High).get();
       }
 
       unique_lock<mutex> loopLock(mu_);
@@ -737,6 +885,7 @@ bool ZeroConfContainer::parseNewZC(function<bool(const BinaryData&)> filter,
 bool ZeroConfContainer::getKeyForTxHash(const BinaryData& txHash,
    BinaryData& zcKey) const
 {
+   unique_lock<mutex> lock(txMapMutex_);
    const auto& hashPair = txHashToDBKey_.find(txHash);
    if (hashPair != txHashToDBKey_.end())
    {
@@ -839,6 +988,7 @@ ZeroConfContainer::ZCisMineBulkFilter(const Tx & tx,
             auto& wltIdVec = keyToSpentScrAddr_[ZCkey];
             wltIdVec.push_back(spentSA);
             
+            unique_lock<mutex> txMapLock(txMapMutex_);
             txOutsSpentByZC_.insert(txio.getDBKeyOfOutput());
             continue;
          }
@@ -870,6 +1020,7 @@ ZeroConfContainer::ZCisMineBulkFilter(const Tx & tx,
                auto& wltIdVec = keyToSpentScrAddr_[ZCkey];
                wltIdVec.push_back(sa);
 
+               unique_lock<mutex> txMapLock(txMapMutex_);
                txOutsSpentByZC_.insert(opKey);
             }
          }
@@ -932,16 +1083,28 @@ ZeroConfContainer::ZCisMineBulkFilter(const Tx & tx,
 ///////////////////////////////////////////////////////////////////////////////
 void ZeroConfContainer::clear()
 {
-   txHashToDBKey_.clear();
-   txMap_.clear();
-   txioMap_.clear();
+   {
+      unique_lock<mutex> lock(txMapMutex_);
+      txHashToDBKey_.clear();
+      txMap_.clear();
+      txioMap_.clear();
+   }
    newZCMap_.clear();
    newTxioMap_.clear();
+   parsedZC_.clear();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 bool ZeroConfContainer::isTxOutSpentByZC(const BinaryData& dbkey) 
    const
+{
+   unique_lock<mutex> lock(txMapMutex_);
+   return isTxOutSpentByZCNoLock(dbkey);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool ZeroConfContainer::isTxOutSpentByZCNoLock(const BinaryData& dbkey) 
+   const
 {
    if (txOutsSpentByZC_.find(dbkey) != txOutsSpentByZC_.end())
       return true;
@@ -953,6 +1116,7 @@ bool ZeroConfContainer::isTxOutSpentByZC(const BinaryData& dbkey)
 const map<BinaryData, TxIOPair> ZeroConfContainer::getZCforScrAddr(
    BinaryData scrAddr) const
 {
+   unique_lock<mutex> lock(txMapMutex_);
    auto saIter = txioMap_.find(scrAddr);
 
    if (ITER_IN_MAP(saIter, txioMap_))
@@ -962,7 +1126,7 @@ const map<BinaryData, TxIOPair> ZeroConfContainer::getZCforScrAddr(
 
       for (auto& zcPair : zcMap)
       {
-         if (isTxOutSpentByZC(zcPair.second.getDBKeyOfOutput()))
+         if (isTxOutSpentByZCNoLock(zcPair.second.getDBKeyOfOutput()))
             continue;
 
          returnMap.insert(zcPair);
@@ -989,6 +1153,11 @@ const vector<BinaryData>& ZeroConfContainer::getSpentSAforZCKey(
 void ZeroConfContainer::updateZCinDB(const vector<BinaryData>& keysToWrite, 
    const vector<BinaryData>& keysToDelete)
 {
+   //read-only attachments keep their mempool in RAM, the writer owns the
+   //persisted one
+   if (db_->isReadOnly())
+      return;
+
    //should run in its own thread to make sure we can get a write tx
    DB_SELECT dbs = BLKDATA;
    if (db_->getDbType() != ARMORY_DB_SUPER)
@@ -1004,6 +1173,8 @@ void ZeroConfContainer::updateZCinDB(const vector<BinaryData>& keysToWrite,
       db_->putStoredZC(zcTx, key);
    }
 
+   putParseResults(dbs);
+
    for (auto& key : keysToDelete)
    {
       BinaryData keyWithPrefix;
@@ -1017,6 +1188,9 @@ void ZeroConfContainer::updateZCinDB(const vector<BinaryData>& keysToWrite,
       else
          keyWithPrefix = key;
 
+      if (keyWithPrefix.getSize() >= 7)
+         db_->deleteValue(dbs, DB_PREFIX_ZCPARSE, keyWithPrefix.getSliceRef(1, 6));
+
       LDBIter dbIter(db_->getIterator(dbs));
 
       if (!dbIter.seekTo(keyWithPrefix))
@@ -1044,6 +1218,12 @@ void ZeroConfContainer::loadZeroConfMempool(
    function<bool(const BinaryData&)> filter,
    bool clearMempool)
 {
+   loadedFromCache_ = 0;
+   reparsedOnLoad_ = 0;
+
+   map<BinaryData, BinaryData> parseResults; //<zcKey, parse result>
+   BinaryData parseContext;
+
    //run this in its own scope so the iter and tx are closed in order to open
    //RW tx afterwards
    {
@@ -1086,6 +1266,19 @@ void ZeroConfContainer::loadZeroConfMempool(
             break;
          }
       } while (dbIter.advanceAndRead(DB_PREFIX_ZCDATA));
+
+      if (dbIter.seekToStartsWith(DB_PREFIX_ZCPARSE))
+      {
+         do
+         {
+            BinaryDataRef key = dbIter.getKeyRef();
+
+            if (key.getSize() == 1)
+               parseContext = dbIter.getValueRef();
+            else if (key.getSize() == 7)
+               parseResults[key.getSliceCopy(1, 6)] = dbIter.getValueRef();
+         } while (dbIter.advanceAndRead(DB_PREFIX_ZCPARSE));
+      }
    }
 
    if (clearMempool == true)
@@ -1100,12 +1293,84 @@ void ZeroConfContainer::loadZeroConfMempool(
    }
    else if (newZCMap_.size())
    {   
+      TIMER_START("loadZeroConfMempool");
 
       //copy newZCmap_ to keep the pre parse ZC map
       auto oldZCMap = newZCMap_;
 
-      //now parse the new ZC
-      parseNewZC(filter);
+      /***
+      The saved parse results hold as long as the blocks they were computed 
+      against are still on the main branch and the scrAddr filter hasn't 
+      changed. A ZC needs to be parsed anew if it was mined since, spends 
+      an outpoint that was consumed or created by a block mined since, or 
+      chains off a ZC that needs parsing.
+      ***/
+      set<BinaryData> minedTxHashes, minedOutPoints;
+      bool useParseResults = false;
+
+      if (parseContext.getSize() > 36)
+      {
+         BinaryRefReader brr(parseContext);
+         uint32_t height = brr.get_uint32_t();
+         BinaryData hash = brr.get_BinaryData(32);
+         
+         uint32_t fpSize = (uint32_t)brr.get_var_int();
+         BinaryData fingerprint;
+         if (brr.getSizeRemaining() >= fpSize)
+            fingerprint = brr.get_BinaryData(fpSize);
+
+         if (fingerprint == filterFingerprint_)
+         {
+            useParseResults = getBlocksMinedSince(
+               height, hash, minedTxHashes, minedOutPoints);
+         }
+      }
+
+      if (useParseResults)
+      {
+         set<BinaryData> reparsedTxHashes;
+
+         //ZC keys follow the order the ZC were received in
+         for (const auto& zcPair : oldZCMap)
+         {
+            const BinaryData& txHash = zcPair.second.getThisHash();
+
+            vector<OutPoint> parents;
+            map<BinaryData, map<BinaryData, TxIOPair> > txioMap;
+
+            auto resultIter = parseResults.find(zcPair.first);
+            bool reparse = resultIter == parseResults.end() ||
+               !unserializeParseResult(resultIter->second, parents, txioMap) ||
+               minedTxHashes.find(txHash) != minedTxHashes.end();
+
+            for (const auto& op : parents)
+            {
+               if (reparse)
+                  break;
+
+               reparse = 
+                  minedOutPoints.find(op.serialize()) != minedOutPoints.end() ||
+                  minedTxHashes.find(op.getTxHash()) != minedTxHashes.end() ||
+                  reparsedTxHashes.find(op.getTxHash()) != 
+                     reparsedTxHashes.end();
+            }
+
+            if (reparse)
+            {
+               reparsedTxHashes.insert(txHash);
+               continue;
+            }
+
+            addParsedZC(zcPair.first, zcPair.second, txioMap);
+            newZCMap_.erase(zcPair.first);
+            loadedFromCache_++;
+         }
+      }
+
+      //now parse the remaining ZC
+      reparsedOnLoad_ = newZCMap_.size();
+      if (newZCMap_.size())
+         parseNewZC(filter);
       
       //set the zckey to the highest used index
       if (txMap_.size() > 0)
@@ -1126,10 +1391,286 @@ void ZeroConfContainer::loadZeroConfMempool(
       //no need to run this in a side thread, this code only runs when we have 
       //full control over the main thread
       updateZCinDB(keysToWrite, keysToDelete);
+
+      TIMER_STOP("loadZeroConfMempool");
+      LOGINFO << "Loaded " << oldZCMap.size() << " ZC from mempool in " 
+         << TIMER_READ_SEC("loadZeroConfMempool") << "s (" 
+         << loadedFromCache_ << " from saved parse results, "
+         << reparsedOnLoad_ << " parsed anew)";
    }
 
    enabled_ = true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+void ZeroConfContainer::addParsedZC(const BinaryData& zcKey, const Tx& tx,
+   const map<BinaryData, map<BinaryData, TxIOPair> >& txioMap)
+{
+   //mirrors what parseNewZC and ZCisMineBulkFilter do with a fresh parse
+   unique_lock<mutex> lock(txMapMutex_);
+   txHashToDBKey_[tx.getThisHash()] = zcKey;
+   txMap_[zcKey] = tx;
+
+   for (const auto& saTxio : txioMap)
+   {
+      auto& txioPair = txioMap_[saTxio.first];
+      txioPair.insert(saTxio.second.begin(), saTxio.second.end());
+
+      auto& newTxioPair = newTxioMap_[saTxio.first];
+      newTxioPair.insert(saTxio.second.begin(), saTxio.second.end());
+
+      for (const auto& txio : saTxio.second)
+      {
+         if (!txio.second.hasTxIn() ||
+             txio.second.getTxRefOfInput().getDBKey() != zcKey)
+            continue;
+
+         keyToSpentScrAddr_[zcKey].push_back(saTxio.first);
+         txOutsSpentByZC_.insert(txio.first);
+      }
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void ZeroConfContainer::putParseResults(DB_SELECT dbs)
+{
+   for (const auto& parsed : parsedZC_)
+   {
+      auto txIter = txMap_.find(parsed.first);
+      if (txIter == txMap_.end())
+         continue;
+
+      db_->putValue(dbs, DB_PREFIX_ZCPARSE, parsed.first,
+         serializeParseResult(txIter->second, parsed.second));
+   }
+
+   parsedZC_.clear();
+
+   //context of the saved parse results
+   StoredDBInfo sdbi;
+   db_->getStoredDBInfo(dbs, sdbi, false);
+
+   BinaryWriter bw;
+   bw.put_uint32_t(sdbi.topBlkHgt_);
+   if (sdbi.topBlkHash_.getSize() == 32)
+      bw.put_BinaryData(sdbi.topBlkHash_);
+   else
+      bw.put_BinaryData(BtcUtils::EmptyHash());
+   bw.put_var_int(filterFingerprint_.getSize());
+   bw.put_BinaryData(filterFingerprint_);
+
+   db_->putValue(dbs, DB_PREFIX_ZCPARSE, BinaryDataRef(), bw.getDataRef());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+BinaryData ZeroConfContainer::serializeParseResult(const Tx& tx,
+   const map<BinaryData, map<BinaryData, TxIOPair> >& txioMap)
+{
+   BinaryWriter bw;
+
+   //parent outpoints
+   bw.put_var_int(tx.getNumTxIn());
+   for (uint32_t iin = 0; iin < tx.getNumTxIn(); iin++)
+      bw.put_BinaryData(tx.getPtr() + tx.getTxInOffset(iin), 36);
+
+   bw.put_var_int(txioMap.size());
+   for (const auto& saTxio : txioMap)
+   {
+      bw.put_var_int(saTxio.first.getSize());
+      bw.put_BinaryData(saTxio.first);
+
+      bw.put_var_int(saTxio.second.size());
+      for (const auto& txioPair : saTxio.second)
+      {
+         const TxIOPair& txio = txioPair.second;
+
+         uint8_t flags = 0;
+         if (txio.hasTxIn())         flags |= 0x01;
+         if (txio.isUTXO())          flags |= 0x02;
+         if (txio.isMultisig())      flags |= 0x04;
+         if (txio.isTxOutFromSelf()) flags |= 0x08;
+         if (txio.isFromCoinbase())  flags |= 0x10;
+
+         bw.put_var_int(txioPair.first.getSize());
+         bw.put_BinaryData(txioPair.first);
+
+         bw.put_uint8_t(flags);
+         bw.put_BinaryData(txio.getDBKeyOfOutput());
+         if (txio.hasTxIn())
+            bw.put_BinaryData(txio.getDBKeyOfInput());
+
+         bw.put_uint64_t(txio.getValue());
+         bw.put_uint32_t(txio.getTxTime());
+
+         BinaryData hashOfOutput = txio.getTxHashOfOutput();
+         bw.put_var_int(hashOfOutput.getSize());
+         bw.put_BinaryData(hashOfOutput);
+
+         BinaryData hashOfInput;
+         if (txio.hasTxIn())
+            hashOfInput = txio.getTxHashOfInput();
+         bw.put_var_int(hashOfInput.getSize());
+         bw.put_BinaryData(hashOfInput);
+      }
+   }
+
+   return bw.getData();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool ZeroConfContainer::unserializeParseResult(BinaryDataRef val,
+   vector<OutPoint>& parents,
+   map<BinaryData, map<BinaryData, TxIOPair> >& txioMap)
+{
+   BinaryRefReader brr(val);
+
+   auto readSize = [&brr](size_t& size)->bool
+   {
+      if (brr.getSizeRemaining() == 0)
+         return false;
+      
+      uint8_t first = *brr.getCurrPtr();
+      size_t varIntSize = first < 0xfd ? 1 : 
+         (first == 0xfd ? 3 : (first == 0xfe ? 5 : 9));
+      if (brr.getSizeRemaining() < varIntSize)
+         return false;
+
+      size = (size_t)brr.get_var_int();
+      return true;
+   };
+
+   auto readBytes = [&brr, &readSize](BinaryData& bd)->bool
+   {
+      size_t size;
+      if (!readSize(size) || brr.getSizeRemaining() < size)
+         return false;
+
+      bd = brr.get_BinaryData((uint32_t)size);
+      return true;
+   };
+
+   size_t count;
+   if (!readSize(count) || brr.getSizeRemaining() < count * 36)
+      return false;
+
+   for (size_t i = 0; i < count; i++)
+   {
+      OutPoint op;
+      op.unserialize(brr);
+      parents.push_back(op);
+   }
+
+   size_t saCount;
+   if (!readSize(saCount))
+      return false;
+
+   for (size_t i = 0; i < saCount; i++)
+   {
+      BinaryData scrAddr;
+      size_t txioCount;
+      if (!readBytes(scrAddr) || !readSize(txioCount))
+         return false;
+
+      auto& saTxioMap = txioMap[scrAddr];
+
+      for (size_t y = 0; y < txioCount; y++)
+      {
+         BinaryData key;
+         if (!readBytes(key) || brr.getSizeRemaining() < 9)
+            return false;
+
+         uint8_t flags = brr.get_uint8_t();
+         TxIOPair txio;
+         txio.setTxOut(brr.get_BinaryData(8));
+
+         if (flags & 0x01)
+         {
+            if (brr.getSizeRemaining() < 8)
+               return false;
+            txio.setTxIn(brr.get_BinaryData(8));
+         }
+
+         if (brr.getSizeRemaining() < 12)
+            return false;
+
+         txio.setValue(brr.get_uint64_t());
+         txio.setTxTime(brr.get_uint32_t());
+         txio.setUTXO((flags & 0x02) != 0);
+         txio.setMultisig((flags & 0x04) != 0);
+         txio.setTxOutFromSelf((flags & 0x08) != 0);
+         txio.setFromCoinbase((flags & 0x10) != 0);
+
+         BinaryData hashOfOutput, hashOfInput;
+         if (!readBytes(hashOfOutput) || !readBytes(hashOfInput))
+            return false;
+
+         if (hashOfOutput.getSize())
+            txio.setTxHashOfOutput(hashOfOutput);
+         if (hashOfInput.getSize())
+            txio.setTxHashOfInput(hashOfInput);
+
+         saTxioMap[key] = txio;
+      }
+   }
+
+   return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool ZeroConfContainer::getBlocksMinedSince(uint32_t height, 
+   const BinaryData& hash,
+   set<BinaryData>& minedTxHashes, set<BinaryData>& minedOutPoints)
+{
+   //past this many blocks, parsing the mempool anew is cheaper
+   static const uint32_t maxBlocks = 144;
+
+   auto dbs = db_->getDbSelect(HISTORY);
+
+   LMDBEnv::Transaction historyTx;
+   db_->beginDBTransaction(&historyTx, dbs, LMDB::ReadOnly);
+   LMDBEnv::Transaction blkdataTx;
+   db_->beginDBTransaction(&blkdataTx, BLKDATA, LMDB::ReadOnly);
+   LMDBEnv::Transaction headersTx;
+   db_->beginDBTransaction(&headersTx, HEADERS, LMDB::ReadOnly);
+
+   StoredDBInfo sdbi;
+   if (!db_->getStoredDBInfo(dbs, sdbi, false))
+      return false;
+
+   if (sdbi.topBlkHgt_ < height || sdbi.topBlkHgt_ - height > maxBlocks)
+      return false;
+
+   //the block the parse results were computed against has to still be on
+   //the main branch
+   StoredHeader sbh;
+   if (!db_->getBareHeader(sbh, height) || sbh.thisHash_ != hash)
+      return false;
+
+   for (uint32_t hgt = height + 1; hgt <= sdbi.topBlkHgt_; hgt++)
+   {
+      StoredHeader block;
+      if (!db_->getStoredHeader(
+         block, hgt, db_->getValidDupIDForHeight(hgt), true))
+         return false;
+
+      for (const auto& stxPair : block.stxMap_)
+      {
+         Tx tx = stxPair.second.getTxCopy();
+         if (!tx.isInitialized())
+            return false;
+
+         minedTxHashes.insert(tx.getThisHash());
+
+         for (uint32_t iin = 0; iin < tx.getNumTxIn(); iin++)
+         {
+            minedOutPoints.insert(
+               BinaryData(tx.getPtr() + tx.getTxInOffset(iin), 36));
+         }
+      }
+   }
+
+   return true;
+}
+
 
 // kate: indent-width 3; replace-tabs on;
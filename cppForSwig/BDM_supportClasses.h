@@ -18,6 +18,7 @@
 
 
 class ZeroConfContainer;
+class UtxoSet;
 
 struct ZeroConfData
 {
@@ -75,8 +76,9 @@ public:
    struct ScrAddrSideScanData
    {
       /***
-      scrAddrMap_ is a map so it can only have meta per scrAddr. This means
-      only 1 wallet can be registered per post BDM init address scan.
+      scrAddrMap_ is a map so it can only have meta per scrAddr. The owning
+      wallet of each scrAddr is kept in wltNAddrMap_ instead, which lets
+      several wallets share a single post BDM init address scan.
       ***/
       uint32_t startScanFrom_=0;
       map<shared_ptr<BtcWallet>, vector<BinaryData>> wltNAddrMap_;
@@ -122,13 +124,33 @@ private:
    ScrAddrFilter*                 root_;
    ScrAddrSideScanData            scrAddrDataForSideScan_;
    atomic<int32_t>                mergeLock_;
-   bool                           mergeFlag_=false;
+
+   //written under mergeLock_, read by the BDM thread without it
+   atomic<bool>                   mergeFlag_;
    
    //false: dont scan
    //true: wipe existing SSH then scan
    bool                           doScan_ = true; 
    bool                           isScanning_ = false;
 
+   //set on the BDM's own filter only, copies leave it off
+   bool                           ownsScanWatermark_ = false;
+
+   //the watermark generation the main filter's scans write, picked when 
+   //the filter is loaded, UINT32_MAX until then
+   uint32_t                       scanGeneration_ = UINT32_MAX;
+   shared_ptr<UtxoSet>            utxoSet_;
+
+   //guards the child_ chain and isScanning_ on the root, as well as the
+   //join queue of the running side scan
+   atomic<int32_t>                sideScanLock_;
+
+   //scrAddrs registered while this side scan is running. They are picked
+   //up at the next block boundary, see scanScrAddrThread
+   map<shared_ptr<BtcWallet>, vector<BinaryData>> joinQueue_;
+   atomic<bool>                   joinFlag_;
+   bool                           acceptsJoins_ = false;
+
    void setScrAddrLastScanned(const BinaryData& scrAddr, uint32_t blkHgt)
    {
       auto scrAddrIter = scrAddrMap_.find(scrAddr);
@@ -145,14 +167,16 @@ public:
    const ARMORY_DB_TYPE           armoryDbType_;
   
    ScrAddrFilter(LMDBBlockDatabase* lmdb, ARMORY_DB_TYPE armoryDbType)
-      : lmdb_(lmdb), mergeLock_(0), armoryDbType_(armoryDbType)
+      : lmdb_(lmdb), mergeLock_(0), mergeFlag_(false), sideScanLock_(0), 
+      joinFlag_(false), armoryDbType_(armoryDbType)
    {
       scanThreadProgressCallback_ = 
          [](const vector<string>&, double, unsigned)->void {};
    }
 
    ScrAddrFilter(const ScrAddrFilter& sca) //copy constructor
-      : lmdb_(sca.lmdb_), mergeLock_(0), armoryDbType_(sca.armoryDbType_)
+      : lmdb_(sca.lmdb_), mergeLock_(0), mergeFlag_(false), sideScanLock_(0),
+      joinFlag_(false), armoryDbType_(sca.armoryDbType_)
    {}
    
    virtual ~ScrAddrFilter() { }
@@ -172,8 +196,7 @@ public:
       const map<shared_ptr<BtcWallet>, vector<BinaryData>>& wltNAddrMap,
       bool areNew);
 
-   void unregisterScrAddr(BinaryData& scrAddrIn)
-   { scrAddrMap_.erase(scrAddrIn); }
+   void unregisterScrAddr(BinaryData& scrAddrIn);
 
    void clear(void);
 
@@ -181,7 +204,18 @@ public:
    { return (scrAddrMap_.find(sa) != scrAddrMap_.end()); }
 
    void getScrAddrCurrentSyncState();
-   void getScrAddrCurrentSyncState(BinaryData const & scrAddr);
+   void getScrAddrCurrentSyncState(BinaryData const & scrAddr, 
+      uint32_t watermark, uint32_t generation);
+
+   //Scans of the filter that owns the watermark move it along instead of
+   //rewriting the SSH of every tracked scrAddr, see StoredScriptHistory
+   void setScanWatermarkOwner(bool owns) { ownsScanWatermark_ = owns; }
+   bool ownsScanWatermark(void) const { return ownsScanWatermark_; }
+   uint32_t getScanGeneration(void) const { return scanGeneration_; }
+
+   //the UTxOs of the filter's scrAddrs, kept by the BDM across scans
+   void setUtxoSet(shared_ptr<UtxoSet> utxoSet) { utxoSet_ = utxoSet; }
+   shared_ptr<UtxoSet> getUtxoSet(void) const { return utxoSet_; }
 
    void setSSHLastScanned(uint32_t height);
 
@@ -190,19 +224,28 @@ public:
 
    void scanScrAddrMapInNewThread(void);
 
+   //true when scrAddrs are waiting to join this side scan. The scan yields
+   //at the next block boundary when this is set
+   bool hasPendingJoin(void) const
+   { return joinFlag_.load(memory_order_acquire); }
+
    //pointer to the SCA object held by the bdm
    void setRoot(ScrAddrFilter* sca) { root_ = sca; }
 
    //shared_ptr to the next object in line waiting to get scanned. Only one
    //scan takes place at a time, so if several wallets are imported before
-   //the first one is done scanning, a SCA will be built and referenced to as
-   //the child to previous side thread scan SCA, which will initiate the next 
-   //scan before it cleans itself up
+   //the first one is done scanning, their scrAddrs are coalesced into a 
+   //single SCA, referenced to as the child of the previous side thread scan 
+   //SCA, which will initiate the next scan before it cleans itself up
    void setChild(const shared_ptr<ScrAddrFilter>& sca) { child_  = sca; }
 
    void merge(const BinaryData& lastScannedBlkHash);
    void checkForMerge(void);
 
+   //true when a finished side scan is waiting for checkForMerge
+   bool hasPendingMerge(void) const 
+   { return mergeFlag_.load(memory_order_acquire); }
+
    bool startSideScan(
       function<void(const vector<string>&, double prog, unsigned time)> progress);
 
@@ -218,6 +261,7 @@ protected:
    )=0;
    virtual uint32_t currentTopBlockHeight() const=0;
    virtual void flagForScanThread(void) = 0;
+   virtual void flagForMerge(void) = 0;
    virtual void wipeScrAddrsSSH(const vector<BinaryData>& saVec) = 0;
    virtual Blockchain& blockchain(void) = 0;
    virtual BlockDataManagerConfig config(void) = 0;
@@ -253,6 +297,12 @@ class ZeroConfContainer
    Indeed, at 7 tx/s, including limbo, it is possible a 2 bytes index will
    overflow on long run cycles.
 
+   The parse result of each stored ZC (its parent outpoints and its TxIOs)
+   is saved under DB_PREFIX_ZCPARSE, next to a context entry carrying the
+   top block and scrAddr fingerprint it was computed against. On reload,
+   ZC unaffected by the blocks mined since then are restored from these
+   instead of being parsed anew.
+
    Methods:
    addRawTx takes in a raw tx, hashes it and verifies it isnt already added.
    It then unserializes the transaction to a Tx Object, assigns it a key and
@@ -271,6 +321,14 @@ private:
    std::atomic<uint32_t>       topId_;
    mutex mu_;
 
+   //txHashToDBKey_, txMap_, txioMap_ and txOutsSpentByZC_ are only modified
+   //by the BDM thread, but the hash and scrAddr lookups are also called from
+   //Python threads, which hold no BDM lock
+   mutable mutex txMapMutex_;
+
+   //for callers already holding txMapMutex_
+   bool isTxOutSpentByZCNoLock(const BinaryData& dbKey) const;
+
    //newZCmap_ is ephemeral. Raw ZC are saved until they are processed.
    //The code has a thread pushing new ZC, and set the BDM thread flag
    //to parse it
@@ -287,6 +345,16 @@ private:
 
    vector<BinaryData> emptyVecBinData_;
 
+   //parse results waiting for updateZCinDB,
+   //<zcKey, <scrAddr, <dbKeyOfOutput, TxIOPair>>>
+   map<BinaryData, map<BinaryData, map<BinaryData, TxIOPair> > > parsedZC_;
+
+   //fingerprint of the scrAddr filter when the mempool was loaded
+   BinaryData filterFingerprint_;
+
+   uint32_t loadedFromCache_ = 0;
+   uint32_t reparsedOnLoad_ = 0;
+
 private:
    BinaryData getNewZCkey(void);
    bool RemoveTxByKey(const BinaryData key);
@@ -299,6 +367,17 @@ private:
       function<bool(const BinaryData&)>,
       bool withSecondOrderMultisig = true);
 
+   void putParseResults(DB_SELECT dbs);
+   static BinaryData serializeParseResult(const Tx& tx,
+      const map<BinaryData, map<BinaryData, TxIOPair> >& txioMap);
+   static bool unserializeParseResult(BinaryDataRef val,
+      vector<OutPoint>& parents,
+      map<BinaryData, map<BinaryData, TxIOPair> >& txioMap);
+   void addParsedZC(const BinaryData& zcKey, const Tx& tx,
+      const map<BinaryData, map<BinaryData, TxIOPair> >& txioMap);
+   bool getBlocksMinedSince(uint32_t height, const BinaryData& hash,
+      set<BinaryData>& minedTxHashes, set<BinaryData>& minedOutPoints);
+
 public:
    ZeroConfContainer(LMDBBlockDatabase* db) :
       topId_(0), db_(db) {}
@@ -334,6 +413,14 @@ public:
       const vector<BinaryData>& keysToWrite, const vector<BinaryData>& keysToDel);
 
    void loadZeroConfMempool(function<bool(const BinaryData&)>, bool clearMempool);
+
+   void setFilterFingerprint(const BinaryData& fingerprint)
+   { filterFingerprint_ = fingerprint; }
+
+   //ZC restored from their saved parse result and ZC parsed anew by the
+   //last loadZeroConfMempool call
+   pair<uint32_t, uint32_t> getReloadCounts(void) const
+   { return make_pair(loadedFromCache_, reparsedOnLoad_); }
 };
 
 #endif
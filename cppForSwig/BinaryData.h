@@ -54,6 +54,7 @@
 #define DEFAULT_BUFFER_SIZE 32*1048576
 
 #include "UniversalTimer.h"
+#include "SecureAllocator.h"
 
 #define READHEX        BinaryData::CreateFromHex
 
@@ -570,7 +571,8 @@ public:
    static BinaryData EmptyBinData_;
 
 private:
-   vector<uint8_t> data_;
+   //from the secure pool for SecureBinaryData, see SecureAllocator.h
+   vector<uint8_t, SecureAwareAllocator<uint8_t> > data_;
 
 private:
    void alloc(size_t sz) 
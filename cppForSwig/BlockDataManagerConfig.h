@@ -39,6 +39,43 @@ struct BlockDataManagerConfig
    BinaryData genesisBlockHash;
    BinaryData genesisTxHash;
    BinaryData magicBytes;
+
+   //fullnode: maintain per block scrAddr filters and use them to skip blocks
+   //during sparse scans
+   bool useBlockFilters;
+
+   //attach to a database maintained by another process: no blk file 
+   //parsing, no scans, headers are refreshed from the db instead
+   bool readOnly;
+
+   //size cap of the backend's worker pool, 0 sizes it from the core count.
+   //Raised to ThreadPool::MIN_BACKEND_THREADS if below
+   unsigned workerThreads;
+
+   //check the scrypt proof of work of headers before adding them to the
+   //chain, as Litecoin nodes do. Off by default: the network parameters 
+   //selectNetwork picks are still Bitcoin's
+   bool checkHeaderPoW;
+
+   //wallet ledgers of blocks at least this deep are kept on disk, so pages 
+   //of old history load without going through SSH again. 0 turns it off
+   unsigned ledgerCacheDepth;
+
+   //how much a scan buffers before committing, see FlushController. The
+   //adaptive policy tunes the batch toward flushTargetMs per commit, within
+   //[flushMinBytes, flushMaxBytes] and under half of flushMemoryCap. 0 picks
+   //the defaults, a quarter of the available RAM for the cap
+   bool adaptiveFlush;
+   unsigned flushTargetMs;
+   uint64_t flushMinBytes;
+   uint64_t flushMaxBytes;
+   uint64_t flushMemoryCap;
+
+   //scan telemetry: rates are computed over the trailing scanStatsWindowMs,
+   //and running stages are reported to BDM_CallBack (BDMAction_ScanStats) 
+   //at most every scanStatsIntervalMs. 0 turns the reports off
+   unsigned scanStatsWindowMs;
+   unsigned scanStatsIntervalMs;
    
    void setGenesisBlockHash(const BinaryData &h)
    {
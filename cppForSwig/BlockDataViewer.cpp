@@ -104,6 +104,9 @@ void BlockDataViewer::scanWallets(uint32_t startBlock,
    }
    const bool reorg = (lastScanned_ > startBlock);
 
+   const uint32_t firstScanned = 
+      *min_element(startBlocks.begin(), startBlocks.end());
+
    sbIter = startBlocks.begin();
    for (auto& group : groups_)
    {
@@ -119,6 +122,145 @@ void BlockDataViewer::scanWallets(uint32_t startBlock,
 
    zeroConfCont_.resetNewZC();
    lastScanned_ = endBlock;
+
+   publishLedgerChanges();
+   if (firstScanned < endBlock)
+      publishBlockEffects(firstScanned, endBlock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockDataViewer::publishLedgerChanges()
+{
+   LedgerChangeSet changeSet;
+   for (unsigned i = 0; i < groups_.size(); i++)
+      groups_[i].popLedgerDeltas(changeSet.wallets_, i == group_lockbox);
+
+   if (changeSet.wallets_.empty())
+      return;
+
+   changeSet.topBlock_ = getTopBlockHeight();
+
+   unique_lock<mutex> lock(changeFeedLock_);
+   changeSet.version_ = ++changeFeedVersion_;
+   changeFeed_.push_back(move(changeSet));
+
+   while (changeFeed_.size() > CHANGE_FEED_DEPTH)
+      changeFeed_.pop_front();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const uint32_t BlockDataViewer::BLOCK_EFFECTS_DEPTH;
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockDataViewer::publishBlockEffects(uint32_t startBlock, 
+   uint32_t endBlock)
+{
+   map<uint32_t, BlockEffects> newEffects;
+   for (uint32_t height = max(startBlock, 
+           endBlock - min(endBlock, BLOCK_EFFECTS_DEPTH));
+        height < endBlock; height++)
+   {
+      auto& header = bc_->getHeaderByHeight(height);
+
+      auto& effects = newEffects[height];
+      effects.height_ = height;
+      effects.blockHash_ = header.getThisHash();
+      effects.rawHeader_ = header.serialize();
+   }
+
+   for (unsigned i = 0; i < groups_.size(); i++)
+      groups_[i].popBlockEffects(newEffects, i == group_lockbox);
+
+   //a tx touching several wallets is listed once, in block order
+   for (auto& effects : values(newEffects))
+   {
+      map<uint32_t, BinaryData> txHashes;
+      for (const auto& wltEffects : effects.wallets_)
+      {
+         for (unsigned i = 0; i < wltEffects.txHashes_.size(); i++)
+            txHashes[wltEffects.txIndexes_[i]] = wltEffects.txHashes_[i];
+      }
+
+      for (auto& txHash : values(txHashes))
+         effects.txHashes_.push_back(move(txHash));
+   }
+
+   unique_lock<mutex> lock(blockEffectsLock_);
+
+   //a reorg replaces the effects of the blocks it undid
+   blockEffects_.erase(
+      blockEffects_.lower_bound(startBlock), blockEffects_.end());
+   blockEffects_.insert(newEffects.begin(), newEffects.end());
+
+   while (blockEffects_.size() > BLOCK_EFFECTS_DEPTH)
+      blockEffects_.erase(blockEffects_.begin());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BlockEffects BlockDataViewer::getBlockEffects(uint32_t height) const
+{
+   unique_lock<mutex> lock(blockEffectsLock_);
+   
+   auto effectsIter = blockEffects_.find(height);
+   if (effectsIter == blockEffects_.end())
+      return BlockEffects();
+
+   return effectsIter->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<BlockEffects> BlockDataViewer::getBlockEffects(
+   uint32_t startHeight, uint32_t endHeight) const
+{
+   unique_lock<mutex> lock(blockEffectsLock_);
+
+   vector<BlockEffects> effects;
+   auto effectsIter = blockEffects_.lower_bound(startHeight);
+   while (effectsIter != blockEffects_.end() && 
+          effectsIter->first <= endHeight)
+   {
+      effects.push_back(effectsIter->second);
+      ++effectsIter;
+   }
+
+   return effects;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t BlockDataViewer::getChangeFeedVersion() const
+{
+   unique_lock<mutex> lock(changeFeedLock_);
+   return changeFeedVersion_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<LedgerChangeSet> BlockDataViewer::getChangesSince(
+   uint64_t version) const
+{
+   unique_lock<mutex> lock(changeFeedLock_);
+   vector<LedgerChangeSet> changes;
+
+   if (version >= changeFeedVersion_)
+      return changes;
+
+   if (changeFeed_.empty() || changeFeed_.front().version_ > version + 1)
+   {
+      //the consumer is too far behind to patch its history
+      LedgerChangeSet resetSet;
+      resetSet.version_ = changeFeedVersion_;
+      resetSet.topBlock_ = getTopBlockHeight();
+      resetSet.resetAll_ = true;
+      changes.push_back(move(resetSet));
+      return changes;
+   }
+
+   for (const auto& changeSet : changeFeed_)
+   {
+      if (changeSet.version_ > version)
+         changes.push_back(changeSet);
+   }
+
+   return changes;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -147,6 +289,7 @@ void BlockDataViewer::addNewZeroConfTx(BinaryData const & rawTx,
       txtime = (uint32_t)time(nullptr);
 
    zeroConfCont_.addRawTx(rawTx, txtime);
+   bdmPtr_->stampWorkRequest(BDMWork_ZC);
    flagRescanZC(true);
 }
 
@@ -161,6 +304,7 @@ void BlockDataViewer::enableZeroConf(bool clearMempool)
    auto zcFilter = [this](const BinaryData& scrAddr)->bool
    { return this->bdmPtr_->getScrAddrFilter()->hasScrAddress(scrAddr); };
 
+   zeroConfCont_.setFilterFingerprint(bdmPtr_->getScrAddrFingerprint());
    zeroConfCont_.loadZeroConfMempool(zcFilter, clearMempool);
 }
 
@@ -382,6 +526,9 @@ void BlockDataViewer::reset()
 
    lastScanned_ = 0;
    initialized_ = false;
+
+   unique_lock<mutex> lock(blockEffectsLock_);
+   blockEffects_.clear();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -458,6 +605,7 @@ void BlockDataViewer::flagRefresh(BDV_refresh refresh, const BinaryData& refresh
 
    unique_lock<mutex> lock(refreshLock_);
 
+   bdmPtr_->stampWorkRequest(BDMWork_Refresh);
    if (refresh_ != BDV_refreshAndRescan)
    {
       if (refresh == BDV_refreshAndRescan)
@@ -485,6 +633,12 @@ StoredHeader BlockDataViewer::getMainBlockFromDB(uint32_t height) const
    return getBlockFromDB(height, dupID);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+BinaryData BlockDataViewer::getSerializedMainBlock(uint32_t height) const
+{
+   return getMainBlockFromDB(height).getSerializedBlock();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 StoredHeader BlockDataViewer::getBlockFromDB(uint32_t height, uint8_t dupID) const
 {
@@ -494,6 +648,24 @@ StoredHeader BlockDataViewer::getBlockFromDB(uint32_t height, uint8_t dupID) con
    return sbh;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+bool BlockDataViewer::getAddressSummary(const BinaryData& scrAddr,
+   StoredAddrSummary& sas) const
+{
+   checkBDMisReady();
+
+   if (bdmPtr_->config().armoryDbType != ARMORY_DB_SUPER)
+      throw runtime_error("address summaries are only kept in supernode");
+
+   LMDBEnv::Transaction tx;
+   db_->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+
+   if (db_->getAddrSummaryStartHeight() != 0)
+      return false;
+
+   return db_->getStoredAddrSummary(sas, scrAddr);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 bool BlockDataViewer::scrAddressIsRegistered(const BinaryData& scrAddr) const
 {
@@ -531,11 +703,8 @@ vector<UnspentTxOut> BlockDataViewer::getUnspentTxoutsForAddr160List(
    {
       const auto& zcTxioMap = zeroConfCont_.getZCforScrAddr(scrAddr);
 
-      StoredScriptHistory ssh;
-      db_->getStoredScriptHistory(ssh, scrAddr);
-
       map<BinaryData, UnspentTxOut> scrAddrUtxoMap;
-      db_->getFullUTXOMapForSSH(ssh, scrAddrUtxoMap);
+      db_->getUTXOMapForScrAddr(scrAddr, scrAddrUtxoMap);
 
       for (const auto& utxoPair : scrAddrUtxoMap)
       {
@@ -951,42 +1120,29 @@ vector<LedgerEntry> WalletGroup::getHistoryPage(uint32_t pageId,
 
    hist_.setCurrentPage(pageId);
 
-   vector<LedgerEntry> vle;
+   //sorted by column, only the result is turned into LedgerEntry objects
+   LedgerTable pageTable;
 
    {
       //globalLedger_.clear();
       ReadWriteLock::ReadLock rl(lock_);
       for (auto& wlt : values(wallets_))
       {
-         auto getTxio = [&wlt](uint32_t start, uint32_t end,
-            map<BinaryData, TxIOPair>& outMap)->void
-         { return wlt->getTxioForRange(start, end, outMap); };
-
-         auto buildLedgers = [&wlt](map<BinaryData, LedgerEntry>& le,
-            const map<BinaryData, TxIOPair>& txioMap,
-            uint32_t startBlock, uint32_t endBlock)->void
-         { wlt->updateWalletLedgersFromTxio(le, txioMap, startBlock, endBlock); };
+         auto getLedgers = [&wlt](uint32_t start, uint32_t end,
+            map<BinaryData, LedgerEntry>& leMap)->void
+         { wlt->getLedgersForRange(start, end, leMap); };
 
          if (!wlt->uiFilter_)
             continue;
 
          map<BinaryData, LedgerEntry> leMap;
-         hist_.getPageLedgerMap(getTxio, buildLedgers, pageId, leMap);
-
-         for (const LedgerEntry& le : values(leMap))
-            vle.push_back(le);
+         hist_.getPageLedgerMap(getLedgers, pageId, leMap);
+         pageTable.append(leMap);
       }
    }
 
-   if (order_ == order_ascending)
-      sort(vle.begin(), vle.end());
-   else
-   {
-      LedgerEntry_DescendingOrder desc;
-      sort(vle.begin(), vle.end(), desc);
-   }
-
-   return vle;
+   pageTable.sortByEntry(order_ != order_ascending);
+   return pageTable.toVector();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1010,6 +1166,43 @@ void WalletGroup::merge()
       wlt->merge();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void WalletGroup::popLedgerDeltas(vector<WalletLedgerDelta>& deltas,
+   bool isLockbox)
+{
+   ReadWriteLock::ReadLock rl(lock_);
+   for (auto& wlt : values(wallets_))
+   {
+      auto delta = wlt->popLedgerDelta();
+      if (delta.empty())
+         continue;
+
+      delta.isLockbox_ = isLockbox;
+      deltas.push_back(move(delta));
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void WalletGroup::popBlockEffects(map<uint32_t, BlockEffects>& effects,
+   bool isLockbox)
+{
+   ReadWriteLock::ReadLock rl(lock_);
+   for (auto& wlt : values(wallets_))
+   {
+      //always pop, effects for blocks that aren't reported anymore go too
+      auto wltEffects = wlt->popBlockEffects();
+      for (auto& blockEffects : wltEffects)
+      {
+         auto effectsIter = effects.find(blockEffects.first);
+         if (effectsIter == effects.end())
+            continue;
+
+         blockEffects.second.isLockbox_ = isLockbox;
+         effectsIter->second.wallets_.push_back(move(blockEffects.second));
+      }
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void WalletGroup::scanWallets(uint32_t startBlock, uint32_t endBlock, 
    bool reorg, map<BinaryData, vector<BinaryData> > invalidatedZCKeys)
@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 #include <string>
+#include <deque>
 
 using namespace std;
 
@@ -137,6 +138,10 @@ public:
       bool writeToFile);
    void purgeZeroConfPool(void);
    bool isZcEnabled() const { return zcEnabled_; }
+
+   //<restored from saved parse results, parsed anew> for the last reload
+   pair<uint32_t, uint32_t> getZcReloadCounts(void) const
+   { return zeroConfCont_.getReloadCounts(); }
    bool parseNewZeroConfTx(void);
 
    TX_AVAILABILITY   getTxHashAvail(BinaryDataRef txhash) const;
@@ -179,6 +184,9 @@ public:
    void notifyMainThread(void) const { bdmPtr_->notifyMainThread(); }
 
    StoredHeader getMainBlockFromDB(uint32_t height) const;
+   //raw block (header, tx count and txs), empty if the db doesn't have it
+   //whole. StoredHeader isn't wrapped, this is the one Python reads
+   BinaryData getSerializedMainBlock(uint32_t height) const;
    StoredHeader getBlockFromDB(uint32_t height, uint8_t dupID) const;
    bool scrAddressIsRegistered(const BinaryData& scrAddr) const;
    
@@ -189,6 +197,12 @@ public:
       getUnspentTxoutsForAddr160List(
       const vector<BinaryData>&, bool ignoreZc) const;
 
+   //Supernode only, a single lookup for any scrAddr. False if it has no 
+   //history, or if the index doesn't go back to genesis (DB scanned before
+   //the index existed, it needs a rebuild)
+   bool getAddressSummary(const BinaryData& scrAddr, 
+      StoredAddrSummary& sas) const;
+
    bool isBDMRunning(void) const 
    { 
       if (bdmPtr_ == nullptr)
@@ -245,6 +259,21 @@ public:
    bool getZCflag(void) const
    { return rescanZC_.load(memory_order_acquire); }
 
+   //ledger change feed: every scan that changes a wallet's history or 
+   //balance publishes a LedgerChangeSet under the next version
+   uint64_t getChangeFeedVersion(void) const;
+   vector<LedgerChangeSet> getChangesSince(uint64_t version) const;
+
+   //what each of the last BLOCK_EFFECTS_DEPTH blocks did to the registered
+   //wallets, recorded by the scan that picked the block up. Uninitialized if
+   //the height isn't held
+   static const uint32_t BLOCK_EFFECTS_DEPTH = 144;
+
+   BlockEffects getBlockEffects(uint32_t height) const;
+   //heights in [startHeight, endHeight], the ones held
+   vector<BlockEffects> getBlockEffects(
+      uint32_t startHeight, uint32_t endHeight) const;
+
 public:
 
    //refresh notifications
@@ -273,6 +302,20 @@ private:
 
    uint32_t lastScanned_ = 0;
    bool initialized_ = false;
+
+   //how many change sets are kept for late consumers
+   static const size_t CHANGE_FEED_DEPTH = 64;
+
+   mutable mutex changeFeedLock_;
+   deque<LedgerChangeSet> changeFeed_;
+   uint64_t changeFeedVersion_ = 0;
+
+   mutable mutex blockEffectsLock_;
+   map<uint32_t, BlockEffects> blockEffects_;
+
+private:
+   void publishLedgerChanges(void);
+   void publishBlockEffects(uint32_t startBlock, uint32_t endBlock);
 };
 
 
@@ -334,6 +377,8 @@ private:
 
    map<BinaryData, shared_ptr<BtcWallet> > getWalletMap(void) const;
    shared_ptr<BtcWallet> getWalletByID(const BinaryData& ID) const;
+   void popLedgerDeltas(vector<WalletLedgerDelta>& deltas, bool isLockbox);
+   void popBlockEffects(map<uint32_t, BlockEffects>& effects, bool isLockbox);
 
    uint32_t getBlockInVicinity(uint32_t) const;
    uint32_t getPageIdForBlockHeight(uint32_t) const;
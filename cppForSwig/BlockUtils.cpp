@@ -13,6 +13,8 @@
 #include "BlockWriteBatcher.h"
 #include "lmdbpp.h"
 #include "Progress.h"
+#include "ThreadPool.h"
+#include "ScryptPoW.h"
 #include "util.h"
 
 #include "ReorgUpdater.h"
@@ -147,7 +149,68 @@ public:
    
    uint64_t totalBlockchainBytes() const { return totalBlockchainBytes_; }
    unsigned numBlockFiles() const { return blkFiles_.size(); }
+
+   // true if there is a block past pos, where header reading left off, or
+   // a blk file after it. The files are preallocated in chunks, their size
+   // doesn't change with every block, so this reads the 4 bytes at pos:
+   // zeros (or eof) if nothing was appended, the magic bytes otherwise
+   bool hasNewData(const BlockFilePosition &pos) const
+   {
+      ifstream is(BtcUtils::getBlkFilename(blkFileLocation_, pos.first),
+         ios::binary);
+      if (is.is_open())
+      {
+         BinaryData magic(4);
+         is.seekg(pos.second, ios::beg);
+         is.read(magic.getCharPtr(), 4);
+         if (is.good() && READ_UINT32_LE(magic.getPtr()) != 0)
+            return true;
+      }
+
+      return BtcUtils::GetFileSize(BtcUtils::getBlkFilename(
+         blkFileLocation_, pos.first + 1)) != FILE_DOES_NOT_EXIST;
+   }
    
+   // true if the block at offset in blk file fnum is there, with this hash
+   // and size. Reads that one header only
+   bool isBlockAt(
+      const BinaryData &hash, size_t fnum, uint64_t offset, uint32_t blksize
+   ) const
+   {
+      if (fnum >= blkFiles_.size())
+         return false;
+
+      const BlkFile &f = blkFiles_[fnum];
+      if (offset + 8 + blksize > f.filesize || blksize < HEADER_SIZE)
+         return false;
+
+      ifstream is(f.path, ios::binary);
+      is.seekg(offset, ios::beg);
+
+      BinaryData magic(4), szstr(4), rawHead(HEADER_SIZE);
+      is.read(magic.getCharPtr(), 4);
+      is.read(szstr.getCharPtr(), 4);
+      is.read(rawHead.getCharPtr(), HEADER_SIZE);
+      if (!is.good())
+         return false;
+
+      if (magic != magicBytes_ || READ_UINT32_LE(szstr.getPtr()) != blksize)
+         return false;
+
+      BinaryData h(32);
+      BtcUtils::getHash256(rawHead, h);
+      return h == hash;
+   }
+
+   // true if header reading can resume at this position
+   bool isResumePosition(const BlockFilePosition &pos) const
+   {
+      if (pos.first >= blkFiles_.size())
+         return false;
+
+      return pos.second <= blkFiles_[pos.first].filesize;
+   }
+
    uint64_t offsetAtStartOfFile(size_t fnum) const
    {
       if (fnum==0) return 0;
@@ -709,6 +772,18 @@ BlockDataManagerConfig::BlockDataManagerConfig()
 {
    armoryDbType = ARMORY_DB_BARE;
    pruneType = DB_PRUNE_NONE;
+   useBlockFilters = true;
+   readOnly = false;
+   workerThreads = 0;
+   checkHeaderPoW = false;
+   ledgerCacheDepth = 6;
+   adaptiveFlush = true;
+   flushTargetMs = 0;
+   flushMinBytes = 0;
+   flushMaxBytes = 0;
+   flushMemoryCap = 0;
+   scanStatsWindowMs = 10000;
+   scanStatsIntervalMs = 60000;
 }
 
 BlockDataManagerConfig::BlockDataManagerConfig(const BlockDataManagerConfig& in)
@@ -730,6 +805,19 @@ BlockDataManagerConfig& BlockDataManagerConfig::operator=(
       genesisBlockHash = in.genesisBlockHash;
       genesisTxHash = in.genesisTxHash;
       magicBytes = in.magicBytes;
+
+      useBlockFilters = in.useBlockFilters;
+      readOnly = in.readOnly;
+      workerThreads = in.workerThreads;
+      checkHeaderPoW = in.checkHeaderPoW;
+      ledgerCacheDepth = in.ledgerCacheDepth;
+      adaptiveFlush = in.adaptiveFlush;
+      flushTargetMs = in.flushTargetMs;
+      flushMinBytes = in.flushMinBytes;
+      flushMaxBytes = in.flushMaxBytes;
+      flushMemoryCap = in.flushMemoryCap;
+      scanStatsWindowMs = in.scanStatsWindowMs;
+      scanStatsIntervalMs = in.scanStatsIntervalMs;
    }
 
    return *this;
@@ -863,9 +951,15 @@ protected:
    
    virtual void flagForScanThread(void)
    {
+      bdm_->stampWorkRequest(BDMWork_Merge);
       bdm_->sideScanFlag_ = true;
    }
 
+   virtual void flagForMerge(void)
+   {
+      bdm_->stampWorkRequest(BDMWork_Merge);
+   }
+
    virtual void wipeScrAddrsSSH(const vector<BinaryData>& saVec)
    {
       bdm_->wipeScrAddrsSSH(saVec);
@@ -897,7 +991,14 @@ BlockDataManager_LevelDB::BlockDataManager_LevelDB(const BlockDataManagerConfig
    auto isready = [this](void)->bool { return this->isReady(); };
    iface_ = new LMDBBlockDatabase(isready);
 
+   for (auto& requestedAt : workRequestedAt_)
+      requestedAt.store(0, memory_order_relaxed);
+
    scrAddrData_ = make_shared<BDM_ScrAddrFilter>(this);
+   scrAddrData_->setScanWatermarkOwner(true);
+
+   utxoSet_ = make_shared<UtxoSet>();
+   scrAddrData_->setUtxoSet(utxoSet_);
    setConfig(bdmConfig);
 }
 
@@ -910,6 +1011,21 @@ void BlockDataManager_LevelDB::setConfig(
       config_.blkFileLocation,
       config_.magicBytes
    );
+   //only side scans read the filters, and supernode doesn't run those
+   iface_->setBuildBlockFilters(config_.useBlockFilters &&
+      config_.armoryDbType != ARMORY_DB_SUPER);
+   iface_->setReadOnly(config_.readOnly);
+
+   unsigned workerThreads = config_.workerThreads;
+   if (workerThreads != 0 && workerThreads < ThreadPool::MIN_BACKEND_THREADS)
+   {
+      LOGWARN << "Worker thread cap " << workerThreads << " is too low, "
+         "using " << ThreadPool::MIN_BACKEND_THREADS;
+      workerThreads = ThreadPool::MIN_BACKEND_THREADS;
+   }
+   ThreadPool::getGlobal().setMaxThreads(workerThreads);
+
+   scanTelemetry_.setWindow(config_.scanStatsWindowMs);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -971,6 +1087,9 @@ pair<BlockFilePosition, vector<BlockHeader*>>
       &prog,
       readBlockHeaders_->totalBlockchainBytes()
    );
+   ScanTelemetry::StageScope telemetryScope(
+      &scanTelemetry_, ScanStage_HeaderLoad);
+
    uint64_t totalOffset=0;
    bool suppressOutput = false;
    if (fileAndOffset.first == 0 && fileAndOffset.second == 0)
@@ -978,28 +1097,81 @@ pair<BlockFilePosition, vector<BlockHeader*>>
    
    class StopReading {};
 
+   struct ReadHeader
+   {
+      BlockHeader header_;
+      BlockFilePosition pos_;
+      uint32_t nTx_;
+      uint32_t blkSize_;
+   };
+
+   auto addHeader = [&](ReadHeader& read)->void
+   {
+      const HashString blockhash = read.header_.getThisHash();
+      BlockHeader& addedBlock = blockchain().addNewBlock(
+         blockhash, read.header_, suppressOutput);
+
+      blockHeadersAdded.push_back(&addedBlock);
+
+      addedBlock.setBlockFileNum(read.pos_.first);
+      addedBlock.setBlockFileOffset(read.pos_.second);
+      addedBlock.setNumTx(read.nTx_);
+      addedBlock.setBlockSize(read.blkSize_);
+   };
+
+   //with PoW checks on, headers are checked in batches over the thread pool
+   //and only the valid ones make it to the chain
+   static const size_t powBatchSize = 4096;
+   vector<ReadHeader> powBatch;
+
+   auto checkPoWBatch = [&](void)->void
+   {
+      vector<BinaryDataRef> raw;
+      raw.reserve(powBatch.size());
+      for (auto& read : powBatch)
+         raw.push_back(read.header_.serialize().getRef());
+
+      const vector<uint8_t> valid =
+         ScryptPoW::checkHeaders(raw, ThreadPool::getGlobal());
+
+      for (size_t i = 0; i < powBatch.size(); i++)
+      {
+         if (valid[i])
+         {
+            addHeader(powBatch[i]);
+            continue;
+         }
+
+         LOGERR << "Header " << powBatch[i].header_.getThisHash().toHexStr(true)
+            << " in file " << powBatch[i].pos_.first << " at offset "
+            << powBatch[i].pos_.second << " fails proof of work, skipping it";
+      }
+
+      powBatch.clear();
+   };
+
    auto blockHeaderCallback
       = [&] (const BinaryData &blockdata, const BlockFilePosition &pos, uint32_t blksize)
       {
-         BlockHeader block;
+         ReadHeader read;
          BinaryRefReader brr(blockdata);
-         block.unserialize(brr);
-         
-         const HashString blockhash = block.getThisHash();
-         
-         const uint32_t nTx = brr.get_var_int();
-         BlockHeader& addedBlock = blockchain().addNewBlock(
-            blockhash, block, suppressOutput);
-
-         blockHeadersAdded.push_back(&addedBlock);
+         read.header_.unserialize(brr);
+         read.pos_ = pos;
+         read.nTx_ = brr.get_var_int();
+         read.blkSize_ = blksize;
 
-         addedBlock.setBlockFileNum(pos.first);
-         addedBlock.setBlockFileOffset(pos.second);
-         addedBlock.setNumTx(nTx);
-         addedBlock.setBlockSize(blksize);
+         if (config_.checkHeaderPoW)
+         {
+            powBatch.push_back(move(read));
+            if (powBatch.size() >= powBatchSize)
+               checkPoWBatch();
+         }
+         else
+            addHeader(read);
          
          totalOffset += blksize+8;
          progfilter.advance(totalOffset);
+         scanTelemetry_.record(ScanStage_HeaderLoad, 1, read.nTx_, blksize, 0);
 
 #ifdef _DEBUG_REPLAY_BLOCKS
          if (fileAndOffset.first == 0)
@@ -1015,6 +1187,9 @@ pair<BlockFilePosition, vector<BlockHeader*>>
    BlockFilePosition position
          = readBlockHeaders_->readHeaders(fileAndOffset, blockHeaderCallback);
 
+   if (!powBatch.empty())
+      checkPoWBatch();
+
    return { position, blockHeadersAdded };
 }
 
@@ -1129,6 +1304,11 @@ BinaryData BlockDataManager_LevelDB::applyBlockRangeToDB(
    BlockWriteBatcher blockWrites(config_, iface_);
    blockWrites.setUpdateSDBI(updateSDBI);
 
+   //only side scans leave the SDBI alone
+   const ScanStage stage = updateSDBI ? ScanStage_Scan : ScanStage_SideScan;
+   ScanTelemetry::StageScope telemetryScope(&scanTelemetry_, stage);
+   blockWrites.setTelemetry(&scanTelemetry_, stage);
+
    auto errorLambda = [this](string str)->void
    {  criticalError_ = str;
       this->notifyMainThread(); };
@@ -1248,6 +1428,12 @@ void BlockDataManager_LevelDB::doInitialSyncOnLoad(
 )
 {
    LOGINFO << "Executing: doInitialSyncOnLoad";
+   if (config_.readOnly)
+   {
+      loadReadOnlyState(progress);
+      return;
+   }
+
    loadDiskState(progress);
 }
 
@@ -1257,6 +1443,21 @@ void BlockDataManager_LevelDB::doInitialSyncOnLoad_Rescan(
 )
 {
    LOGINFO << "Executing: doInitialSyncOnLoad_Rescan";
+   if (config_.readOnly)
+      throw runtime_error("Cannot rescan a read-only database");
+
+   //pick up where an interrupted rescan left off. Only once it committed
+   //something though, as history may have been partially wiped otherwise
+   StoredScanCheckpoint sscp;
+   if (canResumeScan(SCAN_CHECKPOINT_RESCAN, sscp) && 
+       sscp.committedHeight_ != UINT32_MAX)
+   {
+      LOGINFO << "Resuming rescan from block " << sscp.committedHeight_ + 1;
+      loadDiskState(progress);
+      return;
+   }
+
+   startScanCheckpoint(SCAN_CHECKPOINT_RESCAN, 0, 0);
    loadDiskState(progress, true);
 }
 
@@ -1266,7 +1467,28 @@ void BlockDataManager_LevelDB::doInitialSyncOnLoad_Rebuild(
 )
 {
    LOGINFO << "Executing: doInitialSyncOnLoad_Rebuild";
+   if (config_.readOnly)
+      throw runtime_error("Cannot rebuild a read-only database");
+
+   //an interrupted rebuild keeps its imported blocks. If no history was 
+   //committed yet, the block import resumes and the scan runs from scratch
+   StoredScanCheckpoint sscp;
+   if (canResumeScan(SCAN_CHECKPOINT_REBUILD, sscp))
+   {
+      bool scanFromScratch = sscp.committedHeight_ == UINT32_MAX;
+      if (scanFromScratch)
+         LOGINFO << "Resuming rebuild, block import";
+      else
+         LOGINFO << "Resuming rebuild from block " << sscp.committedHeight_ + 1;
+
+      scrAddrData_->clear();
+      blockchain_.clear();
+      loadDiskState(progress, scanFromScratch);
+      return;
+   }
+
    destroyAndResetDatabases();
+   startScanCheckpoint(SCAN_CHECKPOINT_REBUILD, 0, 0);
    scrAddrData_->clear();
    blockchain_.clear();
    loadDiskState(progress, true);
@@ -1278,6 +1500,8 @@ void BlockDataManager_LevelDB::doRebuildDatabases(
 )
 {
    LOGINFO << "Executing: doRebuildDatabases";
+   if (config_.readOnly)
+      throw runtime_error("Cannot rebuild a read-only database");
    destroyAndResetDatabases();
    deleteHistories();
    scrAddrData_->clear();
@@ -1338,6 +1562,7 @@ void BlockDataManager_LevelDB::loadDiskState(
    }
 
    blockchain_.setDuplicateIDinRAM(iface_, true);
+   checkHeaderPoWFromDB(progress);
    uint32_t lastTop = blockchain_.top().getBlockHeight();
    
    if (forceRescan)
@@ -1357,10 +1582,7 @@ void BlockDataManager_LevelDB::loadDiskState(
    // here in loadDiskState, this value is used to read the headers 
    // and then again in loadBlockData.
    // loadBlockData then updates blkDataPosition_ again
-   blkDataPosition_
-      = readBlockHeaders_->findFirstUnrecognizedBlockHeader(
-         blockchain()
-      );
+   blkDataPosition_ = findHeaderResumePosition();
    LOGINFO << "Left off at file " << blkDataPosition_.first
       << ", offset " << blkDataPosition_.second;
    
@@ -1372,10 +1594,13 @@ void BlockDataManager_LevelDB::loadDiskState(
       
    // now load the new headers found in the blkfiles
    BlockFilePosition readHeadersUpTo;
+   vector<BlockHeader*> newHeaders;
    
    {
       ProgressWithPhase prog(BDMPhase_BlockHeaders, progress);
-      readHeadersUpTo = loadBlockHeadersStartingAt(prog, blkDataPosition_).first;
+      auto loadResult = loadBlockHeadersStartingAt(prog, blkDataPosition_);
+      readHeadersUpTo = loadResult.first;
+      newHeaders = move(loadResult.second);
    }
    
    try
@@ -1407,6 +1632,8 @@ void BlockDataManager_LevelDB::loadDiskState(
 
    //Now we can put the new headers found in blk files.
    blockchain_.putNewBareHeaders(iface_);
+   updateHeaderPoWWatermark();
+   updateBlockFilePositions(newHeaders, readHeadersUpTo);
 
    /////////////////////////////////////////////////////////////////////////////
    // Now we start the meat of this process...
@@ -1483,6 +1710,10 @@ void BlockDataManager_LevelDB::loadDiskState(
    {
       ProgressWithPhase progPhase(BDMPhase_Rescan, progress);
 
+      //BlockWriteBatcher moves the checkpoint along as it commits
+      startScanCheckpoint(SCAN_CHECKPOINT_LOAD, scanFrom, 
+         blockchain_.top().getBlockHeight());
+
       // TODO: use applyBlocksProgress in applyBlockRangeToDB
       // scan addresses from BDM
       TIMER_START("applyBlockRangeToDB");
@@ -1516,6 +1747,9 @@ void BlockDataManager_LevelDB::loadDiskState(
       double timeElapsed = TIMER_READ_SEC("applyBlockRangeToDB");
       CLEANUP_ALL_TIMERS();
       LOGINFO << "Scanned Block range in " << timeElapsed << "s";
+
+      //scan completed, nothing to resume
+      iface_->deleteScanCheckpoint();
    }
 
    LOGINFO << "Finished loading at file " << blkDataPosition_.first
@@ -1535,6 +1769,8 @@ void BlockDataManager_LevelDB::loadBlockData(
       &prog,
       readBlockHeaders_->totalBlockchainBytes()
    );
+   ScanTelemetry::StageScope telemetryScope(
+      &scanTelemetry_, ScanStage_BlockImport);
 
    uint64_t totalOffset=0;
    
@@ -1547,6 +1783,12 @@ void BlockDataManager_LevelDB::loadBlockData(
          BinaryRefReader brr(blockdata);
          addRawBlockToDB(brr, updateDupID);
          
+         uint64_t nTx = 0;
+         if (blockdata.getSize() > HEADER_SIZE)
+            nTx = BtcUtils::readVarInt(blockdata.getPtr() + HEADER_SIZE,
+               blockdata.getSize() - HEADER_SIZE);
+         scanTelemetry_.record(ScanStage_BlockImport, 1, nTx, blksize, 0);
+
          totalOffset += blksize;
          progfilter.advance(
             readBlockHeaders_->offsetAtStartOfFile(pos.first) + pos.second
@@ -1560,12 +1802,43 @@ void BlockDataManager_LevelDB::loadBlockData(
    );
 }
 
+void BlockDataManager_LevelDB::stampWorkRequest(BDMWork type)
+{
+   //keep the first stamp, the work has been waiting since then
+   uint64_t unstamped = 0;
+   workRequestedAt_[type].compare_exchange_strong(
+      unstamped, ScanTelemetry::now(), memory_order_acq_rel);
+}
+
+uint64_t BlockDataManager_LevelDB::takeWorkRequest(BDMWork type)
+{
+   return workRequestedAt_[type].exchange(0, memory_order_acq_rel);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool BlockDataManager_LevelDB::hasNewBlkData(void)
+{
+   // read-only instances follow the writer's headers top
+   if (config_.readOnly)
+   {
+      return iface_->getTopBlockHash(HEADERS) != 
+         blockchain_.top().getThisHash();
+   }
+
+   return readBlockHeaders_->hasNewData(blkDataPosition_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
 uint32_t BlockDataManager_LevelDB::readBlkFileUpdate(
    const BlockDataManager_LevelDB::BlkFileUpdateCallbacks& callbacks
 )
 {
    // callbacks is used by gtest to update the blockchain at certain moments
 
+   // read-only instances follow the writer's headers instead
+   if (config_.readOnly)
+      return refreshReadOnlyState();
+
    // i don't know why this is here
    scrAddrData_->checkForMerge();
    
@@ -1632,6 +1905,26 @@ uint32_t BlockDataManager_LevelDB::readBlkFileUpdate(
             uint8_t dup = iface_->putBareHeader(sbh, updateDupID);
             bh->setDuplicateID(dup);
          }
+         updateHeaderPoWWatermark();
+
+         //headers off the main chain were not put, the next restart has to
+         //read them again
+         {
+            set<BlockHeader*> putHeaders(
+               newHeadersVec.begin(), newHeadersVec.end());
+            BlockFilePosition persistedUpTo = readHeadersUpTo;
+            for (auto bh : loadResult.second)
+            {
+               if (putHeaders.find(bh) != putHeaders.end())
+                  continue;
+
+               persistedUpTo = 
+                  BlockFilePosition(bh->getBlockFileNum(), bh->getOffset());
+               break;
+            }
+
+            updateBlockFilePositions(newHeadersVec, persistedUpTo);
+         }
 
          if (callbacks.headersUpdated)
             callbacks.headersUpdated();
@@ -1656,8 +1949,14 @@ uint32_t BlockDataManager_LevelDB::readBlkFileUpdate(
       if(!state.prevTopBlockStillValid)
       {
          LOGWARN << "Blockchain Reorganization detected!";
-         ReorgUpdater reorg(state, &blockchain_, iface_, config_, 
-            scrAddrData_.get(), false);
+         {
+            ScanTelemetry::StageScope telemetryScope(
+               &scanTelemetry_, ScanStage_Reorg);
+            ReorgUpdater reorg(state, &blockchain_, iface_, config_, 
+               scrAddrData_.get(), false);
+            scanTelemetry_.record(ScanStage_Reorg, 
+               prevTopBlk - state.reorgBranchPoint->getBlockHeight(), 0, 0, 0);
+         }
          
          LOGINFO << prevTopBlk - state.reorgBranchPoint->getBlockHeight() << " blocks long reorg!";
          prevTopBlk = state.reorgBranchPoint->getBlockHeight();
@@ -1708,10 +2007,14 @@ void BlockDataManager_LevelDB::loadBlockHeadersFromDB(const ProgressCallback &pr
    }();
    
    ProgressCalculator calc(howManyBlocks);
+   ScanTelemetry::StageScope telemetryScope(
+      &scanTelemetry_, ScanStage_HeaderLoad);
    
    const auto callback= [&] (const BlockHeader &h, uint32_t height, uint8_t dup)
    {
       blockchain().addBlock(h.getThisHash(), h, height, dup);
+      scanTelemetry_.record(ScanStage_HeaderLoad, 
+         1, h.getNumTx(), h.getBlockSize(), 0);
       calc.advance(counter++);
       progress(BDMPhase_DBHeaders, calc.fractionCompleted(), calc.remainingSeconds(), counter);
    };
@@ -1722,6 +2025,186 @@ void BlockDataManager_LevelDB::loadBlockHeadersFromDB(const ProgressCallback &pr
 }
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Headers read from blk files are checked before they are added, so the
+// headers db only holds unchecked ones if it was built with the checks off.
+// The HEADERS SDBI carries the hash of the last header known checked, 
+// everything on the main branch below its fork point is good: only the
+// main branch past it is checked here
+void BlockDataManager_LevelDB::checkHeaderPoWFromDB(
+   const ProgressCallback &progress)
+{
+   //nothing in the db yet
+   if (!config_.checkHeaderPoW || !blockchain_.top().isInitialized())
+      return;
+
+   StoredDBInfo sdbi;
+   iface_->getStoredDBInfo(HEADERS, sdbi, false);
+
+   uint32_t checkFrom = 0;
+   if (sdbi.powCheckedBlkHash_.getSize() > 0 &&
+       blockchain_.hasHeaderWithHash(sdbi.powCheckedBlkHash_))
+   {
+      const BlockHeader* bh = 
+         &blockchain_.getHeaderByHash(sdbi.powCheckedBlkHash_);
+      while (bh != nullptr && !bh->isMainBranch())
+      {
+         const BinaryData prevHash = bh->getPrevHash();
+         if (!blockchain_.hasHeaderWithHash(prevHash))
+            bh = nullptr;
+         else
+            bh = &blockchain_.getHeaderByHash(prevHash);
+      }
+
+      if (bh != nullptr)
+         checkFrom = bh->getBlockHeight() + 1;
+   }
+
+   const uint32_t topHeight = blockchain_.top().getBlockHeight();
+   if (checkFrom <= topHeight)
+   {
+      LOGINFO << "Checking proof of work of headers " << checkFrom 
+         << " to " << topHeight;
+
+      ProgressCalculator calc(topHeight - checkFrom + 1);
+      static const uint32_t batchSize = 4096;
+      for (uint32_t height = checkFrom; height <= topHeight; 
+           height += batchSize)
+      {
+         const uint32_t batchEnd = min(topHeight + 1, height + batchSize);
+
+         vector<BinaryDataRef> raw;
+         for (uint32_t h = height; h < batchEnd; h++)
+            raw.push_back(blockchain_.getHeaderByHeight(h).serialize().getRef());
+
+         const vector<uint8_t> valid =
+            ScryptPoW::checkHeaders(raw, ThreadPool::getGlobal());
+         for (uint32_t i = 0; i < valid.size(); i++)
+         {
+            if (valid[i])
+               continue;
+
+            stringstream ss;
+            ss << "Header " << height + i << " in the db fails proof of "
+               "work, the databases have to be rebuilt";
+            throw runtime_error(ss.str());
+         }
+
+         calc.advance(batchEnd - checkFrom);
+         progress(BDMPhase_DBHeaders, calc.fractionCompleted(),
+            calc.remainingSeconds(), batchEnd);
+      }
+   }
+
+   updateHeaderPoWWatermark();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Every header in RAM has been checked once this is called, mark the top
+void BlockDataManager_LevelDB::updateHeaderPoWWatermark(void)
+{
+   if (!config_.checkHeaderPoW || !blockchain_.top().isInitialized())
+      return;
+
+   const BinaryData& topHash = blockchain_.top().getThisHash();
+
+   LMDBEnv::Transaction tx;
+   iface_->beginDBTransaction(&tx, HEADERS, LMDB::ReadWrite);
+
+   StoredDBInfo sdbi;
+   iface_->getStoredDBInfo(HEADERS, sdbi);
+   if (sdbi.powCheckedBlkHash_ == topHash)
+      return;
+
+   sdbi.powCheckedBlkHash_ = topHash;
+   iface_->putStoredDBInfo(HEADERS, sdbi);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void BlockDataManager_LevelDB::loadReadOnlyState(
+   const ProgressCallback &progress)
+{
+   BDMstate_ = BDM_initializing;
+
+   loadBlockHeadersFromDB(progress);
+
+   progress(BDMPhase_OrganizingChain, 0, 0, 0);
+   blockchain_.forceOrganize();
+   blockchain_.setDuplicateIDinRAM(iface_, true);
+
+   LOGINFO << "Attached read-only at block " 
+      << blockchain_.top().getBlockHeight();
+
+   BDMstate_ = BDM_ready;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+uint32_t BlockDataManager_LevelDB::refreshReadOnlyState()
+{
+   //every read transaction opens a fresh snapshot, so this sees whatever 
+   //the writer committed since the last refresh. Only unknown headers are 
+   //added, pointers to known ones stay valid
+   uint32_t prevTopBlk = blockchain_.top().getBlockHeight() + 1;
+
+   //headers whose parent isn't known yet, the fork of a reorg lies below 
+   //the heights read
+   set<BinaryData> missingParents;
+
+   const auto callback = [this, &missingParents](
+      const BlockHeader &h, uint32_t, uint8_t dup)
+   {
+      if (blockchain_.hasHeaderWithHash(h.getThisHash()))
+         return;
+
+      BlockHeader& bh = blockchain_.addNewBlock(h.getThisHash(), h, true);
+      bh.setDuplicateID(dup);
+
+      missingParents.erase(h.getThisHash());
+      if (!blockchain_.hasHeaderWithHash(h.getPrevHash()))
+         missingParents.insert(h.getPrevHash());
+   };
+
+   //only what the writer added from the known top on, rather than a walk of
+   //the whole headers db on every update
+   iface_->readHeadersFromHeight(prevTopBlk - 1, callback);
+
+   if (missingParents.size() > 0)
+   {
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HEADERS, LMDB::ReadOnly);
+
+      while (missingParents.size() > 0)
+      {
+         BinaryData parentHash = *missingParents.begin();
+         missingParents.erase(missingParents.begin());
+
+         StoredHeader sbh;
+         if (!iface_->getBareHeader(sbh, parentHash))
+            continue;
+
+         BlockHeader parent;
+         parent.unserialize(sbh.dataCopy_);
+         parent.setBlockSize(sbh.numBytes_);
+         callback(parent, sbh.blockHeight_, sbh.duplicateID_);
+      }
+   }
+
+   const Blockchain::ReorganizationState state = blockchain_.organize();
+   if (!state.hasNewTop)
+      return 0;
+
+   blockchain_.setDuplicateIDinRAM(iface_, true);
+
+   if (!state.prevTopBlockStillValid)
+   {
+      //follow the writer's reorg, history was already undone on its end
+      prevTopBlk = state.reorgBranchPoint->getBlockHeight() + 1;
+      LOGINFO << "Read-only reorg, branch point at " << prevTopBlk - 1;
+   }
+
+   return prevTopBlk;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 StoredHeader BlockDataManager_LevelDB::getBlockFromDB(uint32_t hgt, uint8_t dup) const
 {
@@ -1753,6 +2236,8 @@ void BlockDataManager_LevelDB::deleteHistories(void)
       return;
    }
 
+   iface_->deleteAddrSummaries();
+
    LMDBEnv::Transaction tx;
    iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadWrite);
 
@@ -1852,8 +2337,14 @@ void BlockDataManager_LevelDB::wipeHistoryAndHintDB()
       sdbi.appliedToHgt_ = 0;
       sdbi.topScannedBlkHash_ = BinaryData(0);
 
+      //the checkpoint of the scan that wipes the history outlives it
+      StoredScanCheckpoint sscp;
+      bool hasCheckpoint = iface_->getScanCheckpoint(sscp);
+
       iface_->dbs_[HISTORY].drop();
       iface_->putStoredDBInfo(HISTORY, sdbi);
+      if (hasCheckpoint)
+         iface_->putScanCheckpoint(sscp);
    }
 
    LMDBEnv::Transaction tx;
@@ -2017,6 +2508,12 @@ bool BlockDataManager_LevelDB::startSideScan(
    const function<void(const vector<string>&, double prog,unsigned time)> &cb
 )
 {
+   if (config_.readOnly)
+   {
+      LOGWARN << "Side scans are disabled on read-only databases";
+      return false;
+   }
+
    return scrAddrData_->startSideScan(cb);
 }
 
@@ -2130,8 +2627,13 @@ uint32_t BlockDataManager_LevelDB::findFirstBlockToScan(void)
          {
             //undo blocks up to the branch point, we'll apply the main chain
             //through the regular scan
+            ScanTelemetry::StageScope telemetryScope(
+               &scanTelemetry_, ScanStage_Reorg);
             ReorgUpdater reorgOnlyUndo(state,
                &blockchain_, iface_, config_, scrAddrData_.get(), true);
+            scanTelemetry_.record(ScanStage_Reorg, 
+               lastTopBlockHeader.getBlockHeight() - 
+               state.reorgBranchPoint->getBlockHeight(), 0, 0, 0);
 
             scanFrom = state.reorgBranchPoint->getBlockHeight() + 1;
          }
@@ -2142,6 +2644,76 @@ uint32_t BlockDataManager_LevelDB::findFirstBlockToScan(void)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+BinaryData BlockDataManager_LevelDB::getScrAddrFingerprint(void) const
+{
+   //supernode tracks everything
+   if (config_.armoryDbType == ARMORY_DB_SUPER)
+      return BinaryData(0);
+
+   set<BinaryData> scrAddrSet;
+   for (auto& saPair : scrAddrData_->getScrAddrMap())
+      scrAddrSet.insert(saPair.first);
+
+   return StoredScanCheckpoint::getScrAddrFingerprint(scrAddrSet);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool BlockDataManager_LevelDB::canResumeScan(SCAN_CHECKPOINT_TYPE type,
+   StoredScanCheckpoint& sscp)
+{
+   if (!iface_->getScanCheckpoint(sscp))
+      return false;
+
+   if (sscp.type_ != type)
+      return false;
+
+   if (sscp.scrAddrFingerprint_ != getScrAddrFingerprint())
+   {
+      LOGINFO << "Registered addresses changed since the last scan "
+         "checkpoint, starting over";
+      return false;
+   }
+
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockDataManager_LevelDB::startScanCheckpoint(SCAN_CHECKPOINT_TYPE type,
+   uint32_t startBlock, uint32_t endBlock)
+{
+   BinaryData fingerprint = getScrAddrFingerprint();
+
+   //a regular load over the same scrAddrs carries on an unfinished scan, 
+   //keep its type and start
+   StoredScanCheckpoint sscp;
+   if (type != SCAN_CHECKPOINT_LOAD ||
+       !iface_->getScanCheckpoint(sscp) || 
+       sscp.scrAddrFingerprint_ != fingerprint)
+   {
+      sscp = StoredScanCheckpoint();
+      sscp.type_ = type;
+      sscp.startBlock_ = startBlock;
+      sscp.scrAddrFingerprint_ = fingerprint;
+   }
+
+   sscp.endBlock_ = endBlock;
+   iface_->putScanCheckpoint(sscp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool BlockDataManager_LevelDB::hasScanCheckpoint(void)
+{
+   StoredScanCheckpoint sscp;
+   return iface_->getScanCheckpoint(sscp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockDataManager_LevelDB::discardScanCheckpoint(void)
+{
+   iface_->deleteScanCheckpoint();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void BlockDataManager_LevelDB::findFirstBlockToApply(void)
 {
@@ -2167,15 +2739,17 @@ void BlockDataManager_LevelDB::findFirstBlockToApply(void)
       if (nextHash == BtcUtils::EmptyHash_ || nextHash.getSize() == 0)
          return;
 
-      if (bh->hasFilePos())
+      if (bh->hasFilePos() || loadBlockFilePos(*bh))
       {
-         blkDataPosition_ = { bh->getBlockFileNum(), bh->getOffset() + bh->getBlockSize() };
+         //skip the magic bytes and size field too
+         blkDataPosition_ = { bh->getBlockFileNum(), 
+            bh->getOffset() + bh->getBlockSize() + 8 };
          return;
       }
 
       bh = &blockchain_.getHeaderByHash(nextHash);
       
-      if (!bh->hasFilePos())
+      if (!bh->hasFilePos() && !loadBlockFilePos(*bh))
          readBlockHeaders_->getFileAndPosForBlockHash(*bh);
 
       blkDataPosition_ = { bh->getBlockFileNum(), bh->getOffset() };
@@ -2186,6 +2760,118 @@ void BlockDataManager_LevelDB::findFirstBlockToApply(void)
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+BlockFilePosition BlockDataManager_LevelDB::findHeaderResumePosition(void)
+{
+   //the watermark is only good if the last header read before it is still
+   //where it was in the blk files
+   {
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HEADERS, LMDB::ReadOnly);
+
+      uint32_t fileNum;
+      uint64_t offset;
+      StoredBlockFilePos lastHeader;
+      if (iface_->getBlockFileWatermark(fileNum, offset, lastHeader))
+      {
+         const BlockFilePosition resumeAt(fileNum, offset);
+         const BlockFilePosition lastHeaderEnd(lastHeader.fileNum_,
+            lastHeader.offset_ + lastHeader.blockSize_ + 8);
+
+         if (blockchain_.hasHeaderWithHash(lastHeader.hash_) &&
+             readBlockHeaders_->isResumePosition(resumeAt) &&
+             !(resumeAt < lastHeaderEnd) &&
+             readBlockHeaders_->isBlockAt(lastHeader.hash_, 
+               lastHeader.fileNum_, lastHeader.offset_, lastHeader.blockSize_))
+         {
+            BlockHeader& bh = blockchain_.getHeaderByHash(lastHeader.hash_);
+            bh.setBlockFileNum(lastHeader.fileNum_);
+            bh.setBlockFileOffset(lastHeader.offset_);
+            bh.setBlockSize(lastHeader.blockSize_);
+
+            ++watermarkResumes_;
+            return resumeAt;
+         }
+
+         LOGWARN << "Block file watermark does not match the blk files, "
+            "searching for the last known header";
+      }
+   }
+
+   ++headerSearches_;
+   return readBlockHeaders_->findFirstUnrecognizedBlockHeader(blockchain());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockDataManager_LevelDB::updateBlockFilePositions(
+   const vector<BlockHeader*>& headers, const BlockFilePosition& readUpTo)
+{
+   //readUpTo is where the next header read starts, the watermark goes there
+   //along with the last of these headers before it
+   LMDBEnv::Transaction tx;
+   iface_->beginDBTransaction(&tx, HEADERS, LMDB::ReadWrite);
+
+   const BlockHeader* lastHeader = nullptr;
+   for (auto bh : headers)
+   {
+      if (!bh->hasFilePos())
+         continue;
+
+      StoredBlockFilePos sbfp;
+      sbfp.hash_ = bh->getThisHash();
+      sbfp.fileNum_ = bh->getBlockFileNum();
+      sbfp.offset_ = bh->getOffset();
+      sbfp.blockSize_ = bh->getBlockSize();
+      iface_->putBlockFilePos(sbfp);
+
+      const BlockFilePosition pos(sbfp.fileNum_, sbfp.offset_);
+      if (!(pos < readUpTo))
+         continue;
+
+      if (lastHeader == nullptr ||
+          BlockFilePosition(lastHeader->getBlockFileNum(), 
+            lastHeader->getOffset()) < pos)
+         lastHeader = bh;
+   }
+
+   if (lastHeader == nullptr)
+      return;
+
+   StoredBlockFilePos sbfp;
+   sbfp.hash_ = lastHeader->getThisHash();
+   sbfp.fileNum_ = lastHeader->getBlockFileNum();
+   sbfp.offset_ = lastHeader->getOffset();
+   sbfp.blockSize_ = lastHeader->getBlockSize();
+   iface_->putBlockFileWatermark(readUpTo.first, readUpTo.second, sbfp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool BlockDataManager_LevelDB::loadBlockFilePos(BlockHeader& bh)
+{
+   StoredBlockFilePos sbfp;
+   {
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HEADERS, LMDB::ReadOnly);
+
+      if (!iface_->getBlockFilePos(sbfp, bh.getThisHash()))
+         return false;
+   }
+
+   if (!readBlockHeaders_->isBlockAt(
+      sbfp.hash_, sbfp.fileNum_, sbfp.offset_, sbfp.blockSize_))
+   {
+      LOGWARN << "Block " << sbfp.hash_.toHexStr(true) << " is not in blk"
+         " file " << sbfp.fileNum_ << " at offset " << sbfp.offset_ <<
+         " anymore";
+      return false;
+   }
+
+   bh.setBlockFileNum(sbfp.fileNum_);
+   bh.setBlockFileOffset(sbfp.offset_);
+   bh.setBlockSize(sbfp.blockSize_);
+   return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void BlockDataManager_LevelDB::repairBlockDataDB(
    set<BinaryData>& missingBlocksByHash)
@@ -13,6 +13,7 @@
 #include <fstream>
 #include <vector>
 #include <set>
+#include <atomic>
 
 #include "Blockchain.h"
 #include "BinaryData.h"
@@ -27,6 +28,7 @@
 #include "cryptlib.h"
 #include "sha.h"
 #include "UniversalTimer.h"
+#include "Progress.h"
 
 #include <functional>
 #include "BDM_supportClasses.h"
@@ -82,7 +84,6 @@ typedef enum
    BDM_ready
 }BDM_state;
 
-class ProgressReporter;
 
 typedef std::pair<size_t, uint64_t> BlockFilePosition;
 class FoundAllBlocksException {};
@@ -112,6 +113,9 @@ private:
    class BDM_ScrAddrFilter;
    shared_ptr<BDM_ScrAddrFilter>    scrAddrData_;
 
+   //UTxOs of scrAddrData_, carried from one scan to the next
+   shared_ptr<UtxoSet>              utxoSet_;
+
   
    // If the BDM is not in super-node mode, then it will be specifically tracking
    // a set of addresses & wallets.  We register those addresses and wallets so
@@ -140,6 +144,18 @@ private:
 
    BDM_state BDMstate_ = BDM_offline;
 
+   //throughput and stall times of the header load, import and scan phases
+   ScanTelemetry scanTelemetry_;
+
+   //how findHeaderResumePosition got its answer: off the watermark, or
+   //through a search of the blk files
+   uint32_t watermarkResumes_ = 0;
+   uint32_t headerSearches_ = 0;
+
+   //when each type of BDM thread work was first asked for since the BDM 
+   //thread last picked it up, 0 if it wasn't
+   atomic<uint64_t> workRequestedAt_[BDMWork_Count];
+
 
 public:
    bool                               sideScanFlag_ = false;
@@ -179,6 +195,15 @@ public:
    
    bool hasNotifier() const { return notifier_ != nullptr; }
 
+   // flag setters stamp the time their work was asked for, the BDM thread
+   // measures the queue wait from there. take returns the oldest stamp
+   // since the last take, 0 if there is none
+   void stampWorkRequest(BDMWork type);
+   uint64_t takeWorkRequest(BDMWork type);
+
+   ScanTelemetry& getScanTelemetry(void) { return scanTelemetry_; }
+   shared_ptr<UtxoSet> getUtxoSet(void) const { return utxoSet_; }
+
    
    
    /////////////////////////////////////////////////////////////////////////////
@@ -195,6 +220,14 @@ public:
    void doInitialSyncOnLoad(const ProgressCallback &progress);
    void doInitialSyncOnLoad_Rescan(const ProgressCallback &progress);
    void doInitialSyncOnLoad_Rebuild(const ProgressCallback &progress);
+
+   //hash of the registered scrAddr set, empty in supernode
+   BinaryData getScrAddrFingerprint(void) const;
+
+   //interrupted rescans and rebuilds resume from their last commit unless 
+   //the checkpoint is discarded first
+   bool hasScanCheckpoint(void);
+   void discardScanCheckpoint(void);
    
    // for testing only
    struct BlkFileUpdateCallbacks
@@ -203,6 +236,9 @@ public:
    };
    
    uint32_t readBlkFileUpdate(const BlkFileUpdateCallbacks &callbacks=BlkFileUpdateCallbacks());
+
+   // true if readBlkFileUpdate has something to read, without reading it
+   bool hasNewBlkData(void);
    
 private:
    void loadDiskState(
@@ -215,6 +251,10 @@ private:
       bool updateDupID
    );
    void loadBlockHeadersFromDB(const ProgressCallback &progress);
+   void checkHeaderPoWFromDB(const ProgressCallback &progress);
+   void updateHeaderPoWWatermark(void);
+   void loadReadOnlyState(const ProgressCallback &progress);
+   uint32_t refreshReadOnlyState(void);
    pair<BlockFilePosition, vector<BlockHeader*> >
       loadBlockHeadersStartingAt(
          ProgressReporter &prog,
@@ -228,6 +268,15 @@ private:
    uint32_t findFirstBlockToScan(void);
    void findFirstBlockToApply(void);
 
+   //blk file positions persisted in HEADERS, see StoredBlockFilePos
+   void updateBlockFilePositions(
+      const vector<BlockHeader*>& headers, const BlockFilePosition& readUpTo);
+   bool loadBlockFilePos(BlockHeader& bh);
+
+   bool canResumeScan(SCAN_CHECKPOINT_TYPE type, StoredScanCheckpoint& sscp);
+   void startScanCheckpoint(SCAN_CHECKPOINT_TYPE type, 
+      uint32_t startBlock, uint32_t endBlock);
+
 public:
 
    BinaryData applyBlockRangeToDB(ProgressReporter &prog, 
@@ -269,6 +318,12 @@ public:
    
    vector<BinaryData> missingBlockHashes() const { return missingBlockHashes_; }
 
+   //where header reading resumes: the HEADERS watermark if it checks out 
+   //against the blk files, the first unrecognized header otherwise
+   BlockFilePosition findHeaderResumePosition(void);
+   uint32_t getWatermarkResumes(void) const { return watermarkResumes_; }
+   uint32_t getHeaderSearches(void) const { return headerSearches_; }
+
    bool startSideScan(
       const function<void(const vector<string>&, double prog,unsigned time)> &cb
    );
@@ -11,12 +11,502 @@
 #include "BlockDataManagerConfig.h"
 #include "lmdb_wrapper.h"
 #include "Progress.h"
+#include "ThreadPool.h"
 #include "util.h"
 
+#include <fstream>
+
 #ifdef _MSC_VER
 #include "win32_posix.h"
 #endif
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+const uint64_t BlockWriteBatcher::UPDATE_BYTES_THRESH;
+const uint32_t BlockWriteBatcher::UTXO_THRESHOLD;
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// FlushController
+////
+////////////////////////////////////////////////////////////////////////////////
+FlushController::FlushController(bool adaptive, uint64_t minBytes,
+   uint64_t maxBytes, uint32_t targetMs, uint64_t memoryCap)
+   : adaptive_(adaptive)
+{
+   typedef BlockWriteBatcher BWB;
+
+   minBytes_ = (minBytes == 0 ? BWB::UPDATE_BYTES_THRESH / 4 : minBytes);
+   maxBytes_ = (maxBytes == 0 ? BWB::UPDATE_BYTES_THRESH * 4 : maxBytes);
+   maxBytes_ = max(minBytes_, maxBytes_);
+   targetUs_ = uint64_t(targetMs == 0 ? 1000 : targetMs) * 1000;
+
+   memoryCap_ = memoryCap;
+   if (memoryCap_ == 0)
+      memoryCap_ = getAvailableMemory() / 4;
+
+   stats_.adaptive_ = adaptive_;
+   stats_.memoryCap_ = memoryCap_;
+
+   if (!adaptive_)
+   {
+      bytesThreshold_.store(BWB::UPDATE_BYTES_THRESH, memory_order_relaxed);
+      utxoThreshold_.store(BWB::UTXO_THRESHOLD, memory_order_relaxed);
+      stats_.bytesThreshold_ = BWB::UPDATE_BYTES_THRESH;
+      stats_.utxoThreshold_ = BWB::UTXO_THRESHOLD;
+      return;
+   }
+
+   bytesThreshold_.store(0, memory_order_relaxed);
+   setBytesThreshold(BWB::UPDATE_BYTES_THRESH);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+FlushController::FlushController(const BlockDataManagerConfig& config)
+   : FlushController(config.adaptiveFlush, config.flushMinBytes,
+      config.flushMaxBytes, config.flushTargetMs, config.flushMemoryCap)
+{}
+
+////////////////////////////////////////////////////////////////////////////////
+void FlushController::setBytesThreshold(uint64_t bytes)
+{
+   //mu_ is held by the caller, or there is no other user yet
+   typedef BlockWriteBatcher BWB;
+
+   const uint64_t previous = bytesThreshold_.load(memory_order_relaxed);
+   bytes = min(max(bytes, minBytes_), maxBytes_);
+
+   //the memory cap wins over the lower bound
+   if (memoryCap_ != 0 && bytes > memoryCap_ / 3)
+   {
+      bytes = max(memoryCap_ / 3, uint64_t(1));
+      if (previous != 0)
+         stats_.capped_++;
+   }
+
+   if (previous != 0)
+   {
+      if (bytes > previous)
+         stats_.raised_++;
+      else if (bytes < previous)
+         stats_.lowered_++;
+   }
+
+   uint64_t utxos = uint64_t(BWB::UTXO_THRESHOLD) * bytes / 
+      BWB::UPDATE_BYTES_THRESH;
+   utxos = min(max(utxos, uint64_t(1)), uint64_t(UINT32_MAX));
+
+   bytesThreshold_.store(bytes, memory_order_relaxed);
+   utxoThreshold_.store(uint32_t(utxos), memory_order_relaxed);
+   stats_.bytesThreshold_ = bytes;
+   stats_.utxoThreshold_ = uint32_t(utxos);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void FlushController::recordSshWrites(uint32_t count, uint64_t bytes)
+{
+   unique_lock<mutex> lock(mu_);
+
+   stats_.sshWritten_ += count;
+   stats_.sshBytes_ += bytes;
+   stats_.lastSshWritten_ = count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void FlushController::recordCommit(uint64_t bytes, uint64_t serializeUs, 
+   uint64_t writeUs)
+{
+   unique_lock<mutex> lock(mu_);
+
+   const uint64_t commitUs = max(serializeUs + writeUs, uint64_t(1));
+   stats_.commits_++;
+   stats_.bytes_ += bytes;
+   stats_.serializeUs_ += serializeUs;
+   stats_.writeUs_ += writeUs;
+   stats_.lastBytes_ = bytes;
+   stats_.lastCommitUs_ = commitUs;
+
+   //partial batches carry the fixed costs of a commit over too few bytes
+   const uint64_t threshold = bytesThreshold_.load(memory_order_relaxed);
+   if (!adaptive_ || bytes < threshold / 2)
+      return;
+
+   const double rate = double(bytes) / double(commitUs);
+   if (throughput_ == 0.0)
+      throughput_ = rate;
+   else
+      throughput_ = (throughput_ + rate) / 2.0;
+
+   double target = throughput_ * double(targetUs_);
+   target = min(max(target, double(threshold / 2)), double(threshold * 2));
+   setBytesThreshold(uint64_t(target));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+FlushStats FlushController::getStats(void) const
+{
+   unique_lock<mutex> lock(mu_);
+   return stats_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t FlushController::getAvailableMemory(void)
+{
+#ifdef _WIN32
+   MEMORYSTATUSEX status;
+   status.dwLength = sizeof(status);
+   if (!GlobalMemoryStatusEx(&status))
+      return 0;
+   return status.ullAvailPhys;
+#else
+   //MemAvailable counts the page cache the kernel would give up
+   ifstream meminfo("/proc/meminfo");
+   string key;
+   uint64_t kb;
+   while (meminfo >> key >> kb)
+   {
+      if (key == "MemAvailable:")
+         return kb * 1024;
+      meminfo.ignore(256, '\n');
+   }
+
+#ifdef _SC_AVPHYS_PAGES
+   long pages = sysconf(_SC_AVPHYS_PAGES);
+#else
+   long pages = sysconf(_SC_PHYS_PAGES);
+#endif
+   long pageSize = sysconf(_SC_PAGESIZE);
+   if (pages <= 0 || pageSize <= 0)
+      return 0;
+   return uint64_t(pages) * uint64_t(pageSize);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////
+//// UtxoSet
+////
+////////////////////////////////////////////////////////////////////////////////
+bool UtxoSet::checkOut(UtxoMap& utxoMap, set<BinaryData>& scrAddrsToLoad,
+   uint32_t watermark, uint32_t fromHeight, uint32_t& revision)
+{
+   unique_lock<mutex> lock(mu_);
+
+   //a batch starting below the set's height reapplies blocks it already has,
+   //the SSH heights skip their TxOuts and their spent TxIns aren't in it
+   const bool resume = valid_ && 
+      height_ != UINT32_MAX && height_ == watermark &&
+      fromHeight != 0 && fromHeight <= height_ + 1;
+
+   utxoMap.clear();
+   scrAddrsToLoad.clear();
+   if (resume)
+   {
+      utxoMap = move(utxos_);
+      scrAddrsToLoad = move(scrAddrsToLoad_);
+      warmCheckouts_++;
+   }
+   else
+      coldCheckouts_++;
+
+   utxos_.clear();
+   scrAddrsToLoad_.clear();
+   valid_ = false;
+   revision = ++revision_;
+
+   return resume;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void UtxoSet::checkIn(UtxoMap& utxoMap, uint32_t height, uint32_t revision,
+   bool isComplete)
+{
+   unique_lock<mutex> lock(mu_);
+
+   //invalidated or checked out again in the meantime
+   if (revision != revision_ || !isComplete || height == UINT32_MAX)
+      return;
+
+   utxos_ = move(utxoMap);
+   height_ = height;
+   valid_ = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void UtxoSet::addScrAddrs(const vector<BinaryData>& scrAddrs)
+{
+   unique_lock<mutex> lock(mu_);
+   scrAddrsToLoad_.insert(scrAddrs.begin(), scrAddrs.end());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void UtxoSet::invalidate(void)
+{
+   unique_lock<mutex> lock(mu_);
+
+   utxos_.clear();
+   scrAddrsToLoad_.clear();
+   valid_ = false;
+   revision_++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool UtxoSet::isValid(void) const
+{
+   unique_lock<mutex> lock(mu_);
+   return valid_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t UtxoSet::getHeight(void) const
+{
+   unique_lock<mutex> lock(mu_);
+   return height_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t UtxoSet::size(void) const
+{
+   unique_lock<mutex> lock(mu_);
+   return utxos_.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t UtxoSet::getWarmCheckouts(void) const
+{
+   unique_lock<mutex> lock(mu_);
+   return warmCheckouts_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t UtxoSet::getColdCheckouts(void) const
+{
+   unique_lock<mutex> lock(mu_);
+   return coldCheckouts_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void UtxoSet::loadScrAddr(LMDBBlockDatabase* iface,
+   const BinaryData& scrAddr, UtxoMap& utxoMap)
+{
+   BinaryWriter bwKey(scrAddr.getSize() + 1);
+   bwKey.put_uint8_t((uint8_t)DB_PREFIX_SCRIPT);
+   bwKey.put_BinaryData(scrAddr);
+
+   LDBIter dbIter = iface->getIterator(HISTORY);
+
+   if (!dbIter.seekToExact(bwKey.getDataRef()))
+      return;
+
+   while (dbIter.getKeyRef().startsWith(bwKey.getDataRef()))
+   {
+      if (dbIter.getKeyRef().getSize() == bwKey.getSize() + 4)
+      {
+         //grab subssh
+         StoredSubHistory subssh;
+         subssh.hgtX_ = dbIter.getKeyRef().getSliceRef(-4, 4);
+         subssh.unserializeDBValue(dbIter.getValueReader());
+
+         //load all UTXOs listed. Multisig refs aren't marked spent, the 
+         //TxOut is a UTxO of its multisig scrAddr if that one is tracked
+         for (auto txio : subssh.txioMap_)
+         {
+            if (txio.second.isUTXO() && !txio.second.isMultisig())
+            {
+               BinaryData dbKey = txio.second.getDBKeyOfOutput();
+               shared_ptr<StoredTxOut> stxo(new StoredTxOut);
+               iface->getStoredTxOut(*stxo, dbKey);
+
+               BinaryData txHash = 
+                  iface->getTxHashForLdbKey(dbKey.getSliceRef(0, 6));
+
+               BinaryWriter bwUtxoKey(34);
+               bwUtxoKey.put_BinaryData(txHash);
+               bwUtxoKey.put_uint16_t(stxo->txOutIndex_, BE);
+
+               utxoMap[bwUtxoKey.getDataRef()] = stxo;
+            }
+         }
+      }
+
+      dbIter.advanceAndRead(DB_PREFIX_SCRIPT);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The outpoint table entries of scrAddrs. Side scans write to the same 
+// table, entries of other scrAddrs are skipped
+static vector<StoredUtxo> readUtxoTable(LMDBBlockDatabase* iface,
+   const set<BinaryData>& scrAddrs)
+{
+   vector<StoredUtxo> entries;
+
+   BinaryData prefix = WRITE_UINT8_LE((uint8_t)DB_PREFIX_UTXO);
+   LDBIter dbIter = iface->getIterator(HISTORY);
+   if (!dbIter.seekToStartsWith(prefix))
+      return entries;
+
+   do
+   {
+      //the prefix alone is the start height
+      BinaryDataRef key = dbIter.getKeyRef();
+      if (key.getSize() != 35)
+         continue;
+
+      StoredUtxo stu;
+      stu.unserializeDBValue(dbIter.getValueRef());
+      if (stu.isNull() || scrAddrs.find(stu.scrAddr_) == scrAddrs.end())
+         continue;
+
+      stu.hashAndId_ = key.getSliceCopy(1, 34);
+      entries.push_back(move(stu));
+   } while (dbIter.advance() && dbIter.checkKeyStartsWith(prefix));
+
+   return entries;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void UtxoSet::loadTable(LMDBBlockDatabase* iface,
+   const set<BinaryData>& scrAddrs, UtxoMap& utxoMap)
+{
+   //one get per UTxO, the tx hash comes with the key
+   auto&& entries = readUtxoTable(iface, scrAddrs);
+   for (auto& stu : entries)
+   {
+      shared_ptr<StoredTxOut> stxo(new StoredTxOut);
+      if (!iface->getStoredTxOut(*stxo, stu.dbKey_))
+         continue;
+
+      utxoMap[stu.hashAndId_] = stxo;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool UtxoSet::verifyTable(
+   LMDBBlockDatabase* iface, const ScrAddrFilter& filter)
+{
+   set<BinaryData> scrAddrs;
+   for (auto& saPair : filter.getScrAddrMap())
+      scrAddrs.insert(saPair.first);
+
+   UtxoMap rebuilt;
+   vector<StoredUtxo> entries;
+   {
+      LMDBEnv::Transaction tx;
+      iface->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+
+      for (auto& scrAddr : scrAddrs)
+         loadScrAddr(iface, scrAddr, rebuilt);
+      entries = readUtxoTable(iface, scrAddrs);
+   }
+
+   bool match = true;
+   set<BinaryData> seen;
+   for (auto& stu : entries)
+   {
+      seen.insert(stu.hashAndId_);
+
+      auto iter = rebuilt.find(stu.hashAndId_);
+      if (iter == rebuilt.end())
+      {
+         LOGERR << "utxo table has " << stu.hashAndId_.toHexStr() 
+            << ", the sub-histories don't";
+         match = false;
+         continue;
+      }
+
+      auto& stxo = *iter->second;
+      if (stxo.getValue() != stu.value_ ||
+          stxo.getScrAddress() != stu.scrAddr_ ||
+          stxo.getDBKey(false) != stu.dbKey_)
+      {
+         LOGERR << "utxo table and sub-histories differ on " 
+            << stu.hashAndId_.toHexStr();
+         match = false;
+      }
+   }
+
+   for (auto& utxoPair : rebuilt)
+   {
+      if (seen.find(utxoPair.first) == seen.end())
+      {
+         LOGERR << "utxo table is missing " << utxoPair.first.toHexStr();
+         match = false;
+      }
+   }
+
+   return match;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool UtxoSet::verify(
+   LMDBBlockDatabase* iface, const ScrAddrFilter& filter) const
+{
+   UtxoMap rebuilt;
+   {
+      LMDBEnv::Transaction tx;
+      iface->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+
+      for (auto& saPair : filter.getScrAddrMap())
+         loadScrAddr(iface, saPair.first, rebuilt);
+   }
+
+   unique_lock<mutex> lock(mu_);
+   if (!valid_)
+   {
+      LOGERR << "utxo set is not checked in";
+      return false;
+   }
+
+   bool match = true;
+   for (auto& utxoPair : utxos_)
+   {
+      auto iter = rebuilt.find(utxoPair.first);
+      if (iter == rebuilt.end())
+      {
+         LOGERR << "utxo set has " << utxoPair.first.toHexStr() 
+            << ", the DB doesn't";
+         match = false;
+         continue;
+      }
+
+      auto& stxo = *utxoPair.second;
+      if (stxo.getValue() != iter->second->getValue() ||
+          stxo.getScrAddress() != iter->second->getScrAddress() ||
+          stxo.getDBKey(false) != iter->second->getDBKey(false))
+      {
+         LOGERR << "utxo set and DB differ on " << utxoPair.first.toHexStr();
+         match = false;
+      }
+   }
+
+   for (auto& utxoPair : rebuilt)
+   {
+      if (utxos_.find(utxoPair.first) == utxos_.end())
+      {
+         LOGERR << "utxo set is missing " << utxoPair.first.toHexStr();
+         match = false;
+      }
+   }
+   lock.unlock();
+
+   uint32_t tableStart;
+   {
+      LMDBEnv::Transaction tx;
+      iface->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+      tableStart = iface->getUtxoTableStartHeight();
+   }
+
+   if (tableStart == 0 && !verifyTable(iface, filter))
+      match = false;
+
+   return match;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 static void updateBlkDataHeader(
       const BlockDataManagerConfig &config,
@@ -84,11 +574,33 @@ void BlockWriteBatcher::moveStxoToUTXOMap(
    dbUpdateSize_ += sizeof(StoredTxOut)+thisTxOut->dataCopy_.getSize();
 
    utxoMap_[thisTxOut->hashAndId_] = thisTxOut; 
+
+   if (config_.armoryDbType != ARMORY_DB_SUPER)
+      updateUtxoTable(thisTxOut->hashAndId_, thisTxOut.get());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockWriteBatcher::updateUtxoTable(
+   const BinaryData& hashAndId, const StoredTxOut* stxo)
+{
+   auto& stu = utxoTableDelta_[hashAndId];
+   stu.hashAndId_ = hashAndId;
+   dbUpdateSize_ += UPDATE_BYTES_KEY;
+
+   if (stxo == nullptr)
+   {
+      stu.dbKey_.clear();
+      return;
+   }
+
+   stu.dbKey_ = stxo->getDBKey(false);
+   stu.value_ = stxo->getValue();
+   stu.scrAddr_ = stxo->getScrAddress();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 StoredTxOut* BlockWriteBatcher::lookForUTXOInMap(const BinaryData& txHash, 
-   const uint16_t& txoId)
+   const uint16_t& txoId, ScrAddrFilter& scrAddrData)
 {
    auto utxoIter = utxoMap_.find(txHash);
    if (utxoIter != utxoMap_.end())
@@ -96,7 +608,10 @@ StoredTxOut* BlockWriteBatcher::lookForUTXOInMap(const BinaryData& txHash,
       stxoToUpdate_.push_back(utxoIter->second);
 
       if (config_.armoryDbType != ARMORY_DB_SUPER)
+      {
          utxoMap_.erase(utxoIter);
+         updateUtxoTable(txHash, nullptr);
+      }
       return stxoToUpdate_.back().get();
    }
 
@@ -106,7 +621,10 @@ StoredTxOut* BlockWriteBatcher::lookForUTXOInMap(const BinaryData& txHash,
       stxoToUpdate_.push_back(utxoIter->second);
 
       if (config_.armoryDbType != ARMORY_DB_SUPER)
-         utxoMap_.erase(utxoIter);
+      {
+         utxoMapBackup_.erase(utxoIter);
+         updateUtxoTable(txHash, nullptr);
+      }
       return stxoToUpdate_.back().get();
    }
 
@@ -124,6 +642,26 @@ StoredTxOut* BlockWriteBatcher::lookForUTXOInMap(const BinaryData& txHash,
       return stxoToUpdate_.back().get();
    }
 
+   //fullnode with the cache dropped, the outpoint table has every tracked 
+   //UTxO. A miss is a single get
+   if (!haveFullUTXOList_)
+   {
+      StoredUtxo stu;
+      if (!iface_->getStoredUtxo(stu, txHash) ||
+          !scrAddrData.hasScrAddress(stu.scrAddr_))
+         return nullptr;
+
+      shared_ptr<StoredTxOut> stxo(new StoredTxOut);
+      if (!iface_->getStoredTxOut(*stxo, stu.dbKey_))
+         return nullptr;
+
+      updateUtxoTable(txHash, nullptr);
+      dbUpdateSize_ += sizeof(StoredTxOut)+stxo->dataCopy_.getSize();
+      stxoToUpdate_.push_back(stxo);
+
+      return stxoToUpdate_.back().get();
+   }
+
    return nullptr;
 }
 ////////////////////////////////////////////////////////////////////////////////
@@ -215,6 +753,10 @@ StoredScriptHistory& BlockWriteBatcher::makeSureSSHInMap(
    {
       iface_->getStoredScriptHistorySummary(ssh, uniqKey);
       ssh.uniqueKey_ = uniqKey;
+
+      if (useScanWatermark_)
+         ssh.alreadyScannedUpToBlk_ = ssh.getScannedUpTo(
+            iface_->getScanWatermark(), iface_->getScanGeneration());
    }
 
    return ssh;
@@ -231,6 +773,9 @@ void BlockWriteBatcher::insertSpentTxio(
    mirrorTxio = txio;
    mirrorTxio.setTxIn(txInKey);
 
+   //the TxIn is in the block being applied, which is on the main branch
+   mirrorTxio.setSpentInMain(true);
+
    dbUpdateSize_ += UPDATE_BYTES_KEY;
 }
 
@@ -250,6 +795,9 @@ BlockWriteBatcher::BlockWriteBatcher(
       historyDB_ = HISTORY;
 
    parent_ = this;
+
+   if (!forCommit)
+      flushController_.reset(new FlushController(config));
 }
 
 BlockWriteBatcher::~BlockWriteBatcher()
@@ -262,12 +810,19 @@ BlockWriteBatcher::~BlockWriteBatcher()
    }
 
    //call final commit, force it
-   thread committhread = commit(true);
+   auto committing = commit(true);
 
-   //join on the thread, don't want the destuctor to return until the data has
+   //wait on the commit, don't want the destuctor to return until the data has
    //been commited
-   committhread.join();
+   committing.wait();
    clearTransactions();
+
+   //a scan that threw may have stopped mid block
+   if (utxoSet_ != nullptr)
+   {
+      utxoSet_->checkIn(utxoMap_, utxoSetHeight_, utxoSetRevision_,
+         haveFullUTXOList_ && !std::uncaught_exception());
+   }
 }
 
 BinaryData BlockWriteBatcher::applyBlockToDB(shared_ptr<PulledBlock> pb,
@@ -283,6 +838,7 @@ BinaryData BlockWriteBatcher::applyBlockToDB(shared_ptr<PulledBlock> pb,
       pb->isMainBranch_ = true;
    
    mostRecentBlockApplied_ = pb->blockHeight_;
+   utxoSetHeight_ = pb->blockHeight_;
 
    // We will accumulate undoData as we apply the tx
    StoredUndoData sud;
@@ -311,11 +867,10 @@ BinaryData BlockWriteBatcher::applyBlockToDB(shared_ptr<PulledBlock> pb,
    block.blockAppliedToDB_ = true;
    dbUpdateSize_ += block.numBytes_;
 
-   if (dbUpdateSize_ > UPDATE_BYTES_THRESH)
+   if (dbUpdateSize_ > flushController_->getBytesThreshold())
    {
-      thread committhread = commit();
-      if (committhread.joinable())
-         committhread.detach();
+      //no need to wait, the next commit() syncs on writeLock_
+      commit();
    }
 
    return scannedBlockHash;
@@ -328,7 +883,7 @@ void BlockWriteBatcher::reorgApplyBlock(uint32_t hgt, uint8_t dup,
 
    resetTransactions();
 
-   prepareSshToModify(scrAddrData);
+   prepareSshToModify(scrAddrData, hgt);
 
    shared_ptr<PulledBlock> pb(new PulledBlock());
    {
@@ -343,9 +898,9 @@ void BlockWriteBatcher::reorgApplyBlock(uint32_t hgt, uint8_t dup,
 
    applyBlockToDB(pb, scrAddrData);
 
-   thread writeThread = commit(true);
-   if (writeThread.joinable())
-      writeThread.join();
+   auto committing = commit(true);
+   if (committing.valid())
+      committing.wait();
 
    clearTransactions();
 }
@@ -358,7 +913,7 @@ void BlockWriteBatcher::undoBlockFromDB(StoredUndoData & sud,
    if (resetTxn_ > 0)
       clearSubSshMap(resetTxn_);
 
-   prepareSshToModify(scrAddrData);
+   prepareSshToModify(scrAddrData, sud.blockHeight_);
 
    resetTransactions();
 
@@ -369,6 +924,7 @@ void BlockWriteBatcher::undoBlockFromDB(StoredUndoData & sud,
    }
    
    mostRecentBlockApplied_ = sud.blockHeight_ -1;
+   utxoSetHeight_ = sud.blockHeight_ -1;
 
    ///// Put the STXOs back into the DB which were removed by this block
    // Process the stxOutsRemovedByBlock_ in reverse order
@@ -389,6 +945,15 @@ void BlockWriteBatcher::undoBlockFromDB(StoredUndoData & sud,
                sudStxo.parentHash_,
                stxoIdx);
 
+      //ours and unspent again
+      if (config_.armoryDbType != ARMORY_DB_SUPER)
+      {
+         BinaryData hashAndId = sudStxo.parentHash_;
+         hashAndId.append(WRITE_UINT16_BE(stxoIdx));
+         utxoMap_[hashAndId] = stxoToUpdate_.back();
+         updateUtxoTable(hashAndId, stxoPtr);
+      }
+
       {
          ////// Finished updating STX, now update the SSH in the DB
          // Updating the SSH objects works the same regardless of pruning
@@ -421,6 +986,16 @@ void BlockWriteBatcher::undoBlockFromDB(StoredUndoData & sud,
             subsshAtInHgt.eraseTxio(stxoPtr->getDBKey(false));
             ssh.totalTxioCount_--;
          }
+
+         if (config_.armoryDbType == ARMORY_DB_SUPER)
+         {
+            auto& delta = addrSummaryDeltas_[uniqKey];
+            delta.unspentCount_++;
+            delta.unspentValue_ += stxoPtr->getValue();
+            if (stxoPtr->spentness_ == TXOUT_SPENT)
+               delta.txioCount_--;
+            delta.undone_ = true;
+         }
       }
 
       if (config_.pruneType == DB_PRUNE_NONE)
@@ -463,6 +1038,12 @@ void BlockWriteBatcher::undoBlockFromDB(StoredUndoData & sud,
          {
             if (!scrAddrData.hasScrAddress(uniqKey))
                continue;
+
+            BinaryData hashAndId = stx.second.thisHash_;
+            hashAndId.append(WRITE_UINT16_BE(stxo->txOutIndex_));
+            utxoMap_.erase(hashAndId);
+            utxoMapBackup_.erase(hashAndId);
+            updateUtxoTable(hashAndId, nullptr);
          }
 
          BinaryData hgtX    = stxo->getHgtX();
@@ -473,6 +1054,15 @@ void BlockWriteBatcher::undoBlockFromDB(StoredUndoData & sud,
          auto& ssh = makeSureSSHInMap(uniqKey);
          ssh.totalTxioCount_--;
          ssh.totalUnspent_ -= stxo->getValue();
+
+         if (config_.armoryDbType == ARMORY_DB_SUPER)
+         {
+            auto& delta = addrSummaryDeltas_[uniqKey];
+            delta.txioCount_--;
+            delta.unspentCount_--;
+            delta.unspentValue_ -= stxo->getValue();
+            delta.undone_ = true;
+         }
    
          // Now remove any multisig entries that were added due to this TxOut
          if(uniqKey[0] == SCRIPT_PREFIX_MULTISIG)
@@ -496,6 +1086,13 @@ void BlockWriteBatcher::undoBlockFromDB(StoredUndoData & sud,
                
                auto& ssh = makeSureSSHInMap(uniqKey);
                ssh.totalTxioCount_--;
+
+               if (config_.armoryDbType == ARMORY_DB_SUPER)
+               {
+                  auto& delta = addrSummaryDeltas_[uniqKey];
+                  delta.txioCount_--;
+                  delta.undone_ = true;
+               }
             }
          }
       }
@@ -507,11 +1104,11 @@ void BlockWriteBatcher::undoBlockFromDB(StoredUndoData & sud,
    
    clearTransactions();
    
-   if (dbUpdateSize_ > UPDATE_BYTES_THRESH)
+   if (dbUpdateSize_ > flushController_->getBytesThreshold())
    {
-      thread committhread = commit();
-      if (committhread.joinable())
-         committhread.join();
+      auto committing = commit();
+      if (committing.valid())
+         committing.wait();
    }
 }
 
@@ -541,7 +1138,7 @@ bool BlockWriteBatcher::parseTxIns(
 
       //leveraging the stxo in RAM
       StoredTxOut* stxoPtr = nullptr;
-      stxoPtr = lookForUTXOInMap(opTxHashAndId, opTxoIdx);
+      stxoPtr = lookForUTXOInMap(opTxHashAndId, opTxoIdx, scrAddrData);
 
       if (config_.armoryDbType != ARMORY_DB_SUPER)
       {
@@ -590,6 +1187,23 @@ bool BlockWriteBatcher::parseTxIns(
          TxIOPair& mirrorTxio = mirrorsubssh.txioMap_[stxoKey];
          mirrorTxio.flagged = true;
       }
+
+      if (config_.armoryDbType == ARMORY_DB_SUPER)
+      {
+         auto& delta = addrSummaryDeltas_[uniqKey];
+         if (fixed)
+         {
+            //the TxOut was missing from the summary as well
+            delta.txioCount_++;
+            delta.unspentCount_++;
+            delta.unspentValue_ += stxoPtr->getValue();
+         }
+
+         delta.txioCount_++;
+         delta.unspentCount_--;
+         delta.unspentValue_ -= stxoPtr->getValue();
+         delta.seenAt(thisSTX.blockHeight_);
+      }
    }
 
    return txIsMine;
@@ -633,6 +1247,12 @@ bool BlockWriteBatcher::parseTxOuts(
          auto& txio = thisSTX.preprocessedUTXO_[stxoPair.first];
          subssh.txioMap_[txio.getDBKeyOfOutput()] = txio;
          dbUpdateSize_ += sizeof(TxIOPair)+8;
+
+         auto& delta = addrSummaryDeltas_[uniqKey];
+         delta.txioCount_++;
+         delta.unspentCount_++;
+         delta.unspentValue_ += stxoToAdd.getValue();
+         delta.seenAt(thisSTX.blockHeight_);
       }
       else
       {
@@ -673,6 +1293,13 @@ bool BlockWriteBatcher::parseTxOuts(
                stxoToAdd.getValue(),
                stxoToAdd.isCoinbase_,
                true);
+
+            if (config_.armoryDbType == ARMORY_DB_SUPER)
+            {
+               auto& delta = addrSummaryDeltas_[uniqKey];
+               delta.txioCount_++;
+               delta.seenAt(thisSTX.blockHeight_);
+            }
          }
       }
 
@@ -705,23 +1332,30 @@ void BlockWriteBatcher::applyTxToBatchWriteData(
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-thread BlockWriteBatcher::commit(bool finalCommit)
+shared_future<void> BlockWriteBatcher::commit(bool finalCommit)
 {
    bool isCommiting = false;
    unique_lock<mutex> l(writeLock_, try_to_lock);
-   if (!l.owns_lock())
+
+   //a write still queued on the pool doesn't hold writeLock_ yet
+   bool writePending = lastCommit_.valid() &&
+      lastCommit_.wait_for(chrono::seconds(0)) != future_status::ready;
+
+   if (!l.owns_lock() || writePending)
    {
       // lock_ is held if commit() is running, but if we have
       // accumulated too much data we can't return from this function
       // to accumulate some more, so do a commit() anyway at the end
       // of this function. lock_ is used as a flag to indicate 
       // commitThread is running.
-      if (!finalCommit && dbUpdateSize_ < UPDATE_BYTES_THRESH * 2)
-         return thread();
+      if (!finalCommit && 
+          dbUpdateSize_ < flushController_->getBytesThreshold() * 2)
+         return shared_future<void>();
 
       isCommiting = true;
    }
-   else
+   
+   if (l.owns_lock())
       l.unlock();
 
    //create a BWB for commit (pass true to the constructor)
@@ -741,14 +1375,39 @@ thread BlockWriteBatcher::commit(bool finalCommit)
    bwbWriteObj->txCountAndHint_ = std::move(txCountAndHint_);
    
    bwbWriteObj->mostRecentBlockApplied_ = mostRecentBlockApplied_;
+   bwbWriteObj->useScanWatermark_ = useScanWatermark_;
+   bwbWriteObj->scanGeneration_ = scanGeneration_;
+   bwbWriteObj->dataToCommit_.utxoCount_ = utxoMap_.size();
+
+   for (auto& sbh : bwbWriteObj->sbhToUpdate_)
+   {
+      bwbWriteObj->dataToCommit_.lowestHeight_ = min(
+         bwbWriteObj->dataToCommit_.lowestHeight_, sbh.blockHeight_);
+   }
+   bwbWriteObj->dataToCommit_.addrSummaryDeltas_ = 
+      std::move(addrSummaryDeltas_);
+   addrSummaryDeltas_.clear();
+   bwbWriteObj->dataToCommit_.utxoTableDelta_ = std::move(utxoTableDelta_);
+   utxoTableDelta_.clear();
+   bwbWriteObj->dataToCommit_.startsUtxoTable_ = useScanWatermark_;
    bwbWriteObj->parent_ = this;
 
 
-   if (config_.armoryDbType == ARMORY_DB_SUPER && 
-       utxoMap_.size() > UTXO_THRESHOLD)
+   //in fullnode, the cache can only be dropped if the outpoint table can 
+   //stand in for it. The backup keeps the UTxOs of this commit until the 
+   //next one, by then this one is written and the read txn sees it
+   bool dropUtxos = false;
+   if (config_.armoryDbType == ARMORY_DB_SUPER)
+      dropUtxos = utxoMap_.size() > flushController_->getUtxoThreshold();
+   else if (utxoTableComplete_)
+      dropUtxos = utxoMap_.size() * UTXO_CACHE_BYTES > 
+         flushController_->getUtxoMemoryCap();
+
+   if (dropUtxos)
    {
       utxoMapBackup_.clear();
       utxoMapBackup_ = std::move(utxoMap_);
+      utxoMap_.clear();
       haveFullUTXOList_ = false;
    }
 
@@ -756,8 +1415,14 @@ thread BlockWriteBatcher::commit(bool finalCommit)
    {
       //the write thread is already running and we cumulated enough data in the
       //read thread for the next write. Let's use that idle time to serialize
-      //the data to commit ahead of time
+      //the data to commit ahead of time, once the running write is done with
+      //the SSH summaries
+      if (lastSerialized_.valid())
+         lastSerialized_.wait();
+
+      auto serializeStart = ScanTelemetry::now();
       bwbWriteObj->serializeData(subSshMap_);
+      bwbWriteObj->serializeUs_ = ScanTelemetry::now() - serializeStart;
    }
       
    deleteId_++;
@@ -768,20 +1433,33 @@ thread BlockWriteBatcher::commit(bool finalCommit)
       
    dbUpdateSize_ = 0;
 
+   //the previous write has to be done with subSshMapToWrite_
+   const bool hadWrite = lastCommit_.valid();
+   if (hadWrite)
+      lastCommit_.wait();
+
    l.lock();
    subSshMapToWrite_ = std::move(subSshMap_);
    commitingObject_ = bwbWriteObj;
 
-   if (isCommiting)
+   //the read txn has to see what the previous write put in the DB, it's not
+   //in subSshMapToWrite_ anymore
+   if (isCommiting || hadWrite)
       resetTransactions();
 
-   thread committhread(writeToDB, bwbWriteObj);
+   lastSerialized_ = bwbWriteObj->serialized_.get_future().share();
+
+   //writes unblock the scan, let them jump ahead of queued work
+   lastCommit_ = ThreadPool::getGlobal().submit(
+      [bwbWriteObj](void)->void { writeToDB(bwbWriteObj); },
+      TaskPriority_High).share();
 
-   return committhread;
+   return lastCommit_;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-void BlockWriteBatcher::prepareSshToModify(const ScrAddrFilter& sasd)
+void BlockWriteBatcher::prepareSshToModify(const ScrAddrFilter& sasd,
+   uint32_t fromHeight)
 {
    //In fullnode, the sshToModify_ container is not wiped after each commit.
    //Instead, all SSH for tracked scrAddr, since we know they're the onyl one
@@ -799,67 +1477,63 @@ void BlockWriteBatcher::prepareSshToModify(const ScrAddrFilter& sasd)
    if (config_.armoryDbType == ARMORY_DB_SUPER)
       return;
 
-   BinaryData hgtX(0);
+   useScanWatermark_ = sasd.ownsScanWatermark();
 
-   uint32_t utxoCount=0;
    LMDBEnv::Transaction tx;
    iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
 
-   /*StoredDBInfo sdbi;
-   iface_->getStoredDBInfo(HISTORY, sdbi);
-   utxoFromHeight_ = sdbi.topBlkHgt_;*/
+   uint32_t watermark = iface_->getScanWatermark();
+   uint32_t generation = iface_->getScanGeneration();
+
+   //a filter that was never loaded can't vouch for the scrAddrs behind the
+   //current generation, every commit will rewrite them
+   scanGeneration_ = sasd.getScanGeneration();
+   if (scanGeneration_ == UINT32_MAX)
+      scanGeneration_ = generation + 1;
+
+   //the main filter scanning from 0 starts the outpoint table
+   uint32_t tableStart = iface_->getUtxoTableStartHeight();
+   utxoTableComplete_ = tableStart == 0 || 
+      (tableStart == UINT32_MAX && fromHeight == 0 && useScanWatermark_);
+
+   //resume the BDM's UTxO set if it is where the DB is, only the scrAddrs
+   //merged since need their UTxOs pulled then
+   bool haveUtxos = false;
+   set<BinaryData> scrAddrsToLoad;
+   if (useScanWatermark_ && sasd.getUtxoSet() != nullptr)
+   {
+      utxoSet_ = sasd.getUtxoSet();
+      haveUtxos = utxoSet_->checkOut(utxoMap_, scrAddrsToLoad,
+         watermark, fromHeight, utxoSetRevision_);
+      utxoSetHeight_ = watermark;
+   }
 
+   //a rebuild goes through the outpoint table if it is complete: one get 
+   //per UTxO rather than a walk of every sub-history
+   set<BinaryData> tableScrAddrs;
    for (auto saPair : sasd.getScrAddrMap())
    {
       auto& ssh = (*sshToModify_)[saPair.first];
       iface_->getStoredScriptHistorySummary(ssh, saPair.first);
+      if (useScanWatermark_)
+         ssh.alreadyScannedUpToBlk_ = 
+            ssh.getScannedUpTo(watermark, generation);
 
-      if (ssh.totalTxioCount_ != 0)
-      {
-         BinaryWriter bwKey(saPair.first.getSize() + 1);
-         bwKey.put_uint8_t((uint8_t)DB_PREFIX_SCRIPT);
-         bwKey.put_BinaryData(saPair.first);
-
-         LDBIter dbIter = iface_->getIterator(HISTORY);
-
-         dbIter.seekToExact(bwKey.getDataRef());
-         while (dbIter.getKeyRef().startsWith(bwKey.getDataRef()))
-         {
-            if (dbIter.getKeyRef().getSize()==bwKey.getSize() +4)
-            {
-               //grab subssh
-               StoredSubHistory subssh;
-               subssh.hgtX_ = dbIter.getKeyRef().getSliceRef(-4, 4);
-               subssh.unserializeDBValue(dbIter.getValueReader());
-
-               //load all UTXOs listed
-               //if (utxoCount < UTXO_THRESHOLD)
-               {
-                  for (auto txio : subssh.txioMap_)
-                  {
-                     if (txio.second.isUTXO())
-                     {
-                        BinaryData dbKey = txio.second.getDBKeyOfOutput();
-                        shared_ptr<StoredTxOut> stxo(new StoredTxOut);
-                        iface_->getStoredTxOut(*stxo, dbKey);
-
-                        BinaryData txHash = iface_->getTxHashForLdbKey(dbKey.getSliceRef(0, 6));
+      if (ssh.totalTxioCount_ == 0)
+         continue;
 
-                        BinaryWriter bwUtxoKey(34);
-                        bwUtxoKey.put_BinaryData(txHash);
-                        bwUtxoKey.put_uint16_t(stxo->txOutIndex_, BE);
+      if (haveUtxos && 
+          scrAddrsToLoad.find(saPair.first) == scrAddrsToLoad.end())
+         continue;
 
-                        utxoMap_[bwUtxoKey.getDataRef()] = stxo;
-                        utxoCount++;
-                     }
-                  }
-               }
-            }
-               
-            dbIter.advanceAndRead(DB_PREFIX_SCRIPT);
-         }
-      }
+      if (!haveUtxos && utxoTableComplete_)
+         tableScrAddrs.insert(saPair.first);
+      else
+         UtxoSet::loadScrAddr(iface_, saPair.first, utxoMap_);
    }
+
+   if (tableScrAddrs.size() != 0)
+      UtxoSet::loadTable(iface_, tableScrAddrs, utxoMap_);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -868,14 +1542,19 @@ void BlockWriteBatcher::writeToDB(shared_ptr<BlockWriteBatcher> bwb)
    unique_lock<mutex> lock(bwb->parent_->writeLock_);
    LMDBBlockDatabase *db = bwb->iface_;
 
+   auto serializeStart = ScanTelemetry::now();
    bwb->dataToCommit_.serializeData(*bwb, bwb->parent_->subSshMapToWrite_);
+   bwb->serialized_.set_value();
+   auto writeStart = ScanTelemetry::now();
+   const uint64_t serializeUs = 
+      bwb->serializeUs_ + writeStart - serializeStart;
 
    {
       bwb->dataToCommit_.putSSH(db);
       bwb->dataToCommit_.putSTX(db);
       bwb->dataToCommit_.putSBH(db);
       bwb->dataToCommit_.deleteEmptyKeys(db);
-
+      bwb->dataToCommit_.putAddrSummaries(db);
 
       if (bwb->mostRecentBlockApplied_ != 0 && bwb->updateSDBI_ == true)
          bwb->dataToCommit_.updateSDBI(db);
@@ -886,6 +1565,17 @@ void BlockWriteBatcher::writeToDB(shared_ptr<BlockWriteBatcher> bwb)
 
    BlockWriteBatcher* bwbParent = bwb->parent_;
 
+   auto& flushController = *bwbParent->flushController_;
+   flushController.recordSshWrites(bwb->dataToCommit_.sshWritten_,
+      bwb->dataToCommit_.sshBytes_);
+   flushController.recordCommit(bwb->dbUpdateSize_, serializeUs,
+      ScanTelemetry::now() - writeStart);
+   if (bwbParent->telemetry_ != nullptr)
+   {
+      bwbParent->telemetry_->recordFlush(
+         bwbParent->telemetryStage_, flushController.getStats());
+   }
+
    //signal the readonly transaction to reset
    bwbParent->resetTxn_ = bwb->deleteId_;
 
@@ -944,7 +1634,8 @@ void BlockWriteBatcher::grabBlocksFromDB(shared_ptr<LoadedBlockData> blockData,
       while (blockData->bufferLoad_.load(memory_order_acquire)
          < UPDATE_BYTES_THRESH)
       {
-         if (hgt > blockData->endBlock_)
+         if (hgt > blockData->endBlock_ ||
+             blockData->stopGrabbing_.load(memory_order_acquire))
             return;
 
          uint8_t dupID = db->getValidDupIDForHeight(hgt);
@@ -973,12 +1664,43 @@ void BlockWriteBatcher::grabBlocksFromDB(shared_ptr<LoadedBlockData> blockData,
          }
 
          shared_ptr<PulledBlock> pb(new PulledBlock());
-         if (!pullBlockAtIter(*pb, ldbIter, db))
+         if (!filterBlockAtIter(blockData, *pb, ldbIter, db))
          {
-            unique_lock<mutex> assignLock(blockData->assignLock_);
-            *lastBlock = blockData->interruptBlock_;
-            LOGERR << "No block in DB at height " << hgt;
-            return;
+            if (!pullBlockAtIter(*pb, ldbIter, db))
+            {
+               unique_lock<mutex> assignLock(blockData->assignLock_);
+               *lastBlock = blockData->interruptBlock_;
+               LOGERR << "No block in DB at height " << hgt;
+               return;
+            }
+
+            //resolve the TxOut scrAddrs here rather than in the scan 
+            //thread, which only has to look them up
+            for (auto& stx : pb->stxMap_)
+            {
+               for (auto& stxo : stx.second.stxoMap_)
+                  stxo.second->getScrAddress(&blockData->hash160Cache_);
+            }
+
+            //blocks spending from tx that fund our scrAddrs have to match
+            //the filter test as well, add these tx hashes to the query
+            if (blockData->useFilters_)
+            {
+               for (auto& stx : pb->stxMap_)
+               {
+                  for (auto& stxo : stx.second.stxoMap_)
+                  {
+                     if (!blockData->scrAddrFilter_.hasScrAddress(
+                        stxo.second->getScrAddress()))
+                        continue;
+
+                     blockData->filterQuery_.insert(
+                        StoredBlockFilter::getElementHash(
+                           stx.second.thisHash_.getRef()));
+                     break;
+                  }
+               }
+            }
          }
 
          //increment bufferLoad
@@ -1003,7 +1725,8 @@ void BlockWriteBatcher::grabBlocksFromDB(shared_ptr<LoadedBlockData> blockData,
          ++hgt;
       }
 
-      if (hgt > blockData->endBlock_)
+      if (hgt > blockData->endBlock_ ||
+          blockData->stopGrabbing_.load(memory_order_acquire))
          return;
 
       //sleep 10sec or until process thread signals block buffer is low
@@ -1029,8 +1752,10 @@ BinaryData BlockWriteBatcher::applyBlocksToDB(ProgressFilter &progress,
    try
    {
       shared_ptr<PulledBlock> block;
-      thread grabThread(grabBlocksFromDB, blockData, iface_);
-      grabThread.detach();
+      //runs until the scan is done or tells it to stop, nothing to wait on
+      LMDBBlockDatabase* iface = iface_;
+      ThreadPool::getGlobal().submit(
+         [blockData, iface](void)->void { grabBlocksFromDB(blockData, iface); });
 
       uint64_t totalBlockDataProcessed=0;
       unique_lock<mutex> scanLock(blockData->scanLock_);
@@ -1080,9 +1805,32 @@ BinaryData BlockWriteBatcher::applyBlocksToDB(ProgressFilter &progress,
          lastScannedBlockHash = 
             applyBlockToDB(block, blockData->scrAddrFilter_);
 
+         if (telemetry_ != nullptr)
+         {
+            uint64_t txioCount = 0;
+            for (auto& txPair : block->stxMap_)
+               txioCount += txPair.second.stxoMap_.size() +
+                            txPair.second.txInIndexes_.size();
+
+            telemetry_->record(telemetryStage_, 1, block->stxMap_.size(),
+               blockSize, txioCount);
+         }
+
          if (i == blockData->endBlock_)
             break;
 
+         //side scans yield at block boundaries to let late registrations 
+         //join in. Everything up to this block gets committed as usual. 
+         //Not past block 0, as SSH scanned up to 0 read as never scanned
+         if (i != 0 && blockData->scrAddrFilter_.hasPendingJoin())
+         {
+            LOGINFO << "Yielding scan at block " << i;
+            
+            blockData->stopGrabbing_.store(true, memory_order_release);
+            blockData->grabCV_.notify_all();
+            break;
+         }
+
          if (blockData->bufferLoad_.load(memory_order_consume)
             < UPDATE_BYTES_THRESH / 2)
          {
@@ -1098,6 +1846,7 @@ BinaryData BlockWriteBatcher::applyBlocksToDB(ProgressFilter &progress,
          }
 
          //wait until next block is available
+         uint64_t stallStart = 0;
          while (1)
          {
             {
@@ -1108,10 +1857,17 @@ BinaryData BlockWriteBatcher::applyBlocksToDB(ProgressFilter &progress,
             if (block != nullptr)
                break;
             
+            if (stallStart == 0)
+               stallStart = ScanTelemetry::now();
+
             //wait for grabThread signal
             blockData->scanCV_.wait_for(scanLock, chrono::seconds(2));
          }
 
+         if (stallStart != 0 && telemetry_ != nullptr)
+            telemetry_->recordStall(
+               telemetryStage_, ScanTelemetry::now() - stallStart);
+
          //check if next block is valid
          if (block == blockData->interruptBlock_)
          {
@@ -1140,6 +1896,10 @@ BinaryData BlockWriteBatcher::applyBlocksToDB(ProgressFilter &progress,
    }
    catch (...)
    {
+      //let the grab thread go
+      blockData->stopGrabbing_.store(true, memory_order_release);
+      blockData->grabCV_.notify_all();
+
       clearTransactions();
       throw;
    }
@@ -1162,12 +1922,67 @@ BinaryData BlockWriteBatcher::scanBlocks(
    ScrAddrFilter& scf
 )
 {
-   prepareSshToModify(scf);
+   prepareSshToModify(scf, startBlock);
 
    shared_ptr<LoadedBlockData> tempBlockData = 
       make_shared<LoadedBlockData>(startBlock, endBlock, scf);
 
-   return applyBlocksToDB(prog, tempBlockData);
+   if (config_.armoryDbType != ARMORY_DB_SUPER && config_.useBlockFilters)
+   {
+      //seed the filter query with our scrAddrs and the tx hashes of the 
+      //utxos we already know of
+      tempBlockData->useFilters_ = true;
+      
+      for (auto& saPair : scf.getScrAddrMap())
+         tempBlockData->filterQuery_.insert(
+            StoredBlockFilter::getElementHash(saPair.first.getRef()));
+
+      for (auto& utxoPair : utxoMap_)
+         tempBlockData->filterQuery_.insert(
+            StoredBlockFilter::getElementHash(
+               utxoPair.first.getSliceRef(0, 32)));
+   }
+
+   BinaryData lastScannedBlockHash = applyBlocksToDB(prog, tempBlockData);
+   putMissingBlockFilters(tempBlockData);
+
+   return lastScannedBlockHash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BlockWriteBatcher::putMissingBlockFilters(
+   shared_ptr<LoadedBlockData> blockData)
+{
+   if (!blockData->useFilters_)
+      return;
+
+   vector<StoredBlockFilter> missingFilters;
+   {
+      unique_lock<mutex> assignLock(blockData->assignLock_);
+      missingFilters = move(blockData->missingFilters_);
+
+      LOGINFO << "Block filters skipped " << blockData->filteredBlocks_
+         << " out of " << blockData->endBlock_ - blockData->startBlock_ + 1
+         << " blocks";
+   }
+
+   if (missingFilters.size() == 0)
+      return;
+
+   try
+   {
+      LMDBEnv::Transaction tx(iface_->dbEnv_[BLKDATA].get(), LMDB::ReadWrite);
+      for (auto& sbf : missingFilters)
+         iface_->putStoredBlockFilter(sbf);
+   }
+   catch (LMDBException &e)
+   {
+      //not critical, the next scan will compute them again
+      LOGWARN << "Failed to write block filters: " << e.what();
+      return;
+   }
+
+   LOGINFO << "Added filters for " << missingFilters.size() << " blocks";
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1185,6 +2000,68 @@ bool BlockWriteBatcher::pullBlockAtIter(PulledBlock& pb, LDBIter& iter,
    return false;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+bool BlockWriteBatcher::filterBlockAtIter(
+   shared_ptr<LoadedBlockData> blockData,
+   PulledBlock& pb, LDBIter& iter, LMDBBlockDatabase* db)
+{
+   /***
+   Returns true if the block filter rules out this block. pb then only carries
+   the header so that the scan still accounts for this height. Returns false
+   if the full block needs to be pulled.
+   ***/
+
+   if (!blockData->useFilters_)
+      return false;
+
+   BinaryData hgtx = iter.getKeyRef().getSliceCopy(1, 4);
+   uint32_t height = DBUtils::hgtxToHeight(hgtx);
+   uint8_t dup = DBUtils::hgtxToDupID(hgtx);
+   BinaryDataRef rawBlock = iter.getValueRef();
+
+   StoredBlockFilter sbf;
+   if (!db->getStoredBlockFilter(sbf, height, dup))
+   {
+      //this block predates filters, compute one for the next scan
+      try
+      {
+         sbf.createFromRawBlock(rawBlock);
+      }
+      catch (BlockDeserializingException&)
+      {
+         return false;
+      }
+
+      unique_lock<mutex> assignLock(blockData->assignLock_);
+      blockData->missingFilters_.push_back(move(sbf));
+      return false;
+   }
+
+   try
+   {
+      if (sbf.matchAny(blockData->filterQuery_))
+         return false;
+   }
+   catch (runtime_error&)
+   {
+      LOGWARN << "Invalid filter for block at height " << height;
+      return false;
+   }
+
+   if (rawBlock.getSize() < HEADER_SIZE)
+      return false;
+
+   pb.blockHeight_ = height;
+   pb.duplicateID_ = dup;
+   pb.dataCopy_ = rawBlock.getSliceCopy(0, HEADER_SIZE);
+   BtcUtils::getHash256(pb.dataCopy_, pb.thisHash_);
+   pb.numTx_ = 0;
+   pb.numBytes_ = rawBlock.getSize();
+
+   ++blockData->filteredBlocks_;
+   return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 bool BlockWriteBatcher::pullBlockFromDB(
    PulledBlock& pb, uint32_t height, uint8_t dup)
@@ -1310,11 +2187,32 @@ set<BinaryData> DataToCommit::serializeSSH(BlockWriteBatcher& bwb,
       if (bwb.config_.armoryDbType != ARMORY_DB_SUPER)
       {
          ssh.alreadyScannedUpToBlk_ = bwb.mostRecentBlockApplied_;
+         if (bwb.useScanWatermark_)
+         {
+            //untouched SSHs are moved along by the watermark, as long as
+            //they were written with this generation
+            if (subsshIter == subsshMap.end() && ssh.followsScanWatermark_ &&
+                ssh.scanGeneration_ == bwb.scanGeneration_)
+               continue;
+
+            ssh.followsScanWatermark_ = true;
+            ssh.scanGeneration_ = bwb.scanGeneration_;
+         }
+         else
+            ssh.followsScanWatermark_ = false;
+
          BinaryWriter& bw = serializedSshToModify_[sshKey];
          ssh.serializeDBValue(bw, dbType, pruneType);
       }
    }
 
+   if (bwb.useScanWatermark_ && bwb.config_.armoryDbType != ARMORY_DB_SUPER)
+   {
+      writeScanWatermark_ = true;
+      scanWatermark_ = bwb.mostRecentBlockApplied_;
+      scanGeneration_ = bwb.scanGeneration_;
+   }
+
    sshReady_ = true;
 
    return keysToDelete;
@@ -1341,8 +2239,10 @@ void DataToCommit::serializeDataToCommit(BlockWriteBatcher& bwb,
             BinaryData subsshKey = sshKey + subssh.hgtX_;
             if (subssh.txioMap_.size() != 0)
             {
+               //txio spentness was resolved as the blocks were parsed, 
+               //no DB access from here
                BinaryWriter& bw = serializedSubSshToApply_[subsshKey];
-               subssh.serializeDBValue(bw, bwb.iface_, dbType, pruneType);
+               subssh.serializeDBValue(bw, nullptr, dbType, pruneType);
             }
             else
                keysToDelete_.insert(subsshKey);
@@ -1434,13 +2334,13 @@ void DataToCommit::serializeData(BlockWriteBatcher& bwb,
    auto serialize = [&](void)
    { serializeDataToCommit(bwb, subsshMap); };
 
-   thread serThread = thread(serialize);
+   auto serializing = 
+      ThreadPool::getGlobal().submit(serialize, TaskPriority_High);
 
    const auto& keysToDelete = serializeSSH(bwb, subsshMap);
    lock.unlock();
 
-   if (serThread.joinable())
-      serThread.join();
+   serializing.get();
    
    keysToDelete_.insert(keysToDelete.begin(), keysToDelete.end());
 
@@ -1459,10 +2359,18 @@ void DataToCommit::putSSH(LMDBBlockDatabase* db)
       dbs = HISTORY;
       
    for (auto& sshPair : serializedSshToModify_)
+   {
       db->putValue(dbs, sshPair.first, sshPair.second.getData());
+      sshBytes_ += sshPair.second.getSize();
+   }
+   sshWritten_ = serializedSshToModify_.size();
 
    for (auto subSshPair : serializedSubSshToApply_)
       db->putValue(dbs, subSshPair.first, subSshPair.second.getData());
+
+   //same transaction as the SSHs it stands in for
+   if (writeScanWatermark_)
+      db->putScanWatermark(scanWatermark_, scanGeneration_);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1486,6 +2394,14 @@ void DataToCommit::putSTX(LMDBBlockDatabase* db)
    for (auto& txCount : serializedTxCountAndHash_)
       db->putValue(dbs, txCount.first, txCount.second.getData());
 
+   //the outpoint table goes with the TxOuts it points to
+   if (startsUtxoTable_ && lowestHeight_ != UINT32_MAX &&
+       db->getUtxoTableStartHeight() == UINT32_MAX)
+      db->putUtxoTableStartHeight(lowestHeight_);
+
+   for (auto& stuPair : utxoTableDelta_)
+      db->putStoredUtxo(stuPair.second);
+
    LMDBEnv::Transaction txHints(db->dbEnv_[TXHINTS].get(), LMDB::ReadWrite);
       for (auto& txHints : serializedTxHints_)
       db->putValue(TXHINTS, txHints.first, txHints.second.getData());
@@ -1522,6 +2438,61 @@ void DataToCommit::deleteEmptyKeys(LMDBBlockDatabase* db)
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+static uint64_t addSummaryDelta(uint64_t value, int64_t delta)
+{
+   if (delta < 0 && uint64_t(-delta) > value)
+      return 0;
+
+   return value + delta;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void DataToCommit::putAddrSummaries(LMDBBlockDatabase* db)
+{
+   //runs after putSSH and deleteEmptyKeys, so that the sub-history keys are
+   //up to date when an undo has us look them up
+
+   if (dbType_ != ARMORY_DB_SUPER || addrSummaryDeltas_.size() == 0)
+      return;
+
+   LMDBEnv::Transaction tx;
+   db->beginDBTransaction(&tx, HISTORY, LMDB::ReadWrite);
+
+   if (db->getAddrSummaryStartHeight() == UINT32_MAX && 
+       lowestHeight_ != UINT32_MAX)
+      db->putAddrSummaryStartHeight(lowestHeight_);
+
+   for (auto& deltaPair : addrSummaryDeltas_)
+   {
+      auto& delta = deltaPair.second;
+
+      StoredAddrSummary sas;
+      db->getStoredAddrSummary(sas, deltaPair.first);
+
+      sas.txioCount_    = addSummaryDelta(sas.txioCount_, delta.txioCount_);
+      sas.unspentCount_ = 
+         addSummaryDelta(sas.unspentCount_, delta.unspentCount_);
+      sas.unspentValue_ = 
+         addSummaryDelta(sas.unspentValue_, delta.unspentValue_);
+
+      if (delta.undone_)
+      {
+         if (!db->getSubHistoryHeightRange(deltaPair.first,
+            sas.firstSeenHeight_, sas.lastSeenHeight_))
+            sas.txioCount_ = 0;
+      }
+      else
+      {
+         sas.firstSeenHeight_ = min(sas.firstSeenHeight_, delta.firstSeen_);
+         sas.lastSeenHeight_ = max(sas.lastSeenHeight_, delta.lastSeen_);
+      }
+
+      //a null summary is deleted
+      db->putStoredAddrSummary(sas);
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void DataToCommit::updateSDBI(LMDBBlockDatabase* db)
 {
@@ -1549,4 +2520,15 @@ void DataToCommit::updateSDBI(LMDBBlockDatabase* db)
 
       db->putStoredDBInfo(dbs, sdbi);
    }
+
+   //move the scan checkpoint along, if a scan is being tracked. It shares 
+   //the SDBI's transaction, a resume never starts past what was committed
+   StoredScanCheckpoint sscp;
+   if (topBlockHash_ != BtcUtils::EmptyHash_ && db->getScanCheckpoint(sscp))
+   {
+      sscp.committedHeight_ = mostRecentBlockApplied_ - 1;
+      sscp.committedHash_ = topBlockHash_;
+      sscp.utxoCount_ = utxoCount_;
+      db->putScanCheckpoint(sscp);
+   }
 }
\ No newline at end of file
@@ -14,7 +14,7 @@
 #include "log.h"
 #include "txio.h"
 
-#include <thread>
+#include <future>
 #include <condition_variable>
 #include <chrono>
 
@@ -242,6 +242,27 @@ struct keyHasher
    }
 };
 
+//supernode: what a batch of blocks did to a scrAddr, merged into its 
+//StoredAddrSummary on commit
+struct AddrSummaryDelta
+{
+   int64_t txioCount_ = 0;
+   int64_t unspentCount_ = 0;
+   int64_t unspentValue_ = 0;
+   uint32_t firstSeen_ = UINT32_MAX;
+   uint32_t lastSeen_ = 0;
+
+   //an undo may have removed the first or last sub-history, these have to 
+   //be looked up again
+   bool undone_ = false;
+
+   void seenAt(uint32_t height)
+   {
+      firstSeen_ = min(firstSeen_, height);
+      lastSeen_ = max(lastSeen_, height);
+   }
+};
+
 struct DataToCommit
 {
    map<BinaryData, BinaryWriter> serializedSubSshToApply_;
@@ -257,6 +278,27 @@ struct DataToCommit
    uint32_t mostRecentBlockApplied_;
    BinaryData topBlockHash_;
 
+   //size of the utxo cache for the scan checkpoint
+   uint32_t utxoCount_ = 0;
+
+   //set when the SSH summaries left out of this commit follow the watermark
+   bool writeScanWatermark_ = false;
+   uint32_t scanWatermark_ = UINT32_MAX;
+   uint32_t scanGeneration_ = 0;
+   uint32_t sshWritten_ = 0;
+   uint64_t sshBytes_ = 0;
+
+   //Fullnode only, outpoint table entries to write, null ones are deleted.
+   //The table's start height is recorded by the main filter's batcher
+   map<BinaryData, StoredUtxo> utxoTableDelta_;
+   bool startsUtxoTable_ = false;
+
+   //Supernode only
+   map<BinaryData, AddrSummaryDelta> addrSummaryDeltas_;
+
+   //lowest block applied or undone by the commit
+   uint32_t lowestHeight_ = UINT32_MAX;
+
    bool isSerialized_ = false;
    bool sshReady_ = false;
 
@@ -281,12 +323,161 @@ struct DataToCommit
    void putSBH(LMDBBlockDatabase* db);
    void deleteEmptyKeys(LMDBBlockDatabase* db);
    void updateSDBI(LMDBBlockDatabase* db);
+   void putAddrSummaries(LMDBBlockDatabase* db);
 
    //During reorgs, alreadyScannedUpToBlock is not an accurate indicator of the 
    //last blocks this ssh has seen anymore. This value should be used instead.
    uint32_t forceUpdateSshAtHeight_ = UINT32_MAX;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// Decides how much the BlockWriteBatcher accumulates before committing.
+//
+// Fixed: UPDATE_BYTES_THRESH and UTXO_THRESHOLD, whatever the machine.
+//
+// Adaptive: each commit reports its size and how long serializing and 
+// writing it took. The byte threshold moves toward what the measured
+// throughput writes in the target duration, by at most a factor 2 per 
+// commit, within [minBytes, maxBytes] and under a third of the memory cap 
+// (a batch accumulates while the previous one is written, with room for 
+// the block read ahead). Partial batches, like the final commit, are 
+// measured but don't steer. The supernode UTXO cache threshold scales with
+// the byte threshold, the fullnode UTxO cache gets another third of the
+// memory cap.
+//
+// Thresholds are read by the scan thread while commits report from the
+// pool, they are atomic.
+////////////////////////////////////////////////////////////////////////////////
+class FlushController
+{
+private:
+   const bool adaptive_;
+   uint64_t minBytes_;
+   uint64_t maxBytes_;
+   uint64_t targetUs_;
+   uint64_t memoryCap_;
+
+   atomic<uint64_t> bytesThreshold_;
+   atomic<uint32_t> utxoThreshold_;
+
+   //bytes per microsecond, smoothed over the commits
+   double throughput_ = 0.0;
+
+   mutable mutex mu_;
+   FlushStats stats_;
+
+private:
+   void setBytesThreshold(uint64_t bytes);
+
+public:
+   //0 picks the defaults for the bounds, target and memory cap
+   FlushController(bool adaptive, uint64_t minBytes, uint64_t maxBytes,
+      uint32_t targetMs, uint64_t memoryCap);
+   explicit FlushController(const BlockDataManagerConfig& config);
+
+   FlushController(const FlushController&) = delete;
+   FlushController& operator=(const FlushController&) = delete;
+
+   bool isAdaptive(void) const { return adaptive_; }
+   uint64_t getBytesThreshold(void) const
+   { return bytesThreshold_.load(memory_order_relaxed); }
+   uint32_t getUtxoThreshold(void) const
+   { return utxoThreshold_.load(memory_order_relaxed); }
+   uint64_t getUtxoMemoryCap(void) const { return memoryCap_ / 3; }
+
+   void recordCommit(uint64_t bytes, uint64_t serializeUs, uint64_t writeUs);
+   void recordSshWrites(uint32_t count, uint64_t bytes);
+   FlushStats getStats(void) const;
+
+   //RAM the OS reports as available, 0 if it can't tell
+   static uint64_t getAvailableMemory(void);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// The UTxOs of the BDM's own scrAddr filter, kept across BlockWriteBatcher
+// instances so that applying a new block doesn't start with pulling every
+// tracked UTxO from the DB.
+//
+// A batcher checks the set out as it prepares its SSHs, applies and undoes 
+// blocks on it, then checks it back in with the height it left it at once 
+// its final commit is written. The set is resumed if that height is still
+// the DB's scan watermark and the next batch doesn't start past it. 
+// Otherwise the batcher rebuilds it from the DB, out of the outpoint table
+// (see StoredUtxo) if that is complete. ScrAddrs merged into the filter 
+// since have their UTxOs loaded at the next checkout.
+//
+// Checkouts and checkins come from the scan thread, merges from the 
+// maintenance thread.
+////////////////////////////////////////////////////////////////////////////////
+class UtxoSet
+{
+public:
+   typedef map<BinaryData, shared_ptr<StoredTxOut>> UtxoMap;
+
+private:
+   mutable mutex mu_;
+   UtxoMap utxos_;
+
+   //merged into the filter after the set was last built
+   set<BinaryData> scrAddrsToLoad_;
+
+   bool valid_ = false;
+   uint32_t height_ = UINT32_MAX;
+
+   //bumped by checkouts and invalidations, only the holder of the latest 
+   //revision can check the set back in
+   uint32_t revision_ = 0;
+
+   uint32_t warmCheckouts_ = 0;
+   uint32_t coldCheckouts_ = 0;
+
+public:
+   UtxoSet(void) {}
+
+   UtxoSet(const UtxoSet&) = delete;
+   UtxoSet& operator=(const UtxoSet&) = delete;
+
+   //moves the set into utxoMap and returns true if it can be resumed for a
+   //batch starting at fromHeight, with the DB at watermark. Returns false 
+   //with utxoMap empty otherwise.
+   bool checkOut(UtxoMap& utxoMap, set<BinaryData>& scrAddrsToLoad,
+      uint32_t watermark, uint32_t fromHeight, uint32_t& revision);
+   
+   //takes utxoMap back as the UTxOs at height. A batcher that didn't finish
+   //its blocks passes isComplete false and the set is rebuilt next time
+   void checkIn(UtxoMap& utxoMap, uint32_t height, uint32_t revision,
+      bool isComplete);
+
+   void addScrAddrs(const vector<BinaryData>& scrAddrs);
+   void invalidate(void);
+
+   bool isValid(void) const;
+   uint32_t getHeight(void) const;
+   size_t size(void) const;
+   uint32_t getWarmCheckouts(void) const;
+   uint32_t getColdCheckouts(void) const;
+
+   //pulls the UTxOs of scrAddr from its sub-histories, in a HISTORY 
+   //transaction
+   static void loadScrAddr(LMDBBlockDatabase* iface, 
+      const BinaryData& scrAddr, UtxoMap& utxoMap);
+
+   //pulls the UTxOs of scrAddrs from the outpoint table, in a HISTORY 
+   //transaction. Only complete if the table's start height is 0
+   static void loadTable(LMDBBlockDatabase* iface,
+      const set<BinaryData>& scrAddrs, UtxoMap& utxoMap);
+
+   //compares a checked in set with a rebuild from the DB, for the scrAddrs 
+   //of filter, and the outpoint table as well if it is complete. Logs the 
+   //differences
+   bool verify(LMDBBlockDatabase* iface, const ScrAddrFilter& filter) const;
+
+   //compares the outpoint table with a rebuild from the sub-histories, for
+   //the scrAddrs of filter
+   static bool verifyTable(LMDBBlockDatabase* iface, 
+      const ScrAddrFilter& filter);
+};
+
 class BlockWriteBatcher
 {
    friend struct DataToCommit;
@@ -301,6 +492,10 @@ public:
    static const uint64_t UPDATE_BYTES_THRESH = 50 * 1024 * 1024;
    static const uint32_t UTXO_THRESHOLD = 100000;
 #endif
+   //rough footprint of a cached UTxO: its StoredTxOut, TxOut copy, key and
+   //map node
+   static const uint64_t UTXO_CACHE_BYTES = sizeof(StoredTxOut) + 128;
+
    BlockWriteBatcher(const BlockDataManagerConfig &config, 
                      LMDBBlockDatabase* iface, 
                      bool forCommit = false);
@@ -312,6 +507,10 @@ public:
       uint32_t startBlock, uint32_t endBlock, ScrAddrFilter& sca);
    void setUpdateSDBI(bool set) { updateSDBI_ = set; }
    void setCriticalErrorLambda(function<void(string)> lbd) { criticalError_ = lbd; }
+   void setTelemetry(ScanTelemetry* telemetry, ScanStage stage)
+   { telemetry_ = telemetry; telemetryStage_ = stage; }
+   const FlushController& getFlushController(void) const
+   { return *parent_->flushController_; }
 
 private:
 
@@ -331,6 +530,25 @@ private:
       mutex scanLock_, grabLock_, assignLock_;
       condition_variable scanCV_, grabCV_;
 
+      //set by the scan thread when it stops short of endBlock_
+      atomic<bool> stopGrabbing_;
+
+      //fullnode block filters. The query set holds the element hashes of 
+      //tracked scrAddrs and of the tx hashes funding them, so that blocks
+      //spending from tracked scrAddrs match as well. Only the grab thread
+      //touches it.
+      bool useFilters_ = false;
+      set<uint64_t> filterQuery_;
+      uint32_t filteredBlocks_ = 0;
+
+      //filters computed for blocks that didn't have one, written after
+      //the scan. Guarded by assignLock_
+      vector<StoredBlockFilter> missingFilters_;
+
+      //the grab thread computes the scrAddr of the TxOuts it pulls, P2PK
+      //ones through this cache. Only the grab thread touches it.
+      Hash160Cache hash160Cache_;
+
       ////
       LoadedBlockData(uint32_t start, uint32_t end, ScrAddrFilter& scf) :
          startBlock_(start), endBlock_(end), scrAddrFilter_(scf)
@@ -341,6 +559,7 @@ private:
          interruptBlock_->nextBlock_ = interruptBlock_;
 
          bufferLoad_.store(0, memory_order_relaxed);
+         stopGrabbing_.store(false, memory_order_relaxed);
       }
    };
 
@@ -351,10 +570,12 @@ private:
    };
 
    // We have accumulated enough data, actually write it to the db
-   thread commit(bool force = false);
+   //the future is invalid when no commit was started
+   shared_future<void> commit(bool force = false);
    static void writeToDB(shared_ptr<BlockWriteBatcher>);
    
-   void prepareSshToModify(const ScrAddrFilter& sasd);
+   //fromHeight is the lowest block the batch applies or undoes
+   void prepareSshToModify(const ScrAddrFilter& sasd, uint32_t fromHeight);
    BinaryData applyBlockToDB(shared_ptr<PulledBlock> pb, ScrAddrFilter& scrAddrData);
    void applyTxToBatchWriteData(
                            PulledTx& thisSTX,
@@ -382,16 +603,24 @@ private:
    bool pullBlockFromDB(PulledBlock& pb, uint32_t height, uint8_t dup);
    static bool pullBlockAtIter(PulledBlock& pb, LDBIter& iter,
       LMDBBlockDatabase* db);
+   static bool filterBlockAtIter(shared_ptr<LoadedBlockData> blockData,
+      PulledBlock& pb, LDBIter& iter, LMDBBlockDatabase* db);
+   void putMissingBlockFilters(shared_ptr<LoadedBlockData> blockData);
 
    StoredTxOut* makeSureSTXOInMap(
       LMDBBlockDatabase* iface,
       const BinaryData& txHash,
       uint16_t txoId);
 
-   StoredTxOut* lookForUTXOInMap(const BinaryData& txHash, const uint16_t& txoId);
+   StoredTxOut* lookForUTXOInMap(const BinaryData& txHash, const uint16_t& txoId,
+      ScrAddrFilter& scrAddrData);
 
    void moveStxoToUTXOMap(const shared_ptr<StoredTxOut>& thisTxOut);
 
+   //fullnode: queues the outpoint table entry of a TxOut that became 
+   //unspent, or its removal if stxo is null
+   void updateUtxoTable(const BinaryData& hashAndId, const StoredTxOut* stxo);
+
    void serializeData(
       const map<BinaryData, map<BinaryData, StoredSubHistory> >& subsshMap) 
    { dataToCommit_.serializeData(*this, subsshMap); }
@@ -439,9 +668,11 @@ private:
    
    //Supernode only
    vector<PulledBlock>                                   sbhToUpdate_;
+   map<BinaryData, AddrSummaryDelta>                     addrSummaryDeltas_;
    
    //Fullnode only
    map<BinaryData, CountAndHint>                         txCountAndHint_;
+   map<BinaryData, StoredUtxo>                           utxoTableDelta_;
    
    DataToCommit                                          dataToCommit_;
    // incremented for each
@@ -471,16 +702,47 @@ private:
 
    //to sync commits 
    mutex writeLock_;
+
+   //the last write handed to the pool, it may not have taken writeLock_ yet
+   shared_future<void> lastCommit_;
+
+   //set once that write is done updating sshToModify_
+   shared_future<void> lastSerialized_;
+   promise<void> serialized_;
+
    bool updateSDBI_ = true;
 
-   //
+   //the main filter's SSHs follow the scan watermark rather than being
+   //rewritten by every commit, see StoredScriptHistory::followsScanWatermark_
+   bool useScanWatermark_ = false;
+   uint32_t scanGeneration_ = 0;
+
+   //the BDM's UTxO set while this batcher has it checked out, utxoMap_ 
+   //holds its content
+   shared_ptr<UtxoSet> utxoSet_;
+   uint32_t utxoSetRevision_ = 0;
+   uint32_t utxoSetHeight_ = UINT32_MAX;
+
+   //false once the UTxO cache was dropped for being too large, a spend it 
+   //doesn't have is then looked up in the DB: by hash in supernode, in the
+   //outpoint table in fullnode, which requires it to be complete
    bool haveFullUTXOList_ = true;
+   bool utxoTableComplete_ = false;
    //uint32_t utxoFromHeight_ = 0;
 
    DB_SELECT historyDB_;
 
    //to report back fatal errors to the main thread
    function<void(string)> criticalError_ = [](string)->void{};
+
+   ScanTelemetry* telemetry_ = nullptr;
+   ScanStage telemetryStage_ = ScanStage_Scan;
+
+   //only the scanning BWB has one, commit objects go through parent_
+   unique_ptr<FlushController> flushController_;
+
+   //time spent serializing this commit ahead of the write
+   uint64_t serializeUs_ = 0;
 };
 
 
@@ -30,6 +30,8 @@
 #include "log.h"
 
 class LedgerEntry;
+struct LedgerChangeSet;
+struct NewBlockNotification;
 
 #define HEADER_SIZE 80
 #define COIN 100000000ULL
@@ -266,6 +268,36 @@ public:
 };
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Memoizes pubkey -> hash160 for the scrAddr of P2PK outputs, which otherwise
+// hash their pubkey each time. Direct mapped on the first bytes of the key
+// (random, being a curve point), a colliding key takes over the slot. 
+// Lookups never allocate. Not thread safe, use one per scanning thread.
+class Hash160Cache
+{
+   struct Slot
+   {
+      uint8_t pubKey_[65];
+      uint8_t size_ = 0;
+      uint8_t hash160_[20];
+   };
+
+   vector<Slot> slots_;
+   const uint32_t mask_;
+
+   uint64_t hits_ = 0;
+   uint64_t misses_ = 0;
+
+public:
+   //slotCount is rounded down to a power of 2
+   Hash160Cache(uint32_t slotCount = 4096);
+
+   void getHash160(BinaryDataRef pubKey, uint8_t* hash160);
+
+   uint64_t hits(void) const { return hits_; }
+   uint64_t misses(void) const { return misses_; }
+};
+
 // This class holds only static methods.  
 // NOTE:  added default ctor and a few non-static, to support SWIG
 //        (-classic SWIG doesn't support static methods)
@@ -565,6 +597,20 @@ public:
       ripemd160_.CalculateDigest(hashOutput.getPtr(), bd32.getPtr(), 32);
    }
 
+   /////////////////////////////////////////////////////////////////////////////
+   // hashOutput has to hold 20 bytes. Does not allocate
+   static void getHash160(uint8_t const * strToHash,
+                          size_t          nBytes,
+                          uint8_t*        hashOutput)
+   {
+      CryptoPP::SHA256 sha256_;
+      CryptoPP::RIPEMD160 ripemd160_;
+      uint8_t hash256[32];
+
+      sha256_.CalculateDigest(hash256, strToHash, nBytes);
+      ripemd160_.CalculateDigest(hashOutput, hash256, 32);
+   }
+
    /////////////////////////////////////////////////////////////////////////////
    static void getHash160_NoSafetyCheck(
                           uint8_t const * strToHash,
@@ -933,17 +979,14 @@ public:
 
       // Technically, this doesn't recognize all P2SH spends.  Only 
       // spends of P2SH scripts that are, themselves, standard
-      BinaryData lastPush = getLastPushDataInScript(script);
+      BinaryDataRef lastPush;
+      uint32_t pushCount = getLastPushDataRef(script, lastPush);
       if(getTxOutScriptType(lastPush) != TXOUT_SCRIPT_NONSTANDARD)
          return TXIN_SCRIPT_SPENDP2SH;
 
       if(script[0]==0x00)
       {
-         // TODO: All this complexity to check TxIn type may be too slow when 
-         //       scanning the blockchain...will need to investigate later
-         vector<BinaryDataRef> splitScr = splitPushOnlyScriptRefs(script);
-   
-         if(splitScr.size() == 0)
+         if(pushCount == 0)
             return TXIN_SCRIPT_NONSTANDARD;
 
          // TODO: Maybe should identify whether the other pushed data
@@ -997,43 +1040,90 @@ public:
    // We use this for LevelDB keys, to return same key if the same priv/pub 
    // pair is used, and also saving a few bytes for common script types
    static BinaryData getTxOutScrAddr(BinaryDataRef script,
-      TXOUT_SCRIPT_TYPE type = TXOUT_SCRIPT_NONSTANDARD)
+      TXOUT_SCRIPT_TYPE type = TXOUT_SCRIPT_NONSTANDARD,
+      Hash160Cache* cache = nullptr)
+   {
+      if (type == TXOUT_SCRIPT_NONSTANDARD)
+         type = getTxOutScriptType(script);
+
+      if (type == TXOUT_SCRIPT_MULTISIG)
+      {
+         BinaryWriter bw;
+         bw.put_uint8_t(SCRIPT_PREFIX_MULTISIG);
+         bw.put_BinaryData(getMultisigUniqueKey(script));
+         return bw.getData();
+      }
+
+      BinaryData scrAddr(21);
+      if (!writeScrAddr(script, type, scrAddr.getPtr(), cache))
+      {
+         LOGERR << "What kind of TxOutScript did we get?";
+         return BinaryData(0);
+      }
+
+      return scrAddr;
+   }
+
+   /////////////////////////////////////////////////////////////////////////////
+   // Same as getTxOutScrAddr, written to the 21 bytes at scrAddr. Does not 
+   // allocate. Multisig scrAddrs are longer than that: returns false for 
+   // these, use getTxOutScrAddr instead.
+   static bool getTxOutScrAddrNoCopy(BinaryDataRef script, uint8_t* scrAddr,
+      TXOUT_SCRIPT_TYPE type = TXOUT_SCRIPT_NONSTANDARD,
+      Hash160Cache* cache = nullptr)
    {
-      BinaryWriter bw;
       if (type == TXOUT_SCRIPT_NONSTANDARD)
          type = getTxOutScriptType(script);
+
+      return writeScrAddr(script, type, scrAddr, cache);
+   }
+
+private:
+   /////////////////////////////////////////////////////////////////////////////
+   static bool writeScrAddr(BinaryDataRef script, TXOUT_SCRIPT_TYPE type,
+      uint8_t* scrAddr, Hash160Cache* cache)
+   {
+      //a type that doesn't fit the script is an error, like any other
+      //unknown type
       switch (type)
       {
          case(TXOUT_SCRIPT_STDHASH160) :
-            bw.put_uint8_t(SCRIPT_PREFIX_HASH160);
-            bw.put_BinaryData(script.getSliceCopy(3, 20));
-            return bw.getData();
+            if (script.getSize() < 23)
+               return false;
+            scrAddr[0] = SCRIPT_PREFIX_HASH160;
+            memcpy(scrAddr + 1, script.getPtr() + 3, 20);
+            return true;
          case(TXOUT_SCRIPT_STDPUBKEY65) :
-            bw.put_uint8_t(SCRIPT_PREFIX_HASH160);
-            bw.put_BinaryData(getHash160(script.getSliceRef(1, 65)));
-            return bw.getData();
          case(TXOUT_SCRIPT_STDPUBKEY33) :
-            bw.put_uint8_t(SCRIPT_PREFIX_HASH160);
-            bw.put_BinaryData(getHash160(script.getSliceRef(1, 33)));
-            return bw.getData();
+         {
+            BinaryDataRef pubKey = script.getSliceRef(1, 
+               type == TXOUT_SCRIPT_STDPUBKEY65 ? 65 : 33);
+            if (pubKey.getSize() == 0)
+               return false;
+            scrAddr[0] = SCRIPT_PREFIX_HASH160;
+            if (cache != nullptr)
+               cache->getHash160(pubKey, scrAddr + 1);
+            else
+               getHash160(pubKey.getPtr(), pubKey.getSize(), scrAddr + 1);
+            return true;
+         }
          case(TXOUT_SCRIPT_P2SH) :
-            bw.put_uint8_t(SCRIPT_PREFIX_P2SH);
-            bw.put_BinaryData(script.getSliceCopy(2, 20));
-            return bw.getData();
+            if (script.getSize() < 22)
+               return false;
+            scrAddr[0] = SCRIPT_PREFIX_P2SH;
+            memcpy(scrAddr + 1, script.getPtr() + 2, 20);
+            return true;
          case(TXOUT_SCRIPT_NONSTANDARD) :
-            bw.put_uint8_t(SCRIPT_PREFIX_NONSTD);
-            bw.put_BinaryData(getHash160(script));
-            return bw.getData();
-         case(TXOUT_SCRIPT_MULTISIG) :
-            bw.put_uint8_t(SCRIPT_PREFIX_MULTISIG);
-            bw.put_BinaryData(getMultisigUniqueKey(script));
-            return bw.getData();
+            scrAddr[0] = SCRIPT_PREFIX_NONSTD;
+            getHash160(script.getPtr(), script.getSize(), scrAddr + 1);
+            return true;
          default:
-            LOGERR << "What kind of TxOutScript did we get?";
-            return BinaryData(0);
+            return false;
       }
    }
 
+public:
+
    /////////////////////////////////////////////////////////////////////////////
    // This is basically just for SWIG to access via python
    static BinaryData getScrAddrForScript(BinaryData const & script)
@@ -1059,7 +1149,28 @@ public:
    /////////////////////////////////////////////////////////////////////////////
    static bool isMultisigScript(BinaryDataRef script)
    {
-      return (getMultisigUniqueKey(script).getSize() > 0);
+      //same checks as getMultisigPubKeyList, without copying the keys
+      if (script.getSize() == 0 || script[-1] != 0xae)
+         return false;
+
+      uint8_t M = script[0];
+      uint8_t N = script[-2];
+      if(M<81 || M>96|| N<81 || N>96)
+         return false;
+
+      N -= 80;
+      BinaryRefReader brr(script);
+      brr.advance(1); // Skip over M-value
+      for(uint8_t i=0; i<N; i++)
+      {
+         uint8_t nextSz = brr.get_uint8_t();
+         if( nextSz != 0x41 && nextSz != 0x21 )
+            return false;
+
+         brr.get_BinaryDataRef(nextSz);
+      }
+
+      return true;
    }
 
    /////////////////////////////////////////////////////////////////////////////
@@ -1223,8 +1334,9 @@ public:
             return getHash160(script.getSliceRef(-33, 33));
          case(TXIN_SCRIPT_SPENDP2SH):   
          {
-            vector<BinaryDataRef> pushVect = splitPushOnlyScriptRefs(script);
-            return getHash160(pushVect[pushVect.size()-1]);
+            BinaryDataRef lastPush;
+            getLastPushDataRef(script, lastPush);
+            return getHash160(lastPush);
          }
          case(TXIN_SCRIPT_COINBASE):    
          case(TXIN_SCRIPT_SPENDPUBKEY):   
@@ -1309,14 +1421,70 @@ public:
       return out;
    }
 
+   /////////////////////////////////////////////////////////////////////////////
+   // Walks the script like splitPushOnlyScriptRefs without building the list.
+   // Returns the number of pushes, 0 if the script is not push only, and 
+   // points lastPush at the last one.
+   static uint32_t getLastPushDataRef(BinaryDataRef script,
+                                      BinaryDataRef& lastPush)
+   {
+      BinaryRefReader brr(script);
+      uint32_t pushCount = 0;
+      uint8_t nextOp;
+
+      while(brr.getSizeRemaining() > 0)
+      {
+         nextOp = brr.get_uint8_t();
+         if(nextOp == 0)
+         {
+            brr.rewind(1);
+            lastPush = brr.get_BinaryDataRef(1);
+         }
+         else if(nextOp < 76)
+            lastPush = brr.get_BinaryDataRef(nextOp);
+         else if(nextOp == 76)
+         {
+            uint8_t nb = brr.get_uint8_t();
+            lastPush = brr.get_BinaryDataRef(nb);
+         }
+         else if(nextOp == 77)
+         {
+            uint16_t nb = brr.get_uint16_t();
+            lastPush = brr.get_BinaryDataRef(nb);
+         }
+         else if(nextOp == 78)
+         {
+            uint16_t nb = brr.get_uint32_t();
+            lastPush = brr.get_BinaryDataRef(nb);
+         }
+         else if(nextOp > 78 && nextOp < 97 && nextOp !=80)
+         {
+            brr.rewind(1);
+            lastPush = brr.get_BinaryDataRef(1);
+         }
+         else
+         {
+            lastPush = BinaryDataRef();
+            return 0;
+         }
+
+         pushCount++;
+      }
+
+      if(pushCount == 0)
+         lastPush = BinaryDataRef();
+
+      return pushCount;
+   }
+
    /////////////////////////////////////////////////////////////////////////////
    static BinaryData getLastPushDataInScript(BinaryData const & script)
    {
-      vector<BinaryDataRef> refs = splitPushOnlyScriptRefs(script);
-      if(refs.size()==0)
+      BinaryDataRef lastPush;
+      if(getLastPushDataRef(script, lastPush) == 0)
          return BinaryData(0);
 
-      return refs[refs.size() - 1];
+      return lastPush;
    }
 
    /////////////////////////////////////////////////////////////////////////////
@@ -1643,40 +1811,128 @@ public:
       return *vbd;
    }
 
-   /*
-   static bool verifyProofOfWork(BinaryDataRef bh80)
+   static const vector<LedgerChangeSet>& cast_to_LedgerChangeSetVector(
+      void *in)
    {
-      BinaryData theHash = getHash256(bh80);
-      return verifyProofOfWork(bh80, theHash.getRef());
+      vector<LedgerChangeSet>* vcs = (vector<LedgerChangeSet>*)in;
+      return *vcs;
    }
 
-   static bool verifyProofOfWork(BinaryData bh80,
-                                 BinaryData const & theHash)
+   static const NewBlockNotification& cast_to_NewBlockNotification(void *in)
    {
-      return verifyProofOfWork(bh80.getRef(), theHash.getRef());
+      NewBlockNotification* nbn = (NewBlockNotification*)in;
+      return *nbn;
    }
 
-   static bool verifyProofOfWork(BinaryDataRef bh80, BinaryDataRef bhrHash)
+   /////////////////////////////////////////////////////////////////////////////
+   // Expands the compact nBits of a header into the 256 bit target, little
+   // endian like the hashes it is compared to. Returns false for the 
+   // encodings the reference client rejects: negative, zero or overflowing
+   static bool getTargetFromDiffBits(uint32_t diffBits, uint8_t* target)
    {
-      // This is only approximate.  I can put in an exact verifier once 
-      // I figure out big integers better in C++, or another way to do
-      // the calculation.  I just want to make sure this isn't a completely
-      // bogus proof of work.
-      double diff = convertDiffBitsToDouble( BinaryDataRef(bh80.getPtr()+72, 4) );
-      double diffFactor = diff * (double)UINT32_MAX;
-      double nZeroBits  = int( log(diffFactor) / log(2.0));
-      int    nZeroBytes = int( log(diffFactor) / log(2.0) / 8.0);
+      memset(target, 0, 32);
 
-      // TODO: check that I'm comparing the correct end of the hash
-      for(uint32_t i=0; i<nZeroBytes; i++)
-         if(bhrHash[31-i]!=0)
-            return false;
+      const uint32_t nSize = diffBits >> 24;
+      const uint32_t mantissa = diffBits & 0x007fffff;
+      if (mantissa == 0 || (diffBits & 0x00800000) != 0)
+         return false;
+
+      // target = mantissa * 256^(nSize-3)
+      for (uint32_t i = 0; i < 3; i++)
+      {
+         const uint8_t byteVal = (mantissa >> (8 * i)) & 0xff;
+         if (i + nSize < 3)
+            continue;
+         
+         const uint32_t pos = i + nSize - 3;
+         if (pos >= 32)
+         {
+            if (byteVal != 0)
+               return false;
+            continue;
+         }
+         target[pos] = byteVal;
+      }
+
+      for (uint32_t i = 0; i < 32; i++)
+         if (target[i] != 0)
+            return true;
+
+      //the mantissa was shifted out entirely
+      return false;
+   }
+
+   /////////////////////////////////////////////////////////////////////////////
+   // Exact comparison of a 32 byte little endian PoW hash against the target 
+   // encoded in diffBits. This does not check diffBits against the 
+   // retargeting rules, only that the hash meets the difficulty it claims
+   static bool checkProofOfWork(const uint8_t* powHash, uint32_t diffBits)
+   {
+      uint8_t target[32];
+      if (!getTargetFromDiffBits(diffBits, target))
+         return false;
+
+      for (int i = 31; i >= 0; i--)
+      {
+         if (powHash[i] != target[i])
+            return powHash[i] < target[i];
+      }
 
       return true;
    }
-   */
+
+   static bool checkProofOfWork(BinaryDataRef powHash, BinaryDataRef bh80)
+   {
+      if (powHash.getSize() != 32 || bh80.getSize() < HEADER_SIZE)
+         return false;
+
+      return checkProofOfWork(powHash.getPtr(), 
+         READ_UINT32_LE(bh80.getPtr() + 72));
+   }
 
 };
+
+////////////////////////////////////////////////////////////////////////////////
+inline Hash160Cache::Hash160Cache(uint32_t slotCount) :
+   mask_([slotCount](void)->uint32_t
+   {
+      uint32_t size = 1;
+      while (size * 2 <= slotCount)
+         size *= 2;
+      return size - 1;
+   }())
+{
+   slots_.resize(mask_ + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+inline void Hash160Cache::getHash160(BinaryDataRef pubKey, uint8_t* hash160)
+{
+   size_t size = pubKey.getSize();
+   if (size < 5 || size > sizeof(Slot::pubKey_))
+   {
+      BtcUtils::getHash160(pubKey.getPtr(), size, hash160);
+      return;
+   }
+
+   //skip the 0x02/0x03/0x04 prefix byte
+   uint32_t id;
+   memcpy(&id, pubKey.getPtr() + 1, sizeof(id));
+   Slot& slot = slots_[id & mask_];
+
+   if (slot.size_ == size && memcmp(slot.pubKey_, pubKey.getPtr(), size) == 0)
+   {
+      hits_++;
+      memcpy(hash160, slot.hash160_, 20);
+      return;
+   }
+
+   misses_++;
+   BtcUtils::getHash160(pubKey.getPtr(), size, slot.hash160_);
+   memcpy(slot.pubKey_, pubKey.getPtr(), size);
+   slot.size_ = (uint8_t)size;
+   memcpy(hash160, slot.hash160_, 20);
+}
    
 static inline void suppressUnusedFunctionWarning()
 {
@@ -304,6 +304,7 @@ void BtcWallet::pprintAlittle(std::ostream &os) const
 void BtcWallet::clearBlkData(void)
 {
    ledgerAllAddr_ = &LedgerEntry::EmptyLedgerMap_;
+   ledgerDelta_.reset_ = true;
 
    for (auto saIter = scrAddrMap_.begin();
       saIter != scrAddrMap_.end(); ++saIter)
@@ -517,6 +518,10 @@ vector<UnspentTxOut> BtcWallet::getSpendableTxOutListForValue(uint64_t val,
    grabbing all UTXOs in the wallet
    ***/
 
+   //runs without the GIL, keep the BDM thread from merging new addresses 
+   //in the meantime
+   unique_lock<mutex> mergeLock(mergeLock_);
+
    prepareTxOutHistory(val, ignoreZC);
    LMDBBlockDatabase *db = bdvPtr_->getDB();
 
@@ -722,8 +727,11 @@ void BtcWallet::scanWalletZeroConf(bool withReorg)
 bool BtcWallet::scanWallet(uint32_t startBlock, uint32_t endBlock, 
    bool reorg, const map<BinaryData, vector<BinaryData> >& invalidatedZCKeys)
 {
+   const uint64_t balanceBefore = balance_;
+
    if (startBlock < endBlock)
    {
+      auto ledgerTail = getLedgerTail(startBlock);
       purgeZeroConfTxIO(invalidatedZCKeys);
 
       //new top block
@@ -742,12 +750,16 @@ bool BtcWallet::scanWallet(uint32_t startBlock, uint32_t endBlock,
                           startBlock, UINT32_MAX, true);
    
       balance_ = getFullBalanceFromDB();
+      recordLedgerDelta(ledgerTail, startBlock, balanceBefore);
+      recordBlockEffects(txioMap, startBlock, endBlock);
    }
    else
    {
       //top block didnt change, only have to check for new ZC
       if (bdvPtr_->isZcEnabled())
       {
+         auto ledgerTail = getLedgerTail(endBlock + 1);
+
          scanWalletZeroConf();
          map<BinaryData, TxIOPair> txioMap;
          getTxioForRange(endBlock +1, UINT32_MAX, txioMap);
@@ -755,6 +767,7 @@ bool BtcWallet::scanWallet(uint32_t startBlock, uint32_t endBlock,
                              endBlock +1, UINT32_MAX);
 
          balance_ = getFullBalanceFromDB();
+         recordLedgerDelta(ledgerTail, endBlock + 1, balanceBefore);
 
          //return false because no new block was parsed
          return false;
@@ -911,7 +924,9 @@ void BtcWallet::merge()
                bdvPtr_->scanScrAddrVector(scrAddrMapToMerge, bottomBlock, topBlock);
          }
 
-         //merge scrAddrMap
+         //merge scrAddrMap, under mergeLock_ since getSpendableTxOutListForValue
+         //iterates it from the caller's thread
+         mergeLock.lock();
          if (mergeData_->mergeAction_ != MergeAction::DeleteAddresses)
          {
             for (auto& scrAddrPair : scrAddrMapToMerge)
@@ -925,7 +940,6 @@ void BtcWallet::merge()
                scrAddrMap_.erase(scrAddrPair);
          }
 
-         mergeLock.lock();
          currentMergeData = currentMergeData->nextMergeData_;
       }
 
@@ -1030,21 +1044,20 @@ void BtcWallet::mapPages()
    ***/
    TIMER_START("mapPages");
    ledgerAllAddr_ = &LedgerEntry::EmptyLedgerMap_;
+   ledgerDelta_.reset_ = true;
 
    auto computeSSHsummary = [this](bool)->map<uint32_t, uint32_t>
       {return this->computeScrAddrMapHistSummary(); };
 
+   mappedTop_ = bdvPtr_->getTopBlockHeight();
    histPages_.mapHistory(computeSSHsummary);
+   syncLedgerCache();
 
-   auto getTxio = [this](uint32_t start, uint32_t end, map<BinaryData, TxIOPair>& txioMap)->void
-   { this->getTxioForRange(start, end, txioMap); };
-
-   auto computeLedgers = [this](map<BinaryData, LedgerEntry>& leMap, 
-                               const map<BinaryData, TxIOPair>& txioMap,
-                               uint32_t start)->void
-   { this->updateWalletLedgersFromTxio(leMap, txioMap, start, UINT32_MAX, false); };
+   auto getLedgers = [this](uint32_t start, uint32_t end,
+      map<BinaryData, LedgerEntry>& leMap)->void
+   { this->getLedgersForRange(start, end, leMap); };
 
-   ledgerAllAddr_ = &histPages_.getPageLedgerMap(getTxio, computeLedgers, 0);
+   ledgerAllAddr_ = &histPages_.getPageLedgerMap(getLedgers, 0);
 
    TIMER_STOP("mapPages");
    //double mapPagesTimer = TIMER_READ_SEC("mapPages");
@@ -1070,6 +1083,201 @@ void BtcWallet::updateWalletLedgersFromTxio(
                                  bdvPtr_->getDB(), &bdvPtr_->blockchain(), purge);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void BtcWallet::getLedgersForRange(uint32_t start, uint32_t end,
+   map<BinaryData, LedgerEntry>& leMap) const
+{
+   uint32_t buildFrom = loadCachedLedgers(start, end, leMap);
+   if (buildFrom > end)
+      return;
+
+   map<BinaryData, TxIOPair> txioMap;
+   getTxioForRange(buildFrom, end, txioMap);
+   updateWalletLedgersFromTxio(leMap, txioMap, buildFrom, end, false);
+
+   cacheLedgers(buildFrom, end, leMap);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BtcWallet::syncLedgerCache(void)
+{
+   ledgerCacheFingerprint_.clear();
+   if (bdvPtr_->config().ledgerCacheDepth == 0)
+      return;
+
+   set<BinaryData> scrAddrSet;
+   for (auto& scrAddrPair : scrAddrMap_)
+      scrAddrSet.insert(scrAddrPair.first);
+
+   BinaryData fingerprint = 
+      StoredScanCheckpoint::getScrAddrFingerprint(scrAddrSet);
+   if (fingerprint.getSize() == 0)
+      return;
+
+   //entries written for another set of scrAddrs are keyed apart and never
+   //read again, this only reclaims their space
+   auto db = bdvPtr_->getDB();
+   if (!db->isReadOnly() && 
+       db->getLedgerCacheFingerprint(walletID_) != fingerprint)
+   {
+      try
+      {
+         db->resetLedgerCache(walletID_, fingerprint);
+      }
+      catch (LMDBException &)
+      {
+         //a read tx is open on this thread, try again on the next remap
+      }
+   }
+
+   ledgerCacheFingerprint_ = fingerprint;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool BtcWallet::getLedgerCacheTop(uint32_t& cacheTop) const
+{
+   //blocks ledgerCacheDepth deep, that the SSH summary accounts for
+   const uint32_t depth = bdvPtr_->config().ledgerCacheDepth;
+   if (depth == 0 || ledgerCacheFingerprint_.getSize() == 0)
+      return false;
+
+   uint32_t topHeight = bdvPtr_->getTopBlockHeight();
+   if (topHeight < depth)
+      return false;
+
+   cacheTop = min(topHeight - depth, mappedTop_);
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t BtcWallet::loadCachedLedgers(uint32_t start, uint32_t end,
+   map<BinaryData, LedgerEntry>& leMap) const
+{
+   //returns the height ledgers have to be built from, past end if the 
+   //cache had all of the range
+   uint32_t cacheTop;
+   if (!getLedgerCacheTop(cacheTop))
+      return start;
+
+   auto db = bdvPtr_->getDB();
+   const auto& bc = bdvPtr_->blockchain();
+   const auto& summary = histPages_.getSSHsummary();
+
+   LMDBEnv::Transaction tx;
+   db->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+
+   uint32_t buildFrom = start;
+   auto sumIter = summary.lower_bound(start);
+   while (sumIter != summary.end() && sumIter->first <= end)
+   {
+      const uint32_t height = sumIter->first;
+      if (height > cacheTop)
+         return height;
+
+      StoredLedgerCache slc;
+      if (!db->getStoredLedgerCache(
+            slc, walletID_, ledgerCacheFingerprint_, height))
+         return height;
+
+      //written before a reorg
+      if (slc.blockHash_ != bc.getHeaderByHeight(height).getThisHash())
+         return height;
+
+      map<BinaryData, LedgerEntry> heightLedgers;
+      try
+      {
+         BinaryRefReader brr(slc.ledgerData_);
+         uint64_t count = brr.get_var_int();
+         for (uint64_t i = 0; i < count; i++)
+         {
+            BinaryData key = brr.get_BinaryData(6);
+            auto& le = heightLedgers[key];
+            le.unserialize(brr);
+            le.setWalletID(walletID_);
+         }
+      }
+      catch (runtime_error &)
+      {
+         LOGWARN << "Corrupt ledger cache entry at height " << height;
+         return height;
+      }
+
+      leMap.insert(heightLedgers.begin(), heightLedgers.end());
+      buildFrom = height + 1;
+      ++sumIter;
+   }
+
+   //no history in the rest of the range, as of the last mapPages
+   if (end <= cacheTop)
+      return end + 1;
+
+   return max(buildFrom, cacheTop + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BtcWallet::cacheLedgers(uint32_t start, uint32_t end,
+   const map<BinaryData, LedgerEntry>& leMap) const
+{
+   uint32_t cacheTop;
+   if (!getLedgerCacheTop(cacheTop) || start > cacheTop)
+      return;
+
+   auto db = bdvPtr_->getDB();
+   if (db->isReadOnly())
+      return;
+
+   const auto& bc = bdvPtr_->blockchain();
+   const auto& summary = histPages_.getSSHsummary();
+   end = min(end, cacheTop);
+
+   //one entry per height with history, even if it yields no ledger, so that
+   //loading a range never has to tell a miss from an empty height
+   vector<StoredLedgerCache> toWrite;
+   for (auto sumIter = summary.lower_bound(start); 
+        sumIter != summary.end() && sumIter->first <= end; ++sumIter)
+   {
+      const uint32_t height = sumIter->first;
+
+      StoredLedgerCache slc;
+      slc.walletID_ = walletID_;
+      slc.scrAddrFingerprint_ = ledgerCacheFingerprint_;
+      slc.height_ = height;
+      slc.blockHash_ = bc.getHeaderByHeight(height).getThisHash();
+
+      auto first = leMap.lower_bound(LedgerEntry::getLedgerKeyForHeight(height));
+      auto last = leMap.lower_bound(
+         LedgerEntry::getLedgerKeyForHeight(height + 1));
+
+      BinaryWriter bw;
+      bw.put_var_int(distance(first, last));
+      for (auto leIter = first; leIter != last; ++leIter)
+      {
+         bw.put_BinaryData(leIter->first);
+         leIter->second.serialize(bw);
+      }
+
+      slc.ledgerData_ = bw.getData();
+      toWrite.push_back(move(slc));
+   }
+
+   if (toWrite.size() == 0)
+      return;
+
+   try
+   {
+      LMDBEnv::Transaction tx;
+      db->beginDBTransaction(&tx, HISTORY, LMDB::ReadWrite);
+
+      for (auto& slc : toWrite)
+         db->putStoredLedgerCache(slc);
+   }
+   catch (LMDBException &)
+   {
+      //a read tx is open on this thread, the next load of the range will 
+      //write these
+   }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 const ScrAddrObj* BtcWallet::getScrAddrObjByKey(const BinaryData& key) const
 {
@@ -1111,20 +1319,27 @@ const map<BinaryData, LedgerEntry>& BtcWallet::getHistoryPage(uint32_t pageId)
    if (pageId >= getHistoryPageCount())
       throw std::range_error("pageID is out of range");
 
-   auto getTxio = [this](uint32_t start, uint32_t end, map<BinaryData, TxIOPair>& txioMap)->void
-   { this->getTxioForRange(start, end, txioMap); };
-
-   auto computeLedgers = [this](map<BinaryData, LedgerEntry>& leMap,
-      const map<BinaryData, TxIOPair>& txioMap,
-      uint32_t start)->void
-   { this->updateWalletLedgersFromTxio(leMap, txioMap, start, UINT32_MAX, false); };
+   auto getLedgers = [this](uint32_t start, uint32_t end,
+      map<BinaryData, LedgerEntry>& leMap)->void
+   { this->getLedgersForRange(start, end, leMap); };
 
-   return histPages_.getPageLedgerMap(getTxio, computeLedgers, pageId);
+   return histPages_.getPageLedgerMap(getLedgers, pageId);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 vector<LedgerEntry> BtcWallet::getHistoryPageAsVector(uint32_t pageId)
 {
+   //pages past the first are static, they are kept by column
+   if (pageId > 0 && pageId < getHistoryPageCount() && 
+       bdvPtr_->isBDMRunning())
+   {
+      auto getLedgers = [this](uint32_t start, uint32_t end,
+         map<BinaryData, LedgerEntry>& leMap)->void
+      { this->getLedgersForRange(start, end, leMap); };
+
+      return histPages_.getPageLedgerTable(getLedgers, pageId).toVector();
+   }
+
    try
    {
       auto& ledgerMap = getHistoryPage(pageId);
@@ -1142,6 +1357,157 @@ vector<LedgerEntry> BtcWallet::getHistoryPageAsVector(uint32_t pageId)
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+map<BinaryData, LedgerEntry> BtcWallet::getLedgerTail(
+   uint32_t fromHeight) const
+{
+   //scans only rebuild the ledgers from their start height up, that's all 
+   //there is to diff
+   map<BinaryData, LedgerEntry> tail;
+   if (ledgerDelta_.reset_)
+      return tail;
+
+   auto leIter = ledgerAllAddr_->lower_bound(
+      LedgerEntry::getLedgerKeyForHeight(fromHeight));
+   tail.insert(leIter, ledgerAllAddr_->end());
+
+   return tail;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BtcWallet::recordLedgerDelta(
+   const map<BinaryData, LedgerEntry>& tailBefore,
+   uint32_t fromHeight, uint64_t balanceBefore)
+{
+   ledgerDelta_.balanceDelta_ += int64_t(balance_ - balanceBefore);
+   ledgerDelta_.balance_ = balance_;
+
+   //remapped history is fetched anew by consumers, no point diffing it
+   if (ledgerDelta_.reset_)
+      return;
+
+   auto sameEntry = [](const LedgerEntry& a, const LedgerEntry& b)->bool
+   {
+      return a.getValue() == b.getValue() &&
+         a.getBlockNum() == b.getBlockNum() &&
+         a.getIndex() == b.getIndex() &&
+         a.getTxTime() == b.getTxTime() &&
+         a.isCoinbase() == b.isCoinbase() &&
+         a.isSentToSelf() == b.isSentToSelf() &&
+         a.isChangeBack() == b.isChangeBack() &&
+         a.getTxHash() == b.getTxHash();
+   };
+
+   auto afterIter = ledgerAllAddr_->lower_bound(
+      LedgerEntry::getLedgerKeyForHeight(fromHeight));
+   auto beforeIter = tailBefore.begin();
+
+   //both ranges are sorted by ledger key, walk them side by side
+   while (afterIter != ledgerAllAddr_->end() || 
+          beforeIter != tailBefore.end())
+   {
+      if (beforeIter == tailBefore.end() ||
+          (afterIter != ledgerAllAddr_->end() && 
+           afterIter->first < beforeIter->first))
+      {
+         ledgerDelta_.added_.push_back(afterIter->second);
+         ++afterIter;
+      }
+      else if (afterIter == ledgerAllAddr_->end() ||
+               beforeIter->first < afterIter->first)
+      {
+         ledgerDelta_.removed_.push_back(beforeIter->second);
+         ++beforeIter;
+      }
+      else
+      {
+         if (!sameEntry(beforeIter->second, afterIter->second))
+            ledgerDelta_.changed_.push_back(afterIter->second);
+
+         ++afterIter;
+         ++beforeIter;
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+WalletLedgerDelta BtcWallet::popLedgerDelta(void)
+{
+   WalletLedgerDelta delta = move(ledgerDelta_);
+   
+   ledgerDelta_ = WalletLedgerDelta();
+   delta.walletID_ = walletID_;
+   delta.balance_ = balance_;
+
+   return delta;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void BtcWallet::recordBlockEffects(const map<BinaryData, TxIOPair>& txioMap,
+   uint32_t startBlock, uint32_t endBlock)
+{
+   //a reorg replaces what was recorded for the blocks it undid
+   blockEffects_.erase(
+      blockEffects_.lower_bound(startBlock), blockEffects_.end());
+
+   //only the blocks the BDV keeps effects for, the initial scan would 
+   //otherwise go over the whole history
+   if (endBlock - startBlock > BlockDataViewer::BLOCK_EFFECTS_DEPTH)
+      startBlock = endBlock - BlockDataViewer::BLOCK_EFFECTS_DEPTH;
+
+   //the txios are already in RAM from the scan, no db access past this point
+   map<uint32_t, set<BinaryData> > scrAddrsByHeight;
+   auto addTxio = [&](const BinaryData& dbKey, const TxIOPair& txio,
+      int64_t value)->void
+   {
+      if (dbKey.getSize() < 4)
+         return;
+
+      uint32_t height = DBUtils::hgtxToHeight(dbKey.getSliceCopy(0, 4));
+      if (height < startBlock || height >= endBlock)
+         return;
+
+      blockEffects_[height].valueDelta_ += value;
+      scrAddrsByHeight[height].insert(txio.getScrAddr());
+   };
+
+   for (const auto& txio : txioMap)
+   {
+      const int64_t value = int64_t(txio.second.getValue());
+      addTxio(txio.second.getDBKeyOfOutput(), txio.second, value);
+      if (txio.second.hasTxIn())
+         addTxio(txio.second.getDBKeyOfInput(), txio.second, -value);
+   }
+
+   for (auto& scrAddrs : scrAddrsByHeight)
+   {
+      auto& effects = blockEffects_[scrAddrs.first];
+      effects.scrAddrs_.assign(scrAddrs.second.begin(), scrAddrs.second.end());
+
+      auto leIter = ledgerAllAddr_->lower_bound(
+         LedgerEntry::getLedgerKeyForHeight(scrAddrs.first));
+      auto leEnd = ledgerAllAddr_->lower_bound(
+         LedgerEntry::getLedgerKeyForHeight(scrAddrs.first + 1));
+      for (; leIter != leEnd; ++leIter)
+      {
+         effects.txHashes_.push_back(leIter->second.getTxHash());
+         effects.txIndexes_.push_back(leIter->second.getIndex());
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+map<uint32_t, WalletBlockEffects> BtcWallet::popBlockEffects(void)
+{
+   map<uint32_t, WalletBlockEffects> effects = move(blockEffects_);
+   blockEffects_.clear();
+
+   for (auto& blockEffects : values(effects))
+      blockEffects.walletID_ = walletID_;
+
+   return effects;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void BtcWallet::needsRefresh(void)
 { 
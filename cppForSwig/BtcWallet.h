@@ -202,6 +202,13 @@ public:
    vector<LedgerEntry> getHistoryPageAsVector(uint32_t);
    size_t getHistoryPageCount(void) const { return histPages_.getPageCount(); }
 
+   //ledger and balance changes since the previous call
+   WalletLedgerDelta popLedgerDelta(void);
+
+   //per block effects recorded by the new block scans since the previous
+   //call, by height
+   map<uint32_t, WalletBlockEffects> popBlockEffects(void);
+
    void needsRefresh(void);
    void forceScan(void);
    bool hasBdvPtr(void) const { return bdvPtr_ != nullptr; }
@@ -244,11 +251,29 @@ private:
    void getTxioForRange(uint32_t, uint32_t, 
       map<BinaryData, TxIOPair>&) const;
 
+   //ledgers of a block range: what the ledger cache holds of it is read 
+   //from there, the rest is built from SSH and written back
+   void getLedgersForRange(uint32_t start, uint32_t end,
+      map<BinaryData, LedgerEntry>& leMap) const;
+
+   void syncLedgerCache(void);
+   bool getLedgerCacheTop(uint32_t& cacheTop) const;
+   uint32_t loadCachedLedgers(uint32_t start, uint32_t end,
+      map<BinaryData, LedgerEntry>& leMap) const;
+   void cacheLedgers(uint32_t start, uint32_t end,
+      const map<BinaryData, LedgerEntry>& leMap) const;
+
    void sortLedger();
    void unregister(void) { isRegistered_ = false; }
 
    void resetTxOutHistory(void);
 
+   map<BinaryData, LedgerEntry> getLedgerTail(uint32_t fromHeight) const;
+   void recordLedgerDelta(const map<BinaryData, LedgerEntry>& tailBefore,
+      uint32_t fromHeight, uint64_t balanceBefore);
+   void recordBlockEffects(const map<BinaryData, TxIOPair>& txioMap,
+      uint32_t startBlock, uint32_t endBlock);
+
 private:
 
    struct mergeStruct
@@ -279,6 +304,12 @@ private:
    //manages history pages
    HistoryPager                  histPages_;
 
+   //top block as of the last mapPages, the SSH summary is complete up to it
+   uint32_t                      mappedTop_ = 0;
+
+   //of scrAddrMap_ as of the last mapPages, empty with the ledger cache off
+   BinaryData                    ledgerCacheFingerprint_;
+
    //wallet id
    BinaryData                    walletID_;
 
@@ -286,6 +317,10 @@ private:
 
    //set to true to add wallet paged history to global ledgers 
    bool                          uiFilter_ = true;
+
+   //change feed, popped by the BDV after every scan
+   WalletLedgerDelta             ledgerDelta_;
+   map<uint32_t, WalletBlockEffects> blockEffects_;
 };
 
 #endif
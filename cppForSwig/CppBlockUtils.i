@@ -9,10 +9,48 @@
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
 */
-%module(directors="1") CppBlockUtils
+%module(directors="1", threads="1") CppBlockUtils
 %feature("director") BDM_CallBack;
 %feature("director") BDM_Inject;
 
+/*
+GIL policy: every wrapped call releases the GIL (threads="1", same as the 
+-threads command line switch) and directors take it back to call into Python.
+It is not narrowed down to a list of heavy calls on purpose: the BDM thread 
+calls BDM_CallBack::run with BDM locks held, so a Python thread blocking on 
+any of these locks with the GIL in hand would deadlock the two.
+
+The calls below are the long running ones, where releasing the GIL is the 
+point. They are spelled out so that the objects they touch stay audited for 
+concurrent use (other Python threads and the BDM thread run meanwhile):
+ - KdfRomix::DeriveKey: the lookup table is per call, the object is 
+   read only once its parameters are set.
+ - CryptoECDSA::ComputeChainedPublicKey/PrivateKey: stateless.
+ - history pages: WalletGroup::globalLedgerLock_ and the group lock_.
+ - BtcWallet::getSpendableTxOutListForValue: BtcWallet::mergeLock_ keeps
+   the BDM thread from merging addresses in the meantime.
+ - BlockDataViewer::getUnspentTxoutsForAddr160List, getTxByHash: DB reads
+   run in their own read transaction, ZC lookups take 
+   ZeroConfContainer::txMapMutex_.
+ - BDM_Inject::wait/waitRun, BlockDataManagerThread::shutdownAndWait: block
+   on the BDM thread, which may need the GIL to get there.
+
+pytest/testGILRelease.py measures how long a Python thread stalls while 
+these run.
+*/
+%thread KdfRomix::DeriveKey;
+%thread KdfRomix::DeriveKey_OneIter;
+%thread CryptoECDSA::ComputeChainedPublicKey;
+%thread CryptoECDSA::ComputeChainedPrivateKey;
+%thread LedgerDelegate::getHistoryPage;
+%thread BtcWallet::getHistoryPageAsVector;
+%thread BtcWallet::getSpendableTxOutListForValue;
+%thread BlockDataViewer::getUnspentTxoutsForAddr160List;
+%thread BlockDataViewer::getTxByHash;
+%thread BDM_Inject::wait;
+%thread BDM_Inject::waitRun;
+%thread BlockDataManagerThread::shutdownAndWait;
+
 %{
 #define SWIG_PYTHON_EXTRA_NATIVE_CONTAINERS
 #include "BlockObj.h"
@@ -65,6 +103,10 @@ namespace std
    %template(vector_string) std::vector<string>;
    //%template(vector_BinaryData) std::vector<BinaryData>;
    %template(vector_LedgerEntry) std::vector<LedgerEntry>;
+   %template(vector_WalletLedgerDelta) std::vector<WalletLedgerDelta>;
+   %template(vector_LedgerChangeSet) std::vector<LedgerChangeSet>;
+   %template(vector_WalletBlockEffects) std::vector<WalletBlockEffects>;
+   %template(vector_BlockEffects) std::vector<BlockEffects>;
    //%template(vector_LedgerEntryPtr) std::vector<const LedgerEntry*>;
    %template(vector_TxRefPtr) std::vector<TxRef*>;
    %template(vector_Tx) std::vector<Tx>;
@@ -26,6 +26,7 @@ SecureBinaryData & SecureBinaryData::append(SecureBinaryData & sbd2)
    if(sbd2.getSize()==0) 
       return (*this);
 
+   SecureAllocScope scope;
    if(getSize()==0) 
       BinaryData::copyFrom(sbd2.getPtr(), sbd2.getSize());
    else
@@ -48,6 +49,7 @@ SecureBinaryData SecureBinaryData::operator+(SecureBinaryData & sbd2) const
 /////////////////////////////////////////////////////////////////////////////
 SecureBinaryData & SecureBinaryData::operator=(SecureBinaryData const & sbd2)
 { 
+   SecureAllocScope scope;
    copyFrom(sbd2.getPtr(), sbd2.getSize() );
    lockData(); 
    return (*this);
@@ -139,7 +141,6 @@ void KdfRomix::computeKdfParams(double targetComputeSec, uint32_t maxMemReqts)
       memoryReqtBytes_ *= 2;
 
       sequenceCount_ = memoryReqtBytes_ / hashOutputBytes_;
-      lookupTable_.resize(memoryReqtBytes_);
 
       TIMER_RESTART("KDF_Mem_Search");
       testKey = DeriveKey_OneIter(testKey);
@@ -149,7 +150,6 @@ void KdfRomix::computeKdfParams(double targetComputeSec, uint32_t maxMemReqts)
 
    // Recompute here, in case we didn't enter the search above 
    sequenceCount_ = memoryReqtBytes_ / hashOutputBytes_;
-   lookupTable_.resize(memoryReqtBytes_);
 
 
    // Depending on the search above (or if a low max memory was chosen, 
@@ -216,11 +216,13 @@ SecureBinaryData KdfRomix::DeriveKey_OneIter(SecureBinaryData const & password)
    // Concatenate the salt/IV to the password
    SecureBinaryData saltedPassword = password + salt_; 
    
-   // Prepare the lookup table
-   lookupTable_.resize(memoryReqtBytes_);
-   lookupTable_.fill(0);
+   // Prepare the lookup table. It is local so that the same KdfRomix can
+   // derive keys from several threads at once (the GIL is released around
+   // DeriveKey)
+   SecureBinaryData lookupTable(memoryReqtBytes_);
+   lookupTable.fill(0);
    uint32_t const HSZ = hashOutputBytes_;
-   uint8_t* frontOfLUT = lookupTable_.getPtr();
+   uint8_t* frontOfLUT = lookupTable.getPtr();
    uint8_t* nextRead  = NULL;
    uint8_t* nextWrite = NULL;
 
@@ -275,7 +277,7 @@ SecureBinaryData KdfRomix::DeriveKey_OneIter(SecureBinaryData const & password)
       sha512.CalculateDigest(X.getPtr(), Y.getPtr(), HSZ);
    }
    // Truncate the final result to get the final key
-   lookupTable_.destroy();
+   lookupTable.destroy();
    return X.getSliceCopy(0,kdfOutputBytes_);
 }
 
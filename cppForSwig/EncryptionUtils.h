@@ -136,21 +136,23 @@ using namespace std;
 class SecureBinaryData : public BinaryData
 {
 public:
-   // We want regular BinaryData, but page-locked and secure destruction
+   // We want regular BinaryData, but page-locked and secure destruction.
+   // Buffers come from the SecureMemoryPool arenas, which are locked
+   // already. Only those too large for it lock their own pages
    SecureBinaryData(void) : BinaryData() 
                    { lockData(); }
-   SecureBinaryData(size_t sz) : BinaryData(sz) 
-                   { lockData(); }
-   SecureBinaryData(BinaryData const & data) : BinaryData(data) 
-                   { lockData(); }
-   SecureBinaryData(uint8_t const * inData, size_t sz) : BinaryData(inData, sz)
-                   { lockData(); }
-   SecureBinaryData(uint8_t const * d0, uint8_t const * d1) : BinaryData(d0, d1)
-                   { lockData(); }
-   SecureBinaryData(string const & str) : BinaryData(str)
-                   { lockData(); }
-   SecureBinaryData(BinaryDataRef const & bdRef) : BinaryData(bdRef)
-                   { lockData(); }
+   SecureBinaryData(size_t sz) : BinaryData() 
+                   { resize(sz); }
+   SecureBinaryData(BinaryData const & data) : BinaryData() 
+                   { secureCopy(data.getPtr(), data.getSize()); }
+   SecureBinaryData(uint8_t const * inData, size_t sz) : BinaryData()
+                   { secureCopy(inData, sz); }
+   SecureBinaryData(uint8_t const * d0, uint8_t const * d1) : BinaryData()
+                   { secureCopy(d0, d1 - d0); }
+   SecureBinaryData(string const & str) : BinaryData()
+                   { secureCopy((uint8_t const *)str.c_str(), str.size()); }
+   SecureBinaryData(BinaryDataRef const & bdRef) : BinaryData()
+                   { secureCopy(bdRef.getPtr(), bdRef.getSize()); }
 
    ~SecureBinaryData(void) { destroy(); }
 
@@ -164,12 +166,22 @@ public:
    string toHexStr(bool BE=false) const { return BinaryData::toHexStr(BE);}
    string toBinStr(void) const          { return BinaryData::toBinStr();  }
 
-   SecureBinaryData(SecureBinaryData const & sbd2) : 
-           BinaryData(sbd2.getPtr(), sbd2.getSize()) { lockData(); }
+   SecureBinaryData(SecureBinaryData const & sbd2) : BinaryData()
+                   { secureCopy(sbd2.getPtr(), sbd2.getSize()); }
 
 
-   void resize(size_t sz)  { BinaryData::resize(sz);  lockData(); }
-   void reserve(size_t sz) { BinaryData::reserve(sz); lockData(); }
+   void resize(size_t sz)
+   {
+      SecureAllocScope scope;
+      BinaryData::resize(sz);
+      lockData();
+   }
+   void reserve(size_t sz)
+   {
+      SecureAllocScope scope;
+      BinaryData::reserve(sz);
+      lockData();
+   }
 
 
    BinaryData    getRawCopy(void) const { return BinaryData(getPtr(), getSize()); }
@@ -192,9 +204,11 @@ public:
    SecureBinaryData GenerateRandom(uint32_t numBytes, 
                               SecureBinaryData extraEntropy=SecureBinaryData());
 
+   bool isPooled(void) const { return SecureMemoryPool::owns(getPtr()); }
+
    void lockData(void)
    {
-      if(getSize() > 0)
+      if(getSize() > 0 && !isPooled())
          mlock(getPtr(), getSize());
    }
 
@@ -203,11 +217,19 @@ public:
       if(getSize() > 0)
       {
          fill(0x00);
-         munlock(getPtr(), getSize());
+         if(!isPooled())
+            munlock(getPtr(), getSize());
       }
       resize(0);
    }
 
+private:
+   void secureCopy(uint8_t const * inData, size_t sz)
+   {
+      SecureAllocScope scope;
+      BinaryData::copyFrom(inData, sz);
+      lockData();
+   }
 };
 
 
@@ -264,7 +286,6 @@ private:
 
    uint32_t memoryReqtBytes_;
    uint32_t sequenceCount_;
-   SecureBinaryData lookupTable_;
    SecureBinaryData salt_;            // prob not necessary amidst numIter, memReqts
                                 // but I guess it can't hurt
 
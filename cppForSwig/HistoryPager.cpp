@@ -76,6 +76,74 @@ void HistoryPager::getPageLedgerMap(
    buildLedgers(leMap, txio, page.blockStart_, page.blockEnd_);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+map<BinaryData, LedgerEntry>& HistoryPager::getPageLedgerMap(
+   function< void(uint32_t, uint32_t, map<BinaryData, LedgerEntry>&) > 
+      getLedgers,
+   uint32_t pageId)
+{
+   if (!isInitialized_)
+      throw std::runtime_error("Uninitialized history");
+
+   if (pageId >= pages_.size())
+      return LedgerEntry::EmptyLedgerMap_;
+
+   currentPage_ = pageId;
+   Page& page = pages_[pageId];
+
+   if (page.pageLedgers_.size() != 0)
+   {
+      //already loaded this page
+      return page.pageLedgers_;
+   }
+
+   getLedgers(page.blockStart_, page.blockEnd_, page.pageLedgers_);
+   return page.pageLedgers_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void HistoryPager::getPageLedgerMap(
+   function< void(uint32_t, uint32_t, map<BinaryData, LedgerEntry>&) > 
+      getLedgers,
+   uint32_t pageId,
+   map<BinaryData, LedgerEntry>& leMap) const
+{
+   if (!isInitialized_)
+      throw std::runtime_error("Uninitialized history");
+
+   const Page& page = pages_[pageId];
+   getLedgers(page.blockStart_, page.blockEnd_, leMap);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const LedgerTable& HistoryPager::getPageLedgerTable(
+   function< void(uint32_t, uint32_t, map<BinaryData, LedgerEntry>&) > 
+      getLedgers,
+   uint32_t pageId)
+{
+   if (!isInitialized_)
+      throw std::runtime_error("Uninitialized history");
+
+   currentPage_ = pageId;
+   Page& page = pages_[pageId];
+
+   if (page.pageTable_.empty())
+   {
+      if (page.pageLedgers_.size() != 0)
+      {
+         page.pageTable_.append(page.pageLedgers_);
+      }
+      else
+      {
+         map<BinaryData, LedgerEntry> leMap;
+         getLedgers(page.blockStart_, page.blockEnd_, leMap);
+         page.pageTable_.append(leMap);
+      }
+   }
+
+   return page.pageTable_;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 map<BinaryData, LedgerEntry>& HistoryPager::getPageLedgerMap(uint32_t pageId)
 {
@@ -27,6 +27,9 @@ private:
 
       map<BinaryData, LedgerEntry> pageLedgers_;
 
+      //same ledgers by column, for pages that won't change once built
+      LedgerTable pageTable_;
+
       Page(void) : blockStart_(UINT32_MAX), blockEnd_(UINT32_MAX), count_(0)
       {}
 
@@ -67,8 +70,28 @@ public:
       uint32_t pageId,
       map<BinaryData, LedgerEntry>& leMap) const;
 
+   //getLedgers builds the ledgers of a block range by whatever means, 
+   //BtcWallet goes through its ledger cache
+   map<BinaryData, LedgerEntry>& getPageLedgerMap(
+      function< void(uint32_t, uint32_t, map<BinaryData, LedgerEntry>&) > 
+         getLedgers,
+      uint32_t pageId);
+
+   void getPageLedgerMap(
+      function< void(uint32_t, uint32_t, map<BinaryData, LedgerEntry>&) > 
+         getLedgers,
+      uint32_t pageId,
+      map<BinaryData, LedgerEntry>& leMap) const;
+
    map<BinaryData, LedgerEntry>& getPageLedgerMap(uint32_t pageId);
 
+   //Built on first call then kept. Only for pages that don't change after
+   //they are built, i.e. not the first one of a wallet
+   const LedgerTable& getPageLedgerTable(
+      function< void(uint32_t, uint32_t, map<BinaryData, LedgerEntry>&) > 
+         getLedgers,
+      uint32_t pageId);
+
    void reset(void) { 
       pages_.clear(); 
       isInitialized_ = false;
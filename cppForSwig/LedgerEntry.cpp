@@ -127,18 +127,23 @@ void LedgerEntry::purgeLedgerMapFromHeight(
 {
    //Remove all entries starting this height, included.
    
+   auto cutOffIterPair = leMap.equal_range(getLedgerKeyForHeight(purgeFrom));
+   leMap.erase(cutOffIterPair.first, leMap.end());
+}
 
+//////////////////////////////////////////////////////////////////////////////
+BinaryData LedgerEntry::getLedgerKeyForHeight(uint32_t height)
+{
    BinaryData cutOffHeight(6);
    auto heightPtr = cutOffHeight.getPtr();
 
-   uint8_t* purgeFromPtr = reinterpret_cast<uint8_t*>(&purgeFrom);
+   uint8_t* heightValPtr = reinterpret_cast<uint8_t*>(&height);
    memset(heightPtr, 0, 6);
-   heightPtr[0] = purgeFromPtr[2];
-   heightPtr[1] = purgeFromPtr[1];
-   heightPtr[2] = purgeFromPtr[0];
+   heightPtr[0] = heightValPtr[2];
+   heightPtr[1] = heightValPtr[1];
+   heightPtr[2] = heightValPtr[0];
 
-   auto cutOffIterPair = leMap.equal_range(cutOffHeight);
-   leMap.erase(cutOffIterPair.first, leMap.end());
+   return cutOffHeight;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -163,6 +168,50 @@ void LedgerEntry::purgeLedgerVectorFromHeight(
 
 }
 
+//////////////////////////////////////////////////////////////////////////////
+void LedgerEntry::serialize(BinaryWriter& bw) const
+{
+   bw.put_uint64_t((uint64_t)value_);
+   bw.put_uint32_t(blockNum_);
+   bw.put_BinaryData(txHash_);
+   bw.put_uint32_t(index_);
+   bw.put_uint32_t(txTime_);
+
+   uint8_t flags = (isCoinbase_ ? 1 : 0) | (isSentToSelf_ ? 2 : 0) |
+      (isChangeBack_ ? 4 : 0);
+   bw.put_uint8_t(flags);
+
+   bw.put_var_int(scrAddrSet_.size());
+   for (auto& scrAddr : scrAddrSet_)
+   {
+      bw.put_var_int(scrAddr.getSize());
+      bw.put_BinaryData(scrAddr);
+   }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+void LedgerEntry::unserialize(BinaryRefReader& brr)
+{
+   value_ = (int64_t)brr.get_uint64_t();
+   blockNum_ = brr.get_uint32_t();
+   brr.get_BinaryData(txHash_, 32);
+   index_ = brr.get_uint32_t();
+   txTime_ = brr.get_uint32_t();
+
+   uint8_t flags = brr.get_uint8_t();
+   isCoinbase_ = (flags & 1) != 0;
+   isSentToSelf_ = (flags & 2) != 0;
+   isChangeBack_ = (flags & 4) != 0;
+
+   scrAddrSet_.clear();
+   uint64_t count = brr.get_var_int();
+   for (uint64_t i = 0; i < count; i++)
+   {
+      uint32_t size = (uint32_t)brr.get_var_int();
+      scrAddrSet_.insert(brr.get_BinaryData(size));
+   }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 void LedgerEntry::computeLedgerMap(map<BinaryData, LedgerEntry> &leMap,
    const map<BinaryData, TxIOPair>& txioMap,
@@ -294,4 +343,308 @@ void LedgerEntry::computeLedgerMap(map<BinaryData, LedgerEntry> &leMap,
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+//
+// LedgerTable
+//
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+//same bits as LedgerEntry::serialize
+#define LEDGER_FLAG_COINBASE  1
+#define LEDGER_FLAG_SENTTOSELF 2
+#define LEDGER_FLAG_CHANGEBACK 4
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryDataRef LedgerEntryView::getKey(void) const
+{
+   return BinaryDataRef(table_->keys_[row_].data(), 6);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryDataRef LedgerEntryView::getID(void) const
+{
+   return table_->ids_[table_->idRows_[row_]].getRef();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int64_t LedgerEntryView::getValue(void) const
+{
+   return table_->values_[row_];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t LedgerEntryView::getBlockNum(void) const
+{
+   return table_->blockNums_[row_];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryDataRef LedgerEntryView::getTxHash(void) const
+{
+   return BinaryDataRef(table_->txHashes_[row_].data(), 32);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t LedgerEntryView::getIndex(void) const
+{
+   return table_->indexes_[row_];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t LedgerEntryView::getTxTime(void) const
+{
+   return table_->txTimes_[row_];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LedgerEntryView::isCoinbase(void) const
+{
+   return (table_->flags_[row_] & LEDGER_FLAG_COINBASE) != 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LedgerEntryView::isSentToSelf(void) const
+{
+   return (table_->flags_[row_] & LEDGER_FLAG_SENTTOSELF) != 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LedgerEntryView::isChangeBack(void) const
+{
+   return (table_->flags_[row_] & LEDGER_FLAG_CHANGEBACK) != 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+set<BinaryData> LedgerEntryView::getScrAddrList(void) const
+{
+   set<BinaryData> scrAddrSet;
+   for (uint32_t i = table_->scrAddrStart_[row_];
+        i < table_->scrAddrStart_[row_ + 1]; i++)
+      scrAddrSet.insert(table_->scrAddrs_[table_->scrAddrRows_[i]]);
+
+   return scrAddrSet;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+LedgerEntry LedgerEntryView::toLedgerEntry(void) const
+{
+   LedgerEntry le(getID(), getValue(), getBlockNum(), getTxHash(), 
+      getIndex(), getTxTime(), isCoinbase(), isSentToSelf(), isChangeBack());
+   le.scrAddrSet_ = getScrAddrList();
+
+   return le;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t LedgerTable::intern(vector<BinaryData>& values,
+   map<BinaryData, uint32_t>& index, BinaryDataRef value)
+{
+   BinaryData bd(value);
+   auto iter = index.find(bd);
+   if (iter != index.end())
+      return iter->second;
+
+   uint32_t row = values.size();
+   index.insert(make_pair(bd, row));
+   values.push_back(move(bd));
+   return row;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LedgerTable::append(BinaryDataRef key, const LedgerEntry& le)
+{
+   if (key.getSize() != 6)
+      throw runtime_error("invalid ledger key for LedgerTable");
+
+   if (scrAddrStart_.empty())
+      scrAddrStart_.push_back(0);
+
+   keys_.push_back(array<uint8_t, 6>());
+   memcpy(keys_.back().data(), key.getPtr(), 6);
+   //a hash that failed to resolve reads back as zeros
+   txHashes_.push_back(array<uint8_t, 32>());
+   txHashes_.back().fill(0);
+   if (le.txHash_.getSize() == 32)
+      memcpy(txHashes_.back().data(), le.txHash_.getPtr(), 32);
+
+   values_.push_back(le.value_);
+   blockNums_.push_back(le.blockNum_);
+   indexes_.push_back(le.index_);
+   txTimes_.push_back(le.txTime_);
+   flags_.push_back(
+      (le.isCoinbase_ ? LEDGER_FLAG_COINBASE : 0) | 
+      (le.isSentToSelf_ ? LEDGER_FLAG_SENTTOSELF : 0) |
+      (le.isChangeBack_ ? LEDGER_FLAG_CHANGEBACK : 0));
+   idRows_.push_back(intern(ids_, idIndex_, le.ID_.getRef()));
+
+   for (auto& scrAddr : le.scrAddrSet_)
+      scrAddrRows_.push_back(intern(scrAddrs_, scrAddrIndex_, scrAddr.getRef()));
+   scrAddrStart_.push_back(scrAddrRows_.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LedgerTable::append(const map<BinaryData, LedgerEntry>& leMap)
+{
+   size_t newSize = size() + leMap.size();
+   keys_.reserve(newSize);
+   txHashes_.reserve(newSize);
+   values_.reserve(newSize);
+   blockNums_.reserve(newSize);
+   indexes_.reserve(newSize);
+   txTimes_.reserve(newSize);
+   flags_.reserve(newSize);
+   idRows_.reserve(newSize);
+   scrAddrStart_.reserve(newSize + 1);
+
+   for (auto& lePair : leMap)
+      append(lePair.first.getRef(), lePair.second);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LedgerTable::clear(void)
+{
+   *this = LedgerTable();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+LedgerEntry LedgerTable::getEntry(size_t row) const
+{
+   return (*this)[row].toLedgerEntry();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<LedgerEntry> LedgerTable::toVector(void) const
+{
+   vector<LedgerEntry> leVec;
+   leVec.reserve(size());
+
+   for (size_t i = 0; i < size(); i++)
+      leVec.push_back(getEntry(i));
+
+   return leVec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+static void gatherRows(vector<T>& column, const vector<size_t>& rows)
+{
+   vector<T> sorted;
+   sorted.reserve(column.size());
+   for (auto row : rows)
+      sorted.push_back(column[row]);
+   column.swap(sorted);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LedgerTable::reorder(const vector<size_t>& rows)
+{
+   gatherRows(keys_, rows);
+   gatherRows(txHashes_, rows);
+   gatherRows(values_, rows);
+   gatherRows(blockNums_, rows);
+   gatherRows(indexes_, rows);
+   gatherRows(txTimes_, rows);
+   gatherRows(flags_, rows);
+   gatherRows(idRows_, rows);
+
+   vector<uint32_t> scrAddrStart;
+   vector<uint32_t> scrAddrRows;
+   scrAddrStart.reserve(scrAddrStart_.size());
+   scrAddrRows.reserve(scrAddrRows_.size());
+
+   scrAddrStart.push_back(0);
+   for (auto row : rows)
+   {
+      scrAddrRows.insert(scrAddrRows.end(),
+         scrAddrRows_.begin() + scrAddrStart_[row],
+         scrAddrRows_.begin() + scrAddrStart_[row + 1]);
+      scrAddrStart.push_back(scrAddrRows.size());
+   }
+
+   scrAddrStart_.swap(scrAddrStart);
+   scrAddrRows_.swap(scrAddrRows);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LedgerTable::sortByKey(void)
+{
+   vector<size_t> rows(size());
+   for (size_t i = 0; i < rows.size(); i++)
+      rows[i] = i;
+
+   stable_sort(rows.begin(), rows.end(), [this](size_t a, size_t b)->bool
+   { return memcmp(keys_[a].data(), keys_[b].data(), 6) < 0; });
+
+   reorder(rows);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LedgerTable::sortByEntry(bool descending)
+{
+   vector<size_t> rows(size());
+   for (size_t i = 0; i < rows.size(); i++)
+      rows[i] = i;
+
+   auto lessThan = [this](size_t a, size_t b)->bool
+   {
+      if (blockNums_[a] != blockNums_[b])
+         return blockNums_[a] < blockNums_[b];
+      return indexes_[a] < indexes_[b];
+   };
+
+   if (descending)
+   {
+      stable_sort(rows.begin(), rows.end(), [&lessThan](size_t a, size_t b)
+      { return lessThan(b, a); });
+   }
+   else
+      stable_sort(rows.begin(), rows.end(), lessThan);
+
+   reorder(rows);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t LedgerTable::find(BinaryDataRef key) const
+{
+   if (key.getSize() != 6)
+      return size();
+
+   array<uint8_t, 6> target;
+   memcpy(target.data(), key.getPtr(), 6);
+
+   auto iter = lower_bound(keys_.begin(), keys_.end(), target);
+   if (iter == keys_.end() || *iter != target)
+      return size();
+
+   return iter - keys_.begin();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+size_t LedgerTable::getMemoryUsage(void) const
+{
+   size_t total = 
+      keys_.capacity() * sizeof(array<uint8_t, 6>) +
+      txHashes_.capacity() * sizeof(array<uint8_t, 32>) +
+      values_.capacity() * sizeof(int64_t) +
+      (blockNums_.capacity() + indexes_.capacity() + txTimes_.capacity() +
+       idRows_.capacity() + scrAddrStart_.capacity() + 
+       scrAddrRows_.capacity()) * sizeof(uint32_t) +
+      flags_.capacity();
+
+   //interned values are held twice, by the vector and the index map, plus
+   //roughly 4 pointers of map node overhead
+   auto internedSize = [](const vector<BinaryData>& values)->size_t
+   {
+      size_t size = values.capacity() * sizeof(BinaryData);
+      for (auto& value : values)
+         size += 2 * value.getSize() + sizeof(BinaryData) + 
+            sizeof(uint32_t) + 4 * sizeof(void*);
+      return size;
+   };
+
+   return total + internedSize(ids_) + internedSize(scrAddrs_);
+}
+
 // kate: indent-width 3; replace-tabs on;
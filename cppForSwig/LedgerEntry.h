@@ -14,6 +14,8 @@
 #include "Blockchain.h"
 #include "StoredBlockObj.h"
 
+#include <array>
+
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -55,6 +57,9 @@ class LMDBBlockDatabase;
 
 class LedgerEntry
 {
+   friend class LedgerTable;
+   friend class LedgerEntryView;
+
 public:
    LedgerEntry(void) :
       ID_(0),
@@ -112,6 +117,8 @@ public:
 
    static void purgeLedgerMapFromHeight(map<BinaryData, LedgerEntry>& leMap,
                                         uint32_t purgeFrom);
+   //first ledger map key at or above this height, ZC keys sort last
+   static BinaryData getLedgerKeyForHeight(uint32_t height);
    static void purgeLedgerVectorFromHeight(vector<LedgerEntry>& leMap,
       uint32_t purgeFrom);
 
@@ -125,6 +132,11 @@ public:
    
    set<BinaryData> getScrAddrList(void) const
    { return scrAddrSet_; }
+
+   //for the ledger cache, see StoredLedgerCache. The ID isn't written, 
+   //the reader sets it back
+   void serialize(BinaryWriter& bw) const;
+   void unserialize(BinaryRefReader& brr);
    
 public:
 
@@ -157,4 +169,223 @@ struct LedgerEntry_DescendingOrder
    { return a > b; }
 };
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// LedgerTable
+//
+// Ledger entries stored by column, for pages that are built once and read
+// many times. Keys are the 6 byte hgtx + txIndex of the ledger maps, tx 
+// hashes are fixed 32 byte cells, wallet IDs and scrAddrs are interned and
+// referred to by index. A 100 entry page is a couple dozen allocations 
+// instead of several per entry.
+//
+// LedgerEntryView reads a row in place with LedgerEntry's getters, 
+// getEntry and toVector build LedgerEntry objects for the callers that 
+// need them, SWIG among them.
+//
+////////////////////////////////////////////////////////////////////////////////
+class LedgerTable;
+
+class LedgerEntryView
+{
+   friend class LedgerTable;
+
+private:
+   const LedgerTable* table_;
+   size_t row_;
+
+   LedgerEntryView(const LedgerTable* table, size_t row) :
+      table_(table), row_(row)
+   {}
+
+public:
+   BinaryDataRef   getKey(void) const;
+   BinaryDataRef   getID(void) const;
+   int64_t         getValue(void) const;
+   uint32_t        getBlockNum(void) const;
+   BinaryDataRef   getTxHash(void) const;
+   uint32_t        getIndex(void) const;
+   uint32_t        getTxTime(void) const;
+   bool            isCoinbase(void) const;
+   bool            isSentToSelf(void) const;
+   bool            isChangeBack(void) const;
+   set<BinaryData> getScrAddrList(void) const;
+
+   LedgerEntry toLedgerEntry(void) const;
+};
+
+class LedgerTable
+{
+   friend class LedgerEntryView;
+
+public:
+   class const_iterator
+   {
+   private:
+      const LedgerTable* table_;
+      size_t row_;
+
+   public:
+      const_iterator(const LedgerTable* table, size_t row) :
+         table_(table), row_(row)
+      {}
+
+      LedgerEntryView operator*(void) const { return (*table_)[row_]; }
+      const_iterator& operator++(void) { ++row_; return *this; }
+      bool operator!=(const const_iterator& rhs) const
+      { return row_ != rhs.row_; }
+      bool operator==(const const_iterator& rhs) const
+      { return row_ == rhs.row_; }
+   };
+
+public:
+   LedgerTable(void) {}
+   explicit LedgerTable(const map<BinaryData, LedgerEntry>& leMap)
+   { append(leMap); }
+
+   //rows are kept in the order they come in, see sortByKey and sortByEntry
+   void append(BinaryDataRef key, const LedgerEntry& le);
+   void append(const map<BinaryData, LedgerEntry>& leMap);
+   void clear(void);
+
+   size_t size(void) const { return values_.size(); }
+   bool empty(void) const { return values_.empty(); }
+
+   LedgerEntryView operator[](size_t row) const 
+   { return LedgerEntryView(this, row); }
+   const_iterator begin(void) const { return const_iterator(this, 0); }
+   const_iterator end(void) const { return const_iterator(this, size()); }
+
+   LedgerEntry getEntry(size_t row) const;
+   vector<LedgerEntry> toVector(void) const;
+
+   //map order
+   void sortByKey(void);
+   
+   //LedgerEntry order (height, then index), stable across wallets
+   void sortByEntry(bool descending = false);
+
+   //row of the key after sortByKey, size() if there is none
+   size_t find(BinaryDataRef key) const;
+
+   //heap bytes held by the columns and interned values
+   size_t getMemoryUsage(void) const;
+
+private:
+   uint32_t intern(vector<BinaryData>& values, 
+      map<BinaryData, uint32_t>& index, BinaryDataRef value);
+   void reorder(const vector<size_t>& rows);
+
+private:
+   vector<array<uint8_t, 6>>  keys_;
+   vector<array<uint8_t, 32>> txHashes_;
+   vector<int64_t>            values_;
+   vector<uint32_t>           blockNums_;
+   vector<uint32_t>           indexes_;
+   vector<uint32_t>           txTimes_;
+   vector<uint8_t>            flags_;
+   vector<uint32_t>           idRows_;
+
+   //the scrAddrs of row i are scrAddrRows_[scrAddrStart_[i]] up to 
+   //scrAddrRows_[scrAddrStart_[i+1]]
+   vector<uint32_t>           scrAddrStart_;
+   vector<uint32_t>           scrAddrRows_;
+
+   vector<BinaryData>         ids_;
+   map<BinaryData, uint32_t>  idIndex_;
+   vector<BinaryData>         scrAddrs_;
+   map<BinaryData, uint32_t>  scrAddrIndex_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Change feed entries. Ledgers are identified by tx hash within a wallet: 
+// consumers apply removed_ first, then added_ and changed_. A mined ZC shows
+// up as removed (ZC entry) and added (block entry) in the same delta.
+// reset_ means the wallet's history was remapped, its pages should be fetched 
+// again rather than patched.
+struct WalletLedgerDelta
+{
+   BinaryData walletID_;
+   bool isLockbox_ = false;
+   bool reset_ = false;
+
+   vector<LedgerEntry> added_;
+   vector<LedgerEntry> changed_;
+   vector<LedgerEntry> removed_;
+
+   uint64_t balance_ = 0;
+   int64_t balanceDelta_ = 0;
+
+   bool empty(void) const
+   {
+      return !reset_ && balanceDelta_ == 0 && added_.empty() && 
+         changed_.empty() && removed_.empty();
+   }
+};
+
+struct LedgerChangeSet
+{
+   //strictly increasing, one per wallet scan that changed anything
+   uint64_t version_ = 0;
+   uint32_t topBlock_ = 0;
+   
+   //the requested version fell off the feed, refetch all wallets' history
+   bool resetAll_ = false;
+
+   vector<WalletLedgerDelta> wallets_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// What a block did to one wallet, taken from the scan that picked the block
+// up. valueDelta_ is the net balance change (sent-to-self only costs the
+// fee), txHashes_ are in block order with their position in txIndexes_,
+// scrAddrs_ are the wallet's addresses the block touched, sorted.
+struct WalletBlockEffects
+{
+   BinaryData walletID_;
+   bool isLockbox_ = false;
+
+   int64_t valueDelta_ = 0;
+   vector<BinaryData> txHashes_;
+   vector<uint32_t> txIndexes_;
+   vector<BinaryData> scrAddrs_;
+
+   //by value, for the SWIG typemaps
+   BinaryData getWalletID(void) const { return walletID_; }
+   vector<BinaryData> getTxHashes(void) const { return txHashes_; }
+   vector<BinaryData> getScrAddrs(void) const { return scrAddrs_; }
+};
+
+// One per new block, whether or not it touched any wallet. txHashes_ is the
+// union of the wallets' txs, in block order.
+struct BlockEffects
+{
+   uint32_t height_ = UINT32_MAX;
+   BinaryData blockHash_;
+   BinaryData rawHeader_;
+
+   vector<BinaryData> txHashes_;
+   vector<WalletBlockEffects> wallets_;
+
+   bool isInitialized(void) const { return height_ != UINT32_MAX; }
+
+   BinaryData getBlockHash(void) const { return blockHash_; }
+   BinaryData getRawHeader(void) const { return rawHeader_; }
+   vector<BinaryData> getTxHashes(void) const { return txHashes_; }
+   vector<WalletBlockEffects> getWallets(void) const { return wallets_; }
+};
+
+// BDMAction_NewBlock payload
+struct NewBlockNotification
+{
+   int newBlockCount_ = 0;
+
+   //oldest first, only the most recent blocks on a large catch up
+   vector<BlockEffects> effects_;
+
+   //by value, the notification is gone once the callback returns while
+   //listeners may hold on to the effects (queued Qt signals)
+   vector<BlockEffects> getEffects(void) const { return effects_; }
+};
+
 #endif
@@ -6,19 +6,32 @@
 //                                                                            //
 ////////////////////////////////////////////////////////////////////////////////
 #include "Progress.h"
+#include "log.h"
 
-ProgressCalculator::ProgressCalculator(uint64_t total)
-   : total_(total)
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+using namespace std;
+
+ProgressCalculator::ProgressCalculator(
+   uint64_t total, uint32_t sampleIntervalMs)
+   : total_(total), sampleInterval_(uint64_t(sampleIntervalMs) * 1000)
 {
    then_ = 0;
 }
 
 void ProgressCalculator::advance(uint64_t to)
+{
+   advance(to, ScanTelemetry::now());
+}
+
+void ProgressCalculator::advance(uint64_t to, uint64_t now)
 {
    static const double smoothingFactor=.10;
    
    if (to == lastSample_) return;
-   const time_t now = time(0);
    if (then_ == 0)
    {
       then_ = now;
@@ -26,9 +39,9 @@ void ProgressCalculator::advance(uint64_t to)
    }
    if (now == then_) return;
    
-   if (now < then_+10) return;
+   if (now < then_ + sampleInterval_) return;
    
-   double speed = (to-lastSample_)/double(now-then_);
+   double speed = (to-lastSample_)/(double(now-then_) / 1000000.0);
    
    if (lastSample_ == 0)
       avgSpeed_ = speed;
@@ -75,4 +88,313 @@ void ProgressFilter::advance(uint64_t to)
 }   
 
 
+////////////////////////////////////////////////////////////////////////////////
+////
+//// ScanTelemetry
+////
+////////////////////////////////////////////////////////////////////////////////
+uint64_t ScanTelemetry::now()
+{
+   return chrono::duration_cast<chrono::microseconds>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const char* ScanTelemetry::getStageName(ScanStage stage)
+{
+   switch (stage)
+   {
+   case ScanStage_HeaderLoad:  return "header load";
+   case ScanStage_BlockImport: return "block import";
+   case ScanStage_Scan:        return "scan";
+   case ScanStage_SideScan:    return "side scan";
+   case ScanStage_Reorg:       return "reorg";
+   default:                    return "unknown";
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ScanTelemetry::ScanTelemetry(uint32_t windowMs)
+{
+   setWindow(windowMs);
+
+   for (int i = 0; i < ScanStage_Count; i++)
+      stages_[i].stats_.stage_ = ScanStage(i);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanTelemetry::setWindow(uint32_t windowMs)
+{
+   unique_lock<mutex> lock(mu_);
+   windowUs_ = max(uint64_t(windowMs), uint64_t(1)) * 1000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanTelemetry::setCallback(
+   function<void(const ScanStageStats&)> callback, uint32_t intervalMs)
+{
+   unique_lock<mutex> lock(mu_);
+   callback_ = callback;
+   callbackIntervalUs_ = uint64_t(intervalMs) * 1000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanTelemetry::pushSample(StageState& state, uint64_t at)
+{
+   Sample sample;
+   sample.at_ = at;
+   sample.blocks_ = state.stats_.blocks_;
+   sample.tx_ = state.stats_.tx_;
+   sample.bytes_ = state.stats_.bytes_;
+   sample.txios_ = state.stats_.txios_;
+
+   //keep the window to ~64 samples: within a slot, the newest sample 
+   //overwrites the previous one
+   auto& window = state.window_;
+   const uint64_t slot = windowUs_ / 64;
+   if (window.size() >= 2 && window[window.size() - 2].at_ + slot > at)
+      window.back() = sample;
+   else
+      window.push_back(sample);
+
+   //front is the newest sample at or before the start of the window
+   const uint64_t windowStart = at > windowUs_ ? at - windowUs_ : 0;
+   while (window.size() > 2 && window[1].at_ <= windowStart)
+      window.pop_front();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanTelemetry::computeRates(
+   const StageState& state, ScanStageStats& stats) const
+{
+   stats.blocksPerSec_ = stats.txPerSec_ = 0.0;
+   stats.bytesPerSec_ = stats.txiosPerSec_ = 0.0;
+
+   if (state.window_.size() < 2)
+      return;
+
+   auto& first = state.window_.front();
+   auto& last = state.window_.back();
+   if (last.at_ <= first.at_)
+      return;
+
+   const double seconds = double(last.at_ - first.at_) / 1000000.0;
+   stats.blocksPerSec_ = (last.blocks_ - first.blocks_) / seconds;
+   stats.txPerSec_ = (last.tx_ - first.tx_) / seconds;
+   stats.bytesPerSec_ = (last.bytes_ - first.bytes_) / seconds;
+   stats.txiosPerSec_ = (last.txios_ - first.txios_) / seconds;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ScanTelemetry::callbackDue(StageState& state, uint64_t at)
+{
+   if (!callback_ || at < state.lastCallback_ + callbackIntervalUs_)
+      return false;
+
+   state.lastCallback_ = at;
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanTelemetry::beginStage(ScanStage stage, uint64_t at)
+{
+   if (stage >= ScanStage_Count)
+      return;
+
+   unique_lock<mutex> lock(mu_);
+   auto& state = stages_[stage];
+   
+   state.stats_.active_ = true;
+   state.stats_.runs_++;
+   state.startedAt_ = at;
+   state.lastCallback_ = at;
+
+   //rates are per run, don't carry the previous run's samples
+   state.window_.clear();
+   pushSample(state, at);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanTelemetry::endStage(ScanStage stage, uint64_t at)
+{
+   if (stage >= ScanStage_Count)
+      return;
+
+   ScanStageStats stats;
+   function<void(const ScanStageStats&)> callback;
+   uint64_t runUs;
+
+   {
+      unique_lock<mutex> lock(mu_);
+      auto& state = stages_[stage];
+      if (!state.stats_.active_)
+         return;
+
+      pushSample(state, at);
+      runUs = at - state.startedAt_;
+      state.stats_.elapsedUs_ += runUs;
+      state.stats_.active_ = false;
+
+      stats = state.stats_;
+      computeRates(state, stats);
+      callback = callback_;
+   }
+
+   LOGINFO << "Finished " << getStageName(stage) << " in " 
+      << runUs / 1000 << "ms, " << stats.blocksPerSec_ << " blocks/s, "
+      << stats.txPerSec_ << " tx/s, " << stats.bytesPerSec_ << " bytes/s, "
+      << stats.txiosPerSec_ << " txios/s, stalled " 
+      << stats.stallUs_ / 1000 << "ms";
+
+   if (callback)
+      callback(stats);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanTelemetry::record(ScanStage stage, uint64_t blocks, uint64_t tx,
+   uint64_t bytes, uint64_t txios, uint64_t at)
+{
+   if (stage >= ScanStage_Count)
+      return;
+
+   ScanStageStats stats;
+   function<void(const ScanStageStats&)> callback;
+
+   {
+      unique_lock<mutex> lock(mu_);
+      auto& state = stages_[stage];
+
+      state.stats_.blocks_ += blocks;
+      state.stats_.tx_ += tx;
+      state.stats_.bytes_ += bytes;
+      state.stats_.txios_ += txios;
+      pushSample(state, at);
+
+      if (!state.stats_.active_ || !callbackDue(state, at))
+         return;
+
+      stats = state.stats_;
+      stats.elapsedUs_ += at - state.startedAt_;
+      computeRates(state, stats);
+      callback = callback_;
+   }
+
+   callback(stats);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanTelemetry::recordStall(ScanStage stage, uint64_t durationUs)
+{
+   if (stage >= ScanStage_Count)
+      return;
+
+   unique_lock<mutex> lock(mu_);
+   auto& stats = stages_[stage].stats_;
+   stats.stallUs_ += durationUs;
+   stats.stalls_++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScanTelemetry::recordFlush(ScanStage stage, const FlushStats& flush)
+{
+   if (stage >= ScanStage_Count)
+      return;
+
+   unique_lock<mutex> lock(mu_);
+   stages_[stage].stats_.flush_ = flush;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ScanStageStats ScanTelemetry::getStats(ScanStage stage, uint64_t at) const
+{
+   if (stage >= ScanStage_Count)
+      throw runtime_error("invalid scan stage");
+
+   unique_lock<mutex> lock(mu_);
+   auto& state = stages_[stage];
+   ScanStageStats stats = state.stats_;
+
+   if (!stats.active_)
+   {
+      computeRates(state, stats);
+      return stats;
+   }
+
+   //a running stage that stopped producing sees its rates decay
+   stats.elapsedUs_ += at - state.startedAt_;
+   
+   StageState current = state;
+   Sample sample = current.window_.back();
+   if (at > sample.at_)
+   {
+      sample.at_ = at;
+      current.window_.push_back(sample);
+      
+      const uint64_t windowStart = at > windowUs_ ? at - windowUs_ : 0;
+      while (current.window_.size() > 2 && 
+         current.window_[1].at_ <= windowStart)
+         current.window_.pop_front();
+   }
+
+   computeRates(current, stats);
+   return stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+string ScanTelemetry::dump(void) const
+{
+   stringstream ss;
+   const uint64_t at = now();
+   for (int i = 0; i < ScanStage_Count; i++)
+   {
+      auto stats = getStats(ScanStage(i), at);
+      if (stats.runs_ == 0)
+         continue;
+
+      ss << format(stats);
+   }
+
+   return ss.str();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+string ScanTelemetry::format(const ScanStageStats& stats)
+{
+   stringstream ss;
+   ss << fixed << setprecision(1);
+
+   ss << getStageName(stats.stage_) 
+      << (stats.active_ ? " (running)" : "")
+      << ": runs " << stats.runs_ 
+      << ", elapsed " << stats.elapsedUs_ / 1000 << "ms"
+      << ", blocks " << stats.blocks_ 
+      << " (" << stats.blocksPerSec_ << "/s)"
+      << ", tx " << stats.tx_ << " (" << stats.txPerSec_ << "/s)"
+      << ", bytes " << stats.bytes_ << " (" << stats.bytesPerSec_ << "/s)"
+      << ", txios " << stats.txios_ << " (" << stats.txiosPerSec_ << "/s)"
+      << ", stalled " << stats.stallUs_ / 1000 << "ms over " 
+      << stats.stalls_ << " waits" << endl;
+
+   const auto& flush = stats.flush_;
+   if (flush.commits_ == 0)
+      return ss.str();
+
+   ss << "   " << (flush.adaptive_ ? "adaptive" : "fixed") 
+      << " flush: commits " << flush.commits_
+      << ", threshold " << flush.bytesThreshold_ << " bytes / "
+      << flush.utxoThreshold_ << " utxos"
+      << ", memory cap " << flush.memoryCap_
+      << ", written " << flush.bytes_ 
+      << ", serialize " << flush.serializeUs_ / 1000 << "ms"
+      << ", write " << flush.writeUs_ / 1000 << "ms"
+      << ", last " << flush.lastBytes_ << " bytes in " 
+      << flush.lastCommitUs_ / 1000 << "ms"
+      << ", ssh " << flush.sshWritten_ << " (" << flush.sshBytes_ 
+      << " bytes)"
+      << ", raised " << flush.raised_ << ", lowered " << flush.lowered_
+      << ", capped " << flush.capped_ << endl;
+
+   return ss.str();
+}
+
 // kate: indent-width 3; replace-tabs on;
@@ -10,6 +10,10 @@
 
 #include <cstdint>
 #include <time.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <functional>
 
 class ProgressReporter
 {
@@ -34,16 +38,20 @@ class ProgressCalculator
 {
    const uint64_t total_;
    
-   time_t then_;
+   //steady clock, in microseconds
+   uint64_t then_;
    uint64_t lastSample_=0;
    
    double avgSpeed_=0.0;
    
+   //shortest time between two speed samples, in microseconds
+   const uint64_t sampleInterval_;
    
 public:
-   ProgressCalculator(uint64_t total);
+   ProgressCalculator(uint64_t total, uint32_t sampleIntervalMs = 10000);
    
    void advance(uint64_t to);
+   void advance(uint64_t to, uint64_t at);
    uint64_t total() const { return total_; }
 
    double fractionCompleted() const { return lastSample_/double(total_); }
@@ -84,4 +92,161 @@ public:
 };
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Throughput telemetry for the long running BDM phases. Each stage keeps 
+// running totals and a trailing window of samples, from which the rates are 
+// computed. Stalls are the time a stage spent waiting on its input (i.e. the 
+// scan thread waiting on the block grabbing thread).
+// All timestamps are steady clock microseconds, as returned by now().
+////////////////////////////////////////////////////////////////////////////////
+enum ScanStage
+{
+   ScanStage_HeaderLoad=0,
+   ScanStage_BlockImport,
+   ScanStage_Scan,
+   ScanStage_SideScan,
+   ScanStage_Reorg,
+   ScanStage_Count
+};
+
+//BlockWriteBatcher commits of the latest run of a stage, see FlushController
+struct FlushStats
+{
+   bool adaptive_ = false;
+   uint32_t commits_ = 0;
+
+   //thresholds in effect
+   uint64_t bytesThreshold_ = 0;
+   uint32_t utxoThreshold_ = 0;
+   uint64_t memoryCap_ = 0;
+
+   //totals over the run, then the last commit
+   uint64_t bytes_ = 0;
+   uint64_t serializeUs_ = 0;
+   uint64_t writeUs_ = 0;
+   uint64_t lastBytes_ = 0;
+   uint64_t lastCommitUs_ = 0;
+
+   //SSH summaries written, over the run then by the last commit
+   uint64_t sshWritten_ = 0;
+   uint64_t sshBytes_ = 0;
+   uint32_t lastSshWritten_ = 0;
+
+   //threshold decisions: raised, lowered, held down by the memory cap
+   uint32_t raised_ = 0;
+   uint32_t lowered_ = 0;
+   uint32_t capped_ = 0;
+};
+
+struct ScanStageStats
+{
+   ScanStage stage_ = ScanStage_HeaderLoad;
+   bool active_ = false;
+   uint32_t runs_ = 0;
+
+   //totals over all runs of the stage
+   uint64_t blocks_ = 0;
+   uint64_t tx_ = 0;
+   uint64_t bytes_ = 0;
+   uint64_t txios_ = 0;
+   
+   uint64_t elapsedUs_ = 0;
+   uint64_t stallUs_ = 0;
+   uint32_t stalls_ = 0;
+
+   //per second, over the trailing window
+   double blocksPerSec_ = 0.0;
+   double txPerSec_ = 0.0;
+   double bytesPerSec_ = 0.0;
+   double txiosPerSec_ = 0.0;
+
+   FlushStats flush_;
+};
+
+class ScanTelemetry
+{
+   struct Sample
+   {
+      uint64_t at_ = 0;
+      uint64_t blocks_ = 0, tx_ = 0, bytes_ = 0, txios_ = 0;
+   };
+
+   struct StageState
+   {
+      ScanStageStats stats_;
+      std::deque<Sample> window_;
+      uint64_t startedAt_ = 0;
+      uint64_t lastCallback_ = 0;
+   };
+
+   mutable std::mutex mu_;
+   StageState stages_[ScanStage_Count];
+   uint64_t windowUs_;
+   
+   std::function<void(const ScanStageStats&)> callback_;
+   uint64_t callbackIntervalUs_ = 1000000;
+
+private:
+   void pushSample(StageState&, uint64_t at);
+   void computeRates(const StageState&, ScanStageStats&) const;
+   bool callbackDue(StageState&, uint64_t at);
+
+public:
+   static uint64_t now();
+   static const char* getStageName(ScanStage stage);
+
+   ScanTelemetry(uint32_t windowMs = 10000);
+   
+   void setWindow(uint32_t windowMs);
+
+   //called from the thread running the stage, at most once per interval 
+   //while a stage is running and once when it ends
+   void setCallback(
+      std::function<void(const ScanStageStats&)> callback, 
+      uint32_t intervalMs = 1000);
+
+   void beginStage(ScanStage stage) { beginStage(stage, now()); }
+   void beginStage(ScanStage stage, uint64_t at);
+   void endStage(ScanStage stage) { endStage(stage, now()); }
+   void endStage(ScanStage stage, uint64_t at);
+
+   void record(ScanStage stage, uint64_t blocks, uint64_t tx, 
+      uint64_t bytes, uint64_t txios)
+   { record(stage, blocks, tx, bytes, txios, now()); }
+   void record(ScanStage stage, uint64_t blocks, uint64_t tx, 
+      uint64_t bytes, uint64_t txios, uint64_t at);
+   void recordStall(ScanStage stage, uint64_t durationUs);
+   void recordFlush(ScanStage stage, const FlushStats& flush);
+
+   ScanStageStats getStats(ScanStage stage) const 
+   { return getStats(stage, now()); }
+   ScanStageStats getStats(ScanStage stage, uint64_t at) const;
+   
+   //one line per stage that ran at least once
+   std::string dump(void) const;
+   
+   //the line dump() prints for a stage
+   static std::string format(const ScanStageStats& stats);
+
+   class StageScope
+   {
+      ScanTelemetry* telemetry_;
+      const ScanStage stage_;
+
+   public:
+      StageScope(ScanTelemetry* telemetry, ScanStage stage)
+         : telemetry_(telemetry), stage_(stage)
+      {
+         if (telemetry_ != nullptr)
+            telemetry_->beginStage(stage_);
+      }
+
+      ~StageScope()
+      {
+         if (telemetry_ != nullptr)
+            telemetry_->endStage(stage_);
+      }
+   };
+};
+
 #endif
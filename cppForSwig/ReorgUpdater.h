@@ -8,8 +8,7 @@
 #include "Blockchain.h"
 #include "BDM_supportClasses.h"
 #include "BlockWriteBatcher.h"
-
-#include <thread>
+#include "ThreadPool.h"
 
 #ifdef _MSC_VER
 #define NOEXCEPT _NOEXCEPT
@@ -161,13 +160,12 @@ public:
       created in the main thead are read only, and based on user request, a
       real only transaction may be opened. Since LMDB doesn't support different
       transaction types running concurently within the same thread, this whole
-      code is ran in a new thread, while the calling thread joins on it, to
+      code is ran in a pool worker, while the calling thread waits on it, to
       guarantee control over the transactions in the running thread.
       ***/
       auto reassessThread = [this]()
       { this->reassessAfterReorgThread(); };
-      thread reorgthread(reassessThread);
-      reorgthread.join();
+      ThreadPool::getGlobal().submit(reassessThread, TaskPriority_High).get();
 
       if (errorProcessing_)
          throw *errorProcessing_;
@@ -508,10 +508,8 @@ vector<UnspentTxOut> ScrAddrObj::getSpendableTxOutList(
 
 
 
-   StoredScriptHistory ssh;
    map<BinaryData, UnspentTxOut> utxoMap;
-   db_->getStoredScriptHistory(ssh, scrAddr_);
-   db_->getFullUTXOMapForSSH(ssh, utxoMap, false);
+   db_->getUTXOMapForScrAddr(scrAddr_, utxoMap);
 
    vector<UnspentTxOut> utxoVec;
 
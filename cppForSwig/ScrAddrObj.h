@@ -94,13 +94,9 @@ private:
          uint32_t nutxo = 0;
          uint64_t val = 0;
 
-         StoredScriptHistory ssh;
-         scrAddrObj_->db_->getStoredScriptHistory(ssh, 
-            scrAddrObj_->scrAddr_, start, end);
-
-         for (const auto& subsshPair : ssh.subHistMap_)
+         auto addUTXOs = [&](StoredSubHistory& subssh)->bool
          {
-            for (const auto& txioPair : subsshPair.second.txioMap_)
+            for (const auto& txioPair : subssh.txioMap_)
             {
                if (txioPair.second.isUTXO())
                {
@@ -122,7 +118,12 @@ private:
                   }
                }
             }
-         }
+
+            return true;
+         };
+
+         scrAddrObj_->db_->readSubHistories(
+            scrAddrObj_->scrAddr_, start, end, true, addUTXOs);
 
          topBlock_ = end;
          value_ += val;
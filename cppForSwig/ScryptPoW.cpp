@@ -0,0 +1,369 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2011-2015, Armory Technologies, Inc.                        //
+//  Distributed under the GNU Affero General Public License (AGPL v3)         //
+//  See LICENSE or http://www.gnu.org/licenses/agpl.html                      //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+#include "ScryptPoW.h"
+#include "BtcUtils.h"
+#include "ThreadPool.h"
+#include "hmac.h"
+#include "sha.h"
+
+#include <thread>
+#include <future>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+   (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCRYPT_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+#define ROTL32(a, b) (((a) << (b)) | ((a) >> (32 - (b))))
+
+////////////////////////////////////////////////////////////////////////////////
+static inline uint32_t le32dec(const uint8_t* p)
+{
+   return uint32_t(p[0]) | (uint32_t(p[1]) << 8) |
+      (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static inline void le32enc(uint8_t* p, uint32_t x)
+{
+   p[0] = x & 0xff;
+   p[1] = (x >> 8) & 0xff;
+   p[2] = (x >> 16) & 0xff;
+   p[3] = (x >> 24) & 0xff;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// PBKDF2-HMAC-SHA256 with the single iteration scrypt uses. The HMAC is keyed
+// with the password once for both derivations
+static void pbkdf2OneIteration(CryptoPP::HMAC<CryptoPP::SHA256>& hmac,
+   const uint8_t* salt, size_t saltLen, uint8_t* out, size_t outLen)
+{
+   uint8_t block[32];
+   uint8_t counter[4];
+
+   for (uint32_t i = 1; outLen > 0; i++)
+   {
+      counter[0] = (i >> 24) & 0xff;
+      counter[1] = (i >> 16) & 0xff;
+      counter[2] = (i >> 8) & 0xff;
+      counter[3] = i & 0xff;
+
+      hmac.Update(salt, saltLen);
+      hmac.Update(counter, 4);
+      hmac.Final(block);
+
+      const size_t len = min(outLen, sizeof(block));
+      memcpy(out, block, len);
+      out += len;
+      outLen -= len;
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// B = Salsa20/8(B ^ Bx)
+static inline void xorSalsa8(uint32_t* B, const uint32_t* Bx)
+{
+   uint32_t x[16];
+   for (unsigned i = 0; i < 16; i++)
+      x[i] = (B[i] ^= Bx[i]);
+
+   for (unsigned i = 0; i < 8; i += 2)
+   {
+      //columns
+      x[ 4] ^= ROTL32(x[ 0] + x[12],  7);  x[ 8] ^= ROTL32(x[ 4] + x[ 0],  9);
+      x[12] ^= ROTL32(x[ 8] + x[ 4], 13);  x[ 0] ^= ROTL32(x[12] + x[ 8], 18);
+      x[ 9] ^= ROTL32(x[ 5] + x[ 1],  7);  x[13] ^= ROTL32(x[ 9] + x[ 5],  9);
+      x[ 1] ^= ROTL32(x[13] + x[ 9], 13);  x[ 5] ^= ROTL32(x[ 1] + x[13], 18);
+      x[14] ^= ROTL32(x[10] + x[ 6],  7);  x[ 2] ^= ROTL32(x[14] + x[10],  9);
+      x[ 6] ^= ROTL32(x[ 2] + x[14], 13);  x[10] ^= ROTL32(x[ 6] + x[ 2], 18);
+      x[ 3] ^= ROTL32(x[15] + x[11],  7);  x[ 7] ^= ROTL32(x[ 3] + x[15],  9);
+      x[11] ^= ROTL32(x[ 7] + x[ 3], 13);  x[15] ^= ROTL32(x[11] + x[ 7], 18);
+
+      //rows
+      x[ 1] ^= ROTL32(x[ 0] + x[ 3],  7);  x[ 2] ^= ROTL32(x[ 1] + x[ 0],  9);
+      x[ 3] ^= ROTL32(x[ 2] + x[ 1], 13);  x[ 0] ^= ROTL32(x[ 3] + x[ 2], 18);
+      x[ 6] ^= ROTL32(x[ 5] + x[ 4],  7);  x[ 7] ^= ROTL32(x[ 6] + x[ 5],  9);
+      x[ 4] ^= ROTL32(x[ 7] + x[ 6], 13);  x[ 5] ^= ROTL32(x[ 4] + x[ 7], 18);
+      x[11] ^= ROTL32(x[10] + x[ 9],  7);  x[ 8] ^= ROTL32(x[11] + x[10],  9);
+      x[ 9] ^= ROTL32(x[ 8] + x[11], 13);  x[10] ^= ROTL32(x[ 9] + x[ 8], 18);
+      x[12] ^= ROTL32(x[15] + x[14],  7);  x[13] ^= ROTL32(x[12] + x[15],  9);
+      x[14] ^= ROTL32(x[13] + x[12], 13);  x[15] ^= ROTL32(x[14] + x[13], 18);
+   }
+
+   for (unsigned i = 0; i < 16; i++)
+      B[i] += x[i];
+}
+
+#ifdef SCRYPT_SSE2
+////////////////////////////////////////////////////////////////////////////////
+// Same as xorSalsa8 on a 64 byte block laid out by diagonals (position i
+// holds word i*5 % 16), so that a column or row round is 4 vector operations
+// and the rearranging between them is a lane rotation
+static inline void xorSalsa8SSE2(__m128i* B, const __m128i* Bx)
+{
+   __m128i X0 = B[0] = _mm_xor_si128(B[0], Bx[0]);
+   __m128i X1 = B[1] = _mm_xor_si128(B[1], Bx[1]);
+   __m128i X2 = B[2] = _mm_xor_si128(B[2], Bx[2]);
+   __m128i X3 = B[3] = _mm_xor_si128(B[3], Bx[3]);
+   __m128i T;
+
+   for (unsigned i = 0; i < 8; i += 2)
+   {
+      //columns
+      T = _mm_add_epi32(X0, X3);
+      X1 = _mm_xor_si128(X1, _mm_slli_epi32(T, 7));
+      X1 = _mm_xor_si128(X1, _mm_srli_epi32(T, 25));
+      T = _mm_add_epi32(X1, X0);
+      X2 = _mm_xor_si128(X2, _mm_slli_epi32(T, 9));
+      X2 = _mm_xor_si128(X2, _mm_srli_epi32(T, 23));
+      T = _mm_add_epi32(X2, X1);
+      X3 = _mm_xor_si128(X3, _mm_slli_epi32(T, 13));
+      X3 = _mm_xor_si128(X3, _mm_srli_epi32(T, 19));
+      T = _mm_add_epi32(X3, X2);
+      X0 = _mm_xor_si128(X0, _mm_slli_epi32(T, 18));
+      X0 = _mm_xor_si128(X0, _mm_srli_epi32(T, 14));
+
+      X1 = _mm_shuffle_epi32(X1, 0x93);
+      X2 = _mm_shuffle_epi32(X2, 0x4E);
+      X3 = _mm_shuffle_epi32(X3, 0x39);
+
+      //rows
+      T = _mm_add_epi32(X0, X1);
+      X3 = _mm_xor_si128(X3, _mm_slli_epi32(T, 7));
+      X3 = _mm_xor_si128(X3, _mm_srli_epi32(T, 25));
+      T = _mm_add_epi32(X3, X0);
+      X2 = _mm_xor_si128(X2, _mm_slli_epi32(T, 9));
+      X2 = _mm_xor_si128(X2, _mm_srli_epi32(T, 23));
+      T = _mm_add_epi32(X2, X3);
+      X1 = _mm_xor_si128(X1, _mm_slli_epi32(T, 13));
+      X1 = _mm_xor_si128(X1, _mm_srli_epi32(T, 19));
+      T = _mm_add_epi32(X1, X2);
+      X0 = _mm_xor_si128(X0, _mm_slli_epi32(T, 18));
+      X0 = _mm_xor_si128(X0, _mm_srli_epi32(T, 14));
+
+      X1 = _mm_shuffle_epi32(X1, 0x39);
+      X2 = _mm_shuffle_epi32(X2, 0x4E);
+      X3 = _mm_shuffle_epi32(X3, 0x93);
+   }
+
+   B[0] = _mm_add_epi32(B[0], X0);
+   B[1] = _mm_add_epi32(B[1], X1);
+   B[2] = _mm_add_epi32(B[2], X2);
+   B[3] = _mm_add_epi32(B[3], X3);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+ScryptPoW::ScryptPoW(void)
+   : scratchpad_(SCRATCHPAD_SIZE + 64)
+{
+   //cache line aligned, which covers the vector loads
+   uintptr_t ptr = reinterpret_cast<uintptr_t>(scratchpad_.data());
+   V_ = reinterpret_cast<uint32_t*>((ptr + 63) & ~uintptr_t(63));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ScryptPoW::hasSIMD(void)
+{
+#ifdef SCRYPT_SSE2
+   return true;
+#else
+   return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ROMix with r=1: X is one 128 byte block, as 32 words
+void ScryptPoW::romixScalar(uint32_t* X)
+{
+   for (uint32_t i = 0; i < N; i++)
+   {
+      memcpy(V_ + i * 32, X, 128);
+      xorSalsa8(X, X + 16);
+      xorSalsa8(X + 16, X);
+   }
+
+   for (uint32_t i = 0; i < N; i++)
+   {
+      const uint32_t* Vj = V_ + (X[16] & (N - 1)) * 32;
+      for (unsigned k = 0; k < 32; k++)
+         X[k] ^= Vj[k];
+      xorSalsa8(X, X + 16);
+      xorSalsa8(X + 16, X);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// X is in the diagonal layout of xorSalsa8SSE2, 16 byte aligned. Word 0 of
+// the second half, which picks the V entry, stays in place in that layout
+void ScryptPoW::romixSIMD(uint32_t* X)
+{
+#ifdef SCRYPT_SSE2
+   __m128i* Xv = reinterpret_cast<__m128i*>(X);
+   __m128i* V = reinterpret_cast<__m128i*>(V_);
+   __m128i B[8];
+   for (unsigned k = 0; k < 8; k++)
+      B[k] = _mm_load_si128(Xv + k);
+
+   for (uint32_t i = 0; i < N; i++)
+   {
+      for (unsigned k = 0; k < 8; k++)
+         _mm_store_si128(V + i * 8 + k, B[k]);
+      xorSalsa8SSE2(B, B + 4);
+      xorSalsa8SSE2(B + 4, B);
+   }
+
+   for (uint32_t i = 0; i < N; i++)
+   {
+      const __m128i* Vj = V + (_mm_cvtsi128_si32(B[4]) & (N - 1)) * 8;
+      for (unsigned k = 0; k < 8; k++)
+         B[k] = _mm_xor_si128(B[k], _mm_load_si128(Vj + k));
+      xorSalsa8SSE2(B, B + 4);
+      xorSalsa8SSE2(B + 4, B);
+   }
+
+   for (unsigned k = 0; k < 8; k++)
+      _mm_store_si128(Xv + k, B[k]);
+#else
+   romixScalar(X);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScryptPoW::hash(const uint8_t* header, uint8_t* out)
+{
+#ifdef SCRYPT_SSE2
+   CryptoPP::HMAC<CryptoPP::SHA256> hmac(header, HEADER_SIZE);
+
+   uint8_t B[128];
+   pbkdf2OneIteration(hmac, header, HEADER_SIZE, B, 128);
+
+   //to the diagonal layout and back
+   alignas(16) uint32_t X[32];
+   for (unsigned k = 0; k < 2; k++)
+      for (unsigned i = 0; i < 16; i++)
+         X[k * 16 + i] = le32dec(B + (k * 16 + i * 5 % 16) * 4);
+
+   romixSIMD(X);
+
+   for (unsigned k = 0; k < 2; k++)
+      for (unsigned i = 0; i < 16; i++)
+         le32enc(B + (k * 16 + i * 5 % 16) * 4, X[k * 16 + i]);
+
+   pbkdf2OneIteration(hmac, B, 128, out, 32);
+#else
+   hashScalar(header, out);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ScryptPoW::hashScalar(const uint8_t* header, uint8_t* out)
+{
+   CryptoPP::HMAC<CryptoPP::SHA256> hmac(header, HEADER_SIZE);
+
+   uint8_t B[128];
+   pbkdf2OneIteration(hmac, header, HEADER_SIZE, B, 128);
+
+   uint32_t X[32];
+   for (unsigned i = 0; i < 32; i++)
+      X[i] = le32dec(B + i * 4);
+
+   romixScalar(X);
+
+   for (unsigned i = 0; i < 32; i++)
+      le32enc(B + i * 4, X[i]);
+
+   pbkdf2OneIteration(hmac, B, 128, out, 32);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData ScryptPoW::getHash(BinaryDataRef header)
+{
+   if (header.getSize() < HEADER_SIZE)
+      throw runtime_error("scrypt PoW needs an 80 byte header");
+
+   BinaryData result(32);
+   hash(header.getPtr(), result.getPtr());
+   return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ScryptPoW::checkHeader(BinaryDataRef header)
+{
+   if (header.getSize() < HEADER_SIZE)
+      return false;
+
+   uint8_t powHash[32];
+   hash(header.getPtr(), powHash);
+   return BtcUtils::checkProofOfWork(
+      powHash, READ_UINT32_LE(header.getPtr() + 72));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+vector<uint8_t> ScryptPoW::checkHeaders(
+   const vector<BinaryDataRef>& headers, ThreadPool& pool, unsigned maxTasks)
+{
+   vector<uint8_t> valid(headers.size(), 0);
+   if (headers.empty())
+      return valid;
+
+   if (maxTasks == 0)
+      maxTasks = max(1u, thread::hardware_concurrency());
+
+   const size_t taskCount = min<size_t>(maxTasks,
+      (headers.size() + MIN_HEADERS_PER_TASK - 1) / MIN_HEADERS_PER_TASK);
+   const size_t perTask = (headers.size() + taskCount - 1) / taskCount;
+
+   //each slice writes its own range of flags
+   auto checkSlice = [&headers, &valid](size_t start, size_t end)->void
+   {
+      ScryptPoW scrypt;
+      for (size_t i = start; i < end; i++)
+         valid[i] = scrypt.checkHeader(headers[i]) ? 1 : 0;
+   };
+
+   if (taskCount == 1)
+   {
+      checkSlice(0, headers.size());
+      return valid;
+   }
+
+   vector<future<void>> slices;
+   for (size_t start = 0; start < headers.size(); start += perTask)
+   {
+      const size_t end = min(headers.size(), start + perTask);
+      slices.push_back(pool.submit([&checkSlice, start, end](void)->void
+         { checkSlice(start, end); }, TaskPriority_High));
+   }
+
+   //the slices reference this frame, wait on all of them before throwing
+   exception_ptr failure;
+   for (auto& slice : slices)
+   {
+      try
+      {
+         slice.get();
+      }
+      catch (...)
+      {
+         if (!failure)
+            failure = current_exception();
+      }
+   }
+
+   if (failure)
+      rethrow_exception(failure);
+
+   return valid;
+}
+
+// kate: indent-width 3; replace-tabs on;
@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2011-2015, Armory Technologies, Inc.                        //
+//  Distributed under the GNU Affero General Public License (AGPL v3)         //
+//  See LICENSE or http://www.gnu.org/licenses/agpl.html                      //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+#ifndef SCRYPTPOW_H
+#define SCRYPTPOW_H
+
+#include <cstdint>
+#include <vector>
+#include "BinaryData.h"
+
+class ThreadPool;
+
+////////////////////////////////////////////////////////////////////////////////
+// Litecoin's proof of work: scrypt with N=1024, r=1, p=1 over the 80 byte
+// header, which is both the password and the salt. The 32 byte result is
+// compared to the target in the header's nBits the way Bitcoin compares its
+// double SHA256.
+//
+// Salsa20/8 runs on SSE2 when the compiler targets it (always the case on
+// x86_64), in plain C++ otherwise. Each instance owns a 128kB scratchpad and
+// is meant to be used by one thread at a time.
+////////////////////////////////////////////////////////////////////////////////
+class ScryptPoW
+{
+public:
+   static const uint32_t N = 1024;
+   static const size_t SCRATCHPAD_SIZE = 128 * N;
+
+   //how many headers checkHeaders gives a task at least
+   static const size_t MIN_HEADERS_PER_TASK = 16;
+
+private:
+   std::vector<uint8_t> scratchpad_;
+   uint32_t* V_;
+
+private:
+   void romixScalar(uint32_t* X);
+   void romixSIMD(uint32_t* X);
+
+public:
+   ScryptPoW(void);
+
+   ScryptPoW(const ScryptPoW&) = delete;
+   ScryptPoW& operator=(const ScryptPoW&) = delete;
+
+   //80 bytes in, 32 bytes out
+   void hash(const uint8_t* header, uint8_t* out);
+   BinaryData getHash(BinaryDataRef header);
+
+   //always the portable Salsa20/8, for comparison against the SIMD one
+   void hashScalar(const uint8_t* header, uint8_t* out);
+
+   //the header's scrypt hash meets the target of its nBits
+   bool checkHeader(BinaryDataRef header);
+
+   static bool hasSIMD(void);
+
+   //Checks a batch of headers over the pool, a contiguous slice per core.
+   //Returns one flag per header, 1 if its proof of work is valid.
+   //maxTasks caps the slices, 0 picks the core count.
+   static std::vector<uint8_t> checkHeaders(
+      const std::vector<BinaryDataRef>& headers, ThreadPool& pool,
+      unsigned maxTasks = 0);
+};
+
+#endif
+// kate: indent-width 3; replace-tabs on;
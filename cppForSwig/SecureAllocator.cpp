@@ -0,0 +1,286 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2011-2015, Armory Technologies, Inc.                        //
+//  Distributed under the GNU Affero General Public License (AGPL v3)         //
+//  See LICENSE or http://www.gnu.org/licenses/agpl.html                      //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+#include "SecureAllocator.h"
+#include "log.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+//thread_local is missing from older MSVC, its own keyword does for a POD
+#if defined(_MSC_VER) && _MSC_VER < 1900
+static __declspec(thread) unsigned secureScopeDepth = 0;
+#else
+static thread_local unsigned secureScopeDepth = 0;
+#endif
+
+const size_t SecureMemoryPool::ARENA_SIZE;
+const size_t SecureMemoryPool::RESERVED_SIZE;
+const size_t SecureMemoryPool::MIN_CLASS_SIZE;
+const unsigned SecureMemoryPool::CLASS_COUNT;
+const size_t SecureMemoryPool::MAX_CLASS_SIZE;
+
+atomic<uintptr_t> SecureMemoryPool::begin_(0);
+atomic<uintptr_t> SecureMemoryPool::end_(0);
+
+////////////////////////////////////////////////////////////////////////////////
+SecureAllocScope::SecureAllocScope(void)
+{
+   ++secureScopeDepth;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+SecureAllocScope::~SecureAllocScope(void)
+{
+   --secureScopeDepth;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool SecureMemoryPool::inSecureScope(void)
+{
+   return secureScopeDepth > 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+SecureMemoryPool& SecureMemoryPool::getGlobal(void)
+{
+   //leaked on purpose, like the arenas
+   static SecureMemoryPool* pool = [](void)->SecureMemoryPool*
+   {
+      auto newPool = new SecureMemoryPool();
+#ifndef _WIN32
+      pthread_atfork(lockForFork, unlockAfterFork, unlockAfterFork);
+#endif
+      return newPool;
+   }();
+
+   return *pool;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SecureMemoryPool::lockForFork(void)
+{
+   getGlobal().mu_.lock();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SecureMemoryPool::unlockAfterFork(void)
+{
+   getGlobal().mu_.unlock();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned SecureMemoryPool::getSizeClass(size_t size)
+{
+   unsigned sizeClass = 0;
+   while ((MIN_CLASS_SIZE << sizeClass) < size)
+      ++sizeClass;
+
+   return sizeClass;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SecureMemoryPool::wipe(void* ptr, size_t size)
+{
+#ifdef _WIN32
+   SecureZeroMemory(ptr, size);
+#else
+   memset(ptr, 0, size);
+
+   //keeps the memset from being optimized away
+   __asm__ __volatile__("" : : "r"(ptr) : "memory");
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool SecureMemoryPool::reserve(void)
+{
+   //address space only, arenas are committed as they are carved
+#ifdef _WIN32
+   void* ptr = VirtualAlloc(
+      nullptr, RESERVED_SIZE, MEM_RESERVE, PAGE_NOACCESS);
+   if (ptr == nullptr)
+      return false;
+#else
+   int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+   flags |= MAP_NORESERVE;
+#endif
+   void* ptr = mmap(nullptr, RESERVED_SIZE, PROT_NONE, flags, -1, 0);
+   if (ptr == MAP_FAILED)
+      return false;
+#endif
+
+   reserved_ = (uint8_t*)ptr;
+   stats_.reservedBytes_ = RESERVED_SIZE;
+
+   end_.store((uintptr_t)reserved_ + RESERVED_SIZE, memory_order_release);
+   begin_.store((uintptr_t)reserved_, memory_order_release);
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool SecureMemoryPool::addArena(unsigned sizeClass)
+{
+   if (reserved_ == nullptr)
+   {
+      if (reserveFailed_)
+         return false;
+
+      if (!reserve())
+      {
+         reserveFailed_ = true;
+         LOGERR << "Failed to reserve " << RESERVED_SIZE <<
+            " bytes for secure buffers, they will come from the heap";
+         return false;
+      }
+   }
+
+   if (carved_ + ARENA_SIZE > RESERVED_SIZE)
+      return false;
+
+   uint8_t* arena = reserved_ + carved_;
+
+#ifdef _WIN32
+   if (VirtualAlloc(arena, ARENA_SIZE, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+      return false;
+
+   bool locked = VirtualLock(arena, ARENA_SIZE) != 0;
+#else
+   if (mprotect(arena, ARENA_SIZE, PROT_READ | PROT_WRITE) != 0)
+      return false;
+
+#ifdef MADV_DONTDUMP
+   //keep keys out of core dumps too
+   madvise(arena, ARENA_SIZE, MADV_DONTDUMP);
+#endif
+
+   bool locked = mlock(arena, ARENA_SIZE) == 0;
+#endif
+
+   //an unlocked arena is still used, as unlocked heap buffers were before
+   if (!locked)
+   {
+      if (stats_.lockFailures_ == 0)
+      {
+         LOGWARN << "Could not lock secure buffer arena in RAM, check "
+            "RLIMIT_MEMLOCK (ulimit -l)";
+      }
+      ++stats_.lockFailures_;
+   }
+
+   carved_ += ARENA_SIZE;
+   ++stats_.arenas_;
+   stats_.arenaBytes_ += ARENA_SIZE;
+
+   arenaPos_[sizeClass] = arena;
+   arenaEnd_[sizeClass] = arena + ARENA_SIZE;
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void* SecureMemoryPool::allocate(size_t size)
+{
+   unique_lock<mutex> lock(mu_);
+
+   if (!enabled_)
+   {
+      ++stats_.unpooled_;
+      return nullptr;
+   }
+
+   if (size > MAX_CLASS_SIZE)
+   {
+      ++stats_.oversized_;
+      return nullptr;
+   }
+
+   const unsigned sizeClass = getSizeClass(size);
+   const size_t classSize = MIN_CLASS_SIZE << sizeClass;
+
+   void* ptr = nullptr;
+   if (freeLists_[sizeClass] != nullptr)
+   {
+      FreeBuffer* freeBuffer = freeLists_[sizeClass];
+      freeLists_[sizeClass] = freeBuffer->next_;
+
+      //the link was the only thing written to it since it was wiped
+      freeBuffer->next_ = nullptr;
+      ptr = freeBuffer;
+   }
+   else
+   {
+      if (arenaPos_[sizeClass] == arenaEnd_[sizeClass] &&
+          !addArena(sizeClass))
+      {
+         ++stats_.exhausted_;
+         return nullptr;
+      }
+
+      ptr = arenaPos_[sizeClass];
+      arenaPos_[sizeClass] += classSize;
+   }
+
+   ++stats_.allocs_;
+   ++stats_.buffersInUse_;
+   stats_.bytesInUse_ += classSize;
+   if (stats_.bytesInUse_ > stats_.peakBytesInUse_)
+      stats_.peakBytesInUse_ = stats_.bytesInUse_;
+
+   return ptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SecureMemoryPool::deallocate(void* ptr, size_t size)
+{
+   const unsigned sizeClass = getSizeClass(size);
+   const size_t classSize = MIN_CLASS_SIZE << sizeClass;
+
+   //outside the lock, the buffer is ours alone until it is on the list
+   wipe(ptr, classSize);
+
+   unique_lock<mutex> lock(mu_);
+
+   FreeBuffer* freeBuffer = (FreeBuffer*)ptr;
+   freeBuffer->next_ = freeLists_[sizeClass];
+   freeLists_[sizeClass] = freeBuffer;
+
+   ++stats_.frees_;
+   --stats_.buffersInUse_;
+   stats_.bytesInUse_ -= classSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void SecureMemoryPool::setEnabled(bool enabled)
+{
+   unique_lock<mutex> lock(mu_);
+   enabled_ = enabled;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool SecureMemoryPool::isEnabled(void) const
+{
+   unique_lock<mutex> lock(mu_);
+   return enabled_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+SecurePoolStats SecureMemoryPool::getStats(void) const
+{
+   unique_lock<mutex> lock(mu_);
+   return stats_;
+}
+
+// kate: indent-width 3; replace-tabs on;
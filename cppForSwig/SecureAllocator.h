@@ -0,0 +1,191 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2011-2015, Armory Technologies, Inc.                        //
+//  Distributed under the GNU Affero General Public License (AGPL v3)         //
+//  See LICENSE or http://www.gnu.org/licenses/agpl.html                      //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+#ifndef SECUREALLOCATOR_H
+#define SECUREALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <new>
+
+////////////////////////////////////////////////////////////////////////////////
+// Backing store of SecureBinaryData. Locking and unlocking the pages of each
+// buffer costs a syscall every time, and small buffers share pages, so that
+// unlocking one unlocks its neighbours too. Instead, arenas are carved out of
+// an address range reserved once, page locked as they are handed out and
+// never given back. Each arena serves a single size class, freed buffers are
+// wiped and go on the free list of their class.
+//
+// BinaryData allocates through SecureAwareAllocator, which takes from the
+// pool within a SecureAllocScope only, and gives back to the pool whatever
+// lies in its range. Buffers past the largest class, or past the reserved
+// range, come from the heap and SecureBinaryData locks their pages itself.
+////////////////////////////////////////////////////////////////////////////////
+struct SecurePoolStats
+{
+   //address space set aside for arenas, and what of it was carved
+   uint64_t reservedBytes_ = 0;
+   uint64_t arenaBytes_ = 0;
+   uint32_t arenas_ = 0;
+
+   //arenas that could not be page locked, RLIMIT_MEMLOCK usually
+   uint32_t lockFailures_ = 0;
+
+   //by size class, not requested size
+   uint64_t bytesInUse_ = 0;
+   uint64_t peakBytesInUse_ = 0;
+   uint64_t buffersInUse_ = 0;
+   uint64_t allocs_ = 0;
+   uint64_t frees_ = 0;
+
+   //secure allocations left to the heap: too large, no more room, and
+   //with the pool disabled
+   uint64_t oversized_ = 0;
+   uint64_t exhausted_ = 0;
+   uint64_t unpooled_ = 0;
+};
+
+class SecureMemoryPool
+{
+public:
+   static const size_t ARENA_SIZE = 64 * 1024;
+   static const size_t RESERVED_SIZE = 64 * 1024 * 1024;
+
+   //16 to 4096 bytes, in powers of 2
+   static const size_t MIN_CLASS_SIZE = 16;
+   static const unsigned CLASS_COUNT = 9;
+   static const size_t MAX_CLASS_SIZE = MIN_CLASS_SIZE << (CLASS_COUNT - 1);
+
+private:
+   struct FreeBuffer
+   {
+      FreeBuffer* next_;
+   };
+
+   //the reserved range, checked on every BinaryData deallocation
+   static std::atomic<uintptr_t> begin_;
+   static std::atomic<uintptr_t> end_;
+
+   mutable std::mutex mu_;
+   uint8_t* reserved_ = nullptr;
+   bool reserveFailed_ = false;
+   size_t carved_ = 0;
+   bool enabled_ = true;
+
+   FreeBuffer* freeLists_[CLASS_COUNT] = {};
+   uint8_t* arenaPos_[CLASS_COUNT] = {};
+   uint8_t* arenaEnd_[CLASS_COUNT] = {};
+
+   SecurePoolStats stats_;
+
+private:
+   SecureMemoryPool(void) {}
+
+   static unsigned getSizeClass(size_t size);
+   static void wipe(void* ptr, size_t size);
+
+   bool reserve(void);
+   bool addArena(unsigned sizeClass);
+
+   static void lockForFork(void);
+   static void unlockAfterFork(void);
+
+public:
+   //never destroyed, buffers may be freed during static destruction
+   static SecureMemoryPool& getGlobal(void);
+
+   static bool owns(const void* ptr)
+   {
+      uintptr_t p = (uintptr_t)ptr;
+      return p >= begin_.load(std::memory_order_acquire) &&
+         p < end_.load(std::memory_order_acquire);
+   }
+
+   //true within a SecureAllocScope on this thread
+   static bool inSecureScope(void);
+
+   //nullptr when the heap has to serve it
+   void* allocate(size_t size);
+
+   //ptr has to be owned by the pool, it is wiped before reuse
+   void deallocate(void* ptr, size_t size);
+
+   //disabled, new secure buffers come from the heap, as they did before
+   //the pool. Buffers already in the pool go back to it
+   void setEnabled(bool enabled);
+   bool isEnabled(void) const;
+
+   SecurePoolStats getStats(void) const;
+
+   SecureMemoryPool(const SecureMemoryPool&) = delete;
+   SecureMemoryPool& operator=(const SecureMemoryPool&) = delete;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// BinaryData allocations made on this thread while one of these is alive
+// come from the pool. Scopes nest.
+class SecureAllocScope
+{
+public:
+   SecureAllocScope(void);
+   ~SecureAllocScope(void);
+
+   SecureAllocScope(const SecureAllocScope&) = delete;
+   SecureAllocScope& operator=(const SecureAllocScope&) = delete;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+template<typename T> class SecureAwareAllocator
+{
+public:
+   typedef T value_type;
+
+   SecureAwareAllocator(void) {}
+   template<typename U>
+   SecureAwareAllocator(const SecureAwareAllocator<U>&) {}
+
+   T* allocate(size_t n)
+   {
+      if (SecureMemoryPool::inSecureScope())
+      {
+         void* ptr = SecureMemoryPool::getGlobal().allocate(n * sizeof(T));
+         if (ptr != nullptr)
+            return static_cast<T*>(ptr);
+      }
+
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+   }
+
+   void deallocate(T* ptr, size_t n)
+   {
+      if (SecureMemoryPool::owns(ptr))
+      {
+         SecureMemoryPool::getGlobal().deallocate(ptr, n * sizeof(T));
+         return;
+      }
+
+      ::operator delete(ptr);
+   }
+};
+
+template<typename T, typename U>
+bool operator==(const SecureAwareAllocator<T>&, const SecureAwareAllocator<U>&)
+{
+   return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const SecureAwareAllocator<T>&, const SecureAwareAllocator<U>&)
+{
+   return false;
+}
+
+#endif
+
+// kate: indent-width 3; replace-tabs on;
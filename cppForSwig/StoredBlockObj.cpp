@@ -25,6 +25,15 @@ BinaryData StoredDBInfo::getDBKey(void)
    return dbinfokey;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+BinaryData StoredDBInfo::getScanWatermarkKey(void)
+{
+   BinaryWriter bw(2);
+   bw.put_uint8_t((uint8_t)DB_PREFIX_DBINFO);
+   bw.put_uint8_t(0x01);
+   return bw.getData();
+}
+
 /////////////////////////////////////////////////////////////////////////////
 void StoredDBInfo::unserializeDBValue(BinaryRefReader & brr)
 {
@@ -45,8 +54,17 @@ void StoredDBInfo::unserializeDBValue(BinaryRefReader & brr)
    armoryType_ = (ARMORY_DB_TYPE)bitunpack.getBits(4);
    pruneType_  = (DB_PRUNE_TYPE) bitunpack.getBits(4);
 
-   if (brr.getSizeRemaining() == 32)
+   //the optional hashes are written in order, a blank one as zeroes if a
+   //later one is set
+   if (brr.getSizeRemaining() >= 32)
+   {
       brr.get_BinaryData(topScannedBlkHash_, 32);
+      if (topScannedBlkHash_ == BtcUtils::EmptyHash_)
+         topScannedBlkHash_.clear();
+   }
+
+   if (brr.getSizeRemaining() >= 32)
+      brr.get_BinaryData(powCheckedBlkHash_, 32);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -63,7 +81,15 @@ void StoredDBInfo::serializeDBValue(BinaryWriter & bw ) const
    bw.put_uint32_t(appliedToHgt_); // top blk height
    bw.put_BinaryData(topBlkHash_);
 
-   if (topScannedBlkHash_.getSize())
+   if (powCheckedBlkHash_.getSize())
+   {
+      if (topScannedBlkHash_.getSize())
+         bw.put_BinaryData(topScannedBlkHash_);
+      else
+         bw.put_BinaryData(BtcUtils::EmptyHash_);
+      bw.put_BinaryData(powCheckedBlkHash_);
+   }
+   else if (topScannedBlkHash_.getSize())
       bw.put_BinaryData(topScannedBlkHash_);
 }
 
@@ -1203,7 +1229,7 @@ TxOut StoredTxOut::getTxOutCopy(void) const
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-const BinaryData& StoredTxOut::getScrAddress(void) const
+const BinaryData& StoredTxOut::getScrAddress(Hash160Cache* cache) const
 {
    if (scrAddr_.getSize() > 0)
       return scrAddr_;
@@ -1211,7 +1237,8 @@ const BinaryData& StoredTxOut::getScrAddress(void) const
    BinaryRefReader brr(dataCopy_);
    brr.advance(8);
    uint32_t scrsz = (uint32_t)brr.get_var_int();
-   scrAddr_ = BtcUtils::getTxOutScrAddr(brr.get_BinaryDataRef(scrsz));
+   scrAddr_ = BtcUtils::getTxOutScrAddr(brr.get_BinaryDataRef(scrsz),
+      TXOUT_SCRIPT_NONSTANDARD, cache);
 
    return scrAddr_;
 }
@@ -1293,8 +1320,12 @@ void StoredScriptHistory::unserializeDBValue(BinaryRefReader & brr)
    (void)pruneType;
    SCRIPT_UTXO_TYPE txoListType = (SCRIPT_UTXO_TYPE) bitunpack.getBits(2);
    (void)txoListType;
+   followsScanWatermark_ = bitunpack.getBit();
 
    alreadyScannedUpToBlk_ = brr.get_uint32_t();
+   scanGeneration_ = 0;
+   if (followsScanWatermark_)
+      scanGeneration_ = brr.get_uint32_t();
    totalTxioCount_ = brr.get_var_int();
 
    // We shouldn't end up with empty SSH's, but should catch it just in case
@@ -1315,10 +1346,13 @@ void StoredScriptHistory::serializeDBValue(BinaryWriter & bw,
    bitpack.putBits((uint16_t)dbType,                  4);
    bitpack.putBits((uint16_t)pruneType,               2);
    bitpack.putBits((uint16_t)SCRIPT_UTXO_VECTOR,      2);
+   bitpack.putBit(followsScanWatermark_);
    bw.put_BitPacker(bitpack);
 
    // 
    bw.put_uint32_t(alreadyScannedUpToBlk_); 
+   if (followsScanWatermark_)
+      bw.put_uint32_t(scanGeneration_);
    bw.put_var_int(totalTxioCount_); 
    bw.put_uint64_t(totalUnspent_);
 }
@@ -1608,6 +1642,14 @@ void StoredSubHistory::unserializeDBValue(BinaryRefReader & brr)
    BinaryData fullTxKey(8);
    hgtX_.copyTo(fullTxKey.getPtr());
 
+   utxoCount_ = UINT32_MAX;
+   if (brr.getSizeRemaining() > 0 && 
+       *brr.getCurrPtr() == SUBSSH_UTXOCOUNT_MARKER)
+   {
+      brr.advance(1);
+      utxoCount_ = (uint32_t)(brr.get_var_int());
+   }
+
    txioCount_ = (uint32_t)(brr.get_var_int());
    for (uint32_t i = 0; i<txioCount_; i++)
    {
@@ -1639,6 +1681,9 @@ void StoredSubHistory::unserializeDBValue(BinaryRefReader & brr)
          //4 bytes entry
          brr.get_BinaryData(fullTxKey.getPtr() + 4, 4);
          txio.setTxIn(fullTxKey);
+
+         //only written spent if the TxIn was in the main branch
+         txio.setSpentInMain(true);
       }
 
       txio.setTxOutFromSelf(isFromSelf);
@@ -1660,23 +1705,62 @@ void StoredSubHistory::getSummary(BinaryRefReader & brr)
       return;
    }
 
-   BinaryData fullTxKey(8);
-   hgtX_.copyTo(fullTxKey.getPtr());
+   utxoCount_ = UINT32_MAX;
+   if (brr.getSizeRemaining() > 0 &&
+       *brr.getCurrPtr() == SUBSSH_UTXOCOUNT_MARKER)
+   {
+      brr.advance(1);
+      utxoCount_ = (uint32_t)(brr.get_var_int());
+   }
 
    txioCount_ = (uint32_t)(brr.get_var_int());
 }
 
+////////////////////////////////////////////////////////////////////////////////
+uint32_t StoredSubHistory::peekUTXOCount(BinaryDataRef dbValue)
+{
+   if (dbValue.getSize() == 0 || dbValue[0] != SUBSSH_UTXOCOUNT_MARKER)
+      return UINT32_MAX;
+
+   BinaryRefReader brr(dbValue);
+   brr.advance(1);
+   return (uint32_t)(brr.get_var_int());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 void StoredSubHistory::serializeDBValue(BinaryWriter & bw, 
                                         LMDBBlockDatabase *db, 
                                         ARMORY_DB_TYPE dbType, 
                                         DB_PRUNE_TYPE pruneType) const
 {
+   //lets range queries skip fully spent sub-histories
+   uint32_t utxoCount = 0;
+   for (const auto& txioPair : txioMap_)
+   {
+      if (txioPair.second.isUTXO())
+         utxoCount++;
+   }
+
+   bw.put_uint8_t(SUBSSH_UTXOCOUNT_MARKER);
+   bw.put_var_int(utxoCount);
    bw.put_var_int(txioMap_.size());
    for(const auto& txioPair : txioMap_)
    {
       TxIOPair const & txio = txioPair.second;
-      bool isSpent = txio.hasTxInInMain(db);
+
+      //the BlockWriteBatcher resolves spentness as it modifies txios, only
+      //txios built elsewhere still need the TxIn's block looked up
+      bool isSpent;
+      if (txio.isSpentInMainResolved())
+      {
+         isSpent = txio.isSpentInMain();
+      }
+      else
+      {
+         if (db == nullptr)
+            throw runtime_error("txio spentness is not resolved");
+         isSpent = txio.hasTxInInMain(db);
+      }
 
       // If spent and only maintaining a pruned DB, skip it
       if(isSpent)
@@ -1702,7 +1786,7 @@ void StoredSubHistory::serializeDBValue(BinaryWriter & bw,
       BitPacker<uint8_t> bitpack;
       bitpack.putBit(txio.isTxOutFromSelf());
       bitpack.putBit(txio.isFromCoinbase());
-      bitpack.putBit(txio.hasTxInInMain(db));
+      bitpack.putBit(isSpent);
       bitpack.putBit(txio.isMultisig());
       bitpack.putBit(txio.isUTXO());
       bw.put_BitPacker(bitpack);
@@ -2333,6 +2417,610 @@ void StoredHeadHgtList::unserializeDBKey(BinaryDataRef key)
    height_ = brr.get_uint32_t(BIGENDIAN);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// StoredBlockFilter
+////////////////////////////////////////////////////////////////////////////////
+class GolombRiceWriter
+{
+public:
+   void putBits(uint64_t value, uint8_t nBits)
+   {
+      while (nBits > 0)
+      {
+         if (bitPos_ == 0)
+            bytes_.push_back(0);
+
+         uint8_t avail = 8 - bitPos_;
+         uint8_t take = (nBits < avail ? nBits : avail);
+         uint8_t chunk = 
+            (uint8_t)((value >> (nBits - take)) & ((1 << take) - 1));
+
+         bytes_.back() |= chunk << (avail - take);
+         bitPos_ = (bitPos_ + take) % 8;
+         nBits -= take;
+      }
+   }
+
+   void putDelta(uint64_t delta, uint8_t p)
+   {
+      //quotient in unary, terminated by a 0 bit
+      uint64_t quotient = delta >> p;
+      while (quotient > 0)
+      {
+         uint8_t nBits = (quotient < 32 ? (uint8_t)quotient : 32);
+         putBits(0xFFFFFFFFULL, nBits);
+         quotient -= nBits;
+      }
+      putBits(0, 1);
+
+      //remainder in p bits
+      putBits(delta, p);
+   }
+
+   vector<uint8_t> bytes_;
+
+private:
+   uint8_t bitPos_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+class GolombRiceReader
+{
+public:
+   GolombRiceReader(BinaryDataRef data) : data_(data) {}
+
+   uint64_t getBits(uint8_t nBits)
+   {
+      uint64_t value = 0;
+      while (nBits > 0)
+      {
+         if (bytePos_ >= data_.getSize())
+            throw runtime_error("GolombRiceReader: ran out of filter data");
+
+         uint8_t avail = 8 - bitPos_;
+         uint8_t take = (nBits < avail ? nBits : avail);
+         uint8_t chunk = (data_.getPtr()[bytePos_] >> (avail - take)) &
+            ((1 << take) - 1);
+
+         value = (value << take) | chunk;
+         bitPos_ += take;
+         nBits -= take;
+
+         if (bitPos_ == 8)
+         {
+            bitPos_ = 0;
+            ++bytePos_;
+         }
+      }
+
+      return value;
+   }
+
+   uint64_t getDelta(uint8_t p)
+   {
+      uint64_t quotient = 0;
+      while (getBits(1) == 1)
+         ++quotient;
+
+      return (quotient << p) | getBits(p);
+   }
+
+private:
+   BinaryDataRef data_;
+   size_t bytePos_ = 0;
+   uint8_t bitPos_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Maps a 64bit hash uniformly onto [0, range) as (hash * range) >> 64. Unlike
+// a modulo, this preserves ordering, so a sorted query set stays sorted once 
+// mapped against filters of any size.
+static uint64_t mapHashToRange(uint64_t hash, uint64_t range)
+{
+   uint64_t hashHi = hash >> 32, hashLo = hash & 0xFFFFFFFF;
+   uint64_t rangeHi = range >> 32, rangeLo = range & 0xFFFFFFFF;
+
+   uint64_t lolo = hashLo * rangeLo;
+   uint64_t hilo = hashHi * rangeLo;
+   uint64_t lohi = hashLo * rangeHi;
+   uint64_t hihi = hashHi * rangeHi;
+
+   uint64_t cross = (lolo >> 32) + (hilo & 0xFFFFFFFF) + lohi;
+   return hihi + (hilo >> 32) + (cross >> 32);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t StoredBlockFilter::getElementHash(BinaryDataRef element)
+{
+   //FNV-1a followed by the murmur3 finalizer. Elements are scrAddrs and tx
+   //hashes, which are mostly hash outputs already, this only needs to fold 
+   //them into 64 bits with a good spread.
+   uint64_t hash = 0xcbf29ce484222325ULL;
+   const uint8_t* ptr = element.getPtr();
+   for (size_t i = 0; i < element.getSize(); i++)
+   {
+      hash ^= ptr[i];
+      hash *= 0x100000001b3ULL;
+   }
+
+   hash ^= hash >> 33;
+   hash *= 0xff51afd7ed558ccdULL;
+   hash ^= hash >> 33;
+   hash *= 0xc4ceb9fe1a85ec53ULL;
+   hash ^= hash >> 33;
+
+   return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockFilter::createFromRawBlock(BinaryDataRef rawBlock)
+{
+   vector<uint64_t> hashes;
+
+   BinaryRefReader brr(rawBlock);
+   if (brr.getSizeRemaining() < HEADER_SIZE)
+      throw BlockDeserializingException();
+   brr.advance(HEADER_SIZE);
+
+   uint32_t nTx = (uint32_t)brr.get_var_int();
+   vector<size_t> offsetsIn, offsetsOut;
+
+   for (uint32_t tx = 0; tx < nTx; tx++)
+   {
+      const uint8_t* txPtr = brr.getCurrPtr();
+      size_t txSize = BtcUtils::TxCalcLength(
+         txPtr, brr.getSizeRemaining(), &offsetsIn, &offsetsOut);
+
+      if (txSize > brr.getSizeRemaining())
+         throw BlockDeserializingException();
+
+      //spent outpoints, skip coinbase
+      for (uint32_t iin = 0; iin < offsetsIn.size() - 1; iin++)
+      {
+         BinaryDataRef opHash(txPtr + offsetsIn[iin], 32);
+         if (opHash == BtcUtils::EmptyHash_)
+            continue;
+
+         hashes.push_back(getElementHash(opHash));
+      }
+
+      //scrAddr of each TxOut
+      for (uint32_t iout = 0; iout < offsetsOut.size() - 1; iout++)
+      {
+         uint32_t viLen;
+         const uint8_t* scrPtr = txPtr + offsetsOut[iout] + 8;
+         uint32_t scrLen = (uint32_t)BtcUtils::readVarInt(scrPtr, &viLen);
+
+         BinaryDataRef script(scrPtr + viLen, scrLen);
+         uint8_t scrAddr[21];
+         if (BtcUtils::getTxOutScrAddrNoCopy(script, scrAddr))
+         {
+            hashes.push_back(getElementHash(BinaryDataRef(scrAddr, 21)));
+            continue;
+         }
+
+         //multisig
+         hashes.push_back(getElementHash(
+            BtcUtils::getTxOutScrAddr(script).getRef()));
+      }
+
+      brr.advance(txSize);
+   }
+
+   createFromElementHashes(hashes);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockFilter::createFromElementHashes(vector<uint64_t>& hashes)
+{
+   sort(hashes.begin(), hashes.end());
+   hashes.erase(unique(hashes.begin(), hashes.end()), hashes.end());
+
+   numElements_ = hashes.size();
+   uint64_t range = numElements_ * GCS_M;
+
+   GolombRiceWriter writer;
+   uint64_t lastValue = 0;
+   for (auto hash : hashes)
+   {
+      uint64_t value = mapHashToRange(hash, range);
+      writer.putDelta(value - lastValue, GCS_P);
+      lastValue = value;
+   }
+
+   filterData_.copyFrom(writer.bytes_.data(), writer.bytes_.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool StoredBlockFilter::matchAny(const set<uint64_t>& queryHashes) const
+{
+   if (numElements_ == 0 || queryHashes.size() == 0)
+      return false;
+
+   uint64_t range = numElements_ * GCS_M;
+   GolombRiceReader reader(filterData_.getRef());
+
+   auto queryIter = queryHashes.begin();
+   uint64_t queryValue = mapHashToRange(*queryIter, range);
+   uint64_t filterValue = reader.getDelta(GCS_P);
+   uint32_t decoded = 1;
+
+   //both sides are sorted, walk them in lockstep
+   while (1)
+   {
+      if (filterValue == queryValue)
+         return true;
+
+      if (filterValue < queryValue)
+      {
+         if (decoded == numElements_)
+            return false;
+
+         filterValue += reader.getDelta(GCS_P);
+         ++decoded;
+      }
+      else
+      {
+         if (++queryIter == queryHashes.end())
+            return false;
+
+         queryValue = mapHashToRange(*queryIter, range);
+      }
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockFilter::unserializeDBValue(BinaryRefReader & brr)
+{
+   numElements_ = (uint32_t)brr.get_var_int();
+   brr.get_BinaryData(filterData_, brr.getSizeRemaining());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockFilter::serializeDBValue(BinaryWriter & bw) const
+{
+   bw.put_var_int(numElements_);
+   bw.put_BinaryData(filterData_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockFilter::unserializeDBValue(BinaryDataRef bdr)
+{
+   BinaryRefReader brr(bdr);
+   unserializeDBValue(brr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredBlockFilter::serializeDBValue(void) const
+{
+   BinaryWriter bw;
+   serializeDBValue(bw);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredBlockFilter::getDBKey(bool withPrefix) const
+{
+   BinaryWriter bw(5);
+   if (withPrefix)
+      bw.put_uint8_t((uint8_t)DB_PREFIX_BLKFILTER);
+   bw.put_BinaryData(DBUtils::heightAndDupToHgtx(height_, duplicateID_));
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockFilter::unserializeDBKey(BinaryDataRef key)
+{
+   BinaryRefReader brr(key);
+   if (key.getSize() == 5)
+   {
+      uint8_t prefix = brr.get_uint8_t();
+      if (prefix != DB_PREFIX_BLKFILTER)
+      {
+         LOGERR << "Unserialized BLKFILTER key but wrong prefix";
+         return;
+      }
+   }
+
+   BinaryData hgtx = brr.get_BinaryData(4);
+   height_ = DBUtils::hgtxToHeight(hgtx);
+   duplicateID_ = DBUtils::hgtxToDupID(hgtx);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredScanCheckpoint::getDBKey(void)
+{
+   BinaryWriter bw(1);
+   bw.put_uint8_t((uint8_t)DB_PREFIX_SCANCHKPT);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredScanCheckpoint::unserializeDBValue(BinaryRefReader & brr)
+{
+   if (brr.getSizeRemaining() < 49)
+   {
+      type_ = UINT8_MAX;
+      return;
+   }
+
+   type_            = brr.get_uint8_t();
+   startBlock_      = brr.get_uint32_t();
+   endBlock_        = brr.get_uint32_t();
+   committedHeight_ = brr.get_uint32_t();
+   utxoCount_       = brr.get_uint32_t();
+   brr.get_BinaryData(committedHash_, 32);
+
+   uint32_t fpSize = (uint32_t)brr.get_var_int();
+   brr.get_BinaryData(scrAddrFingerprint_, fpSize);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredScanCheckpoint::serializeDBValue(BinaryWriter & bw) const
+{
+   bw.put_uint8_t(type_);
+   bw.put_uint32_t(startBlock_);
+   bw.put_uint32_t(endBlock_);
+   bw.put_uint32_t(committedHeight_);
+   bw.put_uint32_t(utxoCount_);
+
+   if (committedHash_.getSize() == 32)
+      bw.put_BinaryData(committedHash_);
+   else
+      bw.put_BinaryData(BtcUtils::EmptyHash_);
+
+   bw.put_var_int(scrAddrFingerprint_.getSize());
+   bw.put_BinaryData(scrAddrFingerprint_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredScanCheckpoint::unserializeDBValue(BinaryDataRef bdr)
+{
+   BinaryRefReader brr(bdr);
+   unserializeDBValue(brr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredScanCheckpoint::serializeDBValue(void) const
+{
+   BinaryWriter bw;
+   serializeDBValue(bw);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredScanCheckpoint::getScrAddrFingerprint(
+   const set<BinaryData>& scrAddrSet)
+{
+   if (scrAddrSet.size() == 0)
+      return BinaryData(0);
+
+   BinaryWriter bw;
+   for (auto& scrAddr : scrAddrSet)
+   {
+      bw.put_var_int(scrAddr.getSize());
+      bw.put_BinaryData(scrAddr);
+   }
+
+   return BtcUtils::getHash256(bw.getData());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredLedgerCache::getDBKeyPrefix(BinaryDataRef walletID)
+{
+   BinaryWriter bw;
+   bw.put_uint8_t((uint8_t)DB_PREFIX_LEDGERCACHE);
+   bw.put_var_int(walletID.getSize());
+   bw.put_BinaryData(walletID);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredLedgerCache::getDBKey(void) const
+{
+   BinaryWriter bw;
+   bw.put_BinaryData(getDBKeyPrefix(walletID_));
+   bw.put_BinaryData(scrAddrFingerprint_);
+   bw.put_uint32_t(height_, BE);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredLedgerCache::unserializeDBValue(BinaryRefReader & brr)
+{
+   if (brr.getSizeRemaining() < 32)
+   {
+      height_ = UINT32_MAX;
+      return;
+   }
+
+   brr.get_BinaryData(blockHash_, 32);
+   brr.get_BinaryData(ledgerData_, brr.getSizeRemaining());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredLedgerCache::serializeDBValue(BinaryWriter & bw) const
+{
+   bw.put_BinaryData(blockHash_);
+   bw.put_BinaryData(ledgerData_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredLedgerCache::unserializeDBValue(BinaryDataRef bdr)
+{
+   BinaryRefReader brr(bdr);
+   unserializeDBValue(brr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredLedgerCache::serializeDBValue(void) const
+{
+   BinaryWriter bw;
+   serializeDBValue(bw);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredAddrSummary::getDBKey(BinaryDataRef scrAddr)
+{
+   BinaryWriter bw(scrAddr.getSize() + 1);
+   bw.put_uint8_t((uint8_t)DB_PREFIX_ADDRSUMMARY);
+   bw.put_BinaryData(scrAddr);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredAddrSummary::getStartHeightDBKey(void)
+{
+   return getDBKey(BinaryDataRef());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredAddrSummary::unserializeDBValue(BinaryRefReader & brr)
+{
+   if (brr.getSizeRemaining() < 8)
+   {
+      txioCount_ = 0;
+      return;
+   }
+
+   firstSeenHeight_ = brr.get_uint32_t();
+   lastSeenHeight_  = brr.get_uint32_t();
+   txioCount_       = brr.get_var_int();
+   unspentCount_    = brr.get_var_int();
+   unspentValue_    = brr.get_var_int();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredAddrSummary::serializeDBValue(BinaryWriter & bw) const
+{
+   bw.put_uint32_t(firstSeenHeight_);
+   bw.put_uint32_t(lastSeenHeight_);
+   bw.put_var_int(txioCount_);
+   bw.put_var_int(unspentCount_);
+   bw.put_var_int(unspentValue_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredAddrSummary::unserializeDBValue(BinaryDataRef bdr)
+{
+   BinaryRefReader brr(bdr);
+   unserializeDBValue(brr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredAddrSummary::serializeDBValue(void) const
+{
+   BinaryWriter bw;
+   serializeDBValue(bw);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredUtxo::getDBKey(BinaryDataRef hashAndId)
+{
+   BinaryWriter bw(hashAndId.getSize() + 1);
+   bw.put_uint8_t((uint8_t)DB_PREFIX_UTXO);
+   bw.put_BinaryData(hashAndId);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredUtxo::getStartHeightDBKey(void)
+{
+   return getDBKey(BinaryDataRef());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredUtxo::unserializeDBValue(BinaryRefReader & brr)
+{
+   if (brr.getSizeRemaining() < 16)
+   {
+      dbKey_.clear();
+      return;
+   }
+
+   dbKey_   = brr.get_BinaryData(8);
+   value_   = brr.get_uint64_t();
+   scrAddr_ = brr.get_BinaryData((uint32_t)brr.get_var_int());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredUtxo::serializeDBValue(BinaryWriter & bw) const
+{
+   bw.put_BinaryData(dbKey_);
+   bw.put_uint64_t(value_);
+   bw.put_var_int(scrAddr_.getSize());
+   bw.put_BinaryData(scrAddr_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredUtxo::unserializeDBValue(BinaryDataRef bdr)
+{
+   BinaryRefReader brr(bdr);
+   unserializeDBValue(brr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredUtxo::serializeDBValue(void) const
+{
+   BinaryWriter bw;
+   serializeDBValue(bw);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredBlockFilePos::getDBKey(BinaryDataRef hash)
+{
+   BinaryWriter bw(hash.getSize() + 1);
+   bw.put_uint8_t((uint8_t)DB_PREFIX_BLKFILEPOS);
+   bw.put_BinaryData(hash);
+   return bw.getData();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredBlockFilePos::getWatermarkDBKey(void)
+{
+   return getDBKey(BinaryDataRef());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockFilePos::unserializeDBValue(BinaryRefReader & brr)
+{
+   if (brr.getSizeRemaining() < 16)
+   {
+      fileNum_ = UINT32_MAX;
+      return;
+   }
+
+   fileNum_   = brr.get_uint32_t();
+   offset_    = brr.get_uint64_t();
+   blockSize_ = brr.get_uint32_t();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockFilePos::serializeDBValue(BinaryWriter & bw) const
+{
+   bw.put_uint32_t(fileNum_);
+   bw.put_uint64_t(offset_);
+   bw.put_uint32_t(blockSize_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void StoredBlockFilePos::unserializeDBValue(BinaryDataRef bdr)
+{
+   BinaryRefReader brr(bdr);
+   unserializeDBValue(brr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData StoredBlockFilePos::serializeDBValue(void) const
+{
+   BinaryWriter bw;
+   serializeDBValue(bw);
+   return bw.getData();
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 BLKDATA_TYPE DBUtils::readBlkDataKey( BinaryRefReader & brr,
@@ -2457,6 +3145,13 @@ string DBUtils::getPrefixName(DB_PREFIX pref)
       case DB_PREFIX_HEADHASH:  return string("HEADHASH"); 
       case DB_PREFIX_HEADHGT:   return string("HEADHGT"); 
       case DB_PREFIX_UNDODATA:  return string("UNDODATA"); 
+      case DB_PREFIX_BLKFILTER: return string("BLKFILTER"); 
+      case DB_PREFIX_SCANCHKPT: return string("SCANCHKPT"); 
+      case DB_PREFIX_ZCPARSE:   return string("ZCPARSE");
+      case DB_PREFIX_LEDGERCACHE: return string("LEDGERCACHE");
+      case DB_PREFIX_ADDRSUMMARY: return string("ADDRSUMMARY");
+      case DB_PREFIX_UTXO:      return string("UTXO");
+      case DB_PREFIX_BLKFILEPOS: return string("BLKFILEPOS");
       default:                  return string("<unknown>"); 
    }
 }
@@ -11,6 +11,7 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <set>
 #include "BinaryData.h"
 #include "BtcUtils.h"
 #include "BlockObj.h"
@@ -26,6 +27,10 @@ static const uint64_t UPDATE_BYTES_SSH    = 25;
 static const uint64_t UPDATE_BYTES_SUBSSH = 75;
 static const uint64_t UPDATE_BYTES_KEY    = 8;
 
+// Sub-SSH values open with this byte when they carry a UTXO count. A var_int
+// never starts with 0xFF for a txio count, so older values still parse
+static const uint8_t  SUBSSH_UTXOCOUNT_MARKER = 0xFF;
+
 enum BLKDATA_TYPE
 {
   NOT_BLKDATA,
@@ -45,7 +50,14 @@ enum DB_PREFIX
   DB_PREFIX_UNDODATA,
   DB_PREFIX_TRIENODES,
   DB_PREFIX_COUNT,
-  DB_PREFIX_ZCDATA
+  DB_PREFIX_ZCDATA,
+  DB_PREFIX_BLKFILTER,
+  DB_PREFIX_SCANCHKPT,
+  DB_PREFIX_ZCPARSE,
+  DB_PREFIX_LEDGERCACHE,
+  DB_PREFIX_ADDRSUMMARY,
+  DB_PREFIX_UTXO,
+  DB_PREFIX_BLKFILEPOS
 };
 
 // In ARMORY_DB_PARTIAL and LITE, we may not store full tx, but we will know 
@@ -221,6 +233,9 @@ public:
    bool isNull(void) { return !isInitialized(); }
 
    static BinaryData getDBKey(void);
+
+   //the main scrAddr filter's scan watermark, next to the SDBI in HISTORY
+   static BinaryData getScanWatermarkKey(void);
    
    void       unserializeDBValue(BinaryRefReader & brr);
    void         serializeDBValue(BinaryWriter &    bw ) const;
@@ -234,6 +249,7 @@ public:
    uint32_t        topBlkHgt_=0;
    BinaryData      topBlkHash_; //hash of last block commited
    BinaryData      topScannedBlkHash_; //commited to SSH
+   BinaryData      powCheckedBlkHash_; //HEADERS DB, see checkHeaderPoW
    uint32_t        appliedToHgt_=0; // only used in BLKDATA DB
    uint32_t        armoryVer_=ARMORY_DB_VERSION;
    ARMORY_DB_TYPE  armoryType_=ARMORY_DB_WHATEVER;
@@ -279,7 +295,8 @@ public:
    BinaryData    getSerializedTxOut(void) const;
    TxOut         getTxOutCopy(void) const;
 
-   const BinaryData& getScrAddress(void) const;
+   //cache speeds up the P2PK scrAddr, see Hash160Cache
+   const BinaryData& getScrAddress(Hash160Cache* cache = nullptr) const;
    BinaryDataRef     getScriptRef(void) const;
    uint64_t          getValue(void) const;
 
@@ -533,7 +550,7 @@ class StoredSubHistory
 public:
 
    StoredSubHistory(void) : uniqueKey_(0), hgtX_(0), height_(0), dupID_(0),
-                            txioCount_(0) 
+                            txioCount_(0), utxoCount_(UINT32_MAX)
    {
    }
                                
@@ -548,6 +565,10 @@ public:
    void       unserializeDBKey(BinaryDataRef key, bool withPrefix=true);
    void       getSummary(BinaryRefReader & brr);
 
+   // Number of UTXO flagged txios in a serialized value, without parsing 
+   // the txios. UINT32_MAX if the value predates the count
+   static uint32_t peekUTXOCount(BinaryDataRef dbValue);
+
    BinaryData    getDBKey(bool withPrefix=true) const;
    SCRIPT_PREFIX getScriptType(void) const;
    //uint64_t      getTxioCount(void) const {return (uint64_t)txioMap_.size();}
@@ -591,6 +612,7 @@ public:
       height_ = copy.height_;
       dupID_ = copy.dupID_;
       txioCount_ = copy.txioCount_;
+      utxoCount_ = copy.utxoCount_;
 
       //std::atomic types are copyable, and we do not copy
       //accessing_, as this flag is meant to signify 
@@ -606,6 +628,7 @@ public:
    uint32_t height_;
    uint8_t  dupID_;
    uint32_t txioCount_;
+   uint32_t utxoCount_;
 };
 
 
@@ -621,7 +644,9 @@ public:
                                version_(UINT32_MAX),
                                alreadyScannedUpToBlk_(0),
                                totalTxioCount_(0),
-                               totalUnspent_(0) {}
+                               totalUnspent_(0),
+                               followsScanWatermark_(false),
+                               scanGeneration_(0) {}
                                
 
    bool isInitialized(void) const { return uniqueKey_.getSize() > 0; }
@@ -653,12 +678,36 @@ public:
    void insertTxio(const TxIOPair& txio);
    void eraseTxio(const TxIOPair& txio);
 
+   //the height this SSH is scanned up to, given the main filter's scan 
+   //watermark (UINT32_MAX if there is none) and its generation
+   uint32_t getScannedUpTo(uint32_t watermark, uint32_t generation) const
+   {
+      if (!followsScanWatermark_ || watermark == UINT32_MAX ||
+          scanGeneration_ != generation)
+         return alreadyScannedUpToBlk_;
+      return watermark;
+   }
+
    BinaryData     uniqueKey_;  // includes the prefix byte!
    uint32_t       version_;
    uint32_t       alreadyScannedUpToBlk_;
    uint64_t       totalTxioCount_;
    uint64_t       totalUnspent_;
 
+   // SSHs of the main scrAddr filter aren't rewritten by every commit just
+   // to move alreadyScannedUpToBlk_ along. Once flagged, they are scanned up
+   // to the filter's watermark, stored with the SDBI, and only written when
+   // their history changes. SSHs that are behind it, like fresh side scan 
+   // merges, keep their own height until the next main scan commit.
+   //
+   // The flag only holds for the watermark generation it was written with.
+   // The main filter moves to a new generation each time it is loaded and
+   // when it drops a scrAddr, and its first commit rewrites the SSHs it
+   // tracks. SSHs of scrAddrs it no longer tracks keep an older generation,
+   // so they fall back to the height of their last write.
+   bool           followsScanWatermark_;
+   uint32_t       scanGeneration_;
+
    // If this SSH has only one TxIO (most of them), then we don't bother
    // with supplemental entries just to hold that one TxIO in the DB.
    // We always stored them in RAM using the StoredSubHistory 
@@ -768,6 +817,231 @@ public:
    uint8_t            preferredDup_;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// Golomb-Rice coded set of everything a block touches that a fullnode scan
+// cares about: the scrAddr of each TxOut and the tx hash of each spent 
+// OutPoint. Filters live in BLKDATA next to the raw block, keyed by hgtX.
+// A scan for a sparse set of scrAddrs tests the filter first and only pulls
+// the full block on a match. False positives are ~1/GCS_M per element, 
+// there are no false negatives.
+class StoredBlockFilter
+{
+public:
+   static const uint8_t  GCS_P = 19;
+   static const uint64_t GCS_M = 1ULL << GCS_P;
+
+   StoredBlockFilter(void) : height_(UINT32_MAX), duplicateID_(UINT8_MAX) {}
+
+   bool isInitialized(void) const { return height_ != UINT32_MAX; }
+   bool isNull(void) const { return !isInitialized(); }
+
+   //raw block, without the magic bytes and size prefix
+   void createFromRawBlock(BinaryDataRef rawBlock);
+   void createFromElementHashes(vector<uint64_t>& hashes);
+
+   void       unserializeDBValue(BinaryRefReader & brr);
+   void         serializeDBValue(BinaryWriter    & bw ) const;
+   void       unserializeDBValue(BinaryDataRef      bd);
+   BinaryData   serializeDBValue(void) const;
+   void       unserializeDBKey(BinaryDataRef key);
+
+   BinaryData getDBKey(bool withPrefix=true) const;
+
+   //queryHashes are the output of getElementHash for each searched item
+   bool matchAny(const set<uint64_t>& queryHashes) const;
+
+   static uint64_t getElementHash(BinaryDataRef element);
+
+   uint32_t   height_;
+   uint8_t    duplicateID_;
+   uint32_t   numElements_ = 0;
+   BinaryData filterData_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Progress of a scan, updated with each BlockWriteBatcher commit. Lives in 
+// the HISTORY DB, next to the SDBI it tracks, so that both are committed in
+// the same transaction, and is carried over history wipes. A rescan or 
+// rebuild that finds an unfinished checkpoint of its own kind, for the same
+// set of scrAddrs, resumes from the last commit instead of starting over.
+enum SCAN_CHECKPOINT_TYPE
+{
+   SCAN_CHECKPOINT_LOAD,
+   SCAN_CHECKPOINT_RESCAN,
+   SCAN_CHECKPOINT_REBUILD
+};
+
+class StoredScanCheckpoint
+{
+public:
+   StoredScanCheckpoint(void) {}
+
+   bool isInitialized(void) const { return type_ != UINT8_MAX; }
+   bool isNull(void) const { return !isInitialized(); }
+
+   static BinaryData getDBKey(void);
+
+   void       unserializeDBValue(BinaryRefReader & brr);
+   void         serializeDBValue(BinaryWriter    & bw ) const;
+   void       unserializeDBValue(BinaryDataRef      bd);
+   BinaryData   serializeDBValue(void) const;
+
+   //hash of the sorted scrAddr set, empty in supernode
+   static BinaryData getScrAddrFingerprint(const set<BinaryData>& scrAddrSet);
+
+   uint8_t    type_ = UINT8_MAX;
+   uint32_t   startBlock_ = 0;
+   uint32_t   endBlock_ = 0;
+   BinaryData scrAddrFingerprint_;
+
+   //last committed batch, UINT32_MAX until the first commit
+   uint32_t   committedHeight_ = UINT32_MAX;
+   BinaryData committedHash_;
+
+   //utxos held in the BWB cache as of the last commit. All of them were 
+   //flushed as stxos by that commit and are reloaded from SSH on resume
+   uint32_t   utxoCount_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// A wallet's ledger entries for one block, in HISTORY. Keyed by wallet ID, 
+// the fingerprint of the wallet's scrAddr set and the height, so that any 
+// page of history, whatever its bounds, is a run of these. Only valid while
+// blockHash_ is the main chain's hash at height_.
+//
+// The key made of the wallet ID alone holds the fingerprint the wallet's 
+// entries were last written with, so that they can be dropped when the set
+// changes.
+class StoredLedgerCache
+{
+public:
+   StoredLedgerCache(void) {}
+
+   bool isInitialized(void) const { return height_ != UINT32_MAX; }
+   bool isNull(void) const { return !isInitialized(); }
+
+   static BinaryData getDBKeyPrefix(BinaryDataRef walletID);
+   BinaryData getDBKey(void) const;
+
+   void       unserializeDBValue(BinaryRefReader & brr);
+   void         serializeDBValue(BinaryWriter    & bw ) const;
+   void       unserializeDBValue(BinaryDataRef      bd);
+   BinaryData   serializeDBValue(void) const;
+
+   BinaryData walletID_;
+   BinaryData scrAddrFingerprint_;
+   uint32_t   height_ = UINT32_MAX;
+   BinaryData blockHash_;
+
+   //entry count then the entries, see LedgerEntry::serialize
+   BinaryData ledgerData_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Supernode overview of a scrAddr's activity, in BLKDATA, keyed by scrAddr. 
+// Kept up to date by the BlockWriteBatcher as blocks are applied and undone,
+// so that an address lookup is a single get rather than a walk of its SSH.
+//
+// The key made of the prefix alone holds the height the index was started 
+// at. It only covers all activity if that is 0, a DB scanned before the 
+// index existed has to be rebuilt for it.
+class StoredAddrSummary
+{
+public:
+   StoredAddrSummary(void) {}
+
+   bool isInitialized(void) const { return txioCount_ != 0; }
+   bool isNull(void) const { return !isInitialized(); }
+
+   static BinaryData getDBKey(BinaryDataRef scrAddr);
+   static BinaryData getStartHeightDBKey(void);
+   BinaryData getDBKey(void) const { return getDBKey(scrAddr_); }
+
+   void       unserializeDBValue(BinaryRefReader & brr);
+   void         serializeDBValue(BinaryWriter    & bw ) const;
+   void       unserializeDBValue(BinaryDataRef      bd);
+   BinaryData   serializeDBValue(void) const;
+
+   BinaryData scrAddr_;
+   uint32_t   firstSeenHeight_ = UINT32_MAX;
+   uint32_t   lastSeenHeight_ = 0;
+
+   //same count as StoredScriptHistory::totalTxioCount_, a spent output 
+   //counts twice: at the TxOut and at the TxIn heights
+   uint64_t   txioCount_ = 0;
+   uint64_t   unspentCount_ = 0;
+   uint64_t   unspentValue_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Fullnode outpoint table, in HISTORY, keyed by the tx hash and TxOut index
+// of a tracked TxOut for as long as it is unspent. Kept up to date by the 
+// BlockWriteBatcher as blocks are applied and undone, so that a spend of an
+// output that isn't in the UTxO cache resolves with a single get rather 
+// than through the tx hints.
+//
+// As with StoredAddrSummary, the key made of the prefix alone holds the 
+// height the table was started at. It only lists every tracked UTxO if that
+// is 0.
+class StoredUtxo
+{
+public:
+   StoredUtxo(void) {}
+
+   bool isInitialized(void) const { return dbKey_.getSize() == 8; }
+   bool isNull(void) const { return !isInitialized(); }
+
+   //hashAndId is the tx hash followed by the TxOut index as 2 bytes BE, the
+   //BlockWriteBatcher's UTxO key
+   static BinaryData getDBKey(BinaryDataRef hashAndId);
+   static BinaryData getStartHeightDBKey(void);
+   BinaryData getDBKey(void) const { return getDBKey(hashAndId_); }
+
+   void       unserializeDBValue(BinaryRefReader & brr);
+   void         serializeDBValue(BinaryWriter    & bw ) const;
+   void       unserializeDBValue(BinaryDataRef      bd);
+   BinaryData   serializeDBValue(void) const;
+
+   BinaryData hashAndId_;
+
+   //of the StoredTxOut: hgtX, tx index and TxOut index
+   BinaryData dbKey_;
+   uint64_t   value_ = 0;
+   BinaryData scrAddr_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Where a block is in the blk files, in HEADERS, keyed by block hash. Written
+// as new headers are read, so that a restart can find a block without 
+// walking the blk files. The offset is that of the block's magic bytes, 
+// the size doesn't count these nor the size field.
+//
+// The key made of the prefix alone is the resume watermark: the position 
+// header reading got to, followed by the last header read before it, which
+// is checked against the blk files before the watermark is trusted.
+class StoredBlockFilePos
+{
+public:
+   StoredBlockFilePos(void) {}
+
+   bool isInitialized(void) const { return fileNum_ != UINT32_MAX; }
+   bool isNull(void) const { return !isInitialized(); }
+
+   static BinaryData getDBKey(BinaryDataRef hash);
+   static BinaryData getWatermarkDBKey(void);
+   BinaryData getDBKey(void) const { return getDBKey(hash_); }
+
+   void       unserializeDBValue(BinaryRefReader & brr);
+   void         serializeDBValue(BinaryWriter    & bw ) const;
+   void       unserializeDBValue(BinaryDataRef      bd);
+   BinaryData   serializeDBValue(void) const;
+
+   BinaryData hash_;
+   uint32_t   fileNum_ = UINT32_MAX;
+   uint64_t   offset_ = 0;
+   uint32_t   blockSize_ = 0;
+};
+
 
 #endif
 
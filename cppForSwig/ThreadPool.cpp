@@ -0,0 +1,264 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2011-2015, Armory Technologies, Inc.                        //
+//  Distributed under the GNU Affero General Public License (AGPL v3)         //
+//  See LICENSE or http://www.gnu.org/licenses/agpl.html                      //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+#include "ThreadPool.h"
+#include "lmdbpp.h"
+#include "log.h"
+
+#include <chrono>
+#include <thread>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace std;
+
+//how long a worker past the core count idles before exiting
+static const chrono::seconds workerIdleTimeout(30);
+
+const unsigned ThreadPool::MIN_BACKEND_THREADS;
+
+////////////////////////////////////////////////////////////////////////////////
+uint64_t ThreadPool::now(void)
+{
+   return chrono::duration_cast<chrono::microseconds>(
+      chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned ThreadPool::getDefaultMaxThreads(void)
+{
+   //leave room for tasks waiting on one another
+   return max(16u, 4 * thread::hardware_concurrency());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+const char* ThreadPool::getPriorityName(TaskPriority priority)
+{
+   switch (priority)
+   {
+   case TaskPriority_High:   return "high";
+   case TaskPriority_Normal: return "normal";
+   case TaskPriority_Low:    return "low";
+   default:                  return "unknown";
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ThreadPool& ThreadPool::getGlobal(void)
+{
+   //leaked on purpose: workers may still be running at static destruction
+   static ThreadPool* pool = new ThreadPool();
+   return *pool;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ThreadPool::ThreadPool(unsigned maxThreads)
+   : keepAlive_(max(2u, thread::hardware_concurrency()))
+{
+   setMaxThreads(maxThreads);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ThreadPool::~ThreadPool(void)
+{
+   unique_lock<mutex> lock(mu_);
+   stop_ = true;
+   taskCV_.notify_all();
+
+   exitCV_.wait(lock, [this](void)->bool { return workers_.empty(); });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ThreadPool::releaseWorkers(void)
+{
+   unique_lock<mutex> lock(mu_);
+   releasing_ = true;
+   taskCV_.notify_all();
+
+   exitCV_.wait(lock, [this](void)->bool { return workers_.empty(); });
+   releasing_ = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ThreadPool::setMaxThreads(unsigned maxThreads)
+{
+   unique_lock<mutex> lock(mu_);
+   maxThreads_ = (maxThreads == 0 ? getDefaultMaxThreads() : maxThreads);
+
+   //room may have opened up for queued tasks
+   while (workers_.size() < maxThreads_ && queue_.size() > idle_)
+      startWorker();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+unsigned ThreadPool::getMaxThreads(void) const
+{
+   unique_lock<mutex> lock(mu_);
+   return maxThreads_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ThreadPool::enqueue(function<void(void)> run,
+   TaskPriority priority, LMDBEnv* readEnv)
+{
+   if (priority < TaskPriority_High || priority >= TaskPriority_Count)
+      priority = TaskPriority_Normal;
+
+   unique_lock<mutex> lock(mu_);
+
+   Task task;
+   task.run_ = move(run);
+   task.priority_ = priority;
+   task.seq_ = seq_++;
+   task.readEnv_ = readEnv;
+   queue_.push(move(task));
+
+   queueDepthByPriority_[priority]++;
+   peakQueueDepth_ = max(peakQueueDepth_, uint32_t(queue_.size()));
+
+   if (queue_.size() > idle_ && workers_.size() < maxThreads_)
+      startWorker();
+   else
+      taskCV_.notify_one();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ThreadPool::startWorker(void)
+{
+   //mu_ is held by the caller
+   workers_.push_back(Worker());
+   auto self = prev(workers_.end());
+   self->startedAt_ = now();
+   threadsCreated_++;
+
+   //the worker removes itself from workers_ on exit, the destructor waits
+   //for that rather than joining
+   thread worker(&ThreadPool::workerLoop, this, self);
+   worker.detach();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ThreadPool::workerLoop(list<Worker>::iterator self)
+{
+   unique_lock<mutex> lock(mu_);
+
+   while (1)
+   {
+      if (queue_.empty())
+      {
+         if (stop_ || releasing_)
+            break;
+
+         idle_++;
+         auto status = taskCV_.wait_for(lock, workerIdleTimeout);
+         idle_--;
+
+         if (status == cv_status::timeout && queue_.empty() &&
+             workers_.size() > keepAlive_)
+            break;
+
+         continue;
+      }
+
+      Task task = queue_.top();
+      queue_.pop();
+      queueDepthByPriority_[task.priority_]--;
+      self->taskStartedAt_ = now();
+
+      lock.unlock();
+
+      try
+      {
+         if (task.readEnv_ != nullptr)
+         {
+            LMDBEnv::Transaction tx(task.readEnv_, LMDB::ReadOnly);
+            task.run_();
+         }
+         else
+            task.run_();
+      }
+      catch (exception &e)
+      {
+         LOGERR << "thread pool task failed: " << e.what();
+      }
+      catch (...)
+      {
+         LOGERR << "thread pool task failed";
+      }
+
+      lock.lock();
+      busyUs_ += now() - self->taskStartedAt_;
+      self->taskStartedAt_ = 0;
+      tasksRun_++;
+   }
+
+   exitedWorkerUs_ += now() - self->startedAt_;
+   workers_.erase(self);
+   exitCV_.notify_all();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+ThreadPoolStats ThreadPool::getStats(void) const
+{
+   unique_lock<mutex> lock(mu_);
+
+   ThreadPoolStats stats;
+   stats.maxThreads_ = maxThreads_;
+   stats.threads_ = workers_.size();
+   stats.threadsCreated_ = threadsCreated_;
+   stats.tasksRun_ = tasksRun_;
+   stats.queueDepth_ = queue_.size();
+   stats.peakQueueDepth_ = peakQueueDepth_;
+   for (int i = 0; i < TaskPriority_Count; i++)
+      stats.queueDepthByPriority_[i] = queueDepthByPriority_[i];
+
+   const uint64_t at = now();
+   uint64_t busyUs = busyUs_;
+   uint64_t workerUs = exitedWorkerUs_;
+   for (auto& worker : workers_)
+   {
+      workerUs += at - worker.startedAt_;
+      if (worker.taskStartedAt_ != 0)
+      {
+         stats.busy_++;
+         busyUs += at - worker.taskStartedAt_;
+      }
+   }
+
+   if (workerUs > 0)
+      stats.utilization_ = double(busyUs) / double(workerUs);
+
+   return stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+string ThreadPool::dump(void) const
+{
+   auto stats = getStats();
+
+   stringstream ss;
+   ss << fixed << setprecision(1);
+   ss << "workers " << stats.threads_ << "/" << stats.maxThreads_
+      << " (" << stats.busy_ << " busy)"
+      << ", created " << stats.threadsCreated_
+      << ", tasks " << stats.tasksRun_
+      << ", queued " << stats.queueDepth_ << " (";
+   for (int i = 0; i < TaskPriority_Count; i++)
+   {
+      if (i > 0)
+         ss << ", ";
+      ss << getPriorityName(TaskPriority(i)) << " "
+         << stats.queueDepthByPriority_[i];
+   }
+   ss << "), peak queued " << stats.peakQueueDepth_
+      << ", utilization " << stats.utilization_ * 100.0 << "%";
+
+   return ss.str();
+}
+
+// kate: indent-width 3; replace-tabs on;
@@ -0,0 +1,169 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//  Copyright (C) 2011-2015, Armory Technologies, Inc.                        //
+//  Distributed under the GNU Affero General Public License (AGPL v3)         //
+//  See LICENSE or http://www.gnu.org/licenses/agpl.html                      //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <cstdint>
+#include <list>
+#include <queue>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+
+class LMDBEnv;
+
+////////////////////////////////////////////////////////////////////////////////
+// Worker pool shared by the BDM backend: block grabbing, commits, side scans,
+// ZC writes and reorgs. Workers are started when a task is queued and none
+// is idle, up to maxThreads. Idle workers past the core count exit after a
+// while.
+//
+// Tasks may wait on other tasks (a commit on its serialization, a side scan
+// on its block grabber), so maxThreads has to cover all such chains that can
+// be up at once, see MIN_BACKEND_THREADS. Past that, queued tasks wait for a
+// worker by priority, then in submission order.
+//
+// LMDB transactions are per thread. Workers start each task with no
+// transaction open, so tasks can always get a RW one. Tasks submitted with a
+// read env run within a read transaction the worker opens on that env.
+////////////////////////////////////////////////////////////////////////////////
+enum TaskPriority
+{
+   TaskPriority_High=0,
+   TaskPriority_Normal,
+   TaskPriority_Low,
+   TaskPriority_Count
+};
+
+struct ThreadPoolStats
+{
+   uint32_t maxThreads_ = 0;
+   uint32_t threads_ = 0;
+   uint32_t busy_ = 0;
+
+   uint64_t threadsCreated_ = 0;
+   uint64_t tasksRun_ = 0;
+
+   uint32_t queueDepth_ = 0;
+   uint32_t peakQueueDepth_ = 0;
+   uint32_t queueDepthByPriority_[TaskPriority_Count] = {};
+
+   //time spent running tasks over the lifetime of the workers, 0 to 1
+   double utilization_ = 0.0;
+};
+
+class ThreadPool
+{
+   struct Task
+   {
+      std::function<void(void)> run_;
+      TaskPriority priority_;
+      uint64_t seq_;
+      LMDBEnv* readEnv_;
+   };
+
+   struct TaskOrder
+   {
+      bool operator()(const Task& lhs, const Task& rhs) const
+      {
+         if (lhs.priority_ != rhs.priority_)
+            return lhs.priority_ > rhs.priority_;
+         return lhs.seq_ > rhs.seq_;
+      }
+   };
+
+   struct Worker
+   {
+      uint64_t startedAt_ = 0;
+      uint64_t taskStartedAt_ = 0;
+   };
+
+   mutable std::mutex mu_;
+   std::condition_variable taskCV_;
+   std::condition_variable exitCV_;
+   std::priority_queue<Task, std::vector<Task>, TaskOrder> queue_;
+   std::list<Worker> workers_;
+
+   unsigned maxThreads_ = 0;
+   const unsigned keepAlive_;
+   unsigned idle_ = 0;
+   uint64_t seq_ = 0;
+   bool stop_ = false;
+   bool releasing_ = false;
+
+   uint64_t threadsCreated_ = 0;
+   uint64_t tasksRun_ = 0;
+   uint32_t peakQueueDepth_ = 0;
+   uint32_t queueDepthByPriority_[TaskPriority_Count] = {};
+   uint64_t busyUs_ = 0;
+   uint64_t exitedWorkerUs_ = 0;
+
+private:
+   void enqueue(std::function<void(void)> run,
+      TaskPriority priority, LMDBEnv* readEnv);
+   void startWorker(void);
+   void workerLoop(std::list<Worker>::iterator self);
+
+public:
+   //the most backend tasks that can be waiting on one another at once: a 
+   //side scan with its block grabber, commit and serialization, the main 
+   //scan's grabber, commit and serialization, and a ZC write. A smaller cap
+   //deadlocks, the BDM config can't go below it
+   static const unsigned MIN_BACKEND_THREADS = 8;
+
+   static uint64_t now(void);
+   static unsigned getDefaultMaxThreads(void);
+   static const char* getPriorityName(TaskPriority priority);
+
+   //the backend's pool. Never destroyed, its workers end with the process
+   static ThreadPool& getGlobal(void);
+
+   //0 picks the default
+   ThreadPool(unsigned maxThreads = 0);
+
+   //waits for the workers to finish the queued tasks
+   ~ThreadPool(void);
+
+   ThreadPool(const ThreadPool&) = delete;
+   ThreadPool& operator=(const ThreadPool&) = delete;
+
+   void setMaxThreads(unsigned maxThreads);
+   unsigned getMaxThreads(void) const;
+
+   //runs the queued tasks, then lets every worker exit. New tasks start new
+   //workers. A child forked after this gets a pool it can use, a child 
+   //forked with workers up would wait on workers it doesn't have
+   void releaseWorkers(void);
+
+   template<typename F>
+   auto submit(F&& f, TaskPriority priority = TaskPriority_Normal,
+      LMDBEnv* readEnv = nullptr) -> std::future<decltype(f())>
+   {
+      typedef decltype(f()) result_type;
+
+      //exceptions are passed to the future
+      auto task = std::make_shared<std::packaged_task<result_type(void)>>(
+         std::forward<F>(f));
+      std::future<result_type> result = task->get_future();
+
+      enqueue([task](void)->void { (*task)(); }, priority, readEnv);
+      return result;
+   }
+
+   ThreadPoolStats getStats(void) const;
+
+   //one line summary
+   std::string dump(void) const;
+};
+
+#endif
+// kate: indent-width 3; replace-tabs on;
@@ -25,7 +25,19 @@ enum BDMAction
    BDMAction_Refresh,
    BDMAction_Exited,
    BDMAction_ErrorMsg,
-   BDMAction_StartedWalletScan
+   BDMAction_StartedWalletScan,
+   BDMAction_LedgerDelta,
+   BDMAction_ScanStats
+};
+
+//work queues of the BDM thread, in dispatch priority order
+enum BDMWork
+{
+   BDMWork_NewBlock=0,
+   BDMWork_ZC,
+   BDMWork_Merge,
+   BDMWork_Refresh,
+   BDMWork_Count
 };
 
 #endif
@@ -15,14 +15,23 @@
 #include "../ScrAddrObj.h"
 #include "../BtcWallet.h"
 #include "../BlockDataViewer.h"
+#include "../BDM_mainthread.h"
 #include "../cryptopp/DetSign.h"
 #include "../cryptopp/integer.h"
 #include "../Progress.h"
+#include "../ThreadPool.h"
+#include "../ScryptPoW.h"
+#include "../BlockWriteBatcher.h"
 #include "../reorgTest/blkdata.h"
 #include "../txio.h"
 
 #include <thread>
 
+#ifndef _WIN32
+   #include <unistd.h>
+   #include <sys/wait.h>
+#endif
+
 
 #ifdef _MSC_VER
    #ifdef mlock
@@ -443,6 +452,123 @@ TEST_F(CryptoPPTest, DetSigning)
 
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(CryptoPPTest, KdfRomixConcurrentDeriveKey)
+{
+    // Python calls DeriveKey without the GIL, several threads may share a
+    // KdfRomix
+    KdfRomix kdf(256 * 1024, 2, SecureBinaryData(READHEX(
+        "3131313131313131313131313131313131313131313131313131313131313131")));
+    SecureBinaryData password("This is a passphrase");
+    SecureBinaryData expected = kdf.DeriveKey(password);
+    EXPECT_EQ(expected.getSize(), 32U);
+
+    vector<SecureBinaryData> keys(4);
+    vector<thread> threads;
+    for (unsigned i = 0; i < keys.size(); i++)
+        threads.push_back(thread([&kdf, &password, &keys, i](void)->void
+        { keys[i] = kdf.DeriveKey(password); }));
+    for (auto& t : threads)
+        t.join();
+
+    for (const auto& key : keys)
+        EXPECT_EQ(expected, key);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// keyCount private keys chained off a fixed root, the way a wallet's bulk
+// key derivation makes them. Returns how long that took in microseconds.
+static uint64_t deriveChainedKeys(unsigned keyCount, 
+    vector<SecureBinaryData>& keys)
+{
+    SecureBinaryData chainCode(READHEX(
+        "9a4f2c5b8e1d7f3c6a0b4e8d2f5c1a7b3e9d6f0c4a8b2e5d1f7c3a9b6e0d4f8c"));
+    SecureBinaryData rootKey(READHEX(
+        "1d8a7e3f5c9b2d4e6a0f8c1b3e5d7a9c2f4b6d8e0a1c3e5f7b9d2a4c6e8f0b1d"));
+    SecureBinaryData rootPub = CryptoECDSA().ComputePublicKey(rootKey);
+
+    keys.clear();
+    keys.reserve(keyCount);
+
+    auto start = ScanTelemetry::now();
+    SecureBinaryData priv = rootKey;
+    for (unsigned i = 0; i < keyCount; i++)
+    {
+        priv = CryptoECDSA().ComputeChainedPrivateKey(
+            priv, chainCode, rootPub);
+        keys.push_back(priv);
+    }
+    return ScanTelemetry::now() - start;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(CryptoPPTest, SecureMemoryPool)
+{
+    SecureMemoryPool& pool = SecureMemoryPool::getGlobal();
+    ASSERT_TRUE(pool.isEnabled());
+    SecurePoolStats before = pool.getStats();
+
+    // Secure buffers come from the pool, plain ones and copies of secure 
+    // ones into plain BinaryData from the heap
+    uint8_t* freedPtr = nullptr;
+    {
+        SecureBinaryData key(32);
+        key.fill(0xaa);
+        EXPECT_TRUE(key.isPooled());
+        freedPtr = key.getPtr();
+
+        BinaryData plain(key);
+        EXPECT_FALSE(SecureMemoryPool::owns(plain.getPtr()));
+        EXPECT_EQ(plain, key.getRawCopy());
+
+        SecureBinaryData fromPlain(plain);
+        EXPECT_TRUE(fromPlain.isPooled());
+
+        SecurePoolStats during = pool.getStats();
+        EXPECT_EQ(during.buffersInUse_, before.buffersInUse_ + 2);
+        EXPECT_GE(during.arenas_, 1U);
+        EXPECT_EQ(during.reservedBytes_, SecureMemoryPool::RESERVED_SIZE);
+    }
+
+    // Wiped on free, past the free list link
+    for (unsigned i = sizeof(void*); i < 32; i++)
+        EXPECT_EQ(freedPtr[i], 0);
+
+    // Too large for the size classes, on the heap
+    {
+        SecureBinaryData large(SecureMemoryPool::MAX_CLASS_SIZE + 1);
+        EXPECT_FALSE(large.isPooled());
+    }
+
+    // Growing out of its size class moves it to the next one
+    {
+        SecureBinaryData grown(READHEX("0102030405060708"));
+        SecureBinaryData tail(100);
+        grown.append(tail);
+        EXPECT_TRUE(grown.isPooled());
+        EXPECT_EQ(grown.getSize(), 108U);
+        EXPECT_EQ(grown[0], 1);
+    }
+
+    SecurePoolStats after = pool.getStats();
+    EXPECT_EQ(after.buffersInUse_, before.buffersInUse_);
+    EXPECT_EQ(after.bytesInUse_, before.bytesInUse_);
+    EXPECT_GT(after.allocs_, before.allocs_);
+    EXPECT_EQ(after.allocs_ - before.allocs_, after.frees_ - before.frees_);
+    EXPECT_EQ(after.oversized_, before.oversized_ + 1);
+
+    // Chained private keys come out the same with and without the pool
+    vector<SecureBinaryData> pooledKeys, unpooledKeys;
+    pool.setEnabled(false);
+    deriveChainedKeys(200, unpooledKeys);
+    EXPECT_FALSE(unpooledKeys.back().isPooled());
+    pool.setEnabled(true);
+    deriveChainedKeys(200, pooledKeys);
+    EXPECT_TRUE(pooledKeys.back().isPooled());
+
+    EXPECT_EQ(pooledKeys, unpooledKeys);
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 class BinaryDataTest : public ::testing::Test
@@ -1680,6 +1806,173 @@ protected:
          "0000000000000000000000000000000000000000000000000000000000000000");
       prevHashReg_ = READHEX(
          "894862e362905c6075074d9ec4b4e2dc34720089b1e9ef4738ee1b13f3bdcdb7");
+
+      ltcGenesisHead_ = READHEX(
+         "0100000000000000000000000000000000000000000000000000000000000000"
+         "00000000d9ced4ed1130f7b7faad9be25323ffafa33232a17c3edf6cfd97bee6"
+         "bafbdd97b9aa8e4ef0ff0f1ecd513f7c");
+   }
+
+   /////
+   // the Litecoin genesis header with count different nonces
+   vector<BinaryData> makeNonceHeaders(uint32_t count) const
+   {
+      vector<BinaryData> headers;
+      for (uint32_t i = 0; i < count; i++)
+      {
+         BinaryData header = ltcGenesisHead_;
+         BinaryData nonce = WRITE_UINT32_LE(i * 2654435761U);
+         memcpy(header.getPtr() + 76, nonce.getPtr(), 4);
+         headers.push_back(header);
+      }
+
+      return headers;
+   }
+
+   /////
+   // scrAddr of a TxOut script, the way the scan got it before the no copy
+   // analysis
+   static BinaryData legacyScrAddr(BinaryDataRef script)
+   {
+      BinaryWriter bw;
+      switch (BtcUtils::getTxOutScriptType(script))
+      {
+      case TXOUT_SCRIPT_STDHASH160:
+         bw.put_uint8_t(SCRIPT_PREFIX_HASH160);
+         bw.put_BinaryData(script.getSliceCopy(3, 20));
+         break;
+      case TXOUT_SCRIPT_STDPUBKEY65:
+         bw.put_uint8_t(SCRIPT_PREFIX_HASH160);
+         bw.put_BinaryData(BtcUtils::getHash160(script.getSliceRef(1, 65)));
+         break;
+      case TXOUT_SCRIPT_STDPUBKEY33:
+         bw.put_uint8_t(SCRIPT_PREFIX_HASH160);
+         bw.put_BinaryData(BtcUtils::getHash160(script.getSliceRef(1, 33)));
+         break;
+      case TXOUT_SCRIPT_P2SH:
+         bw.put_uint8_t(SCRIPT_PREFIX_P2SH);
+         bw.put_BinaryData(script.getSliceCopy(2, 20));
+         break;
+      case TXOUT_SCRIPT_NONSTANDARD:
+         bw.put_uint8_t(SCRIPT_PREFIX_NONSTD);
+         bw.put_BinaryData(BtcUtils::getHash160(script));
+         break;
+      case TXOUT_SCRIPT_MULTISIG:
+         bw.put_uint8_t(SCRIPT_PREFIX_MULTISIG);
+         bw.put_BinaryData(BtcUtils::getMultisigUniqueKey(script));
+         break;
+      }
+      return bw.getData();
+   }
+
+   /////
+   // TxIn script type, the way the scan got it before the no copy analysis
+   static TXIN_SCRIPT_TYPE legacyTxInType(BinaryDataRef script,
+      BinaryDataRef prevHash)
+   {
+      if (script.getSize() == 0)
+         return TXIN_SCRIPT_NONSTANDARD;
+      if (prevHash == BtcUtils::EmptyHash_)
+         return TXIN_SCRIPT_COINBASE;
+
+      vector<BinaryDataRef> pushes = BtcUtils::splitPushOnlyScriptRefs(script);
+      BinaryData lastPush;
+      if (pushes.size() > 0)
+         lastPush = pushes.back();
+      if (BtcUtils::getTxOutScriptType(lastPush) != TXOUT_SCRIPT_NONSTANDARD)
+         return TXIN_SCRIPT_SPENDP2SH;
+
+      if (script[0] == 0x00)
+      {
+         if (pushes.size() == 0)
+            return TXIN_SCRIPT_NONSTANDARD;
+         if (script[2] == 0x30 && script[4] == 0x02)
+            return TXIN_SCRIPT_SPENDMULTI;
+      }
+
+      if (!(script[1] == 0x30 && script[3] == 0x02))
+         return TXIN_SCRIPT_NONSTANDARD;
+
+      uint32_t sigSize = script[2] + 4;
+      if (script.getSize() == sigSize)
+         return TXIN_SCRIPT_SPENDPUBKEY;
+      if (script.getSize() == sigSize + 66)
+         return TXIN_SCRIPT_STDUNCOMPR;
+      if (script.getSize() == sigSize + 34)
+         return TXIN_SCRIPT_STDCOMPR;
+      return TXIN_SCRIPT_NONSTANDARD;
+   }
+
+   /////
+   // the scripts of the reorgTest blocks and a few less common ones
+   bool loadAnalysisScripts(vector<BinaryData>& txOutScripts,
+      vector<pair<BinaryData, BinaryData>>& txInScripts)
+   {
+      for (unsigned i = 0; i < 5; i++)
+      {
+         string path = "../reorgTest/blk_" + to_string(i) + ".dat";
+         ifstream is(path.c_str(), ios::in | ios::binary);
+         if (!is.good())
+            return false;
+         string raw((istreambuf_iterator<char>(is)), 
+            istreambuf_iterator<char>());
+         BinaryData blkFile(raw);
+
+         BinaryRefReader brr(blkFile);
+         while (brr.getSizeRemaining() > 8)
+         {
+            brr.advance(4);
+            uint32_t blkSize = brr.get_uint32_t();
+            BinaryRefReader blkReader(brr.get_BinaryDataRef(blkSize));
+            blkReader.advance(HEADER_SIZE);
+
+            uint32_t numTx = (uint32_t)blkReader.get_var_int();
+            for (uint32_t itx = 0; itx < numTx; itx++)
+            {
+               Tx tx(blkReader);
+               for (uint32_t iin = 0; iin < tx.getNumTxIn(); iin++)
+               {
+                  TxIn txin = tx.getTxInCopy(iin);
+                  txInScripts.push_back(make_pair(txin.getScript(),
+                     txin.getOutPoint().getTxHash()));
+               }
+               for (uint32_t iout = 0; iout < tx.getNumTxOut(); iout++)
+                  txOutScripts.push_back(tx.getTxOutCopy(iout).getScript());
+            }
+         }
+      }
+
+      //compressed P2PK, P2SH, 1-of-2 multisig, nonstandard
+      txOutScripts.push_back(READHEX(
+         "21024005c945d86ac6b01fb04258345abea7a845bd25689edb723d5ad4068ddd30"
+         "36ac"));
+      txOutScripts.push_back(READHEX(
+         "a914d0c15a7d41500976056b3345f542d8c944077c8a87"));
+      txOutScripts.push_back(READHEX(
+         "5121034758cefcb75e16e4dfafb32383b709fa632086ea5ca982712de6add93060b1"
+         "7a2103fe96237629128a0ae8c3825af8a4be8fe3109b16f62af19cec0b1eb93b871"
+         "7e252ae"));
+      txOutScripts.push_back(READHEX("6a0b68656c6c6f20776f726c64"));
+
+      //P2SH spend, spends through OP_PUSHDATA1/2, not push only
+      txInScripts.push_back(make_pair(READHEX(
+         "004830450221009254113fa46918f299b1d18ec918613e56cffbeba0960db05f"
+         "66b51496e5bf3802201e229de334bd753a2b08b36cc3f38f5263a23e9714a737"
+         "520db45494ec095ce80148304502206ee62f539d5cd94f990b7abfda77750f58"
+         "ff91043c3f002501e5448ef6dba2520221009d29229cdfedda1dd02a1a90bb71"
+         "b30b77e9c3fc28d1353f054c86371f6c2a8101475221034758cefcb75e16e4df"
+         "afb32383b709fa632086ea5ca982712de6add93060b17a2103fe96237629128a"
+         "0ae8c3825af8a4be8fe3109b16f62af19cec0b1eb93b8717e252ae"),
+         prevHashReg_));
+      txInScripts.push_back(make_pair(READHEX(
+         "4c17a914d0c15a7d41500976056b3345f542d8c944077c8a87"), 
+         prevHashReg_));
+      txInScripts.push_back(make_pair(READHEX(
+         "4d1700a914d0c15a7d41500976056b3345f542d8c944077c8a87"), 
+         prevHashReg_));
+      txInScripts.push_back(make_pair(READHEX("0051ae"), prevHashReg_));
+
+      return txOutScripts.size() > 5 && txInScripts.size() > 5;
    }
 
    BinaryData rawHead_;
@@ -1691,6 +1984,8 @@ protected:
 
    BinaryData prevHashCB_;
    BinaryData prevHashReg_;
+
+   BinaryData ltcGenesisHead_;
 };
 
 
@@ -2208,6 +2503,142 @@ TEST_F(BtcUtilsTest, TxInScriptID_SpendP2SH)
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BtcUtilsTest, NoCopyScriptAnalysis)
+{
+   //the scan's script analysis against the way it used to be done
+   vector<BinaryData> txOutScripts;
+   vector<pair<BinaryData, BinaryData>> txInScripts;
+   ASSERT_TRUE(loadAnalysisScripts(txOutScripts, txInScripts));
+
+   Hash160Cache cache;
+   for (const auto& script : txOutScripts)
+   {
+      BinaryData expected = legacyScrAddr(script.getRef());
+      EXPECT_EQ(BtcUtils::getTxOutScrAddr(script.getRef()), expected);
+      EXPECT_EQ(BtcUtils::getTxOutScrAddr(
+         script.getRef(), TXOUT_SCRIPT_NONSTANDARD, &cache), expected);
+
+      uint8_t scrAddr[21];
+      bool fits = BtcUtils::getTxOutScrAddrNoCopy(script.getRef(), scrAddr);
+      EXPECT_EQ(fits, expected.getSize() == 21);
+      if (fits)
+         EXPECT_EQ(BinaryData(scrAddr, 21), expected);
+   }
+
+   //the P2PK scripts a second time, out of the cache
+   uint64_t hits = cache.hits();
+   uint64_t misses = cache.misses();
+   uint64_t p2pkCount = 0;
+   for (const auto& script : txOutScripts)
+   {
+      auto type = BtcUtils::getTxOutScriptType(script.getRef());
+      if (type == TXOUT_SCRIPT_STDPUBKEY65 || type == TXOUT_SCRIPT_STDPUBKEY33)
+         p2pkCount++;
+
+      EXPECT_EQ(BtcUtils::getTxOutScrAddr(
+         script.getRef(), TXOUT_SCRIPT_NONSTANDARD, &cache),
+         legacyScrAddr(script.getRef()));
+   }
+   EXPECT_GT(p2pkCount, 0U);
+   EXPECT_EQ(cache.hits(), hits + p2pkCount);
+   EXPECT_EQ(cache.misses(), misses);
+
+   for (const auto& txin : txInScripts)
+   {
+      TXIN_SCRIPT_TYPE expected =
+         legacyTxInType(txin.first.getRef(), txin.second.getRef());
+      TXIN_SCRIPT_TYPE type =
+         BtcUtils::getTxInScriptType(txin.first.getRef(), txin.second.getRef());
+      EXPECT_EQ(type, expected);
+
+      if (type == TXIN_SCRIPT_SPENDP2SH)
+      {
+         vector<BinaryDataRef> pushes =
+            BtcUtils::splitPushOnlyScriptRefs(txin.first.getRef());
+         EXPECT_EQ(BtcUtils::getTxInAddrFromType(txin.first.getRef(), type),
+            BtcUtils::getHash160(pushes.back()));
+      }
+   }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BtcUtilsTest, ScryptProofOfWork)
+{
+   //the Litecoin genesis header, and the same with a flipped nonce bit
+   BinaryData genesis = ltcGenesisHead_;
+   BinaryData badNonce = genesis;
+   badNonce[76] ^= 1;
+
+   EXPECT_EQ(BtcUtils::getHash256(genesis), READHEX(
+      "e2bf047e7e5a191aa4ef34d314979dc9986e0f19251edaba5940fd1fe365a712"));
+
+   ScryptPoW scrypt;
+   BinaryData genesisPoW = READHEX(
+      "001e67b013726fd7382e9acb69165b4b6316227fb3156b5b414ba6340c050000");
+   EXPECT_EQ(scrypt.getHash(genesis), genesisPoW);
+   EXPECT_EQ(scrypt.getHash(badNonce), READHEX(
+      "018c9fa348b6f58150954533cee1fd7d2a4c46d7627c73bf4b356546497f32cc"));
+
+   BinaryData scalarHash(32);
+   scrypt.hashScalar(genesis.getPtr(), scalarHash.getPtr());
+   EXPECT_EQ(scalarHash, genesisPoW);
+
+   EXPECT_TRUE(scrypt.checkHeader(genesis));
+   EXPECT_FALSE(scrypt.checkHeader(badNonce));
+   EXPECT_FALSE(scrypt.checkHeader(genesis.getSliceRef(0, 79)));
+
+   //the SIMD and portable cores agree
+   for (auto& header : makeNonceHeaders(64))
+   {
+      BinaryData simdHash = scrypt.getHash(header);
+      scrypt.hashScalar(header.getPtr(), scalarHash.getPtr());
+      EXPECT_EQ(simdHash, scalarHash);
+   }
+
+   //exact target comparison: the genesis PoW hash is 0x0000050c34a64b...
+   const uint8_t* powPtr = genesisPoW.getPtr();
+   EXPECT_TRUE(BtcUtils::checkProofOfWork(powPtr, 0x1e0ffff0));
+   EXPECT_TRUE(BtcUtils::checkProofOfWork(powPtr, 0x1e050c35));
+   EXPECT_FALSE(BtcUtils::checkProofOfWork(powPtr, 0x1e050c34));
+   EXPECT_FALSE(BtcUtils::checkProofOfWork(powPtr, 0x1d050c34));
+
+   //a hash equal to its target passes
+   uint8_t target[32];
+   ASSERT_TRUE(BtcUtils::getTargetFromDiffBits(0x1e050c34, target));
+   EXPECT_EQ(BinaryData(target, 32), READHEX(
+      "000000000000000000000000000000000000000000000000000000340c050000"));
+   EXPECT_TRUE(BtcUtils::checkProofOfWork(target, 0x1e050c34));
+   target[0] = 1;
+   EXPECT_FALSE(BtcUtils::checkProofOfWork(target, 0x1e050c34));
+
+   //small exponents shift the mantissa down
+   ASSERT_TRUE(BtcUtils::getTargetFromDiffBits(0x02123456, target));
+   EXPECT_EQ(BinaryData(target, 4), READHEX("34120000"));
+
+   //negative, zero and overflowing targets are rejected
+   EXPECT_FALSE(BtcUtils::getTargetFromDiffBits(0x1e850c34, target));
+   EXPECT_FALSE(BtcUtils::getTargetFromDiffBits(0x1e000000, target));
+   EXPECT_FALSE(BtcUtils::getTargetFromDiffBits(0x01003456, target));
+   EXPECT_FALSE(BtcUtils::getTargetFromDiffBits(0x22010000, target));
+   EXPECT_TRUE(BtcUtils::getTargetFromDiffBits(0x2100ffff, target));
+   EXPECT_FALSE(BtcUtils::checkProofOfWork(powPtr, 0x1e850c34));
+
+   //batches over the pool flag each header
+   vector<BinaryDataRef> batch;
+   for (unsigned i = 0; i < 40; i++)
+      batch.push_back(i % 3 == 0 ? genesis.getRef() : badNonce.getRef());
+   vector<uint8_t> valid =
+      ScryptPoW::checkHeaders(batch, ThreadPool::getGlobal(), 3);
+   ASSERT_EQ(valid.size(), batch.size());
+   for (unsigned i = 0; i < valid.size(); i++)
+      EXPECT_EQ(valid[i], i % 3 == 0 ? 1 : 0);
+   EXPECT_TRUE(
+      ScryptPoW::checkHeaders({}, ThreadPool::getGlobal()).empty());
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(BtcUtilsTest, BitsToDifficulty)
 {
@@ -3018,6 +3449,46 @@ TEST_F(StoredBlockObjTest, GetDBKeys)
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(StoredBlockObjTest, SDBIOptionalHashes)
+{
+   StoredDBInfo sdbi;
+   sdbi.magic_ = READHEX("f9beb4d9");
+   sdbi.topBlkHgt_ = 123;
+   sdbi.topBlkHash_ = READHEX(
+      "6fe28c0ab6f1b372c1a6a246ae63f74f931e8365e15a089c68d6190000000000");
+   BinaryData checkedHash = READHEX(
+      "e2bf047e7e5a191aa4ef34d314979dc9986e0f19251edaba5940fd1fe365a712");
+
+   auto roundTrip = [](const StoredDBInfo& in)->StoredDBInfo
+   {
+      BinaryWriter bw;
+      in.serializeDBValue(bw);
+      StoredDBInfo out;
+      out.unserializeDBValue(bw.getData());
+      return out;
+   };
+
+   //neither set
+   StoredDBInfo sdbiOut = roundTrip(sdbi);
+   EXPECT_EQ(sdbiOut.topBlkHash_, sdbi.topBlkHash_);
+   EXPECT_EQ(sdbiOut.topScannedBlkHash_.getSize(), 0);
+   EXPECT_EQ(sdbiOut.powCheckedBlkHash_.getSize(), 0);
+
+   //only the PoW watermark, the scanned hash stays blank
+   sdbi.powCheckedBlkHash_ = checkedHash;
+   sdbiOut = roundTrip(sdbi);
+   EXPECT_EQ(sdbiOut.topScannedBlkHash_.getSize(), 0);
+   EXPECT_EQ(sdbiOut.powCheckedBlkHash_, checkedHash);
+
+   //both
+   sdbi.topScannedBlkHash_ = sdbi.topBlkHash_;
+   sdbiOut = roundTrip(sdbi);
+   EXPECT_EQ(sdbiOut.topScannedBlkHash_, sdbi.topBlkHash_);
+   EXPECT_EQ(sdbiOut.powCheckedBlkHash_, checkedHash);
+   EXPECT_EQ(sdbiOut.topBlkHgt_, 123);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(StoredBlockObjTest, LengthUnfrag)
 {
@@ -4273,12 +4744,13 @@ TEST_F(StoredBlockObjTest, SScriptHistorySer)
    EXPECT_EQ(serializeDBValue(ssh, ARMORY_DB_BARE, DB_PRUNE_NONE), expect);
 
    /////////////////////////////////////////////////////////////////////////////
-   // Added a second one, different subSSH
+   // Added a second one, different subSSH. Sub-histories open with the UTXO
+   // count marker and count, none of these txios are flagged UTXO
    TxIOPair txio1(READHEX("00010000""0002""0002"), READ_UINT64_HEX_LE("0002000000000000"));
    ssh.insertTxio(txio1);
    expect  = READHEX("0400""ffff0000""02""0102000000000000");
-   expSub1 = READHEX("01""00""0100000000000000""0001""0001");
-   expSub2 = READHEX("01""00""0002000000000000""0002""0002");
+   expSub1 = READHEX("ff00""01""00""0100000000000000""0001""0001");
+   expSub2 = READHEX("ff00""01""00""0002000000000000""0002""0002");
    EXPECT_EQ(serializeDBValue(ssh, ARMORY_DB_BARE, DB_PRUNE_NONE), expect);
    EXPECT_EQ(serializeDBValue(ssh.subHistMap_[READHEX("0000ff00")], nullptr, ARMORY_DB_BARE, DB_PRUNE_NONE), expSub1);
    EXPECT_EQ(serializeDBValue(ssh.subHistMap_[READHEX("00010000")], nullptr, ARMORY_DB_BARE, DB_PRUNE_NONE), expSub2);
@@ -4288,9 +4760,9 @@ TEST_F(StoredBlockObjTest, SScriptHistorySer)
    TxIOPair txio2(READHEX("00010000""0004""0004"), READ_UINT64_HEX_LE("0000030000000000"));
    ssh.insertTxio(txio2);
    expect  = READHEX("0400""ffff0000""03""0102030000000000");
-   expSub1 = READHEX("01"
+   expSub1 = READHEX("ff00""01"
                        "00""0100000000000000""0001""0001");
-   expSub2 = READHEX("02"
+   expSub2 = READHEX("ff00""02"
                        "00""0002000000000000""0002""0002"
                        "00""0000030000000000""0004""0004");
    EXPECT_EQ(serializeDBValue(ssh, ARMORY_DB_BARE, DB_PRUNE_NONE), expect);
@@ -4303,9 +4775,9 @@ TEST_F(StoredBlockObjTest, SScriptHistorySer)
    // just the base insert/erase operations)
    ssh.eraseTxio(txio1);
    expect  = READHEX("0400""ffff0000""02""0100030000000000");
-   expSub1 = READHEX("01"
+   expSub1 = READHEX("ff00""01"
                        "00""0100000000000000""0001""0001");
-   expSub2 = READHEX("01"
+   expSub2 = READHEX("ff00""01"
                        "00""0000030000000000""0004""0004");
    EXPECT_EQ(serializeDBValue(ssh, ARMORY_DB_BARE, DB_PRUNE_NONE), expect);
    EXPECT_EQ(serializeDBValue(ssh.subHistMap_[READHEX("0000ff00")], nullptr, ARMORY_DB_BARE, DB_PRUNE_NONE), expSub1);
@@ -4318,9 +4790,9 @@ TEST_F(StoredBlockObjTest, SScriptHistorySer)
    txio3.setMultisig(true);
    ssh.insertTxio(txio3);
    expect  = READHEX("0400""ffff0000""03""0100030000000000");
-   expSub1 = READHEX("01"
+   expSub1 = READHEX("ff00""01"
                        "00""0100000000000000""0001""0001");
-   expSub2 = READHEX("02"
+   expSub2 = READHEX("ff00""02"
                        "00""0000030000000000""0004""0004"
                        "10""0000000400000000""0006""0006");
    EXPECT_EQ(serializeDBValue(ssh, ARMORY_DB_BARE, DB_PRUNE_NONE), expect);
@@ -4331,9 +4803,9 @@ TEST_F(StoredBlockObjTest, SScriptHistorySer)
    // Remove the multisig
    ssh.eraseTxio(txio3);
    expect  = READHEX("0400""ffff0000""02""0100030000000000");
-   expSub1 = READHEX("01"
+   expSub1 = READHEX("ff00""01"
                        "00""0100000000000000""0001""0001");
-   expSub2 = READHEX("01"
+   expSub2 = READHEX("ff00""01"
                        "00""0000030000000000""0004""0004");
    EXPECT_EQ(serializeDBValue(ssh, ARMORY_DB_BARE, DB_PRUNE_NONE), expect);
    EXPECT_EQ(serializeDBValue(ssh.subHistMap_[READHEX("0000ff00")], nullptr, ARMORY_DB_BARE, DB_PRUNE_NONE), expSub1);
@@ -4344,8 +4816,8 @@ TEST_F(StoredBlockObjTest, SScriptHistorySer)
    // by BlockUtils in a post-processing step
    ssh.eraseTxio(txio0);
    expect  = READHEX("0400""ffff0000""01""0000030000000000");
-   expSub1 = READHEX("00");
-   expSub2 = READHEX("01"
+   expSub1 = READHEX("ff00""00");
+   expSub2 = READHEX("ff00""01"
                        "00""0000030000000000""0004""0004");
    EXPECT_EQ(serializeDBValue(ssh, ARMORY_DB_BARE, DB_PRUNE_NONE), expect);
    EXPECT_EQ(serializeDBValue(ssh.subHistMap_[READHEX("0000ff00")], nullptr, ARMORY_DB_BARE, DB_PRUNE_NONE), expSub1);
@@ -4952,6 +5424,65 @@ protected:
       return iface_->databasesAreOpen();
    }
 
+   /////
+   static BinaryData txHintKey(uint32_t i)
+   {
+      BinaryWriter bw;
+      bw.put_uint8_t((uint8_t)DB_PREFIX_TXHINTS);
+      bw.put_uint32_t(i, BE);
+      return bw.getData();
+   }
+
+   /////
+   void putTxHints(uint32_t count)
+   {
+      LMDBEnv::Transaction tx(iface_->dbEnv_[TXHINTS].get(), LMDB::ReadWrite);
+      for (uint32_t i = 0; i < count; i++)
+         iface_->putValue(TXHINTS, txHintKey(i), WRITE_UINT32_LE(i));
+   }
+
+   /////
+   // an old address: sub-histories at heights 1 to depth, one UTXO left 
+   // every 250 blocks. Returns the heights of the UTXOs
+   set<uint32_t> putDeepSubHistories(const BinaryData& uniq, uint32_t depth)
+   {
+      StoredScriptHistory ssh;
+      ssh.uniqueKey_ = uniq;
+      ssh.version_ = 1;
+      ssh.alreadyScannedUpToBlk_ = depth;
+      iface_->putStoredScriptHistorySummary(ssh);
+
+      set<uint32_t> utxoHeights;
+      for (uint32_t hgt = 1; hgt <= depth; hgt++)
+      {
+         StoredSubHistory subssh;
+         subssh.uniqueKey_ = uniq;
+         subssh.hgtX_ = DBUtils::heightAndDupToHgtx(hgt, 0);
+
+         BinaryData dbkey = subssh.hgtX_ + READHEX("0001""0000");
+         TxIOPair txio(dbkey, COIN);
+         txio.setUTXO(hgt % 250 == 0);
+         if (txio.isUTXO())
+            utxoHeights.insert(hgt);
+         subssh.txioMap_[dbkey] = txio;
+
+         iface_->putStoredSubHistory(subssh);
+      }
+
+      return utxoHeights;
+   }
+
+   /////
+   // a short lookup in its own transaction, as getTxRef does
+   uint32_t readTxHint(uint32_t i)
+   {
+      LMDBEnv::Transaction tx(iface_->dbEnv_[TXHINTS].get(), LMDB::ReadOnly);
+      BinaryDataRef val = iface_->getValueNoCopy(TXHINTS, txHintKey(i));
+      if (val.getSize() != 4)
+         return UINT32_MAX;
+      return READ_UINT32_LE(val.getPtr());
+   }
+
 
    LMDBBlockDatabase* iface_;
    BlockDataManagerConfig config_;
@@ -5727,6 +6258,247 @@ TEST_F(LMDBTest, PutGetStoredScriptHistory)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(LMDBTest, RangeBoundedSubHistories)
+{
+   ASSERT_TRUE(standardOpenDBs());
+   LMDBEnv::Transaction tx(iface_->dbEnv_[HISTORY].get(), LMDB::ReadWrite);
+
+   //an old address: a deep history with a handful of UTXOs left
+   const uint32_t depth = 2000;
+   BinaryData uniq = READHEX("00""0000ffff0000ffff0000ffff0000ffff0000ffff");
+   set<uint32_t> utxoHeights = putDeepSubHistories(uniq, depth);
+
+   //a value predating the UTXO count can't be skipped
+   {
+      StoredSubHistory subssh;
+      subssh.uniqueKey_ = uniq;
+      subssh.hgtX_ = DBUtils::heightAndDupToHgtx(depth + 1, 0);
+      BinaryData dbkey = subssh.hgtX_ + READHEX("0001""0000");
+      TxIOPair txio(dbkey, COIN);
+      txio.setUTXO(true);
+      subssh.txioMap_[dbkey] = txio;
+
+      BinaryWriter bw;
+      subssh.serializeDBValue(bw, iface_, ARMORY_DB_FULL, DB_PRUNE_NONE);
+      EXPECT_EQ(StoredSubHistory::peekUTXOCount(bw.getDataRef()), 1);
+
+      BinaryData oldValue = bw.getData().getSliceCopy(2, bw.getSize() - 2);
+      EXPECT_EQ(StoredSubHistory::peekUTXOCount(oldValue), UINT32_MAX);
+      iface_->putValue(HISTORY, subssh.getDBKey(), oldValue);
+   }
+
+   set<uint32_t> visited;
+   auto collect = [&visited](StoredSubHistory& subssh)->bool
+   {
+      visited.insert(subssh.height_);
+      return true;
+   };
+
+   EXPECT_EQ(iface_->readSubHistories(uniq, 0, UINT32_MAX, false, collect),
+      depth + 1);
+
+   visited.clear();
+   EXPECT_EQ(iface_->readSubHistories(uniq, 500, 1000, false, collect), 501);
+   EXPECT_EQ(*visited.begin(), 500);
+   EXPECT_EQ(*visited.rbegin(), 1000);
+
+   visited.clear();
+   EXPECT_EQ(iface_->readSubHistories(uniq, 500, 1000, true, collect), 3);
+   EXPECT_EQ(visited, set<uint32_t>({ 500, 750, 1000 }));
+
+   visited.clear();
+   iface_->readSubHistories(uniq, 0, UINT32_MAX, true, collect);
+   set<uint32_t> expected = utxoHeights;
+   expected.insert(depth + 1);
+   EXPECT_EQ(visited, expected);
+
+   //stops when asked to
+   auto first = [](StoredSubHistory&)->bool { return false; };
+   EXPECT_EQ(iface_->readSubHistories(uniq, 0, UINT32_MAX, false, first), 1);
+
+   //same UTXOs as the full history load
+   set<BinaryData> fullUtxos, rangeUtxos;
+
+   StoredScriptHistory fullssh;
+   iface_->getStoredScriptHistory(fullssh, uniq);
+   for (auto& subPair : fullssh.subHistMap_)
+   {
+      for (auto& txioPair : subPair.second.txioMap_)
+      {
+         if (txioPair.second.isUTXO())
+            fullUtxos.insert(txioPair.first);
+      }
+   }
+
+   auto addUTXOs = [&rangeUtxos](StoredSubHistory& subssh)->bool
+   {
+      for (auto& txioPair : subssh.txioMap_)
+      {
+         if (txioPair.second.isUTXO())
+            rangeUtxos.insert(txioPair.first);
+      }
+      return true;
+   };
+   iface_->readSubHistories(uniq, 0, UINT32_MAX, true, addUTXOs);
+
+   EXPECT_EQ(fullUtxos, rangeUtxos);
+   EXPECT_EQ(rangeUtxos.size(), utxoHeights.size() + 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(LMDBTest, ReusedReadTxnsPointLookups)
+{
+   ASSERT_TRUE(standardOpenDBs());
+   LMDBEnv* env = iface_->dbEnv_[TXHINTS].get();
+
+   const uint32_t count = 1000;
+   putTxHints(count);
+
+   //a parked read txn sees commits made since it was last used
+   EXPECT_EQ(readTxHint(5), 5);
+   {
+      LMDBEnv::Transaction tx(env, LMDB::ReadWrite);
+      iface_->putValue(TXHINTS, txHintKey(5), WRITE_UINT32_LE(55));
+   }
+   EXPECT_EQ(readTxHint(5), 55);
+   EXPECT_EQ(readTxHint(count), UINT32_MAX);
+
+   //concurrent readers get the right values with and without reuse
+   for (bool reuse : { false, true })
+   {
+      env->setReuseReadTxns(reuse);
+
+      atomic<uint32_t> wrong(0);
+      vector<thread> threads;
+      for (unsigned t = 0; t < 4; t++)
+      {
+         threads.push_back(thread([&, t](void)->void
+         {
+            uint32_t i = t;
+            for (unsigned j = 0; j < 2000; j++)
+            {
+               i = (i * 2654435761U + 1) % count;
+               if (readTxHint(i) != (i == 5 ? 55 : i))
+                  wrong++;
+            }
+         }));
+      }
+
+      for (auto& thr : threads)
+         thr.join();
+
+      EXPECT_EQ(wrong.load(), 0);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(LMDBTest, SubHistorySpentnessResolved)
+{
+   ASSERT_TRUE(standardOpenDBs());
+   iface_->setValidDupIDForHeight(100, 0);
+   iface_->setValidDupIDForHeight(101, 0);
+
+   BinaryData hgtXOut = DBUtils::heightAndDupToHgtx(100, 0);
+   BinaryData hgtXIn = DBUtils::heightAndDupToHgtx(101, 0);
+   auto keyAt = [](const BinaryData& hgtX, uint16_t txIdx, 
+      uint16_t idx)->BinaryData
+   {
+      BinaryWriter bw;
+      bw.put_BinaryData(hgtX);
+      bw.put_uint16_t(txIdx, BE);
+      bw.put_uint16_t(idx, BE);
+      return bw.getData();
+   };
+
+   //a sub-history at TxIn height as the BlockWriteBatcher builds it: spent
+   //txios mirrored from height 100 plus a few UTXOs, once with the TxIns
+   //left for serialization to look up and once resolved
+   const uint16_t txioCount = 2000;
+   StoredSubHistory lookedUp, resolved;
+   lookedUp.uniqueKey_ = resolved.uniqueKey_ = 
+      READHEX("00""aabbccdd11223344aabbccdd11223344aabbccdd");
+   lookedUp.hgtX_ = resolved.hgtX_ = hgtXIn;
+
+   for (uint16_t i = 0; i < txioCount; i++)
+   {
+      if (i % 10 == 0)
+      {
+         TxIOPair txio(keyAt(hgtXIn, i, 0), (i + 1) * COIN);
+         txio.setUTXO(true);
+         EXPECT_TRUE(txio.isSpentInMainResolved());
+         lookedUp.insertTxio(txio);
+         resolved.insertTxio(txio);
+         continue;
+      }
+
+      TxIOPair txio(keyAt(hgtXOut, i, 1), (i + 1) * COIN);
+      txio.setTxIn(keyAt(hgtXIn, i, 0));
+      EXPECT_FALSE(txio.isSpentInMainResolved());
+      lookedUp.insertTxio(txio);
+
+      txio.setSpentInMain(true);
+      resolved.insertTxio(txio);
+   }
+
+   //serializing resolved txios doesn't need the DB at all
+   BinaryWriter bwLookedUp, bwResolved;
+   lookedUp.serializeDBValue(bwLookedUp, iface_, ARMORY_DB_BARE, DB_PRUNE_NONE);
+   EXPECT_NO_THROW(resolved.serializeDBValue(
+      bwResolved, nullptr, ARMORY_DB_BARE, DB_PRUNE_NONE));
+   EXPECT_EQ(bwResolved.getData(), bwLookedUp.getData());
+
+   BinaryWriter bwThrow;
+   EXPECT_THROW(lookedUp.serializeDBValue(
+      bwThrow, nullptr, ARMORY_DB_BARE, DB_PRUNE_NONE), runtime_error);
+
+   //txios read back from the DB come out resolved
+   StoredSubHistory fromDB;
+   fromDB.hgtX_ = hgtXIn;
+   fromDB.unserializeDBValue(bwResolved.getData());
+   ASSERT_EQ(fromDB.txioMap_.size(), txioCount);
+   for (auto& txioPair : fromDB.txioMap_)
+   {
+      EXPECT_TRUE(txioPair.second.isSpentInMainResolved());
+      EXPECT_EQ(txioPair.second.isSpentInMain(), txioPair.second.hasTxIn());
+   }
+
+   BinaryWriter bwFromDB;
+   fromDB.serializeDBValue(bwFromDB, nullptr, ARMORY_DB_BARE, DB_PRUNE_NONE);
+   EXPECT_EQ(bwFromDB.getData(), bwResolved.getData());
+
+   //clearing the TxIn, as an undo does, leaves it resolved unspent
+   TxIOPair& undone = fromDB.txioMap_.begin()->second;
+   undone.setTxIn(BinaryData(0));
+   EXPECT_TRUE(undone.isSpentInMainResolved());
+   EXPECT_FALSE(undone.isSpentInMain());
+
+   //per commit serialization cost, with and without the lookups
+   const unsigned rounds = 50;
+   auto nsPerTxio = [&](StoredSubHistory& subssh, 
+      LMDBBlockDatabase* db)->double
+   {
+      auto start = chrono::steady_clock::now();
+      for (unsigned i = 0; i < rounds; i++)
+      {
+         BinaryWriter bw;
+         subssh.serializeDBValue(bw, db, ARMORY_DB_BARE, DB_PRUNE_NONE);
+      }
+      auto ns = chrono::duration_cast<chrono::nanoseconds>(
+         chrono::steady_clock::now() - start).count();
+      return double(ns) / double(rounds * txioCount);
+   };
+
+   double lookupNs = nsPerTxio(lookedUp, iface_);
+   double resolvedNs = nsPerTxio(resolved, nullptr);
+   EXPECT_GT(lookupNs, 0.0);
+   EXPECT_GT(resolvedNs, 0.0);
+
+   LOGINFO << "sub-history serialization, ns/txio: " << lookupNs
+      << " looking up TxIn blocks, " << resolvedNs 
+      << " with resolved spentness (" << txioCount << " txios)";
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(LMDBTest, DISABLED_PutGetStoredUndoData)
 {
@@ -6986,39 +7758,318 @@ TEST_F(LMDBTest_Super, PutGetStoredScriptHistory)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
-class TxRefTest : public ::testing::Test
+TEST_F(LMDBTest_Super, AddrSummaries)
 {
-protected:
-};
+   ASSERT_TRUE(standardOpenDBs());
 
+   BinaryData scrAddrA = READHEX("00""1111111111111111111111111111111111111111");
+   BinaryData scrAddrB = READHEX("00""2222222222222222222222222222222222222222");
 
-////////////////////////////////////////////////////////////////////////////////
-TEST_F(TxRefTest, TxRefNoInit)
-{
-   TxRef txr;
-   EXPECT_FALSE(txr.isInitialized());
-   //EXPECT_FALSE(txr.isBound());
+   //putAddrSummaries looks at the sub-history keys after an undo, these 
+   //stand in for what putSSH and deleteEmptyKeys leave behind
+   auto putSubHistory = [this](const BinaryData& scrAddr, uint32_t height)
+   {
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadWrite);
+      iface_->putValue(BLKDATA, DB_PREFIX_SCRIPT,
+         scrAddr + DBUtils::heightAndDupToHgtx(height, 0), READHEX("00"));
+   };
+   auto deleteSubHistory = [this](const BinaryData& scrAddr, uint32_t height)
+   {
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadWrite);
+      iface_->deleteValue(BLKDATA, DB_PREFIX_SCRIPT,
+         scrAddr + DBUtils::heightAndDupToHgtx(height, 0));
+   };
 
-   EXPECT_EQ(txr.getDBKey(),     BinaryData(0));
-   EXPECT_EQ(txr.getDBKeyRef(),  BinaryDataRef());
-   //EXPECT_EQ(txr.getBlockTimestamp(), UINT32_MAX);
-   EXPECT_EQ(txr.getBlockHeight(),    UINT32_MAX);
-   EXPECT_EQ(txr.getDuplicateID(),    UINT8_MAX );
-   EXPECT_EQ(txr.getBlockTxIndex(),   UINT16_MAX);
-}
+   auto getSummary = [this](const BinaryData& scrAddr, 
+      StoredAddrSummary& sas)->bool
+   {
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+      return iface_->getStoredAddrSummary(sas, scrAddr);
+   };
 
-////////////////////////////////////////////////////////////////////////////////
-TEST_F(TxRefTest, TxRefKeyParts)
-{
-   TxRef txr;
-   BinaryData    newKey = READHEX("e3c4027f000f");
-   BinaryDataRef newRef(newKey);
+   auto getStartHeight = [this](void)->uint32_t
+   {
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+      return iface_->getAddrSummaryStartHeight();
+   };
 
+   StoredAddrSummary sas;
+   EXPECT_EQ(getStartHeight(), UINT32_MAX);
 
-   txr.setDBKey(newKey);
-   EXPECT_EQ(txr.getDBKey(),    newKey);
-   EXPECT_EQ(txr.getDBKeyRef(), newRef);
+   //blocks 0 to 2: A receives 50 at 1 and 25 at 2, B receives 5 at 2
+   putSubHistory(scrAddrA, 1);
+   putSubHistory(scrAddrA, 2);
+   putSubHistory(scrAddrB, 2);
+   {
+      DataToCommit dtc(ARMORY_DB_SUPER);
+      dtc.lowestHeight_ = 0;
+
+      auto& deltaA = dtc.addrSummaryDeltas_[scrAddrA];
+      deltaA.txioCount_ = 2;
+      deltaA.unspentCount_ = 2;
+      deltaA.unspentValue_ = 75 * COIN;
+      deltaA.seenAt(1);
+      deltaA.seenAt(2);
+
+      auto& deltaB = dtc.addrSummaryDeltas_[scrAddrB];
+      deltaB.txioCount_ = 1;
+      deltaB.unspentCount_ = 1;
+      deltaB.unspentValue_ = 5 * COIN;
+      deltaB.seenAt(2);
+
+      dtc.putAddrSummaries(iface_);
+   }
+
+   EXPECT_EQ(getStartHeight(), 0U);
+   ASSERT_TRUE(getSummary(scrAddrA, sas));
+   EXPECT_EQ(sas.firstSeenHeight_, 1U);
+   EXPECT_EQ(sas.lastSeenHeight_, 2U);
+   EXPECT_EQ(sas.txioCount_, 2U);
+   EXPECT_EQ(sas.unspentCount_, 2U);
+   EXPECT_EQ(sas.unspentValue_, 75 * COIN);
+   ASSERT_TRUE(getSummary(scrAddrB, sas));
+   EXPECT_EQ(sas.firstSeenHeight_, 2U);
+   EXPECT_EQ(sas.lastSeenHeight_, 2U);
+   EXPECT_EQ(sas.txioCount_, 1U);
+   EXPECT_EQ(sas.unspentValue_, 5 * COIN);
+   EXPECT_FALSE(getSummary(READHEX("00""3333333333333333333333333333333333333333"), sas));
+
+   //block 3: A spends its 50
+   putSubHistory(scrAddrA, 3);
+   {
+      DataToCommit dtc(ARMORY_DB_SUPER);
+      dtc.lowestHeight_ = 3;
+
+      auto& deltaA = dtc.addrSummaryDeltas_[scrAddrA];
+      deltaA.txioCount_ = 1;
+      deltaA.unspentCount_ = -1;
+      deltaA.unspentValue_ = -50 * (int64_t)COIN;
+      deltaA.seenAt(3);
+
+      dtc.putAddrSummaries(iface_);
+   }
+
+   EXPECT_EQ(getStartHeight(), 0U);
+   ASSERT_TRUE(getSummary(scrAddrA, sas));
+   EXPECT_EQ(sas.firstSeenHeight_, 1U);
+   EXPECT_EQ(sas.lastSeenHeight_, 3U);
+   EXPECT_EQ(sas.txioCount_, 3U);
+   EXPECT_EQ(sas.unspentCount_, 1U);
+   EXPECT_EQ(sas.unspentValue_, 25 * COIN);
+
+   //undo block 3
+   deleteSubHistory(scrAddrA, 3);
+   {
+      DataToCommit dtc(ARMORY_DB_SUPER);
+
+      auto& deltaA = dtc.addrSummaryDeltas_[scrAddrA];
+      deltaA.txioCount_ = -1;
+      deltaA.unspentCount_ = 1;
+      deltaA.unspentValue_ = 50 * COIN;
+      deltaA.undone_ = true;
+
+      dtc.putAddrSummaries(iface_);
+   }
+
+   ASSERT_TRUE(getSummary(scrAddrA, sas));
+   EXPECT_EQ(sas.firstSeenHeight_, 1U);
+   EXPECT_EQ(sas.lastSeenHeight_, 2U);
+   EXPECT_EQ(sas.txioCount_, 2U);
+   EXPECT_EQ(sas.unspentCount_, 2U);
+   EXPECT_EQ(sas.unspentValue_, 75 * COIN);
+
+   //undo block 2, B has no history left
+   deleteSubHistory(scrAddrA, 2);
+   deleteSubHistory(scrAddrB, 2);
+   {
+      DataToCommit dtc(ARMORY_DB_SUPER);
+
+      auto& deltaA = dtc.addrSummaryDeltas_[scrAddrA];
+      deltaA.txioCount_ = -1;
+      deltaA.unspentCount_ = -1;
+      deltaA.unspentValue_ = -25 * (int64_t)COIN;
+      deltaA.undone_ = true;
+
+      auto& deltaB = dtc.addrSummaryDeltas_[scrAddrB];
+      deltaB.txioCount_ = -1;
+      deltaB.unspentCount_ = -1;
+      deltaB.unspentValue_ = -5 * (int64_t)COIN;
+      deltaB.undone_ = true;
+
+      dtc.putAddrSummaries(iface_);
+   }
+
+   ASSERT_TRUE(getSummary(scrAddrA, sas));
+   EXPECT_EQ(sas.firstSeenHeight_, 1U);
+   EXPECT_EQ(sas.lastSeenHeight_, 1U);
+   EXPECT_EQ(sas.txioCount_, 1U);
+   EXPECT_EQ(sas.unspentCount_, 1U);
+   EXPECT_EQ(sas.unspentValue_, 50 * COIN);
+   EXPECT_FALSE(getSummary(scrAddrB, sas));
+
+   iface_->deleteAddrSummaries();
+   EXPECT_EQ(getStartHeight(), UINT32_MAX);
+   EXPECT_FALSE(getSummary(scrAddrA, sas));
+
+   /////////////////////////////////////////////////////////////////////////////
+   // Random address queries, a quarter of them for addresses with history,
+   // against the overview built from the SSH
+   srand(42);
+   const unsigned addrCount = 2000;
+   vector<BinaryData> scrAddrs;
+   {
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadWrite);
+
+      DataToCommit dtc(ARMORY_DB_SUPER);
+      dtc.lowestHeight_ = 0;
+
+      for (unsigned i = 0; i < addrCount; i++)
+      {
+         BinaryData scrAddr(21);
+         scrAddr.getPtr()[0] = SCRIPT_PREFIX_HASH160;
+         for (unsigned b = 1; b < 21; b++)
+            scrAddr.getPtr()[b] = uint8_t(rand());
+         scrAddrs.push_back(scrAddr);
+
+         StoredScriptHistory ssh;
+         ssh.uniqueKey_ = scrAddr;
+         auto& delta = dtc.addrSummaryDeltas_[scrAddr];
+
+         for (unsigned t = 0; t <= i % 5; t++)
+         {
+            uint32_t height = 10 + (rand() % 1000);
+            iface_->setValidDupIDForHeight(height, 0);
+
+            BinaryWriter bwKey;
+            bwKey.put_BinaryData(DBUtils::heightAndDupToHgtx(height, 0));
+            bwKey.put_uint16_t((uint16_t)i, BE);
+            bwKey.put_uint16_t((uint16_t)t, BE);
+
+            uint64_t value = (1 + rand() % 100) * COIN;
+            TxIOPair txio(bwKey.getData(), value);
+            txio.setUTXO(true);
+            ssh.insertTxio(txio);
+
+            delta.txioCount_++;
+            delta.unspentCount_++;
+            delta.unspentValue_ += value;
+            delta.seenAt(height);
+         }
+
+         iface_->putStoredScriptHistory(ssh);
+      }
+
+      dtc.putAddrSummaries(iface_);
+   }
+
+   vector<BinaryData> queries;
+   for (unsigned i = 0; i < 20000; i++)
+   {
+      if (i % 4 == 0)
+      {
+         queries.push_back(scrAddrs[rand() % scrAddrs.size()]);
+         continue;
+      }
+
+      BinaryData scrAddr(21);
+      scrAddr.getPtr()[0] = SCRIPT_PREFIX_HASH160;
+      for (unsigned b = 1; b < 21; b++)
+         scrAddr.getPtr()[b] = uint8_t(rand());
+      queries.push_back(scrAddr);
+   }
+
+   LMDBEnv::Transaction tx;
+   iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+
+   uint64_t found = 0, foundValue = 0;
+   auto start = chrono::steady_clock::now();
+   for (auto& scrAddr : queries)
+   {
+      StoredAddrSummary summary;
+      if (iface_->getStoredAddrSummary(summary, scrAddr))
+      {
+         found += summary.txioCount_;
+         foundValue += summary.unspentValue_;
+      }
+   }
+   auto summaryNs = chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now() - start).count();
+
+   uint64_t walked = 0, walkedValue = 0;
+   start = chrono::steady_clock::now();
+   for (auto& scrAddr : queries)
+   {
+      StoredScriptHistory ssh;
+      iface_->getStoredScriptHistorySummary(ssh, scrAddr);
+      if (!ssh.isInitialized())
+         continue;
+
+      auto countPerHeight = iface_->getSSHSummary(scrAddr, UINT32_MAX);
+      for (auto& count : countPerHeight)
+         walked += count.second;
+
+      iface_->readSubHistories(scrAddr, 0, UINT32_MAX, true,
+         [&walkedValue](StoredSubHistory& subssh)->bool
+      {
+         for (auto& txioPair : subssh.txioMap_)
+         {
+            if (txioPair.second.isUTXO())
+               walkedValue += txioPair.second.getValue();
+         }
+         return true;
+      });
+   }
+   auto walkNs = chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now() - start).count();
+
+   EXPECT_GT(found, 0U);
+   EXPECT_EQ(found, walked);
+   EXPECT_EQ(foundValue, walkedValue);
+
+   LOGINFO << "address overview, ns/query: " << summaryNs / queries.size()
+      << " from the summary index, " << walkNs / queries.size()
+      << " from the SSH (" << queries.size() << " queries)";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+class TxRefTest : public ::testing::Test
+{
+protected:
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(TxRefTest, TxRefNoInit)
+{
+   TxRef txr;
+   EXPECT_FALSE(txr.isInitialized());
+   //EXPECT_FALSE(txr.isBound());
+
+   EXPECT_EQ(txr.getDBKey(),     BinaryData(0));
+   EXPECT_EQ(txr.getDBKeyRef(),  BinaryDataRef());
+   //EXPECT_EQ(txr.getBlockTimestamp(), UINT32_MAX);
+   EXPECT_EQ(txr.getBlockHeight(),    UINT32_MAX);
+   EXPECT_EQ(txr.getDuplicateID(),    UINT8_MAX );
+   EXPECT_EQ(txr.getBlockTxIndex(),   UINT16_MAX);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(TxRefTest, TxRefKeyParts)
+{
+   TxRef txr;
+   BinaryData    newKey = READHEX("e3c4027f000f");
+   BinaryDataRef newRef(newKey);
+
+
+   txr.setDBKey(newKey);
+   EXPECT_EQ(txr.getDBKey(),    newKey);
+   EXPECT_EQ(txr.getDBKeyRef(), newRef);
 
    EXPECT_EQ(txr.getBlockHeight(),  0xe3c402);
    EXPECT_EQ(txr.getDuplicateID(),  127);
@@ -7274,6 +8325,198 @@ protected:
    }
 
 
+   // Replace the BDM and BDV with new ones built on config, over an empty DB
+   // unless keepDB. Wallets have to be registered again.
+   void restartBDM(bool keepDB = false)
+   {
+      delete theBDV;
+      delete theBDM;
+      if (!keepDB)
+         rmdir(ldbdir_ + "/*");
+
+      theBDM = new BlockDataManager_LevelDB(config);
+      theBDM->openDatabase();
+      iface_ = theBDM->getIFace();
+      theBDV = new BlockDataViewer(theBDM);
+   }
+
+
+   // hash160 scrAddrs no test chain tx pays to
+   vector<BinaryData> makeIdleScrAddrs(uint32_t count) const
+   {
+      vector<BinaryData> scrAddrs;
+      for (uint32_t i = 0; i < count; i++)
+      {
+         BinaryWriter bw;
+         bw.put_uint8_t(SCRIPT_PREFIX_HASH160);
+         bw.put_uint32_t(i, BE);
+         bw.put_BinaryData(BinaryData(16));
+         scrAddrs.push_back(bw.getData());
+      }
+
+      return scrAddrs;
+   }
+
+
+   // Runs blocks 3 to 5 one at a time for a wallet of scrAddrs over a fresh
+   // DB, rewriting every SSH per commit or moving the scan watermark along,
+   // then restarts on the same DB. Returns the flush stats summed over the 3
+   // blocks.
+   FlushStats scanWithWatermark(bool useWatermark,
+      const vector<BinaryData>& scrAddrs)
+   {
+      setBlocks({ "0", "1", "2" }, blk0dat_);
+      restartBDM();
+      theBDM->getScrAddrFilter()->setScanWatermarkOwner(useWatermark);
+
+      BtcWallet* wlt;
+      regWallet(scrAddrs, "wallet1", theBDV, &wlt);
+
+      TheBDM.doInitialSyncOnLoad(nullProgress);
+      theBDV->scanWallets();
+
+      FlushStats total;
+      for (auto& blk : { "3", "4", "5" })
+      {
+         appendBlocks({ blk }, blk0dat_);
+         TheBDM.readBlkFileUpdate();
+         theBDV->scanWallets();
+
+         auto flush = 
+            TheBDM.getScanTelemetry().getStats(ScanStage_Scan).flush_;
+         total.sshWritten_ += flush.sshWritten_;
+         total.sshBytes_ += flush.sshBytes_;
+         total.serializeUs_ += flush.serializeUs_;
+         total.writeUs_ += flush.writeUs_;
+      }
+
+      EXPECT_EQ(wlt->getFullBalance(), 240 * COIN);
+
+      //restart on the same DB, every scrAddr is picked up where it was left
+      restartBDM(true);
+      theBDM->getScrAddrFilter()->setScanWatermarkOwner(useWatermark);
+      regWallet(scrAddrs, "wallet1", theBDV, &wlt);
+
+      theBDM->getScrAddrFilter()->getScrAddrCurrentSyncState();
+      EXPECT_EQ(theBDM->getScrAddrFilter()->scanFrom(), 5);
+
+      TheBDM.doInitialSyncOnLoad(nullProgress);
+      theBDV->scanWallets();
+      EXPECT_EQ(wlt->getFullBalance(), 240 * COIN);
+
+      return total;
+   }
+
+
+   // One tx per idle scrAddr after the real ones of block 1, written the way
+   // a scan leaves them in HISTORY
+   void putIdleUtxos(const vector<BinaryData>& idleScrAddrs, 
+      uint32_t utxosPerScrAddr)
+   {
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadWrite);
+
+      BinaryData hgtX = DBUtils::heightAndDupToHgtx(1, 0);
+      for (uint32_t i = 0; i < idleScrAddrs.size(); i++)
+      {
+         auto& scrAddr = idleScrAddrs[i];
+
+         BinaryData txKey = hgtX + WRITE_UINT16_BE(uint16_t(100 + i));
+         BinaryData txHash = BtcUtils::getHash256(txKey);
+         iface_->putValue(HISTORY, DB_PREFIX_TXDATA, txKey,
+            WRITE_UINT32_LE(utxosPerScrAddr) + txHash);
+
+         BinaryWriter bwTxOut;
+         bwTxOut.put_uint64_t(COIN);
+         bwTxOut.put_var_int(25);
+         bwTxOut.put_BinaryData(READHEX("76a914"));
+         bwTxOut.put_BinaryData(scrAddr.getSliceRef(1, 20));
+         bwTxOut.put_BinaryData(READHEX("88ac"));
+
+         StoredScriptHistory ssh;
+         ssh.uniqueKey_ = scrAddr;
+         ssh.version_ = ARMORY_DB_VERSION;
+         ssh.alreadyScannedUpToBlk_ = 2;
+         ssh.followsScanWatermark_ = true;
+         ssh.totalTxioCount_ = utxosPerScrAddr;
+         ssh.totalUnspent_ = utxosPerScrAddr * COIN;
+
+         auto& subssh = ssh.subHistMap_[hgtX];
+         subssh.uniqueKey_ = scrAddr;
+         subssh.hgtX_ = hgtX;
+
+         for (uint16_t j = 0; j < utxosPerScrAddr; j++)
+         {
+            StoredTxOut stxo;
+            stxo.txVersion_ = 1;
+            stxo.dataCopy_ = bwTxOut.getData();
+            stxo.blockHeight_ = 1;
+            stxo.duplicateID_ = 0;
+            stxo.txIndex_ = uint16_t(100 + i);
+            stxo.txOutIndex_ = j;
+            stxo.parentHash_ = txHash;
+            stxo.spentness_ = TXOUT_UNSPENT;
+            iface_->putStoredTxOut(stxo);
+
+            StoredUtxo stu;
+            stu.hashAndId_ = txHash + WRITE_UINT16_BE(j);
+            stu.dbKey_ = stxo.getDBKey(false);
+            stu.value_ = COIN;
+            stu.scrAddr_ = scrAddr;
+            iface_->putStoredUtxo(stu);
+
+            uint64_t additionalSize = 0;
+            subssh.markTxOutUnspent(stxo.getDBKey(false), additionalSize,
+               COIN, false, false);
+         }
+
+         iface_->putStoredScriptHistory(ssh);
+      }
+   }
+
+
+   // Runs blocks 3 to 5 one at a time over a fresh DB, with the test chain
+   // wallet and the idle UTxOs, through the BDM's UTxO set or a rebuild from
+   // the DB in each batcher. blockUs gets how long each block took to read.
+   BtcWallet* scanIdleUtxos(bool useSet, const vector<BinaryData>& idleScrAddrs,
+      uint32_t utxosPerScrAddr, vector<uint64_t>& blockUs)
+   {
+      setBlocks({ "0", "1", "2" }, blk0dat_);
+      restartBDM();
+
+      auto filter = theBDM->getScrAddrFilter();
+      if (!useSet)
+         filter->setUtxoSet(nullptr);
+
+      BtcWallet* wlt;
+      regWallet({ TestChain::scrAddrA, TestChain::scrAddrB, 
+         TestChain::scrAddrC, TestChain::scrAddrD, TestChain::scrAddrE,
+         TestChain::scrAddrF }, "wallet1", theBDV, &wlt);
+      for (auto& scrAddr : idleScrAddrs)
+         filter->regScrAddrForScan(scrAddr, 0);
+
+      TheBDM.doInitialSyncOnLoad(nullProgress);
+      putIdleUtxos(idleScrAddrs, utxosPerScrAddr);
+
+      //as if they had been merged in
+      if (useSet)
+         TheBDM.getUtxoSet()->addScrAddrs(idleScrAddrs);
+
+      blockUs.clear();
+      for (auto& blk : { "3", "4", "5" })
+      {
+         appendBlocks({ blk }, blk0dat_);
+
+         auto start = ScanTelemetry::now();
+         TheBDM.readBlkFileUpdate();
+         blockUs.push_back(ScanTelemetry::now() - start);
+      }
+
+      theBDV->scanWallets();
+      return wlt;
+   }
+
+
    /////////////////////////////////////////////////////////////////////////////
    virtual void SetUp()
    {
@@ -7769,6 +9012,152 @@ TEST_F(BlockDir, BlockFileSplitUpdate)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockDir, BlockFileWatermark)
+{
+   BlockDataManagerConfig config;
+   config.armoryDbType = ARMORY_DB_BARE;
+   config.pruneType = DB_PRUNE_NONE;
+   config.blkFileLocation = blkdir_;
+   config.levelDBLocation = ldbdir_;
+   
+   config.genesisBlockHash = READHEX(MAINNET_GENESIS_HASH_HEX);
+   config.genesisTxHash = READHEX(MAINNET_GENESIS_TX_HASH_HEX);
+   config.magicBytes = READHEX(MAINNET_MAGIC_BYTES);
+
+   std::string blk1dat = BtcUtils::getBlkFilename(blkdir_, 1);
+   std::string blk2dat = BtcUtils::getBlkFilename(blkdir_, 2);
+   setBlocks({ "0", "1" }, blk0dat_);
+   setBlocks({ "2", "3" }, blk1dat);
+   setBlocks({ "4" }, blk2dat);
+
+   const std::vector<BinaryData> scraddrs
+   {
+      TestChain::scrAddrA, TestChain::scrAddrB, TestChain::scrAddrC
+   };
+
+   auto checkWatermark = [&](BlockDataManager_LevelDB& bdm)->void
+   {
+      LMDBBlockDatabase* iface = bdm.getIFace();
+      LMDBEnv::Transaction tx;
+      iface->beginDBTransaction(&tx, HEADERS, LMDB::ReadOnly);
+
+      //resumes at the end of the last file, after the top block
+      uint32_t fileNum;
+      uint64_t offset;
+      StoredBlockFilePos lastHeader;
+      ASSERT_TRUE(iface->getBlockFileWatermark(fileNum, offset, lastHeader));
+      EXPECT_EQ(fileNum, 2);
+      EXPECT_EQ(offset, BtcUtils::GetFileSize(blk2dat));
+      EXPECT_EQ(lastHeader.hash_, bdm.blockchain().top().getThisHash());
+      EXPECT_EQ(lastHeader.offset_ + lastHeader.blockSize_ + 8, offset);
+
+      //block 3 follows block 2 in blk00001.dat
+      StoredBlockFilePos sbfp2, sbfp3;
+      ASSERT_TRUE(iface->getBlockFilePos(sbfp2,
+         bdm.blockchain().getHeaderByHeight(2).getThisHash()));
+      ASSERT_TRUE(iface->getBlockFilePos(sbfp3,
+         bdm.blockchain().getHeaderByHeight(3).getThisHash()));
+      EXPECT_EQ(sbfp2.fileNum_, 1);
+      EXPECT_EQ(sbfp2.offset_, 0);
+      EXPECT_EQ(sbfp3.fileNum_, 1);
+      EXPECT_EQ(sbfp3.offset_, sbfp2.blockSize_ + 8);
+   };
+
+   auto checkBalances = [&](BtcWallet& wlt)->void
+   {
+      // we should get the same balance as we do for test 'Load5Blocks'
+      const ScrAddrObj *scrobj;
+      scrobj = wlt.getScrAddrObjByKey(scraddrs[0]);
+      EXPECT_EQ(scrobj->getFullBalance(), 50*COIN);
+      scrobj = wlt.getScrAddrObjByKey(scraddrs[1]);
+      EXPECT_EQ(scrobj->getFullBalance(), 70*COIN);
+      scrobj = wlt.getScrAddrObjByKey(scraddrs[2]);
+      EXPECT_EQ(scrobj->getFullBalance(), 20*COIN);
+   };
+
+   //moves the last header of the watermark off its block
+   auto shiftWatermark = [&](BlockDataManager_LevelDB& bdm, int shift)->void
+   {
+      LMDBBlockDatabase* iface = bdm.getIFace();
+      LMDBEnv::Transaction tx;
+      iface->beginDBTransaction(&tx, HEADERS, LMDB::ReadWrite);
+
+      uint32_t fileNum;
+      uint64_t offset;
+      StoredBlockFilePos lastHeader;
+      ASSERT_TRUE(iface->getBlockFileWatermark(fileNum, offset, lastHeader));
+      lastHeader.offset_ += shift;
+      iface->putBlockFileWatermark(fileNum, offset, lastHeader);
+   };
+
+   auto restart = [&](bool fromWatermark)->void
+   {
+      BlockDataManager_LevelDB bdm(config);
+      bdm.openDatabase();
+
+      BlockDataViewer bdv(&bdm);
+      BtcWallet& wlt = *bdv.registerWallet(scraddrs, "wallet1", false);
+
+      bdm.doInitialSyncOnLoad(nullProgress);
+      bdv.scanWallets();
+
+      //the 6 headers come from the DB, none were read again from blk files
+      EXPECT_EQ(bdm.getScanTelemetry().getStats(ScanStage_HeaderLoad).blocks_,
+         6);
+      EXPECT_EQ(bdm.blockchain().top().getBlockHeight(), 5);
+      checkBalances(wlt);
+
+      EXPECT_EQ(bdm.getWatermarkResumes(), fromWatermark ? 1 : 0);
+      EXPECT_EQ(bdm.getHeaderSearches(), fromWatermark ? 0 : 1);
+   };
+
+   {
+      BlockDataManager_LevelDB bdm(config);
+      bdm.openDatabase();
+
+      BlockDataViewer bdv(&bdm);
+      BtcWallet& wlt = *bdv.registerWallet(scraddrs, "wallet1", false);
+
+      bdm.doInitialSyncOnLoad(nullProgress);
+      bdv.scanWallets();
+
+      //the update moves the watermark along
+      appendBlocks({ "5" }, blk2dat);
+      bdm.readBlkFileUpdate();
+      bdv.scanWallets();
+
+      checkBalances(wlt);
+      checkWatermark(bdm);
+
+      //a watermark that doesn't match the blk files falls back to searching
+      //for the first unrecognized header, both land on the same spot
+      const BlockFilePosition endOfChain(2, BtcUtils::GetFileSize(blk2dat));
+      const uint32_t resumesBefore = bdm.getWatermarkResumes();
+      const uint32_t searchesBefore = bdm.getHeaderSearches();
+
+      EXPECT_EQ(bdm.findHeaderResumePosition(), endOfChain);
+      EXPECT_EQ(bdm.getWatermarkResumes(), resumesBefore + 1);
+      EXPECT_EQ(bdm.getHeaderSearches(), searchesBefore);
+
+      shiftWatermark(bdm, 1);
+      EXPECT_EQ(bdm.findHeaderResumePosition(), endOfChain);
+      EXPECT_EQ(bdm.getWatermarkResumes(), resumesBefore + 1);
+      EXPECT_EQ(bdm.getHeaderSearches(), searchesBefore + 1);
+      shiftWatermark(bdm, -1);
+   }
+
+   restart(true);
+
+   //restarting on a bad watermark reads no header twice either
+   {
+      BlockDataManager_LevelDB bdm(config);
+      bdm.openDatabase();
+      shiftWatermark(bdm, 1);
+   }
+   restart(false);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(BlockUtilsBare, Load5Blocks)
 {
@@ -7817,131 +9206,416 @@ TEST_F(BlockUtilsBare, Load5Blocks)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load5Blocks_DamagedBlkFile)
+TEST_F(BlockUtilsBare, Load5Blocks_WorkerThreadsFloor)
 {
-   vector<BinaryData> scrAddrVec;
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
+   //a cap below the tasks that wait on one another is raised to the floor
+   BlockDataManagerConfig lowConfig = config;
+   lowConfig.workerThreads = 2;
+   theBDM->setConfig(lowConfig);
+   EXPECT_EQ(ThreadPool::getGlobal().getMaxThreads(), 
+      ThreadPool::MIN_BACKEND_THREADS);
+
    BtcWallet* wlt;
-   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   regWallet({ TestChain::scrAddrA, TestChain::scrAddrB, 
+      TestChain::scrAddrC, TestChain::scrAddrD, TestChain::scrAddrE,
+      TestChain::scrAddrF }, "wallet1", theBDV, &wlt);
 
-   // this test should be reworked to be in terms of createTestChain.py
-   BtcUtils::copyFile("../reorgTest/botched_block.dat", blk0dat_);
    TheBDM.doInitialSyncOnLoad(nullProgress);
    theBDV->scanWallets();
+   EXPECT_EQ(wlt->getFullBalance(), 240 * COIN);
 
-   const ScrAddrObj* scrObj;
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 100*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(),   0*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(),  50*COIN);
-
-   EXPECT_EQ(wlt->getFullBalance(), 150 * COIN);
+   theBDM->setConfig(config);
+   EXPECT_EQ(ThreadPool::getGlobal().getMaxThreads(), 
+      ThreadPool::getDefaultMaxThreads());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load4Blocks_Plus2)
+TEST_F(BlockUtilsBare, Load5Blocks_ThreadPool)
 {
-   vector<BinaryData> scrAddrVec;
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
-   scrAddrVec.push_back(TestChain::scrAddrD);
-   scrAddrVec.push_back(TestChain::scrAddrE);
-   scrAddrVec.push_back(TestChain::scrAddrF);
    BtcWallet* wlt;
-   BtcWallet* wltLB1;
-   BtcWallet* wltLB2;
-   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
-   regLockboxes(theBDV, &wltLB1, &wltLB2);
+   regWallet({ TestChain::scrAddrA, TestChain::scrAddrB, 
+      TestChain::scrAddrC, TestChain::scrAddrD, TestChain::scrAddrE,
+      TestChain::scrAddrF }, "wallet1", theBDV, &wlt);
+
+   auto poolBefore = ThreadPool::getGlobal().getStats();
 
-   // Copy only the first four blocks.  Will copy the full file next to test
-   // readBlkFileUpdate method on non-reorg blocks.
-   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
    TheBDM.doInitialSyncOnLoad(nullProgress);
    theBDV->scanWallets();
+   EXPECT_EQ(wlt->getFullBalance(), 240 * COIN);
 
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 3);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash3);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash3).isMainBranch());
+   //grab and commits went through the pool, which stayed within its cap
+   auto poolAfter = ThreadPool::getGlobal().getStats();
+   EXPECT_GT(poolAfter.tasksRun_, poolBefore.tasksRun_);
+   EXPECT_LE(poolAfter.threads_, poolAfter.maxThreads_);
+}
 
-   const ScrAddrObj* scrObj;
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_ScanTelemetry)
+{
+   BtcWallet* wlt;
+   regWallet({ TestChain::scrAddrA, TestChain::scrAddrB, 
+      TestChain::scrAddrC, TestChain::scrAddrD, TestChain::scrAddrE,
+      TestChain::scrAddrF }, "wallet1", theBDV, &wlt);
 
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 10*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(),  0*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 10*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->scanWallets();
+   EXPECT_EQ(wlt->getFullBalance(), 240 * COIN);
 
-   // Load the remaining blocks.
-   setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+   //every block of the test chain went through each stage of the load
+   auto& telemetry = TheBDM.getScanTelemetry();
+   EXPECT_EQ(telemetry.getStats(ScanStage_HeaderLoad).blocks_, 6);
+   EXPECT_EQ(telemetry.getStats(ScanStage_BlockImport).blocks_, 6);
+   EXPECT_EQ(telemetry.getStats(ScanStage_Scan).blocks_, 6);
+   EXPECT_FALSE(telemetry.getStats(ScanStage_Scan).active_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_FlushPolicies)
+{
+   //the initial scan of the test chain under the fixed policy, the adaptive
+   //one and the adaptive one under a memory cap. Same balances, commits 
+   //follow the cap
+   struct PolicyRun
+   {
+      string name_;
+      bool adaptive_;
+      uint64_t memoryCap_;
+
+      FlushStats flush_;
+   };
+
+   //the cap has to bind below the smallest threshold the adaptive policy
+   //picks on its own, UPDATE_BYTES_THRESH / 4, which is 75 bytes in debug
+   //builds
+   const uint64_t memoryCap = min(uint64_t(8 * 1024),
+      BlockWriteBatcher::UPDATE_BYTES_THRESH / 2);
+
+   vector<PolicyRun> runs =
+   {
+      { "fixed", false, 0, FlushStats() },
+      { "adaptive", true, 0, FlushStats() },
+      { "adaptive, capped", true, memoryCap, FlushStats() },
+   };
+
+   for (auto& run : runs)
+   {
+      config.adaptiveFlush = run.adaptive_;
+      config.flushMemoryCap = run.memoryCap_;
+      restartBDM();
+
+      BtcWallet* wlt;
+      regWallet({ TestChain::scrAddrA, TestChain::scrAddrB, 
+         TestChain::scrAddrC, TestChain::scrAddrD, TestChain::scrAddrE,
+         TestChain::scrAddrF }, "wallet1", theBDV, &wlt);
+
+      TheBDM.doInitialSyncOnLoad(nullProgress);
+      theBDV->scanWallets();
+      run.flush_ = TheBDM.getScanTelemetry().getStats(ScanStage_Scan).flush_;
+
+      EXPECT_EQ(wlt->getFullBalance(), 240 * COIN) << run.name_;
+      EXPECT_EQ(run.flush_.adaptive_, run.adaptive_);
+      EXPECT_GT(run.flush_.commits_, 0);
+      if (run.memoryCap_ != 0)
+      {
+         EXPECT_EQ(run.flush_.memoryCap_, run.memoryCap_);
+         EXPECT_LE(run.flush_.bytesThreshold_, run.memoryCap_ / 3);
+      }
+   }
+
+   //the cap lowers the threshold the uncapped run settled on. Debug builds 
+   //commit every block either way, so commits can only tie there
+   EXPECT_EQ(runs[0].flush_.bytesThreshold_, 
+      BlockWriteBatcher::UPDATE_BYTES_THRESH);
+   EXPECT_LT(runs[2].flush_.bytesThreshold_, runs[1].flush_.bytesThreshold_);
+   EXPECT_GE(runs[2].flush_.commits_, runs[1].flush_.commits_);
+   EXPECT_NE(TheBDM.getScanTelemetry().dump().find("adaptive flush"),
+      string::npos);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load3BlocksPlus3_ScanWatermark)
+{
+   //a wallet with idle scrAddrs, fed one block at a time. Rewriting every 
+   //SSH per commit versus moving the watermark along
+   vector<BinaryData> scrAddrVec =
+   {
+      TestChain::scrAddrA, TestChain::scrAddrB, TestChain::scrAddrC,
+      TestChain::scrAddrD, TestChain::scrAddrE, TestChain::scrAddrF
+   };
+
+   auto idleScrAddrs = makeIdleScrAddrs(20);
+   scrAddrVec.insert(scrAddrVec.end(), 
+      idleScrAddrs.begin(), idleScrAddrs.end());
+
+   auto rewrite = scanWithWatermark(false, scrAddrVec);
+   auto watermark = scanWithWatermark(true, scrAddrVec);
+
+   //only the scrAddrs with traffic are written past the initial scan
+   EXPECT_GE(rewrite.sshWritten_, 3 * scrAddrVec.size());
+   EXPECT_LT(watermark.sshWritten_, 3 * 10);
+   EXPECT_LT(watermark.sshBytes_, rewrite.sshBytes_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load3BlocksPlus3_ScanWatermarkDroppedScrAddrs)
+{
+   //scrAddrs left out of the main filter for a while don't follow the 
+   //watermark when they come back
+   vector<BinaryData> scrAddrVec =
+   {
+      TestChain::scrAddrA, TestChain::scrAddrB, TestChain::scrAddrC,
+      TestChain::scrAddrD, TestChain::scrAddrE, TestChain::scrAddrF
+   };
+
+   auto restart = [this](const vector<BinaryData>& scrAddrs)->BtcWallet*
+   {
+      restartBDM(true);
+
+      BtcWallet* wlt;
+      regWallet(scrAddrs, "wallet1", theBDV, &wlt);
+      return wlt;
+   };
+
+   setBlocks({ "0", "1", "2" }, blk0dat_);
+   BtcWallet* wlt = restart(scrAddrVec);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->scanWallets();
+
+   //only scrAddrA is registered while the last 3 blocks are scanned
+   wlt = restart({ TestChain::scrAddrA });
+   appendBlocks({ "3", "4", "5" }, blk0dat_);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->scanWallets();
+   EXPECT_EQ(iface_->getTopBlockHeight(HISTORY), 5);
+
+   {
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+      EXPECT_EQ(iface_->getScanWatermark(), 5);
+
+      StoredScriptHistory ssh;
+      iface_->getStoredScriptHistorySummary(ssh, TestChain::scrAddrB);
+      EXPECT_EQ(ssh.getScannedUpTo(iface_->getScanWatermark(), 
+         iface_->getScanGeneration()), 2);
+   }
+
+   //the rest of the wallet is back, it has to be scanned again
+   wlt = restart(scrAddrVec);
+   theBDM->getScrAddrFilter()->getScrAddrCurrentSyncState();
+   EXPECT_EQ(theBDM->getScrAddrFilter()->scanFrom(), 0);
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->scanWallets();
+   EXPECT_EQ(wlt->getScrAddrObjByKey(TestChain::scrAddrB)->getFullBalance(),
+      70 * COIN);
+   EXPECT_EQ(wlt->getFullBalance(), 240 * COIN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load3BlocksPlus3_UtxoSet)
+{
+   //UTxOs on idle scrAddrs tracked next to the test chain wallet, fed one 
+   //block at a time. Each batcher rebuilding them from the DB versus the
+   //BDM's UTxO set
+   const uint32_t utxosPerScrAddr = 10;
+   auto idleScrAddrs = makeIdleScrAddrs(20);
+   vector<uint64_t> blockUs;
+
+   BtcWallet* wlt = 
+      scanIdleUtxos(false, idleScrAddrs, utxosPerScrAddr, blockUs);
+   EXPECT_EQ(wlt->getFullBalance(), 240 * COIN);
+   EXPECT_EQ(TheBDM.getUtxoSet()->getWarmCheckouts(), 0);
+
+   wlt = scanIdleUtxos(true, idleScrAddrs, utxosPerScrAddr, blockUs);
+   EXPECT_EQ(wlt->getFullBalance(), 240 * COIN);
+
+   //the set was resumed for every block and matches a rebuild
+   auto utxoSet = TheBDM.getUtxoSet();
+   EXPECT_EQ(utxoSet->getWarmCheckouts(), 3);
+   EXPECT_EQ(utxoSet->getHeight(), 5);
+   EXPECT_GT(utxoSet->size(), idleScrAddrs.size() * utxosPerScrAddr);
+   EXPECT_TRUE(utxoSet->verify(iface_, *TheBDM.getScrAddrFilter()));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_FullReorg_UtxoSet)
+{
+   //undone blocks give back the UTxOs they spent and take back the ones they
+   //created
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+   regWallet({ TestChain::scrAddrA, TestChain::scrAddrB, 
+      TestChain::scrAddrC, TestChain::scrAddrD, TestChain::scrAddrE,
+      TestChain::scrAddrF }, "wallet1", theBDV, &wlt);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   auto utxoSet = TheBDM.getUtxoSet();
+   EXPECT_TRUE(utxoSet->verify(iface_, *TheBDM.getScrAddrFilter()));
+   EXPECT_EQ(utxoSet->getHeight(), 5);
+
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A" }, blk0dat_);
    TheBDM.readBlkFileUpdate();
+
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
+   uint32_t prevBlock = TheBDM.readBlkFileUpdate();
+   theBDV->scanWallets(prevBlock);
+
+   EXPECT_EQ(wlt->getFullBalance(), 285*COIN);
+   EXPECT_EQ(utxoSet->getColdCheckouts(), 1);
+   EXPECT_GE(utxoSet->getWarmCheckouts(), 2);
+   EXPECT_EQ(utxoSet->getHeight(), 5);
+   EXPECT_TRUE(utxoSet->verify(iface_, *TheBDM.getScrAddrFilter()));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_UtxoTable)
+{
+   //the initial scan with the UTxO cache kept whole versus dropped at every
+   //commit, spends then resolve out of the outpoint table. Then the cost of
+   //a cache miss through the table versus through the tx hints
+   struct UtxoTableRun
+   {
+      string name_;
+      uint64_t memoryCap_;
+      uint64_t elapsedUs_;
+   };
+
+   vector<UtxoTableRun> runs =
+   {
+      { "utxo cache", 0, 0 },
+      { "outpoint table", 1, 0 },
+   };
+
+   for (auto& run : runs)
+   {
+      config.adaptiveFlush = false;
+      config.flushMemoryCap = run.memoryCap_;
+      restartBDM();
+
+      BtcWallet* wlt;
+      BtcWallet* wltLB1;
+      BtcWallet* wltLB2;
+      regWallet({ TestChain::scrAddrA, TestChain::scrAddrB, 
+         TestChain::scrAddrC, TestChain::scrAddrD, TestChain::scrAddrE,
+         TestChain::scrAddrF }, "wallet1", theBDV, &wlt);
+      regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+      auto start = ScanTelemetry::now();
+      TheBDM.doInitialSyncOnLoad(nullProgress);
+      run.elapsedUs_ = ScanTelemetry::now() - start;
+      theBDV->scanWallets();
+
+      EXPECT_EQ(wlt->getFullBalance(), 240 * COIN) << run.name_;
+      EXPECT_EQ(wltLB1->getFullBalance(), 30 * COIN) << run.name_;
+      EXPECT_EQ(wltLB2->getFullBalance(), 30 * COIN) << run.name_;
+      EXPECT_TRUE(UtxoSet::verifyTable(iface_, *TheBDM.getScrAddrFilter()));
+
+      //a dropped cache isn't kept for the next batcher
+      EXPECT_EQ(TheBDM.getUtxoSet()->isValid(), run.memoryCap_ == 0);
+
+      LOGINFO << run.name_ << ": initial scan " << run.elapsedUs_ << "us";
+   }
+
+   set<BinaryData> scrAddrs;
+   for (auto& saPair : TheBDM.getScrAddrFilter()->getScrAddrMap())
+      scrAddrs.insert(saPair.first);
+
+   LMDBEnv::Transaction tx;
+   iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+
+   UtxoSet::UtxoMap utxos;
+   UtxoSet::loadTable(iface_, scrAddrs, utxos);
+   ASSERT_GT(utxos.size(), 0);
+
+   const uint32_t rounds = 1000;
+   uint64_t tableUs = 0;
+   uint64_t hintsUs = 0;
+   for (uint32_t i = 0; i < rounds; i++)
+   {
+      for (auto& utxoPair : utxos)
+      {
+         auto start = ScanTelemetry::now();
+         StoredUtxo stu;
+         StoredTxOut stxoFromTable;
+         iface_->getStoredUtxo(stu, utxoPair.first);
+         iface_->getStoredTxOut(stxoFromTable, stu.dbKey_);
+         tableUs += ScanTelemetry::now() - start;
+
+         start = ScanTelemetry::now();
+         StoredTxOut stxoFromHints;
+         BinaryData dbKey;
+         iface_->getStoredTx_byHash(
+            utxoPair.first.getSliceCopy(0, 32), nullptr, &dbKey);
+         dbKey.append(utxoPair.first.getSliceRef(32, 2));
+         iface_->getStoredTxOut(stxoFromHints, dbKey);
+         hintsUs += ScanTelemetry::now() - start;
+
+         if (i == 0)
+         {
+            EXPECT_EQ(stxoFromTable.getDBKey(false), 
+               utxoPair.second->getDBKey(false));
+            EXPECT_EQ(stxoFromTable.getDBKey(false), 
+               stxoFromHints.getDBKey(false));
+         }
+      }
+   }
+
+   const uint64_t lookups = rounds * utxos.size();
+   LOGINFO << "cache miss over " << utxos.size() << " utxos: outpoint table "
+      << tableUs * 1000 / lookups << "ns, tx hints " 
+      << hintsUs * 1000 / lookups << "ns";
+
+   EXPECT_LT(tableUs, hintsUs);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_DamagedBlkFile)
+{
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   BtcWallet* wlt;
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+
+   // this test should be reworked to be in terms of createTestChain.py
+   BtcUtils::copyFile("../reorgTest/botched_block.dat", blk0dat_);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
    theBDV->scanWallets();
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5).isMainBranch());
 
+   const ScrAddrObj* scrObj;
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 100*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(),   0*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(),  50*COIN);
 
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+   EXPECT_EQ(wlt->getFullBalance(), 150 * COIN);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load4Blocks_ReloadBDM_ZC_Plus2)
+TEST_F(BlockUtilsBare, Load4Blocks_Plus2)
 {
    vector<BinaryData> scrAddrVec;
    scrAddrVec.push_back(TestChain::scrAddrA);
    scrAddrVec.push_back(TestChain::scrAddrB);
    scrAddrVec.push_back(TestChain::scrAddrC);
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
    BtcWallet* wlt;
    BtcWallet* wltLB1;
    BtcWallet* wltLB2;
    regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
    regLockboxes(theBDV, &wltLB1, &wltLB2);
 
-   wlt->addScrAddress(TestChain::scrAddrE);
-
    // Copy only the first four blocks.  Will copy the full file next to test
    // readBlkFileUpdate method on non-reorg blocks.
    setBlocks({ "0", "1", "2", "3" }, blk0dat_);
    TheBDM.doInitialSyncOnLoad(nullProgress);
-   theBDV->enableZeroConf();
    theBDV->scanWallets();
 
    EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 3);
@@ -7955,150 +9629,440 @@ TEST_F(BlockUtilsBare, Load4Blocks_ReloadBDM_ZC_Plus2)
    EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
    EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
-
-   uint64_t fullBalance = wlt->getFullBalance();
-   uint64_t spendableBalance = wlt->getSpendableBalance(4);
-   uint64_t unconfirmedBalance = wlt->getUnconfirmedBalance(4);
-   EXPECT_EQ(fullBalance, 165*COIN);
-   EXPECT_EQ(spendableBalance, 65*COIN);
-   EXPECT_EQ(unconfirmedBalance, 165*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
 
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 10*COIN);
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(),  0*COIN);
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 10*COIN);
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
-
-   EXPECT_EQ(wltLB1->getFullBalance(), 10 * COIN);
-   EXPECT_EQ(wltLB2->getFullBalance(), 15 * COIN);
-
-   //restart bdm
-   theBDV->unregisterWallet("wallet1");
-   delete theBDM;
-   delete theBDV;
-
-   theBDM = new BlockDataManager_LevelDB(config);
-   theBDM->openDatabase();
-   theBDV = new BlockDataViewer(theBDM);
-   iface_ = theBDM->getIFace();
-
-   wlt = theBDV->registerWallet(scrAddrVec, "wallet1", false);
-   wlt->addScrAddress(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
 
-   regLockboxes(theBDV, &wltLB1, &wltLB2);
+   // the BDM thread only reads the blk files when there is a new block
+   EXPECT_FALSE(TheBDM.hasNewBlkData());
 
-   TheBDM.doInitialSyncOnLoad(nullProgress);
-   theBDV->enableZeroConf();
+   // Load the remaining blocks.
+   setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+   EXPECT_TRUE(TheBDM.hasNewBlkData());
+   TheBDM.readBlkFileUpdate();
+   EXPECT_FALSE(TheBDM.hasNewBlkData());
    theBDV->scanWallets();
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5).isMainBranch());
 
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
    EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
-
-   fullBalance = wlt->getFullBalance();
-   spendableBalance = wlt->getSpendableBalance(4);
-   unconfirmedBalance = wlt->getUnconfirmedBalance(4);
-   EXPECT_EQ(fullBalance, 165 * COIN);
-   EXPECT_EQ(spendableBalance, 65 * COIN);
-   EXPECT_EQ(unconfirmedBalance, 165 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
 
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
-
-   EXPECT_EQ(wltLB1->getFullBalance(), 10 * COIN);
-   EXPECT_EQ(wltLB2->getFullBalance(), 15 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+}
 
-   //add ZC
-   BinaryData rawZC(TestChain::zcTxSize);
-   FILE *ff = fopen("../reorgTest/ZCtx.tx", "rb");
-   fread(rawZC.getPtr(), TestChain::zcTxSize, 1, ff);
-   fclose(ff);
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load4Blocks_Plus2_PreallocatedBlkFile)
+{
+   //bitcoind grows its blk files in zeroed chunks, appending a block to one
+   //doesn't change its size
+   const uint64_t chunkSize = 64 * 1024;
+   auto setPaddedBlocks = [&](const vector<string>& blocks)->void
+   {
+      setBlocks(blocks, blk0dat_);
+      uint64_t blkSize = BtcUtils::GetFileSize(blk0dat_);
+      ofstream os(blk0dat_, ios::app | ios::binary);
+      os << string(chunkSize - blkSize, '\0');
+   };
 
-   BinaryData rawLBZC(TestChain::lbZCTxSize);
-   FILE *flb = fopen("../reorgTest/LBZC.tx", "rb");
-   fread(rawLBZC.getPtr(), TestChain::lbZCTxSize, 1, flb);
-   fclose(flb);
+   BtcWallet* wlt;
+   regWallet({ TestChain::scrAddrA, TestChain::scrAddrB }, "wallet1",
+      theBDV, &wlt);
 
-   theBDV->addNewZeroConfTx(rawZC, 0, false);
-   theBDV->addNewZeroConfTx(rawLBZC, 0, false);
-   theBDV->parseNewZeroConfTx();
+   setPaddedBlocks({ "0", "1", "2", "3" });
+   TheBDM.doInitialSyncOnLoad(nullProgress);
    theBDV->scanWallets();
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 3);
+   EXPECT_FALSE(TheBDM.hasNewBlkData());
 
-   fullBalance = wlt->getFullBalance();
-   spendableBalance = wlt->getSpendableBalance(4);
-   unconfirmedBalance = wlt->getUnconfirmedBalance(4);
-   EXPECT_EQ(fullBalance, 165*COIN);
-   EXPECT_EQ(spendableBalance, 35*COIN);
-   EXPECT_EQ(unconfirmedBalance, 135*COIN);
+   setPaddedBlocks({ "0", "1", "2", "3", "4", "5" });
+   EXPECT_EQ(BtcUtils::GetFileSize(blk0dat_), chunkSize);
+   EXPECT_TRUE(TheBDM.hasNewBlkData());
 
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
+   TheBDM.readBlkFileUpdate();
+   theBDV->scanWallets();
+   EXPECT_FALSE(TheBDM.hasNewBlkData());
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5);
+   EXPECT_EQ(wlt->getScrAddrObjByKey(TestChain::scrAddrB)->getFullBalance(),
+      70 * COIN);
+}
 
-   EXPECT_EQ(wltLB1->getFullBalance(), 5 * COIN);
-   EXPECT_EQ(wltLB2->getFullBalance(), 15 * COIN);
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load4Blocks_Plus2_BlockEffects)
+{
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->scanWallets();
+
+   //the initial scan leaves the effects of the blocks it went over
+   EXPECT_TRUE(theBDV->getBlockEffects(3).isInitialized());
+   EXPECT_FALSE(theBDV->getBlockEffects(4).isInitialized());
+
+   map<BinaryData, BtcWallet*> walletsByID;
+   map<BtcWallet*, uint64_t> balances;
+   for (auto w : { wlt, wltLB1, wltLB2 })
+   {
+      walletsByID[w->walletID()] = w;
+      balances[w] = w->getFullBalance();
+   }
 
-   //
    setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+   uint32_t prevBlock = TheBDM.readBlkFileUpdate();
+   EXPECT_EQ(prevBlock, 4U);
+   theBDV->scanWallets(prevBlock);
+
+   auto effectsVec = theBDV->getBlockEffects(4, UINT32_MAX);
+   ASSERT_EQ(effectsVec.size(), 2U);
+   EXPECT_EQ(effectsVec[0].height_, 4U);
+   EXPECT_EQ(effectsVec[0].blockHash_, TestChain::blkHash4);
+   EXPECT_EQ(effectsVec[1].height_, 5U);
+   EXPECT_EQ(effectsVec[1].blockHash_, TestChain::blkHash5);
+
+   map<BinaryData, int64_t> deltas;
+   for (const auto& effects : effectsVec)
+   {
+      EXPECT_EQ(BtcUtils::getHash256(effects.rawHeader_), effects.blockHash_);
+      EXPECT_FALSE(effects.txHashes_.empty());
+
+      set<BinaryData> blockTxHashes(
+         effects.txHashes_.begin(), effects.txHashes_.end());
+      EXPECT_EQ(blockTxHashes.size(), effects.txHashes_.size());
+
+      for (const auto& wltEffects : effects.wallets_)
+      {
+         ASSERT_EQ(walletsByID.count(wltEffects.walletID_), 1U);
+         BtcWallet* w = walletsByID[wltEffects.walletID_];
+         EXPECT_EQ(wltEffects.isLockbox_, w != wlt);
+         deltas[wltEffects.walletID_] += wltEffects.valueDelta_;
+
+         //the wallet's ledgers for this block, in block order
+         ASSERT_EQ(wltEffects.txHashes_.size(), wltEffects.txIndexes_.size());
+         for (unsigned i = 0; i < wltEffects.txHashes_.size(); i++)
+         {
+            auto& le = w->getLedgerEntryForTx(wltEffects.txHashes_[i]);
+            EXPECT_EQ(le.getBlockNum(), effects.height_);
+            EXPECT_EQ(le.getIndex(), wltEffects.txIndexes_[i]);
+            if (i > 0)
+               EXPECT_LT(wltEffects.txIndexes_[i - 1], 
+                  wltEffects.txIndexes_[i]);
+            EXPECT_EQ(blockTxHashes.count(wltEffects.txHashes_[i]), 1U);
+         }
+
+         EXPECT_FALSE(wltEffects.scrAddrs_.empty());
+         for (const auto& scrAddr : wltEffects.scrAddrs_)
+            EXPECT_NE(w->getScrAddrObjByKey(scrAddr), nullptr);
+      }
+   }
+
+   //the deltas add up to the balance changes
+   for (auto& balance : balances)
+   {
+      EXPECT_EQ(balance.first->getFullBalance() - balance.second,
+         deltas[balance.first->walletID()]);
+   }
+   EXPECT_EQ(deltas[wlt->walletID()], int64_t(65*COIN));
+
+   //a reorg replaces the effects of the blocks it undid
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A" }, blk0dat_);
    TheBDM.readBlkFileUpdate();
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
+   prevBlock = TheBDM.readBlkFileUpdate();
+   theBDV->scanWallets(prevBlock);
+
+   EXPECT_EQ(theBDV->getBlockEffects(4).blockHash_, TestChain::blkHash4A);
+   EXPECT_EQ(theBDV->getBlockEffects(5).blockHash_, TestChain::blkHash5A);
+   EXPECT_EQ(theBDV->getBlockEffects(3).blockHash_, TestChain::blkHash3);
+
+   //armoryd runs its new block functions on the whole main chain block
+   BinaryData rawBlock = theBDV->getSerializedMainBlock(5);
+   ASSERT_GT(rawBlock.getSize(), HEADER_SIZE);
+   EXPECT_EQ(BtcUtils::getHash256(rawBlock.getSliceRef(0, HEADER_SIZE)),
+      TestChain::blkHash5A);
+   BinaryRefReader brr(rawBlock.getRef());
+   brr.advance(HEADER_SIZE);
+   EXPECT_EQ(brr.get_var_int(), 
+      TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5A).getNumTx());
+}
+
+#ifndef _WIN32
+////////////////////////////////////////////////////////////////////////////////
+// LMDB envs can't be opened twice in one process, read-only instances are run
+// in forked children. These report through their exit code and must not touch
+// the parent's envs
+TEST_F(BlockUtilsBare, Load4Blocks_Plus2_ReadOnlyAttach)
+{
+   //fullnode only has history for what the writer tracks
+   const vector<BinaryData> scrAddrVec
+   { 
+      TestChain::scrAddrA, TestChain::scrAddrB, TestChain::scrAddrC 
+   };
+   BtcWallet* wlt;
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+
+   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
    theBDV->scanWallets();
+   EXPECT_EQ(wlt->getFullBalance(), 135 * COIN);
 
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5).isMainBranch());
+   int toChild[2], toParent[2];
+   ASSERT_EQ(pipe(toChild), 0);
+   ASSERT_EQ(pipe(toParent), 0);
 
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(),  50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(),  70*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(),  20*COIN);
+   //the child only gets the forking thread
+   ThreadPool::getGlobal().releaseWorkers();
+   pid_t pid = fork();
+   ASSERT_NE(pid, -1);
 
-   fullBalance = wlt->getFullBalance();
-   spendableBalance = wlt->getSpendableBalance(5);
-   unconfirmedBalance = wlt->getUnconfirmedBalance(5);
-   EXPECT_EQ(fullBalance, 170*COIN);
-   EXPECT_EQ(spendableBalance, 70*COIN);
-   EXPECT_EQ(unconfirmedBalance, 170*COIN);
+   if (pid == 0)
+   {
+      auto readOnlyInstance = [&](void)->int
+      {
+         BlockDataManagerConfig roConfig = config;
+         roConfig.readOnly = true;
 
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25 * COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+         BlockDataManager_LevelDB bdm(roConfig);
+         bdm.openDatabase();
+         BlockDataViewer bdv(&bdm);
+         BtcWallet* roWlt = bdv.registerWallet(scrAddrVec, "wallet1", false);
 
-   EXPECT_EQ(wltLB1->getFullBalance(), 30 * COIN);
-   EXPECT_EQ(wltLB2->getFullBalance(), 30 * COIN);
+         bdm.doInitialSyncOnLoad(nullProgress);
+         bdv.scanWallets();
+
+         if (bdm.blockchain().top().getThisHash() != TestChain::blkHash3)
+            return 1;
+         if (roWlt->getFullBalance() != 135 * COIN)
+            return 2;
+
+         //writes are refused
+         try
+         {
+            bdm.doInitialSyncOnLoad_Rebuild(nullProgress);
+            return 3;
+         }
+         catch (runtime_error&)
+         {}
+
+         char c = 0;
+         if (write(toParent[1], &c, 1) != 1 || read(toChild[0], &c, 1) != 1)
+            return 4;
+
+         //the writer's new top is seen without reading the headers
+         if (!bdm.hasNewBlkData())
+            return 15;
+
+         uint32_t prevTop = bdm.readBlkFileUpdate();
+         if (prevTop != 4)
+            return 5;
+         if (bdm.hasNewBlkData())
+            return 16;
+         bdv.scanWallets(prevTop);
+
+         if (bdm.blockchain().top().getThisHash() != TestChain::blkHash5)
+            return 6;
+         if (bdm.getIFace()->getTopBlockHash(HEADERS) != TestChain::blkHash5)
+            return 7;
+         if (roWlt->getFullBalance() != 140 * COIN)
+            return 8;
+         
+         //nothing new
+         if (bdm.readBlkFileUpdate() != 0)
+            return 9;
+
+         //the writer's reorg forks below the heights the reader looks at,
+         //the rest of the branch is found through the parents
+         if (write(toParent[1], &c, 1) != 1 || read(toChild[0], &c, 1) != 1)
+            return 11;
+
+         prevTop = bdm.readBlkFileUpdate();
+         if (prevTop != 4)
+            return 12;
+         if (bdm.blockchain().top().getThisHash() != TestChain::blkHash5A)
+            return 13;
+         if (!bdm.blockchain().getHeaderByHash(TestChain::blkHash4A)
+               .isMainBranch())
+            return 14;
+
+         return 0;
+      };
+
+      int result = 10;
+      try
+      {
+         result = readOnlyInstance();
+      }
+      catch (...)
+      {}
+      
+      _exit(result);
+   }
+
+   close(toChild[0]);
+   close(toParent[1]);
+
+   //the child exits early on failure, the exit code tells where
+   char c = 0;
+   if (read(toParent[0], &c, 1) == 1)
+   {
+      //the writer moves on while the reader is attached
+      setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+      TheBDM.readBlkFileUpdate();
+      theBDV->scanWallets();
+      EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5);
+      EXPECT_EQ(wlt->getFullBalance(), 140 * COIN);
+
+      EXPECT_EQ(write(toChild[1], &c, 1), 1);
+   }
+
+   if (read(toParent[0], &c, 1) == 1)
+   {
+      setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
+      TheBDM.readBlkFileUpdate();
+      theBDV->scanWallets();
+      EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5A);
+
+      EXPECT_EQ(write(toChild[1], &c, 1), 1);
+   }
+
+   close(toChild[1]);
+   close(toParent[0]);
+
+   int status;
+   ASSERT_EQ(waitpid(pid, &status, 0), pid);
+   ASSERT_TRUE(WIFEXITED(status));
+   EXPECT_EQ(WEXITSTATUS(status), 0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load3Blocks_ZC_Plus3_TestLedgers)
+// Runs nProcs read-only processes over config's DB, each querying headers and
+// an SSH until it has done maxQueries or maxTime is up. Returns the number of
+// queries they got through.
+static uint64_t runReadOnlyReaders(const BlockDataManagerConfig& config,
+   unsigned nProcs, uint64_t maxQueries, chrono::milliseconds maxTime)
+{
+   int results[2];
+   if (pipe(results) != 0)
+      return 0;
+
+   //the children only get the forking thread
+   ThreadPool::getGlobal().releaseWorkers();
+
+   vector<pid_t> pids;
+   for (unsigned i = 0; i < nProcs; i++)
+   {
+      pid_t pid = fork();
+      if (pid != 0)
+      {
+         pids.push_back(pid);
+         continue;
+      }
+         
+      uint64_t count = 0;
+      try
+      {
+         BlockDataManagerConfig roConfig = config;
+         roConfig.readOnly = true;
+
+         BlockDataManager_LevelDB bdm(roConfig);
+         bdm.openDatabase();
+         bdm.doInitialSyncOnLoad(nullProgress);
+         LMDBBlockDatabase* iface = bdm.getIFace();
+
+         //fresh read transaction per query, as a client would
+         auto start = chrono::steady_clock::now();
+         while (count < maxQueries &&
+                chrono::steady_clock::now() - start < maxTime)
+         {
+            StoredHeader sbh;
+            if (!iface->getStoredHeader(sbh, count % 6, 0))
+               break;
+            
+            StoredScriptHistory ssh;
+            iface->getStoredScriptHistory(ssh, TestChain::scrAddrB);
+            count++;
+         }
+      }
+      catch (...)
+      {
+         count = 0;
+      }
+
+      if (write(results[1], &count, sizeof(count)) != sizeof(count))
+         _exit(1);
+      _exit(0);
+   }
+
+   uint64_t total = 0;
+   for (unsigned i = 0; i < pids.size(); i++)
+   {
+      uint64_t count = 0;
+      if (read(results[0], &count, sizeof(count)) == sizeof(count))
+         total += count;
+   }
+
+   for (auto pid : pids)
+      waitpid(pid, nullptr, 0);
+
+   close(results[0]);
+   close(results[1]);
+   return total;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_ReadOnlyAttach_ConcurrentReaders)
+{
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   //every process gets through all of its queries
+   EXPECT_EQ(runReadOnlyReaders(config, 2, 100, chrono::seconds(10)), 200);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load4Blocks_ReloadBDM_ZC_Plus2)
 {
    vector<BinaryData> scrAddrVec;
    scrAddrVec.push_back(TestChain::scrAddrA);
@@ -8112,83 +10076,43 @@ TEST_F(BlockUtilsBare, Load3Blocks_ZC_Plus3_TestLedgers)
 
    wlt->addScrAddress(TestChain::scrAddrE);
 
-   //copy the first 3 blocks
-   setBlocks({ "0", "1", "2" }, blk0dat_);
+   // Copy only the first four blocks.  Will copy the full file next to test
+   // readBlkFileUpdate method on non-reorg blocks.
+   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
    TheBDM.doInitialSyncOnLoad(nullProgress);
-
-   //enable ZC after the initial sync
    theBDV->enableZeroConf();
-
    theBDV->scanWallets();
 
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 2);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash2);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash2).isMainBranch());
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 3);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash3);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash3).isMainBranch());
 
    const ScrAddrObj* scrObj;
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
    EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(),  0*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
 
    uint64_t fullBalance = wlt->getFullBalance();
-   uint64_t spendableBalance = wlt->getSpendableBalance(3);
-   uint64_t unconfirmedBalance = wlt->getUnconfirmedBalance(3);
-   EXPECT_EQ(fullBalance, 105 * COIN);
-   EXPECT_EQ(spendableBalance, 5 * COIN);
-   EXPECT_EQ(unconfirmedBalance, 105 * COIN);
-
-   //add ZC
-   BinaryData rawZC(259);
-   FILE *ff = fopen("../reorgTest/ZCtx.tx", "rb");
-   fread(rawZC.getPtr(), 259, 1, ff);
-   fclose(ff);
-
-   BinaryData ZChash = READHEX(TestChain::zcTxHash256);
-
-   theBDV->addNewZeroConfTx(rawZC, 1300000000, false);
-   theBDV->parseNewZeroConfTx();
-   theBDV->scanWallets();
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 75*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(),  10*COIN);
-
-   fullBalance = wlt->getFullBalance();
-   spendableBalance = wlt->getSpendableBalance(4);
-   unconfirmedBalance = wlt->getUnconfirmedBalance(4);
-   EXPECT_EQ(fullBalance, 135 * COIN);
-   EXPECT_EQ(spendableBalance, 5 * COIN);
-   EXPECT_EQ(unconfirmedBalance, 135 * COIN);
-
-   //check ledger for ZC
-   LedgerEntry le = wlt->getLedgerEntryForTx(ZChash);
-   EXPECT_EQ(le.getTxTime(), 1300000000);
-   EXPECT_EQ(le.getValue(),  3000000000);
-   EXPECT_EQ(le.getBlockNum(), UINT32_MAX);
-
-   //pull ZC from DB, verify it's carrying the proper data
-   LMDBEnv::Transaction *dbtx = 
-      new LMDBEnv::Transaction(iface_->dbEnv_[HISTORY].get(), LMDB::ReadOnly);
-   StoredTx zcStx;
-   BinaryData zcKey = WRITE_UINT16_BE(0xFFFF);
-   zcKey.append(WRITE_UINT32_LE(0));
-
-   EXPECT_EQ(iface_->getStoredZcTx(zcStx, zcKey), true);
-   EXPECT_EQ(zcStx.thisHash_, ZChash);
-   EXPECT_EQ(zcStx.numBytes_ , TestChain::zcTxSize);
-   EXPECT_EQ(zcStx.fragBytes_, 190);
-   EXPECT_EQ(zcStx.numTxOut_, 2);
-   EXPECT_EQ(zcStx.stxoMap_.begin()->second.getValue(), 10 * COIN);
+   uint64_t spendableBalance = wlt->getSpendableBalance(4);
+   uint64_t unconfirmedBalance = wlt->getUnconfirmedBalance(4);
+   EXPECT_EQ(fullBalance, 165*COIN);
+   EXPECT_EQ(spendableBalance, 65*COIN);
+   EXPECT_EQ(unconfirmedBalance, 165*COIN);
 
-   //check ZChash in DB
-   EXPECT_EQ(iface_->getTxHashForLdbKey(zcKey), ZChash);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
 
-   delete dbtx;
+   EXPECT_EQ(wltLB1->getFullBalance(), 10 * COIN);
+   EXPECT_EQ(wltLB2->getFullBalance(), 15 * COIN);
 
    //restart bdm
    theBDV->unregisterWallet("wallet1");
@@ -8200,94 +10124,84 @@ TEST_F(BlockUtilsBare, Load3Blocks_ZC_Plus3_TestLedgers)
    theBDV = new BlockDataViewer(theBDM);
    iface_ = theBDM->getIFace();
 
-   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   wlt = theBDV->registerWallet(scrAddrVec, "wallet1", false);
+   wlt->addScrAddress(TestChain::scrAddrE);
+
    regLockboxes(theBDV, &wltLB1, &wltLB2);
 
    TheBDM.doInitialSyncOnLoad(nullProgress);
    theBDV->enableZeroConf();
    theBDV->scanWallets();
 
-   //add 4th block
-   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
-   TheBDM.readBlkFileUpdate();
-   theBDV->scanWallets();
-
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 3);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash3);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash3).isMainBranch());
-
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
    EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
 
    fullBalance = wlt->getFullBalance();
-   spendableBalance = wlt->getSpendableBalance(5);
-   unconfirmedBalance = wlt->getUnconfirmedBalance(5);
+   spendableBalance = wlt->getSpendableBalance(4);
+   unconfirmedBalance = wlt->getUnconfirmedBalance(4);
    EXPECT_EQ(fullBalance, 165 * COIN);
-   EXPECT_EQ(spendableBalance, 35 * COIN);
+   EXPECT_EQ(spendableBalance, 65 * COIN);
    EXPECT_EQ(unconfirmedBalance, 165 * COIN);
 
-   le = wlt->getLedgerEntryForTx(ZChash);
-   EXPECT_EQ(le.getTxTime(), 1300000000);
-   EXPECT_EQ(le.getValue(),  3000000000);
-   EXPECT_EQ(le.getBlockNum(), UINT32_MAX);
-
-   //The BDM was recycled, but the ZC is still live, and the mempool should 
-   //have reloaded it. Pull from DB and verify
-   dbtx = new LMDBEnv::Transaction(iface_->dbEnv_[HISTORY].get(), LMDB::ReadOnly);
-   StoredTx zcStx2;
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
 
-   EXPECT_EQ(iface_->getStoredZcTx(zcStx2, zcKey), true);
-   EXPECT_EQ(zcStx2.thisHash_, ZChash);
-   EXPECT_EQ(zcStx2.numBytes_, TestChain::zcTxSize);
-   EXPECT_EQ(zcStx2.fragBytes_, 190);
-   EXPECT_EQ(zcStx2.numTxOut_, 2);
-   EXPECT_EQ(zcStx2.stxoMap_.begin()->second.getValue(), 10 * COIN);
+   EXPECT_EQ(wltLB1->getFullBalance(), 10 * COIN);
+   EXPECT_EQ(wltLB2->getFullBalance(), 15 * COIN);
 
-   delete dbtx;
+   //add ZC
+   BinaryData rawZC(TestChain::zcTxSize);
+   FILE *ff = fopen("../reorgTest/ZCtx.tx", "rb");
+   fread(rawZC.getPtr(), TestChain::zcTxSize, 1, ff);
+   fclose(ff);
 
-   //add 5th block
-   setBlocks({ "0", "1", "2", "3", "4" }, blk0dat_);
+   BinaryData rawLBZC(TestChain::lbZCTxSize);
+   FILE *flb = fopen("../reorgTest/LBZC.tx", "rb");
+   fread(rawLBZC.getPtr(), TestChain::lbZCTxSize, 1, flb);
+   fclose(flb);
 
-   TheBDM.readBlkFileUpdate();
+   theBDV->addNewZeroConfTx(rawZC, 0, false);
+   theBDV->addNewZeroConfTx(rawLBZC, 0, false);
+   theBDV->parseNewZeroConfTx();
    theBDV->scanWallets();
-
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 4);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash4);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4).isMainBranch());
-
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
    EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
    EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
 
    fullBalance = wlt->getFullBalance();
-   spendableBalance = wlt->getSpendableBalance(5);
-   unconfirmedBalance = wlt->getUnconfirmedBalance(5);
-   EXPECT_EQ(fullBalance, 120 * COIN);
-   EXPECT_EQ(spendableBalance, 40 * COIN);
-   EXPECT_EQ(unconfirmedBalance, 120 * COIN);
-
-   dbtx = new LMDBEnv::Transaction(iface_->dbEnv_[HISTORY].get(), LMDB::ReadOnly);
-   StoredTx zcStx3;
+   spendableBalance = wlt->getSpendableBalance(4);
+   unconfirmedBalance = wlt->getUnconfirmedBalance(4);
+   EXPECT_EQ(fullBalance, 165*COIN);
+   EXPECT_EQ(spendableBalance, 35*COIN);
+   EXPECT_EQ(unconfirmedBalance, 135*COIN);
 
-   EXPECT_EQ(iface_->getStoredZcTx(zcStx3, zcKey), true);
-   EXPECT_EQ(zcStx3.thisHash_, ZChash);
-   EXPECT_EQ(zcStx3.numBytes_, TestChain::zcTxSize);
-   EXPECT_EQ(zcStx3.fragBytes_, 190); // Not sure how Python can get this value
-   EXPECT_EQ(zcStx3.numTxOut_, 2);
-   EXPECT_EQ(zcStx3.stxoMap_.begin()->second.getValue(), 10 * COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
 
-   delete dbtx;
+   EXPECT_EQ(wltLB1->getFullBalance(), 5 * COIN);
+   EXPECT_EQ(wltLB2->getFullBalance(), 15 * COIN);
 
-   //add 6th block
+   //
    setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
-
    TheBDM.readBlkFileUpdate();
    theBDV->scanWallets();
 
@@ -8296,754 +10210,1114 @@ TEST_F(BlockUtilsBare, Load3Blocks_ZC_Plus3_TestLedgers)
    EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5).isMainBranch());
 
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(),  50*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(),  70*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(),  20*COIN);
 
    fullBalance = wlt->getFullBalance();
    spendableBalance = wlt->getSpendableBalance(5);
    unconfirmedBalance = wlt->getUnconfirmedBalance(5);
-   EXPECT_EQ(fullBalance, 140 * COIN);
-   EXPECT_EQ(spendableBalance, 40 * COIN);
-   EXPECT_EQ(unconfirmedBalance, 140 * COIN);
-
-   le = wlt->getLedgerEntryForTx(ZChash);
-   EXPECT_EQ(le.getTxTime(), 1231009513);
-   EXPECT_EQ(le.getValue(), 3000000000);
-   EXPECT_EQ(le.getBlockNum(), 5);
-
-   //Tx is now in a block, ZC should be gone from DB
-   dbtx = new LMDBEnv::Transaction(iface_->dbEnv_[HISTORY].get(), LMDB::ReadWrite);
-   StoredTx zcStx4;
+   EXPECT_EQ(fullBalance, 170*COIN);
+   EXPECT_EQ(spendableBalance, 70*COIN);
+   EXPECT_EQ(unconfirmedBalance, 170*COIN);
 
-   EXPECT_EQ(iface_->getStoredZcTx(zcStx4, zcKey), false);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 25 * COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
 
-   delete dbtx;
+   EXPECT_EQ(wltLB1->getFullBalance(), 30 * COIN);
+   EXPECT_EQ(wltLB2->getFullBalance(), 30 * COIN);
 }
 
-
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load5Blocks_FullReorg)
+TEST_F(BlockUtilsBare, Load4Blocks_ReloadBDM_ZC_FromParseResults)
 {
-   BtcWallet* wlt;
-   BtcWallet* wlt2;
-   BtcWallet* wltLB1;
-   BtcWallet* wltLB2;
-
    vector<BinaryData> scrAddrVec;
    scrAddrVec.push_back(TestChain::scrAddrA);
    scrAddrVec.push_back(TestChain::scrAddrB);
    scrAddrVec.push_back(TestChain::scrAddrC);
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
    regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
-
-   scrAddrVec.clear();
-   scrAddrVec.push_back(TestChain::scrAddrD);
-   scrAddrVec.push_back(TestChain::scrAddrE);
-   scrAddrVec.push_back(TestChain::scrAddrF);
-   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
    regLockboxes(theBDV, &wltLB1, &wltLB2);
 
+   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
    TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->enableZeroConf();
+   theBDV->scanWallets();
 
-   setBlocks({ "0", "1", "2", "3", "4", "5", "4A" }, blk0dat_);
-   TheBDM.readBlkFileUpdate();
+   //add ZC
+   BinaryData rawZC(TestChain::zcTxSize);
+   FILE *ff = fopen("../reorgTest/ZCtx.tx", "rb");
+   fread(rawZC.getPtr(), TestChain::zcTxSize, 1, ff);
+   fclose(ff);
 
-   setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
+   BinaryData rawLBZC(TestChain::lbZCTxSize);
+   FILE *flb = fopen("../reorgTest/LBZC.tx", "rb");
+   fread(rawLBZC.getPtr(), TestChain::lbZCTxSize, 1, flb);
+   fclose(flb);
 
-   uint32_t prevBlock = TheBDM.readBlkFileUpdate();
+   theBDV->addNewZeroConfTx(rawZC, 0, false);
+   theBDV->addNewZeroConfTx(rawLBZC, 0, false);
+   theBDV->parseNewZeroConfTx();
+   theBDV->scanWallets();
 
-   theBDV->scanWallets(prevBlock);
+   const map<BinaryData, map<BinaryData, TxIOPair> > zcTxioMap =
+      theBDV->getFullZeroConfTxIOMap();
+   ASSERT_FALSE(zcTxioMap.empty());
+
+   auto reload = [&](void)->void
+   {
+      restartBDM(true);
+
+      regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+      regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+      TheBDM.doInitialSyncOnLoad(nullProgress);
+      theBDV->enableZeroConf();
+      theBDV->scanWallets();
+   };
+
+   auto checkZCBalances = [&](void)->void
+   {
+      const ScrAddrObj* scrObj;
+      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+      EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
+      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+      EXPECT_EQ(scrObj->getFullBalance(), 20 * COIN);
+      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+      EXPECT_EQ(scrObj->getFullBalance(), 65 * COIN);
+
+      EXPECT_EQ(wltLB1->getFullBalance(), 5 * COIN);
+      EXPECT_EQ(wltLB2->getFullBalance(), 15 * COIN);
+   };
+
+   checkZCBalances();
+
+   //same top block and addresses, the ZC are restored as parsed
+   reload();
+   EXPECT_EQ(theBDV->getZcReloadCounts(), make_pair(2U, 0U));
+
+   const auto& reloadedTxioMap = theBDV->getFullZeroConfTxIOMap();
+   ASSERT_EQ(reloadedTxioMap.size(), zcTxioMap.size());
+   for (const auto& saTxio : zcTxioMap)
+   {
+      auto saIter = reloadedTxioMap.find(saTxio.first);
+      ASSERT_TRUE(saIter != reloadedTxioMap.end());
+      ASSERT_EQ(saIter->second.size(), saTxio.second.size());
+
+      for (const auto& txioPair : saTxio.second)
+      {
+         auto txioIter = saIter->second.find(txioPair.first);
+         ASSERT_TRUE(txioIter != saIter->second.end());
+
+         const TxIOPair& txio = txioPair.second;
+         const TxIOPair& reloaded = txioIter->second;
+         EXPECT_EQ(reloaded.getDBKeyOfOutput(), txio.getDBKeyOfOutput());
+         EXPECT_EQ(reloaded.hasTxIn(), txio.hasTxIn());
+         if (txio.hasTxIn())
+            EXPECT_EQ(reloaded.getDBKeyOfInput(), txio.getDBKeyOfInput());
+         EXPECT_EQ(reloaded.getValue(), txio.getValue());
+         EXPECT_EQ(reloaded.getTxTime(), txio.getTxTime());
+         EXPECT_EQ(reloaded.isUTXO(), txio.isUTXO());
+         EXPECT_EQ(reloaded.isMultisig(), txio.isMultisig());
+         EXPECT_EQ(reloaded.getTxHashOfOutput(), txio.getTxHashOfOutput());
+         EXPECT_EQ(reloaded.getTxHashOfInput(), txio.getTxHashOfInput());
+      }
+   }
+
+   checkZCBalances();
+
+   //blocks 4 and 5 mine the ZC, they have to be revalidated
+   setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+   reload();
+   EXPECT_EQ(theBDV->getZcReloadCounts(), make_pair(0U, 2U));
+   EXPECT_TRUE(theBDV->getFullZeroConfTxIOMap().empty());
 
    const ScrAddrObj* scrObj;
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 70 * COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
-
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(),60*COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(),30*COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(),60*COIN);
-
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 10*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 20 * COIN);
 
-   EXPECT_EQ(wlt->getFullBalance(), 135*COIN);
-   EXPECT_EQ(wlt2->getFullBalance(), 150*COIN);
-   EXPECT_EQ(wltLB1->getFullBalance(), 5*COIN);
-   EXPECT_EQ(wltLB2->getFullBalance(), 10*COIN);
+   EXPECT_EQ(wltLB1->getFullBalance(), 30 * COIN);
+   EXPECT_EQ(wltLB2->getFullBalance(), 30 * COIN);
 }
 
-
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load5Blocks_DoubleReorg)
+TEST_F(BlockUtilsBare, Load3Blocks_ZC_Plus3_TestLedgers)
 {
-   BtcWallet* wlt;
-   BtcWallet* wlt2;
-   BtcWallet* wltLB1;
-   BtcWallet* wltLB2;
-
    vector<BinaryData> scrAddrVec;
    scrAddrVec.push_back(TestChain::scrAddrA);
    scrAddrVec.push_back(TestChain::scrAddrB);
    scrAddrVec.push_back(TestChain::scrAddrC);
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
    regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
-
-   scrAddrVec.clear();
-   scrAddrVec.push_back(TestChain::scrAddrD);
-   scrAddrVec.push_back(TestChain::scrAddrE);
-   scrAddrVec.push_back(TestChain::scrAddrF);
-   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
    regLockboxes(theBDV, &wltLB1, &wltLB2);
 
-   setBlocks({ "0", "1", "2", "3", "4A"}, blk0dat_);
+   wlt->addScrAddress(TestChain::scrAddrE);
+
+   //copy the first 3 blocks
+   setBlocks({ "0", "1", "2" }, blk0dat_);
    TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   //enable ZC after the initial sync
+   theBDV->enableZeroConf();
+
    theBDV->scanWallets();
 
-   //first reorg: up to 5
-   setBlocks({ "0", "1", "2", "3", "4A", "4", "5" }, blk0dat_);
-   uint32_t prevBlock = TheBDM.readBlkFileUpdate();
-   theBDV->scanWallets(prevBlock);
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 2);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash2);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash2).isMainBranch());
 
    const ScrAddrObj* scrObj;
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20 * COIN);
-   
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(), 65 * COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(),  0*COIN);
 
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25 * COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+   uint64_t fullBalance = wlt->getFullBalance();
+   uint64_t spendableBalance = wlt->getSpendableBalance(3);
+   uint64_t unconfirmedBalance = wlt->getUnconfirmedBalance(3);
+   EXPECT_EQ(fullBalance, 105 * COIN);
+   EXPECT_EQ(spendableBalance, 5 * COIN);
+   EXPECT_EQ(unconfirmedBalance, 105 * COIN);
 
-   EXPECT_EQ(wlt->getFullBalance(), 140 * COIN);
-   EXPECT_EQ(wlt2->getFullBalance(), 100 * COIN);
-   EXPECT_EQ(wltLB1->getFullBalance(), 30 * COIN);
-   EXPECT_EQ(wltLB2->getFullBalance(), 30 * COIN);
+   //add ZC
+   BinaryData rawZC(259);
+   FILE *ff = fopen("../reorgTest/ZCtx.tx", "rb");
+   fread(rawZC.getPtr(), 259, 1, ff);
+   fclose(ff);
 
-   //second reorg: up to 5A
-   setBlocks({ "0", "1", "2", "3", "4A", "4", "5", "5A" }, blk0dat_);
-   prevBlock = TheBDM.readBlkFileUpdate();
-   theBDV->scanWallets(prevBlock);
+   BinaryData ZChash = READHEX(TestChain::zcTxHash256);
 
+   theBDV->addNewZeroConfTx(rawZC, 1300000000, false);
+   theBDV->parseNewZeroConfTx();
+   theBDV->scanWallets();
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 75*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 55 * COIN);
-
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
-
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+   EXPECT_EQ(scrObj->getFullBalance(),  10*COIN);
 
-   EXPECT_EQ(wlt->getFullBalance(), 135 * COIN);
-   EXPECT_EQ(wlt2->getFullBalance(), 150 * COIN);
-   EXPECT_EQ(wltLB1->getFullBalance(), 5 * COIN);
-   EXPECT_EQ(wltLB2->getFullBalance(), 10 * COIN);
-}
+   fullBalance = wlt->getFullBalance();
+   spendableBalance = wlt->getSpendableBalance(4);
+   unconfirmedBalance = wlt->getUnconfirmedBalance(4);
+   EXPECT_EQ(fullBalance, 135 * COIN);
+   EXPECT_EQ(spendableBalance, 5 * COIN);
+   EXPECT_EQ(unconfirmedBalance, 135 * COIN);
 
+   //check ledger for ZC
+   LedgerEntry le = wlt->getLedgerEntryForTx(ZChash);
+   EXPECT_EQ(le.getTxTime(), 1300000000);
+   EXPECT_EQ(le.getValue(),  3000000000);
+   EXPECT_EQ(le.getBlockNum(), UINT32_MAX);
 
-////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load5Blocks_ReloadBDM_Reorg)
-{
-   BtcWallet* wlt;
-   BtcWallet* wlt2;
-   BtcWallet* wltLB1;
-   BtcWallet* wltLB2;
+   //pull ZC from DB, verify it's carrying the proper data
+   LMDBEnv::Transaction *dbtx = 
+      new LMDBEnv::Transaction(iface_->dbEnv_[HISTORY].get(), LMDB::ReadOnly);
+   StoredTx zcStx;
+   BinaryData zcKey = WRITE_UINT16_BE(0xFFFF);
+   zcKey.append(WRITE_UINT32_LE(0));
 
-   vector<BinaryData> scrAddrVec;
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
-   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   EXPECT_EQ(iface_->getStoredZcTx(zcStx, zcKey), true);
+   EXPECT_EQ(zcStx.thisHash_, ZChash);
+   EXPECT_EQ(zcStx.numBytes_ , TestChain::zcTxSize);
+   EXPECT_EQ(zcStx.fragBytes_, 190);
+   EXPECT_EQ(zcStx.numTxOut_, 2);
+   EXPECT_EQ(zcStx.stxoMap_.begin()->second.getValue(), 10 * COIN);
 
-   scrAddrVec.clear();
-   scrAddrVec.push_back(TestChain::scrAddrD);
-   scrAddrVec.push_back(TestChain::scrAddrE);
-   scrAddrVec.push_back(TestChain::scrAddrF);
-   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
-   regLockboxes(theBDV, &wltLB1, &wltLB2);
+   //check ZChash in DB
+   EXPECT_EQ(iface_->getTxHashForLdbKey(zcKey), ZChash);
 
-   TheBDM.doInitialSyncOnLoad(nullProgress);
+   delete dbtx;
 
-   //reload BDM
-   delete theBDV;
+   //restart bdm
+   theBDV->unregisterWallet("wallet1");
    delete theBDM;
-
-   //add the reorg blocks
-   setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
+   delete theBDV;
 
    theBDM = new BlockDataManager_LevelDB(config);
    theBDM->openDatabase();
-   iface_ = theBDM->getIFace();
    theBDV = new BlockDataViewer(theBDM);
+   iface_ = theBDM->getIFace();
 
-   scrAddrVec.clear();
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
    regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
-
-   scrAddrVec.clear();
-   scrAddrVec.push_back(TestChain::scrAddrD);
-   scrAddrVec.push_back(TestChain::scrAddrE);
-   scrAddrVec.push_back(TestChain::scrAddrF);
-   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
    regLockboxes(theBDV, &wltLB1, &wltLB2);
 
    TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->enableZeroConf();
    theBDV->scanWallets();
 
-   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
-
-   const ScrAddrObj* scrObj;
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA); //unspent 50
-   EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB); //spent 50, spent 50, spent 25, spent 5, unspent 30
-   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC); //unspent 50, unspent 5
-   EXPECT_EQ(scrObj->getFullBalance(), 55 * COIN);
-
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD); //unspent 5, unspent 50, unspent 5
-   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE); //unspent 5, unspent 25
-   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF); //spent 20, spent 15, unspent 5, unspent 50, unspent 5
-   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
-
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr); //spent 10, unspent 5
-   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH); //spent 15
-   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr); //spent 10, unspent 10
-   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH); //spent 5
-   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
-
-   EXPECT_EQ(wlt->getFullBalance(), 135 * COIN);
-   EXPECT_EQ(wlt2->getFullBalance(), 150 * COIN);
-   EXPECT_EQ(wltLB1->getFullBalance(), 5 * COIN);
-   EXPECT_EQ(wltLB2->getFullBalance(), 10 * COIN);
-}
-
-////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load5Blocks_ReloadBDM_Reorg_DontTrigger)
-{
-   /***
-   By registering extra addresses after reseting the BDM, this test covers an
-   edge case where the set of registered scrAddr is extended with unscanned
-   scrAddr, so the reorg cannot be performed on the entire set and will be 
-   bypassed instead.
-   ***/
-
-   BtcWallet* wlt;
-   BtcWallet* wlt2;
-   BtcWallet* wltLB1;
-   BtcWallet* wltLB2;
+   //add 4th block
+   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
+   TheBDM.readBlkFileUpdate();
+   theBDV->scanWallets();
 
-   vector<BinaryData> scrAddrVec;
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
-   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 3);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash3);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash3).isMainBranch());
 
-   scrAddrVec.clear();
-   scrAddrVec.push_back(TestChain::scrAddrD);
-   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
-   regLockboxes(theBDV, &wltLB1, &wltLB2);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
 
-   TheBDM.doInitialSyncOnLoad(nullProgress);
+   fullBalance = wlt->getFullBalance();
+   spendableBalance = wlt->getSpendableBalance(5);
+   unconfirmedBalance = wlt->getUnconfirmedBalance(5);
+   EXPECT_EQ(fullBalance, 165 * COIN);
+   EXPECT_EQ(spendableBalance, 35 * COIN);
+   EXPECT_EQ(unconfirmedBalance, 165 * COIN);
 
-   //reload BDM
-   delete theBDV;
-   delete theBDM;
+   le = wlt->getLedgerEntryForTx(ZChash);
+   EXPECT_EQ(le.getTxTime(), 1300000000);
+   EXPECT_EQ(le.getValue(),  3000000000);
+   EXPECT_EQ(le.getBlockNum(), UINT32_MAX);
 
-   //add the reorg blocks
-   setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
+   //The BDM was recycled, but the ZC is still live, and the mempool should 
+   //have reloaded it. Pull from DB and verify
+   dbtx = new LMDBEnv::Transaction(iface_->dbEnv_[HISTORY].get(), LMDB::ReadOnly);
+   StoredTx zcStx2;
 
-   theBDM = new BlockDataManager_LevelDB(config);
-   theBDM->openDatabase();
-   iface_ = theBDM->getIFace();
-   theBDV = new BlockDataViewer(theBDM);
+   EXPECT_EQ(iface_->getStoredZcTx(zcStx2, zcKey), true);
+   EXPECT_EQ(zcStx2.thisHash_, ZChash);
+   EXPECT_EQ(zcStx2.numBytes_, TestChain::zcTxSize);
+   EXPECT_EQ(zcStx2.fragBytes_, 190);
+   EXPECT_EQ(zcStx2.numTxOut_, 2);
+   EXPECT_EQ(zcStx2.stxoMap_.begin()->second.getValue(), 10 * COIN);
 
-   scrAddrVec.clear();
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
-   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   delete dbtx;
 
-   scrAddrVec.clear();
-   scrAddrVec.push_back(TestChain::scrAddrD);
-   scrAddrVec.push_back(TestChain::scrAddrE);
-   scrAddrVec.push_back(TestChain::scrAddrF);
-   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
-   regLockboxes(theBDV, &wltLB1, &wltLB2);
+   //add 5th block
+   setBlocks({ "0", "1", "2", "3", "4" }, blk0dat_);
 
-   TheBDM.doInitialSyncOnLoad(nullProgress);
+   TheBDM.readBlkFileUpdate();
    theBDV->scanWallets();
 
-   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 4);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash4);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4).isMainBranch());
 
-   const ScrAddrObj* scrObj;
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
    EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
 
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
-   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
+   fullBalance = wlt->getFullBalance();
+   spendableBalance = wlt->getSpendableBalance(5);
+   unconfirmedBalance = wlt->getUnconfirmedBalance(5);
+   EXPECT_EQ(fullBalance, 120 * COIN);
+   EXPECT_EQ(spendableBalance, 40 * COIN);
+   EXPECT_EQ(unconfirmedBalance, 120 * COIN);
 
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(),  0*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 10*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(),  0*COIN);
+   dbtx = new LMDBEnv::Transaction(iface_->dbEnv_[HISTORY].get(), LMDB::ReadOnly);
+   StoredTx zcStx3;
 
-   EXPECT_EQ(wlt->getFullBalance(),   135*COIN);
-   EXPECT_EQ(wlt2->getFullBalance(),  150*COIN);
-   EXPECT_EQ(wltLB1->getFullBalance(), 5*COIN);
-   EXPECT_EQ(wltLB2->getFullBalance(), 10*COIN);
+   EXPECT_EQ(iface_->getStoredZcTx(zcStx3, zcKey), true);
+   EXPECT_EQ(zcStx3.thisHash_, ZChash);
+   EXPECT_EQ(zcStx3.numBytes_, TestChain::zcTxSize);
+   EXPECT_EQ(zcStx3.fragBytes_, 190); // Not sure how Python can get this value
+   EXPECT_EQ(zcStx3.numTxOut_, 2);
+   EXPECT_EQ(zcStx3.stxoMap_.begin()->second.getValue(), 10 * COIN);
+
+   delete dbtx;
+
+   //add 6th block
+   setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+
+   TheBDM.readBlkFileUpdate();
+   theBDV->scanWallets();
+
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5).isMainBranch());
+
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70 * COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20 * COIN);
+
+   fullBalance = wlt->getFullBalance();
+   spendableBalance = wlt->getSpendableBalance(5);
+   unconfirmedBalance = wlt->getUnconfirmedBalance(5);
+   EXPECT_EQ(fullBalance, 140 * COIN);
+   EXPECT_EQ(spendableBalance, 40 * COIN);
+   EXPECT_EQ(unconfirmedBalance, 140 * COIN);
+
+   le = wlt->getLedgerEntryForTx(ZChash);
+   EXPECT_EQ(le.getTxTime(), 1231009513);
+   EXPECT_EQ(le.getValue(), 3000000000);
+   EXPECT_EQ(le.getBlockNum(), 5);
+
+   //Tx is now in a block, ZC should be gone from DB
+   dbtx = new LMDBEnv::Transaction(iface_->dbEnv_[HISTORY].get(), LMDB::ReadWrite);
+   StoredTx zcStx4;
+
+   EXPECT_EQ(iface_->getStoredZcTx(zcStx4, zcKey), false);
+
+   delete dbtx;
 }
 
+
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, CorruptedBlock)
+TEST_F(BlockUtilsBare, Load3Blocks_ZC_Plus3_LedgerDeltas)
 {
-   BtcWallet* wlt;
-   BtcWallet* wltLB1;
-   BtcWallet* wltLB2;
-
    vector<BinaryData> scrAddrVec;
    scrAddrVec.push_back(TestChain::scrAddrA);
    scrAddrVec.push_back(TestChain::scrAddrB);
    scrAddrVec.push_back(TestChain::scrAddrC);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
    regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
    regLockboxes(theBDV, &wltLB1, &wltLB2);
 
+   setBlocks({ "0", "1", "2" }, blk0dat_);
    TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->enableZeroConf();
+   theBDV->scanWallets();
+
+   map<BinaryData, BtcWallet*> wallets;
+   wallets[wlt->walletID()] = wlt;
+   wallets[wltLB1->walletID()] = wltLB1;
+   wallets[wltLB2->walletID()] = wltLB2;
+
+   auto fetchHistory = [](BtcWallet* wltPtr)->map<BinaryData, LedgerEntry>
    {
-      setBlocks({ "0", "1", "2", "3", "4A", "5A" }, blk0dat_);
-      const uint64_t srcsz = BtcUtils::GetFileSize(blk0dat_);
-      BinaryData temp(srcsz);
+      map<BinaryData, LedgerEntry> history;
+      for (uint32_t i = 0; i < wltPtr->getHistoryPageCount(); i++)
       {
-         ifstream is(blk0dat_.c_str(), ios::in  | ios::binary);
-         is.read((char*)temp.getPtr(), srcsz);
+         for (const auto& le : wltPtr->getHistoryPageAsVector(i))
+            history[le.getTxHash()] = le;
       }
 
-      const std::string dst = blk0dat_;
+      return history;
+   };
 
-      ofstream os(dst.c_str(), ios::out | ios::binary);
-      os.write((char*)temp.getPtr(), 100);
-      os.write((char*)temp.getPtr()+120, srcsz-100-20); // erase 20 bytes
+   //shadow model, built from full page fetches then patched with deltas
+   map<BinaryData, map<BinaryData, LedgerEntry>> shadow;
+   map<BinaryData, uint64_t> shadowBalance;
+   for (auto& wltPair : wallets)
+   {
+      shadow[wltPair.first] = fetchHistory(wltPair.second);
+      shadowBalance[wltPair.first] = wltPair.second->getFullBalanceFromDB();
    }
 
+   uint64_t version = theBDV->getChangeFeedVersion();
+   unsigned minedZC = 0;
+
+   auto applyAndCompare = [&](void)->void
+   {
+      auto changes = theBDV->getChangesSince(version);
+      ASSERT_FALSE(changes.empty());
+      ASSERT_FALSE(changes.front().resetAll_);
+      EXPECT_EQ(changes.front().version_, version + 1);
+
+      for (auto& changeSet : changes)
+      {
+         EXPECT_EQ(changeSet.version_, version + 1);
+         version = changeSet.version_;
+
+         for (auto& delta : changeSet.wallets_)
+         {
+            auto& history = shadow[delta.walletID_];
+            if (delta.reset_)
+               history = fetchHistory(wallets[delta.walletID_]);
+
+            for (auto& le : delta.removed_)
+            {
+               EXPECT_EQ(history.erase(le.getTxHash()), 1);
+               if (le.getBlockNum() == UINT32_MAX)
+                  minedZC++;
+            }
+
+            for (auto& le : delta.added_)
+               history[le.getTxHash()] = le;
+
+            for (auto& le : delta.changed_)
+            {
+               EXPECT_EQ(history.count(le.getTxHash()), 1);
+               history[le.getTxHash()] = le;
+            }
+
+            shadowBalance[delta.walletID_] += delta.balanceDelta_;
+            EXPECT_EQ(shadowBalance[delta.walletID_], delta.balance_);
+         }
+      }
+
+      for (auto& wltPair : wallets)
+      {
+         auto history = fetchHistory(wltPair.second);
+         auto& shadowHistory = shadow[wltPair.first];
+         ASSERT_EQ(shadowHistory.size(), history.size());
+
+         for (auto& lePair : history)
+         {
+            auto shadowIter = shadowHistory.find(lePair.first);
+            ASSERT_TRUE(shadowIter != shadowHistory.end());
+            EXPECT_EQ(shadowIter->second.getValue(), lePair.second.getValue());
+            EXPECT_EQ(shadowIter->second.getBlockNum(), 
+               lePair.second.getBlockNum());
+            EXPECT_EQ(shadowIter->second.getTxTime(), 
+               lePair.second.getTxTime());
+         }
+
+         EXPECT_EQ(shadowBalance[wltPair.first], 
+            wltPair.second->getFullBalanceFromDB());
+      }
+   };
+
+   //add ZC
+   BinaryData rawZC(259);
+   FILE *ff = fopen("../reorgTest/ZCtx.tx", "rb");
+   fread(rawZC.getPtr(), 259, 1, ff);
+   fclose(ff);
+
+   theBDV->addNewZeroConfTx(rawZC, 1300000000, false);
+   theBDV->parseNewZeroConfTx();
+   theBDV->scanWallets();
+   applyAndCompare();
+
+   BinaryData ZChash = READHEX(TestChain::zcTxHash256);
+   EXPECT_EQ(shadow[wlt->walletID()][ZChash].getBlockNum(), UINT32_MAX);
+
+   //nothing changed, nothing published
+   uint64_t lastVersion = theBDV->getChangeFeedVersion();
+   theBDV->scanWallets();
+   EXPECT_EQ(theBDV->getChangeFeedVersion(), lastVersion);
+
+   //add blocks, the ZC is mined in the last one
+   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
    TheBDM.readBlkFileUpdate();
    theBDV->scanWallets();
+   applyAndCompare();
 
-   const ScrAddrObj* scrObj;
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
-   //scrObj = &wlt->getScrAddrObjByKey(TestChain::scrAddrD);
-   //EXPECT_EQ(scrObj->getFullBalance(),140*COIN);
+   setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+   TheBDM.readBlkFileUpdate();
+   theBDV->scanWallets();
+   applyAndCompare();
 
-   EXPECT_EQ(wlt->getFullBalance(), 140*COIN);
+   EXPECT_EQ(shadow[wlt->walletID()][ZChash].getBlockNum(), 5);
+   EXPECT_EQ(minedZC, 1);
+
+   //the feed still holds every change set since the start
+   auto changes = theBDV->getChangesSince(0);
+   ASSERT_EQ(changes.size(), version);
+   EXPECT_FALSE(changes.front().resetAll_);
+   EXPECT_EQ(changes.front().version_, 1);
+   EXPECT_TRUE(theBDV->getChangesSince(version).empty());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load5Blocks_RescanOps)
+TEST_F(BlockUtilsBare, Load5Blocks_FullReorg)
 {
    BtcWallet* wlt;
+   BtcWallet* wlt2;
    BtcWallet* wltLB1;
    BtcWallet* wltLB2;
-   const ScrAddrObj* scrObj;
+
    vector<BinaryData> scrAddrVec;
    scrAddrVec.push_back(TestChain::scrAddrA);
    scrAddrVec.push_back(TestChain::scrAddrB);
    scrAddrVec.push_back(TestChain::scrAddrC);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+
+   scrAddrVec.clear();
    scrAddrVec.push_back(TestChain::scrAddrD);
    scrAddrVec.push_back(TestChain::scrAddrE);
    scrAddrVec.push_back(TestChain::scrAddrF);
-   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
    regLockboxes(theBDV, &wltLB1, &wltLB2);
 
-   // Regular sync
    TheBDM.doInitialSyncOnLoad(nullProgress);
 
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A" }, blk0dat_);
+   TheBDM.readBlkFileUpdate();
 
-   // Rebuild on-the-fly
-   TheBDM.doRebuildDatabases(nullProgress);
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
 
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+   uint32_t prevBlock = TheBDM.readBlkFileUpdate();
 
-   // Rebuild on-the-fly
-   // used to be doFullRescanRegardlessOfSync, but this is a synonym
-   TheBDM.doInitialSyncOnLoad_Rebuild(nullProgress);
+   theBDV->scanWallets(prevBlock);
 
+   const ScrAddrObj* scrObj;
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
    EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
    EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
 
-   TheBDM.doInitialSyncOnLoad(nullProgress);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(),60*COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(),30*COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),60*COIN);
 
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
    EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 10*COIN);
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
    EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+
+   EXPECT_EQ(wlt->getFullBalance(), 135*COIN);
+   EXPECT_EQ(wlt2->getFullBalance(), 150*COIN);
+   EXPECT_EQ(wltLB1->getFullBalance(), 5*COIN);
+   EXPECT_EQ(wltLB2->getFullBalance(), 10*COIN);
 }
 
+
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load5Blocks_RescanEmptyDB)
+TEST_F(BlockUtilsBare, Load5Blocks_DoubleReorg)
 {
    BtcWallet* wlt;
+   BtcWallet* wlt2;
    BtcWallet* wltLB1;
    BtcWallet* wltLB2;
+
    vector<BinaryData> scrAddrVec;
    scrAddrVec.push_back(TestChain::scrAddrA);
    scrAddrVec.push_back(TestChain::scrAddrB);
    scrAddrVec.push_back(TestChain::scrAddrC);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+
+   scrAddrVec.clear();
    scrAddrVec.push_back(TestChain::scrAddrD);
    scrAddrVec.push_back(TestChain::scrAddrE);
    scrAddrVec.push_back(TestChain::scrAddrF);
-   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
    regLockboxes(theBDV, &wltLB1, &wltLB2);
 
-   TheBDM.doInitialSyncOnLoad_Rescan(nullProgress);
-   //TheBDM.scanBlockchainForTx(wlt);
+   setBlocks({ "0", "1", "2", "3", "4A"}, blk0dat_);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->scanWallets();
+
+   //first reorg: up to 5
+   setBlocks({ "0", "1", "2", "3", "4A", "4", "5" }, blk0dat_);
+   uint32_t prevBlock = TheBDM.readBlkFileUpdate();
+   theBDV->scanWallets(prevBlock);
 
    const ScrAddrObj* scrObj;
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 70 * COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 20 * COIN);
+   
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 65 * COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
+
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 25 * COIN);
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
-}
-
-////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load5Blocks_RebuildEmptyDB)
-{
-   BtcWallet* wlt;
-   BtcWallet* wltLB1;
-   BtcWallet* wltLB2;
-   vector<BinaryData> scrAddrVec;
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
-   scrAddrVec.push_back(TestChain::scrAddrD);
-   scrAddrVec.push_back(TestChain::scrAddrE);
-   scrAddrVec.push_back(TestChain::scrAddrF);
-   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
-   regLockboxes(theBDV, &wltLB1, &wltLB2);
+   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
 
-   ///////////////////////////////////////////
-   TheBDM.doInitialSyncOnLoad_Rebuild(nullProgress);
-   ///////////////////////////////////////////
+   EXPECT_EQ(wlt->getFullBalance(), 140 * COIN);
+   EXPECT_EQ(wlt2->getFullBalance(), 100 * COIN);
+   EXPECT_EQ(wltLB1->getFullBalance(), 30 * COIN);
+   EXPECT_EQ(wltLB2->getFullBalance(), 30 * COIN);
 
-   //TheBDM.scanBlockchainForTx(wlt);
+   //second reorg: up to 5A
+   setBlocks({ "0", "1", "2", "3", "4A", "4", "5", "5A" }, blk0dat_);
+   prevBlock = TheBDM.readBlkFileUpdate();
+   theBDV->scanWallets(prevBlock);
 
-   const ScrAddrObj* scrObj;
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
-   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 55 * COIN);
+
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
+
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+
+   EXPECT_EQ(wlt->getFullBalance(), 135 * COIN);
+   EXPECT_EQ(wlt2->getFullBalance(), 150 * COIN);
+   EXPECT_EQ(wltLB1->getFullBalance(), 5 * COIN);
+   EXPECT_EQ(wltLB2->getFullBalance(), 10 * COIN);
 }
 
+
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load5Blocks_ForceFullRewhatever)
+TEST_F(BlockUtilsBare, Load5Blocks_ReloadBDM_Reorg)
 {
    BtcWallet* wlt;
+   BtcWallet* wlt2;
    BtcWallet* wltLB1;
    BtcWallet* wltLB2;
-   const ScrAddrObj* scrObj;
+
    vector<BinaryData> scrAddrVec;
    scrAddrVec.push_back(TestChain::scrAddrA);
    scrAddrVec.push_back(TestChain::scrAddrB);
    scrAddrVec.push_back(TestChain::scrAddrC);
    regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+
+   scrAddrVec.clear();
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
    regLockboxes(theBDV, &wltLB1, &wltLB2);
 
-   // This is just a regular load
    TheBDM.doInitialSyncOnLoad(nullProgress);
 
-   //post initial load address registration
-   wlt->addScrAddress(TestChain::scrAddrD);
-
-   EXPECT_EQ(TheBDM.sideScanFlag_, true);
+   //reload BDM
+   delete theBDV;
+   delete theBDM;
 
-   //fire side scan manually since there is no maintenance thread with unit tests
-   theBDM->startSideScan([](const vector<string>&, double prog, unsigned time){});
+   //add the reorg blocks
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
 
-   //wait on the address scan
-   while (wlt->getMergeFlag() == false)
-      usleep(100);
+   theBDM = new BlockDataManager_LevelDB(config);
+   theBDM->openDatabase();
+   iface_ = theBDM->getIFace();
+   theBDV = new BlockDataViewer(theBDM);
 
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   try
-   {
-      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
-      EXPECT_EQ(scrObj, nullptr);
-   }
-   catch (std::runtime_error &)
-   {
-   }
+   scrAddrVec.clear();
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
 
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+   scrAddrVec.clear();
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
 
-   ///////////////////////////////////////////
-   theBDV->reset();
-   TheBDM.doInitialSyncOnLoad_Rescan(nullProgress);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
    theBDV->scanWallets();
-   ///////////////////////////////////////////
 
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
 
-   ///////////////////////////////////////////
-   theBDV->reset();
-   TheBDM.doRebuildDatabases(nullProgress);
-   theBDV->scanWallets();
-   ///////////////////////////////////////////
+   const ScrAddrObj* scrObj;
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA); //unspent 50
+   EXPECT_EQ(scrObj->getFullBalance(), 50 * COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB); //spent 50, spent 50, spent 25, spent 5, unspent 30
+   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC); //unspent 50, unspent 5
+   EXPECT_EQ(scrObj->getFullBalance(), 55 * COIN);
 
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
-   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD); //unspent 5, unspent 50, unspent 5
+   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE); //unspent 5, unspent 25
+   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF); //spent 20, spent 15, unspent 5, unspent 50, unspent 5
+   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
+
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr); //spent 10, unspent 5
+   EXPECT_EQ(scrObj->getFullBalance(), 5 * COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH); //spent 15
+   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr); //spent 10, unspent 10
+   EXPECT_EQ(scrObj->getFullBalance(), 10 * COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH); //spent 5
+   EXPECT_EQ(scrObj->getFullBalance(), 0 * COIN);
+
+   EXPECT_EQ(wlt->getFullBalance(), 135 * COIN);
+   EXPECT_EQ(wlt2->getFullBalance(), 150 * COIN);
+   EXPECT_EQ(wltLB1->getFullBalance(), 5 * COIN);
+   EXPECT_EQ(wltLB2->getFullBalance(), 10 * COIN);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsBare, Load5Blocks_ScanWhatIsNeeded)
+TEST_F(BlockUtilsBare, Load5Blocks_LedgerCache)
 {
+   //cache all but the top block
+   config.ledgerCacheDepth = 1;
+
    BtcWallet* wlt;
-   BtcWallet* wltLB1;
-   BtcWallet* wltLB2;
-   const ScrAddrObj* scrObj;
-   vector<BinaryData> scrAddrVec;
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
-   scrAddrVec.push_back(TestChain::scrAddrE);
-   scrAddrVec.push_back(TestChain::scrAddrF);
-   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
-   regLockboxes(theBDV, &wltLB1, &wltLB2);
+   BtcWallet* wlt2;
+   vector<BinaryData> scrAddrVec1 = 
+      { TestChain::scrAddrA, TestChain::scrAddrB, TestChain::scrAddrC };
+   vector<BinaryData> scrAddrVec2 =
+      { TestChain::scrAddrD, TestChain::scrAddrE, TestChain::scrAddrF };
 
-   // This is just a regular load
-   TheBDM.doInitialSyncOnLoad(nullProgress);
+   auto restart = [&](const vector<BinaryData>& scrAddrs2)->void
+   {
+      restartBDM(true);
 
-   wlt->addScrAddress(TestChain::scrAddrD);
+      regWallet(scrAddrVec1, "wallet1", theBDV, &wlt);
+      regWallet(scrAddrs2, "wallet2", theBDV, &wlt2);
 
-   EXPECT_EQ(TheBDM.sideScanFlag_, true);
+      TheBDM.doInitialSyncOnLoad(nullProgress);
+      theBDV->scanWallets();
+   };
 
-   //fire side scan manually since there is no maintenance thread with unit tests
-   theBDM->startSideScan([](const vector<string>&, double prog, unsigned time){});
+   auto fingerprint = [](const vector<BinaryData>& scrAddrs)->BinaryData
+   {
+      set<BinaryData> scrAddrSet(scrAddrs.begin(), scrAddrs.end());
+      return StoredScanCheckpoint::getScrAddrFingerprint(scrAddrSet);
+   };
 
-   //wait on the address scan
-   while (wlt->getMergeFlag() == false)
-      usleep(100);
+   //first page of the wallets' history, keyed by wallet and tx hash, with
+   //how long it took in ms
+   double elapsed = 0;
+   auto firstPage = [&](void)->map<BinaryData, LedgerEntry>
+   {
+      auto start = chrono::steady_clock::now();
+      auto ledgers = theBDV->getWalletsHistoryPage(0, false, false);
+      elapsed = chrono::duration<double, milli>(
+         chrono::steady_clock::now() - start).count();
+
+      map<BinaryData, LedgerEntry> leMap;
+      for (auto& le : ledgers)
+         leMap[BinaryData(le.getWalletID()) + le.getTxHash()] = le;
+      return leMap;
+   };
 
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
-   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
-   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
-   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
-   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
-   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
-   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   auto expectSameLedgers = [](const map<BinaryData, LedgerEntry>& a, 
+      const map<BinaryData, LedgerEntry>& b)->void
+   {
+      ASSERT_EQ(a.size(), b.size());
+      for (auto& lePair : a)
+      {
+         auto bIter = b.find(lePair.first);
+         ASSERT_TRUE(bIter != b.end());
+         EXPECT_EQ(lePair.second.getValue(), bIter->second.getValue());
+         EXPECT_EQ(lePair.second.getBlockNum(), bIter->second.getBlockNum());
+         EXPECT_EQ(lePair.second.getIndex(), bIter->second.getIndex());
+         EXPECT_EQ(lePair.second.getTxTime(), bIter->second.getTxTime());
+         EXPECT_EQ(lePair.second.isCoinbase(), bIter->second.isCoinbase());
+         EXPECT_EQ(lePair.second.isSentToSelf(), 
+            bIter->second.isSentToSelf());
+         EXPECT_EQ(lePair.second.isChangeBack(), 
+            bIter->second.isChangeBack());
+         EXPECT_EQ(lePair.second.getScrAddrList(), 
+            bIter->second.getScrAddrList());
+      }
+   };
 
-   try
+   auto countCached = [&](BtcWallet* wltPtr, const BinaryData& fp,
+      uint32_t& topCached)->unsigned
    {
-      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
-      EXPECT_EQ(scrObj, nullptr);
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+
+      unsigned count = 0;
+      topCached = UINT32_MAX;
+      for (uint32_t hgt = 0; hgt <= 5; hgt++)
+      {
+         StoredLedgerCache slc;
+         if (iface_->getStoredLedgerCache(slc, wltPtr->walletID(), fp, hgt))
+         {
+            count++;
+            topCached = hgt;
+         }
+      }
+
+      return count;
+   };
+
+   restart(scrAddrVec2);
+   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
+
+   //the scan mapped the wallets' pages, which filled the cache up to the
+   //block below the top
+   uint32_t topCached;
+   EXPECT_GT(countCached(wlt, fingerprint(scrAddrVec1), topCached), 0U);
+   EXPECT_EQ(topCached, 4);
+   EXPECT_GT(countCached(wlt2, fingerprint(scrAddrVec2), topCached), 0U);
+   EXPECT_EQ(topCached, 4);
+
+   //cold: nothing cached, warm: all but the top block from the cache
+   iface_->resetLedgerCache(wlt->walletID(), fingerprint(scrAddrVec1));
+   iface_->resetLedgerCache(wlt2->walletID(), fingerprint(scrAddrVec2));
+   EXPECT_EQ(countCached(wlt, fingerprint(scrAddrVec1), topCached), 0U);
+
+   auto coldPage = firstPage();
+   double coldMs = elapsed;
+   ASSERT_GT(coldPage.size(), 0U);
+   EXPECT_GT(countCached(wlt, fingerprint(scrAddrVec1), topCached), 0U);
+
+   auto warmPage = firstPage();
+   double warmMs = elapsed;
+   expectSameLedgers(coldPage, warmPage);
+
+   //an entry that doesn't match the chain is ignored, then rewritten
+   {
+      StoredLedgerCache slc;
+      slc.walletID_ = wlt->walletID();
+      slc.scrAddrFingerprint_ = fingerprint(scrAddrVec1);
+      slc.height_ = topCached;
+      slc.blockHash_ = READHEX(
+         "0000000000000000000000000000000000000000000000000000000000000001");
+      slc.ledgerData_ = READHEX("00");
+
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadWrite);
+      iface_->putStoredLedgerCache(slc);
    }
-   catch (std::runtime_error &)
+
+   expectSameLedgers(coldPage, firstPage());
+   expectSameLedgers(coldPage, firstPage());
+
+   //restart on a chain where blocks 4 and 5 were reorganized away, wallet2 
+   //loses an address
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
+   vector<BinaryData> scrAddrVec2b = { TestChain::scrAddrD, TestChain::scrAddrE };
+   restart(scrAddrVec2b);
+   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
+
+   auto restartPage = firstPage();
+   double restartMs = elapsed;
+
+   //wallet2's entries for its former set of scrAddrs are gone
+   EXPECT_EQ(countCached(wlt2, fingerprint(scrAddrVec2), topCached), 0U);
+   EXPECT_GT(countCached(wlt2, fingerprint(scrAddrVec2b), topCached), 0U);
+
+   //same ledgers as without the cache
+   iface_->resetLedgerCache(wlt->walletID(), fingerprint(scrAddrVec1));
+   iface_->resetLedgerCache(wlt2->walletID(), fingerprint(scrAddrVec2b));
+   expectSameLedgers(restartPage, firstPage());
+
+   EXPECT_EQ(wlt->getFullBalance(), 135 * COIN);
+
+   LOGINFO << "First history page: " << coldMs << "ms cold, " << warmMs 
+      << "ms warm, " << restartMs << "ms after a restart (" 
+      << coldPage.size() << " ledger entries)";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_ReloadBDM_Reorg_DontTrigger)
+{
+   /***
+   By registering extra addresses after reseting the BDM, this test covers an
+   edge case where the set of registered scrAddr is extended with unscanned
+   scrAddr, so the reorg cannot be performed on the entire set and will be 
+   bypassed instead.
+   ***/
+
+   BtcWallet* wlt;
+   BtcWallet* wlt2;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+
+   scrAddrVec.clear();
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   //reload BDM
+   delete theBDV;
+   delete theBDM;
+
+   //add the reorg blocks
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
+
+   theBDM = new BlockDataManager_LevelDB(config);
+   theBDM->openDatabase();
+   iface_ = theBDM->getIFace();
+   theBDV = new BlockDataViewer(theBDM);
+
+   scrAddrVec.clear();
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+
+   scrAddrVec.clear();
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->scanWallets();
+
+   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
+
+   const ScrAddrObj* scrObj;
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 55*COIN);
+
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30 * COIN);
+   scrObj = wlt2->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(), 60 * COIN);
+
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(),  0*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 10*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(),  0*COIN);
+
+   EXPECT_EQ(wlt->getFullBalance(),   135*COIN);
+   EXPECT_EQ(wlt2->getFullBalance(),  150*COIN);
+   EXPECT_EQ(wltLB1->getFullBalance(), 5*COIN);
+   EXPECT_EQ(wltLB2->getFullBalance(), 10*COIN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, CorruptedBlock)
+{
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
    {
+      setBlocks({ "0", "1", "2", "3", "4A", "5A" }, blk0dat_);
+      const uint64_t srcsz = BtcUtils::GetFileSize(blk0dat_);
+      BinaryData temp(srcsz);
+      {
+         ifstream is(blk0dat_.c_str(), ios::in  | ios::binary);
+         is.read((char*)temp.getPtr(), srcsz);
+      }
+
+      const std::string dst = blk0dat_;
+
+      ofstream os(dst.c_str(), ios::out | ios::binary);
+      os.write((char*)temp.getPtr(), 100);
+      os.write((char*)temp.getPtr()+120, srcsz-100-20); // erase 20 bytes
    }
 
+   TheBDM.readBlkFileUpdate();
+   theBDV->scanWallets();
+
+   const ScrAddrObj* scrObj;
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   //scrObj = &wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   //EXPECT_EQ(scrObj->getFullBalance(),140*COIN);
+
+   EXPECT_EQ(wlt->getFullBalance(), 140*COIN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_RescanOps)
+{
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+   const ScrAddrObj* scrObj;
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+   // Regular sync
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+
+   // Rebuild on-the-fly
+   TheBDM.doRebuildDatabases(nullProgress);
+
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
    EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
    scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
@@ -9053,11 +11327,9 @@ TEST_F(BlockUtilsBare, Load5Blocks_ScanWhatIsNeeded)
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
    EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
 
-   ///////////////////////////////////////////
-   theBDV->reset();
-   TheBDM.doInitialSyncOnLoad(nullProgress);
-   theBDV->scanWallets();
-   ///////////////////////////////////////////
+   // Rebuild on-the-fly
+   // used to be doFullRescanRegardlessOfSync, but this is a synonym
+   TheBDM.doInitialSyncOnLoad_Rebuild(nullProgress);
 
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
    EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
@@ -9065,6 +11337,8 @@ TEST_F(BlockUtilsBare, Load5Blocks_ScanWhatIsNeeded)
    EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
    EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
    EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
@@ -9078,11 +11352,7 @@ TEST_F(BlockUtilsBare, Load5Blocks_ScanWhatIsNeeded)
    scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
    EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
 
-   ///////////////////////////////////////////
-   theBDV->reset();
    TheBDM.doInitialSyncOnLoad(nullProgress);
-   theBDV->scanWallets();
-   ///////////////////////////////////////////
 
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
    EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
@@ -9090,6 +11360,8 @@ TEST_F(BlockUtilsBare, Load5Blocks_ScanWhatIsNeeded)
    EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
    EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
    EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
    scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
@@ -9105,558 +11377,1651 @@ TEST_F(BlockUtilsBare, Load5Blocks_ScanWhatIsNeeded)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
-/*
-class FullScanTest : public ::testing::Test
+TEST_F(BlockUtilsBare, Load5Blocks_RescanEmptyDB)
 {
-protected:
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
 
-   /////////////////////////////////////////////////////////////////////////////
-   virtual void SetUp(void) 
-   {
-      LOGDISABLESTDOUT();
-      //iface_ = LSMWrapper::GetInterfacePtr();
-      magic_ = READHEX(MAINNET_MAGIC_BYTES);
-      ghash_ = READHEX(MAINNET_GENESIS_HASH_HEX);
-      gentx_ = READHEX(MAINNET_GENESIS_TX_HASH_HEX);
-      zeros_ = READHEX("00000000");
-      //DBUtils::setArmoryDbType(ARMORY_DB_BARE);
-      //DBUtils::setDbPruneType(DB_PRUNE_NONE);
-
-      blkdatadir_ = string("./databases/leveldb_blkdata");
-   }
-
-   /////
-   virtual void TearDown(void)
-   {
-      // This seem to be the best way to remove a dir tree in C++ (in Linux)
-      //iface_->closeDatabases();
-      iface_ = NULL;
+   TheBDM.doInitialSyncOnLoad_Rescan(nullProgress);
+   //TheBDM.scanBlockchainForTx(wlt);
 
-   }
+   const ScrAddrObj* scrObj;
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+}
 
-   leveldb::Slice binaryDataToSlice(BinaryData const & bd) 
-         {return leveldb::Slice((char*)bd.getPtr(), bd.getSize());}
-   leveldb::Slice binaryDataRefToSlice(BinaryDataRef const & bdr)
-         {return leveldb::Slice((char*)bdr.getPtr(), bdr.getSize());}
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_RebuildEmptyDB)
+{
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
 
-   BinaryRefReader sliceToRefReader(leveldb::Slice slice)
-         { return BinaryRefReader( (uint8_t*)(slice.data()), slice.size()); }
+   ///////////////////////////////////////////
+   TheBDM.doInitialSyncOnLoad_Rebuild(nullProgress);
+   ///////////////////////////////////////////
 
-   LMDBBlockDatabase* iface_;
-   BinaryData magic_;
-   BinaryData ghash_;
-   BinaryData gentx_;
-   BinaryData zeros_;
-   string blkdatadir_;
-   BinaryRefReader currKey_;
-   BinaryRefReader currVal_;
+   //TheBDM.scanBlockchainForTx(wlt);
 
-};
+   const ScrAddrObj* scrObj;
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(FullScanTest, DISABLED_TestSuperRaw)
+TEST_F(BlockUtilsBare, Load5Blocks_ResumeInterruptedScans)
 {
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   scrAddrVec.push_back(TestChain::scrAddrD);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
 
+   auto dumpHistory = [this](void)->map<BinaryData, BinaryData>
+   {
+      map<BinaryData, BinaryData> dbDump;
 
-   leveldb::Options opts;
-   opts.compression = leveldb::kNoCompression;
-   //opts.block_cache = leveldb::NewLRUCache(2048 * 1024 * 1024);   
-   leveldb::DB* dbptr;
-   leveldb::Status stat = leveldb::DB::Open(opts, blkdatadir_, &dbptr);
-   
-   if(!stat.ok())
-      cout << "Error opening DB: " << stat.ToString() << endl;
+      LMDBEnv::Transaction tx(iface_->dbEnv_[HISTORY].get(), LMDB::ReadOnly);
+      LDBIter ldbIter = iface_->getIterator(HISTORY);
+      if (!ldbIter.seekToFirst())
+         return dbDump;
 
-   leveldb::ReadOptions readopts;
-   readopts.fill_cache = false;
-   //cout << "fill_cache = true (bad)" << endl;
-   cout << "fill_cache = false (good)" << endl;
-   leveldb::Iterator* iter = dbptr->NewIterator(readopts);
+      do
+      {
+         BinaryData key = ldbIter.getKey();
+         BinaryData val = ldbIter.getValue();
 
+         //stxo values can carry trailing bytes depending on how commits 
+         //were batched, compare what they deserialize to
+         if (key.getSize() == 9 && key[0] == (uint8_t)DB_PREFIX_TXDATA)
+         {
+            StoredTxOut stxo;
+            stxo.unserializeDBValue(val);
+            BinaryWriter bw;
+            stxo.serializeDBValue(bw, ARMORY_DB_BARE, DB_PRUNE_NONE, true);
+            val = bw.getData();
+         }
 
-   BinaryData firstKeyBD = DBUtils::getBlkDataKey(0,0);
-   leveldb::Slice firstKey = binaryDataToSlice(firstKeyBD);
-   iter->Seek(firstKey);
+         dbDump[key] = val;
+      } while (ldbIter.advanceAndRead());
 
-   uint32_t hgt;
-   uint8_t  dup;
-   uint16_t txi;
-   uint16_t txo;
-   BLKDATA_TYPE bdtype;
-   BinaryData pref = WRITE_UINT8_LE((uint8_t)DB_PREFIX_TXDATA);
+      //SSH summaries that follow the scan watermark keep the height of their
+      //last write, compare the height they resolve to. The generation counts
+      //the loads, it isn't compared
+      uint32_t watermark = iface_->getScanWatermark();
+      uint32_t generation = iface_->getScanGeneration();
+      auto watermarkIter = dbDump.find(StoredDBInfo::getScanWatermarkKey());
+      if (watermarkIter != dbDump.end())
+         watermarkIter->second = WRITE_UINT32_LE(watermark);
 
-   // This scraddr should have 8 tx
-   BinaryData scraddr = WRITE_UINT8_LE((uint8_t)TXOUT_SCRIPT_STDHASH160);
-   scraddr = scraddr + READHEX("33da2736b16558c9569cc226d4b349ce1aacf649");
-      
+      for (auto& dumpPair : dbDump)
+      {
+         auto& key = dumpPair.first;
+         if (key.getSize() < 5 || key[0] != (uint8_t)DB_PREFIX_SCRIPT ||
+             dbDump.find(key.getSliceCopy(0, key.getSize() - 4)) != 
+             dbDump.end())
+            continue;
+
+         StoredScriptHistory ssh;
+         BinaryRefReader brr(dumpPair.second);
+         ssh.unserializeDBValue(brr);
+         ssh.alreadyScannedUpToBlk_ = 
+            ssh.getScannedUpTo(watermark, generation);
+         ssh.scanGeneration_ = 0;
+
+         BinaryWriter bw;
+         ssh.serializeDBValue(bw, ARMORY_DB_BARE, DB_PRUNE_NONE);
+         dumpPair.second = bw.getData();
+      }
 
-   vector<OutPoint> opList;
+      return dbDump;
+   };
 
-   BinaryData currTxHash(32);
-   while(iter->Valid())
+   auto expectSameHistory = [&dumpHistory](
+      const map<BinaryData, BinaryData>& refDump)->void
    {
-      currKey_.setNewData((uint8_t*)iter->key().data(), iter->key().size());
-      currVal_.setNewData((uint8_t*)iter->value().data(), iter->value().size());
-
-      if(!currKey_.getRawRef().startsWith(pref))
-         break;
-
-      bdtype = DBUtils::readBlkDataKey(currKey_, hgt, dup, txi, txo);      
+      auto dbDump = dumpHistory();
+      EXPECT_EQ(dbDump.size(), refDump.size());
 
-      if(bdtype==BLKDATA_HEADER)
-      {
-         // Need to do a little reading&processing to make sure it is actually pulling dat afrom disk
-         currVal_.advance(4);
-         BinaryData hhash = currVal_.get_BinaryData(80);
-         if(hhash.startsWith(zeros_))
-            cout << "Starts with four zeros!" << endl;
-      }
-      else if(bdtype==BLKDATA_TX)
-      {
-         currVal_.advance(2);
-         currTxHash = currVal_.get_BinaryData(32);
-      }
-      else if(bdtype==BLKDATA_TXOUT)
+      for (auto& refPair : refDump)
       {
-         currVal_.advance(2);
-
-         TxOut txout;
-         txout.unserialize(currVal_);
-         if(txout.getScrAddressStr() == scraddr)
-         {
-            cout << "Found a txout!" << endl;
-            opList.push_back(OutPoint(currTxHash, txo));
-         }
+         auto iter = dbDump.find(refPair.first);
+         ASSERT_TRUE(iter != dbDump.end()) << refPair.first.toHexStr();
+         EXPECT_EQ(iter->second, refPair.second) << refPair.first.toHexStr();
       }
-      else if(bdtype==NOT_BLKDATA)
-         break;
-
-      iter->Next();
-   }
+   };
 
-   for(uint32_t o=0; o<opList.size(); o++)
+   //throws like a shutdown request would, after block 2 is applied. The 
+   //first report comes from the phase setup, then one per block
+   unsigned rescanReports = 0;
+   auto stopMidway = [&rescanReports](unsigned phase, double prog, 
+      unsigned, unsigned)->void
    {
-      cout << o << ": " << opList[o].getTxHash().toHexStr().c_str()
-                << ":" << opList[o].getTxOutIndex() << endl;
-   }
-}
+      if (phase == BDMPhase_Rescan && ++rescanReports == 4)
+         throw runtime_error("scan interrupted");
+   };
 
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   auto refHistory = dumpHistory();
+   EXPECT_FALSE(TheBDM.hasScanCheckpoint());
 
-////////////////////////////////////////////////////////////////////////////////
-TEST_F(FullScanTest, DISABLED_CreateSuperRawDB)
-{
-   string dbdir("./rawdbdir");
-   
-   leveldb::Options opts;
-   opts.compression = leveldb::kNoCompression;
-   opts.create_if_missing = true;
-   opts.block_size = 8*1024*1024;
-   leveldb::DB* dbptr;
-   leveldb::Status stat = leveldb::DB::Open(opts, dbdir, &dbptr);
-   
-   if(!stat.ok())
-      cout << "Error opening DB: " << stat.ToString() << endl;
+   //rescan
+   theBDV->reset();
+   EXPECT_THROW(TheBDM.doInitialSyncOnLoad_Rescan(stopMidway), runtime_error);
 
-   //leveldb::Iterator* iter = dbptr->NewIterator(leveldb::ReadOptions());
-   uint32_t i=0;
-   uint32_t nblk=0;
-   uint64_t lastWrite=0;
-   uint64_t writeBytes=0;
-   string fname = BtcUtils::getBlkFilename("/home/alan/.bitcoin/blocks", i);
-   
-   BinaryData magic(4), nbytes(4);
-   BinaryData expectedMagicBytes = READHEX(MAINNET_MAGIC_BYTES);
+   StoredScanCheckpoint sscp;
+   ASSERT_TRUE(iface_->getScanCheckpoint(sscp));
+   EXPECT_EQ(sscp.type_, SCAN_CHECKPOINT_RESCAN);
+   EXPECT_EQ(sscp.startBlock_, 0);
+   EXPECT_EQ(sscp.endBlock_, 5);
+   EXPECT_LT(sscp.committedHeight_, 5);
+   EXPECT_NE(dumpHistory(), refHistory);
 
-   leveldb::WriteBatch* writebatch = new leveldb::WriteBatch;
-   
-   while(BtcUtils::GetFileSize(fname) != FILE_DOES_NOT_EXIST)
+   //committed along with the SDBI
    {
-      cout << "Opening: " << fname.c_str() << "(" << BtcUtils::GetFileSize(fname) << ")" << endl;
-      ifstream is(fname.c_str(), ios::in | ios::binary);
+      LMDBEnv::Transaction tx;
+      iface_->beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+      StoredDBInfo sdbi;
+      iface_->getStoredDBInfo(HISTORY, sdbi);
+      EXPECT_EQ(sscp.committedHeight_ + 1, sdbi.appliedToHgt_);
+      EXPECT_EQ(sscp.committedHash_, sdbi.topScannedBlkHash_);
+   }
 
-      while(!is.eof())
-      {
-         // Magic bytes
-         is.read((char*)magic.getPtr(), 4);
-         if(magic != expectedMagicBytes)
-            break;         
+   theBDV->reset();
+   TheBDM.doInitialSyncOnLoad_Rescan(nullProgress);
+   EXPECT_FALSE(TheBDM.hasScanCheckpoint());
+   expectSameHistory(refHistory);
 
-         // Number of bytes in block
-         is.read((char*)nbytes.getPtr(), 4);
-         uint32_t blkBytes = READ_UINT32_LE(nbytes.getPtr());
+   //rebuild
+   rescanReports = 0;
+   theBDV->reset();
+   EXPECT_THROW(TheBDM.doInitialSyncOnLoad_Rebuild(stopMidway), runtime_error);
 
-         // Reading
-         cout << nblk << " Reading " << blkBytes << " bytes in block; ";
-         BinaryReader br(blkBytes);
-         is.read((char*)br.exposeDataPtr(), blkBytes);
+   ASSERT_TRUE(iface_->getScanCheckpoint(sscp));
+   EXPECT_EQ(sscp.type_, SCAN_CHECKPOINT_REBUILD);
+   EXPECT_LT(sscp.committedHeight_, 5);
 
-         br.advance(80);
-         uint32_t numTx = (uint32_t)br.get_var_int();
-         cout << "Number of tx in block: " << numTx << endl;
-         for(uint32_t tx=0; tx<numTx; tx++)
-         {
-            uint32_t txSize = BtcUtils::TxCalcLength(br.getCurrPtr());
-            BinaryData rawTx, txHash;
-            br.get_BinaryData(rawTx, txSize);
-            BtcUtils::getHash256(rawTx, txHash);
-            leveldb::Slice ldbKey((char*)txHash.getPtr(), 32);
-            leveldb::Slice ldbVal((char*)rawTx.getPtr(), txSize);
-         
-            writeBytes += (uint64_t)txSize;
-            writebatch->Put(ldbKey, ldbVal);
+   theBDV->reset();
+   TheBDM.doInitialSyncOnLoad_Rebuild(nullProgress);
+   EXPECT_FALSE(TheBDM.hasScanCheckpoint());
+   expectSameHistory(refHistory);
 
-         }
+   theBDV->scanWallets();
+
+   const ScrAddrObj* scrObj;
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+   EXPECT_EQ(scrObj->getFullBalance(), 65*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_ForceFullRewhatever)
+{
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+   const ScrAddrObj* scrObj;
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+   // This is just a regular load
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   //post initial load address registration
+   wlt->addScrAddress(TestChain::scrAddrD);
+
+   EXPECT_EQ(TheBDM.sideScanFlag_, true);
+
+   //fire side scan manually since there is no maintenance thread with unit tests
+   theBDM->startSideScan([](const vector<string>&, double prog, unsigned time){});
+
+   //wait on the address scan
+   while (wlt->getMergeFlag() == false)
+      usleep(100);
+
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   try
+   {
+      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+      EXPECT_EQ(scrObj, nullptr);
+   }
+   catch (std::runtime_error &)
+   {
+   }
+
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+
+   ///////////////////////////////////////////
+   theBDV->reset();
+   TheBDM.doInitialSyncOnLoad_Rescan(nullProgress);
+   theBDV->scanWallets();
+   ///////////////////////////////////////////
+
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+
+   ///////////////////////////////////////////
+   theBDV->reset();
+   TheBDM.doRebuildDatabases(nullProgress);
+   theBDV->scanWallets();
+   ///////////////////////////////////////////
+
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_ScanWhatIsNeeded)
+{
+   BtcWallet* wlt;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+   const ScrAddrObj* scrObj;
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   scrAddrVec.push_back(TestChain::scrAddrE);
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+   // This is just a regular load
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   wlt->addScrAddress(TestChain::scrAddrD);
+
+   EXPECT_EQ(TheBDM.sideScanFlag_, true);
+
+   //fire side scan manually since there is no maintenance thread with unit tests
+   theBDM->startSideScan([](const vector<string>&, double prog, unsigned time){});
+
+   //wait on the address scan
+   while (wlt->getMergeFlag() == false)
+      usleep(100);
+
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+
+   try
+   {
+      scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrD);
+      EXPECT_EQ(scrObj, nullptr);
+   }
+   catch (std::runtime_error &)
+   {
+   }
+
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+
+   ///////////////////////////////////////////
+   theBDV->reset();
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->scanWallets();
+   ///////////////////////////////////////////
+
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+
+   ///////////////////////////////////////////
+   theBDV->reset();
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDV->scanWallets();
+   ///////////////////////////////////////////
+
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrA);
+   EXPECT_EQ(scrObj->getFullBalance(), 50*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrB);
+   EXPECT_EQ(scrObj->getFullBalance(), 70*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrC);
+   EXPECT_EQ(scrObj->getFullBalance(), 20*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrE);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wlt->getScrAddrObjByKey(TestChain::scrAddrF);
+   EXPECT_EQ(scrObj->getFullBalance(),  5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 5*COIN);
+   scrObj = wltLB1->getScrAddrObjByKey(TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 25*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddr);
+   EXPECT_EQ(scrObj->getFullBalance(), 30*COIN);
+   scrObj = wltLB2->getScrAddrObjByKey(TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(scrObj->getFullBalance(), 0*COIN);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_SideScan_BlockFilters)
+{
+   BtcWallet* wlt;
+   BtcWallet* wlt2;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+
+   scrAddrVec.clear();
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   //every block got a filter on import, check it has no false negatives
+   uint64_t filterBytes = 0, blockBytes = 0;
+   {
+      LMDBEnv::Transaction tx(iface_->dbEnv_[BLKDATA].get(), LMDB::ReadOnly);
+      for (uint32_t hgt = 0; hgt <= 5; hgt++)
+      {
+         uint8_t dup = iface_->getValidDupIDForHeight(hgt);
+         StoredBlockFilter sbf;
+         ASSERT_TRUE(iface_->getStoredBlockFilter(sbf, hgt, dup));
+
+         BinaryDataRef rawBlock = 
+            iface_->getValueNoCopy(BLKDATA, DBUtils::getBlkDataKey(hgt, dup));
+         filterBytes += sbf.serializeDBValue().getSize();
+         blockBytes += rawBlock.getSize();
+
+         BinaryRefReader brr(rawBlock);
+         brr.advance(HEADER_SIZE);
+         uint32_t nTx = (uint32_t)brr.get_var_int();
+         for (uint32_t i = 0; i < nTx; i++)
+         {
+            Tx thisTx(brr);
+            for (uint32_t iout = 0; iout < thisTx.getNumTxOut(); iout++)
+            {
+               set<uint64_t> query;
+               query.insert(StoredBlockFilter::getElementHash(
+                  thisTx.getTxOutCopy(iout).getScrAddressStr().getRef()));
+               EXPECT_TRUE(sbf.matchAny(query));
+            }
+
+            for (uint32_t iin = 0; iin < thisTx.getNumTxIn(); iin++)
+            {
+               BinaryData opHash = 
+                  thisTx.getTxInCopy(iin).getOutPoint().getTxHash();
+               if (opHash == BtcUtils::EmptyHash_)
+                  continue;
+
+               set<uint64_t> query;
+               query.insert(StoredBlockFilter::getElementHash(opHash.getRef()));
+               EXPECT_TRUE(sbf.matchAny(query));
+            }
+         }
+
+         //round trip through the DB format
+         StoredBlockFilter sbf2;
+         sbf2.unserializeDBValue(sbf.serializeDBValue().getRef());
+         EXPECT_EQ(sbf2.numElements_, sbf.numElements_);
+         EXPECT_EQ(sbf2.filterData_, sbf.filterData_);
+      }
+   }
+
+   LOGINFO << "Block filters: " << filterBytes << " bytes for " 
+      << blockBytes << " bytes of blocks (" 
+      << (double)filterBytes * 100.0 / (double)blockBytes << "%)";
+
+   //side scan with filters
+   wlt->addScrAddress(TestChain::scrAddrD);
+   TIMER_START("sideScanWithFilters");
+   theBDM->startSideScan([](const vector<string>&, double prog, unsigned time){});
+   while (wlt->getMergeFlag() == false)
+      usleep(100);
+   TIMER_STOP("sideScanWithFilters");
+
+   //side scan without filters
+   BlockDataManagerConfig noFilterConfig = theBDM->config();
+   noFilterConfig.useBlockFilters = false;
+   theBDM->setConfig(noFilterConfig);
+
+   wlt2->addScrAddress(TestChain::scrAddrE);
+   TIMER_START("sideScanNoFilters");
+   while (wlt2->getMergeFlag() == false)
+   {
+      //no-op until the previous side scan is done cleaning up
+      theBDM->startSideScan(
+         [](const vector<string>&, double prog, unsigned time){});
+      usleep(100);
+   }
+   TIMER_STOP("sideScanNoFilters");
+
+   LOGINFO << "side scan with filters: " 
+      << TIMER_READ_SEC("sideScanWithFilters") << "s, without: "
+      << TIMER_READ_SEC("sideScanNoFilters") << "s";
+
+   //both scans should yield the same history as a full scan
+   {
+      LMDBEnv::Transaction tx(iface_->dbEnv_[HISTORY].get(), LMDB::ReadOnly);
+      EXPECT_EQ(iface_->getBalanceForScrAddr(TestChain::scrAddrD), 65*COIN);
+      EXPECT_EQ(iface_->getBalanceForScrAddr(TestChain::scrAddrE), 30*COIN);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_SideScan_Coalesced)
+{
+   BtcWallet* wlt;
+   BtcWallet* wlt2;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+
+   scrAddrVec.clear();
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   //both imports land in the same pending side scan
+   wlt->addScrAddress(TestChain::scrAddrD);
+   wlt2->addScrAddress(TestChain::scrAddrE);
+   EXPECT_EQ(theBDM->getScrAddrFilter()->getNextWalletIDToScan().size(), 2);
+
+   EXPECT_TRUE(theBDM->startSideScan(
+      [](const vector<string>&, double prog, unsigned time){}));
+   while (wlt->getMergeFlag() == false || wlt2->getMergeFlag() == false)
+      usleep(100);
+
+   //nothing left to scan after the single pass
+   EXPECT_FALSE(theBDM->startSideScan(
+      [](const vector<string>&, double prog, unsigned time){}));
+
+   {
+      LMDBEnv::Transaction tx(iface_->dbEnv_[HISTORY].get(), LMDB::ReadOnly);
+      EXPECT_EQ(iface_->getBalanceForScrAddr(TestChain::scrAddrD), 65*COIN);
+      EXPECT_EQ(iface_->getBalanceForScrAddr(TestChain::scrAddrE), 30*COIN);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_SideScan_JoinMidScan)
+{
+   BtcWallet* wlt;
+   BtcWallet* wlt2;
+   BtcWallet* wltLB1;
+   BtcWallet* wltLB2;
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+
+   scrAddrVec.clear();
+   scrAddrVec.push_back(TestChain::scrAddrF);
+   regWallet(scrAddrVec, "wallet2", theBDV, &wlt2);
+   regLockboxes(theBDV, &wltLB1, &wltLB2);
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   //register E from the scan thread once the side scan for D is under way
+   bool joined = false;
+   auto progress = [&](const vector<string>&, double prog, unsigned time)
+   {
+      if (joined)
+         return;
+
+      joined = true;
+      wlt2->addScrAddress(TestChain::scrAddrE);
+   };
+
+   wlt->addScrAddress(TestChain::scrAddrD);
+   EXPECT_TRUE(theBDM->startSideScan(progress));
+   while (wlt->getMergeFlag() == false || wlt2->getMergeFlag() == false)
+      usleep(100);
+
+   //E joined the running pass instead of queuing a new one
+   EXPECT_TRUE(joined);
+   EXPECT_FALSE(theBDM->startSideScan(
+      [](const vector<string>&, double prog, unsigned time){}));
+
+   {
+      LMDBEnv::Transaction tx(iface_->dbEnv_[HISTORY].get(), LMDB::ReadOnly);
+      EXPECT_EQ(iface_->getBalanceForScrAddr(TestChain::scrAddrD), 65*COIN);
+      EXPECT_EQ(iface_->getBalanceForScrAddr(TestChain::scrAddrE), 30*COIN);
+   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBare, Load5Blocks_WorkRequestStamps)
+{
+   BtcWallet* wlt;
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   regWallet(scrAddrVec, "wallet1", theBDV, &wlt);
+
+   //nothing asked for yet
+   EXPECT_EQ(theBDM->takeWorkRequest(BDMWork_ZC), 0);
+
+   //a repeated request keeps the first stamp, taking it clears it
+   theBDM->stampWorkRequest(BDMWork_ZC);
+   uint64_t between = ScanTelemetry::now();
+   usleep(1000);
+   theBDM->stampWorkRequest(BDMWork_ZC);
+   uint64_t stamp = theBDM->takeWorkRequest(BDMWork_ZC);
+   EXPECT_GT(stamp, 0);
+   EXPECT_LE(stamp, between);
+   EXPECT_EQ(theBDM->takeWorkRequest(BDMWork_ZC), 0);
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   theBDM->takeWorkRequest(BDMWork_Merge);
+
+   //a side scan stamps the merge when it flags the BDM thread
+   uint64_t before = ScanTelemetry::now();
+   wlt->addScrAddress(TestChain::scrAddrB);
+   EXPECT_TRUE(theBDM->startSideScan(
+      [](const vector<string>&, double prog, unsigned time){}));
+   while (wlt->getMergeFlag() == false)
+      usleep(100);
+
+   EXPECT_GE(theBDM->takeWorkRequest(BDMWork_Merge), before);
+   EXPECT_EQ(theBDM->takeWorkRequest(BDMWork_Merge), 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+/*
+class FullScanTest : public ::testing::Test
+{
+protected:
+
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void SetUp(void) 
+   {
+      LOGDISABLESTDOUT();
+      //iface_ = LSMWrapper::GetInterfacePtr();
+      magic_ = READHEX(MAINNET_MAGIC_BYTES);
+      ghash_ = READHEX(MAINNET_GENESIS_HASH_HEX);
+      gentx_ = READHEX(MAINNET_GENESIS_TX_HASH_HEX);
+      zeros_ = READHEX("00000000");
+      //DBUtils::setArmoryDbType(ARMORY_DB_BARE);
+      //DBUtils::setDbPruneType(DB_PRUNE_NONE);
+
+      blkdatadir_ = string("./databases/leveldb_blkdata");
+   }
+
+   /////
+   virtual void TearDown(void)
+   {
+      // This seem to be the best way to remove a dir tree in C++ (in Linux)
+      //iface_->closeDatabases();
+      iface_ = NULL;
+
+   }
+
+   leveldb::Slice binaryDataToSlice(BinaryData const & bd) 
+         {return leveldb::Slice((char*)bd.getPtr(), bd.getSize());}
+   leveldb::Slice binaryDataRefToSlice(BinaryDataRef const & bdr)
+         {return leveldb::Slice((char*)bdr.getPtr(), bdr.getSize());}
+
+   BinaryRefReader sliceToRefReader(leveldb::Slice slice)
+         { return BinaryRefReader( (uint8_t*)(slice.data()), slice.size()); }
+
+   LMDBBlockDatabase* iface_;
+   BinaryData magic_;
+   BinaryData ghash_;
+   BinaryData gentx_;
+   BinaryData zeros_;
+   string blkdatadir_;
+   BinaryRefReader currKey_;
+   BinaryRefReader currVal_;
+
+};
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(FullScanTest, DISABLED_TestSuperRaw)
+{
+
+
+   leveldb::Options opts;
+   opts.compression = leveldb::kNoCompression;
+   //opts.block_cache = leveldb::NewLRUCache(2048 * 1024 * 1024);   
+   leveldb::DB* dbptr;
+   leveldb::Status stat = leveldb::DB::Open(opts, blkdatadir_, &dbptr);
+   
+   if(!stat.ok())
+      cout << "Error opening DB: " << stat.ToString() << endl;
+
+   leveldb::ReadOptions readopts;
+   readopts.fill_cache = false;
+   //cout << "fill_cache = true (bad)" << endl;
+   cout << "fill_cache = false (good)" << endl;
+   leveldb::Iterator* iter = dbptr->NewIterator(readopts);
+
+
+   BinaryData firstKeyBD = DBUtils::getBlkDataKey(0,0);
+   leveldb::Slice firstKey = binaryDataToSlice(firstKeyBD);
+   iter->Seek(firstKey);
+
+   uint32_t hgt;
+   uint8_t  dup;
+   uint16_t txi;
+   uint16_t txo;
+   BLKDATA_TYPE bdtype;
+   BinaryData pref = WRITE_UINT8_LE((uint8_t)DB_PREFIX_TXDATA);
+
+   // This scraddr should have 8 tx
+   BinaryData scraddr = WRITE_UINT8_LE((uint8_t)TXOUT_SCRIPT_STDHASH160);
+   scraddr = scraddr + READHEX("33da2736b16558c9569cc226d4b349ce1aacf649");
+      
+
+   vector<OutPoint> opList;
+
+   BinaryData currTxHash(32);
+   while(iter->Valid())
+   {
+      currKey_.setNewData((uint8_t*)iter->key().data(), iter->key().size());
+      currVal_.setNewData((uint8_t*)iter->value().data(), iter->value().size());
+
+      if(!currKey_.getRawRef().startsWith(pref))
+         break;
+
+      bdtype = DBUtils::readBlkDataKey(currKey_, hgt, dup, txi, txo);      
+
+      if(bdtype==BLKDATA_HEADER)
+      {
+         // Need to do a little reading&processing to make sure it is actually pulling dat afrom disk
+         currVal_.advance(4);
+         BinaryData hhash = currVal_.get_BinaryData(80);
+         if(hhash.startsWith(zeros_))
+            cout << "Starts with four zeros!" << endl;
+      }
+      else if(bdtype==BLKDATA_TX)
+      {
+         currVal_.advance(2);
+         currTxHash = currVal_.get_BinaryData(32);
+      }
+      else if(bdtype==BLKDATA_TXOUT)
+      {
+         currVal_.advance(2);
+
+         TxOut txout;
+         txout.unserialize(currVal_);
+         if(txout.getScrAddressStr() == scraddr)
+         {
+            cout << "Found a txout!" << endl;
+            opList.push_back(OutPoint(currTxHash, txo));
+         }
+      }
+      else if(bdtype==NOT_BLKDATA)
+         break;
+
+      iter->Next();
+   }
+
+   for(uint32_t o=0; o<opList.size(); o++)
+   {
+      cout << o << ": " << opList[o].getTxHash().toHexStr().c_str()
+                << ":" << opList[o].getTxOutIndex() << endl;
+   }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(FullScanTest, DISABLED_CreateSuperRawDB)
+{
+   string dbdir("./rawdbdir");
+   
+   leveldb::Options opts;
+   opts.compression = leveldb::kNoCompression;
+   opts.create_if_missing = true;
+   opts.block_size = 8*1024*1024;
+   leveldb::DB* dbptr;
+   leveldb::Status stat = leveldb::DB::Open(opts, dbdir, &dbptr);
+   
+   if(!stat.ok())
+      cout << "Error opening DB: " << stat.ToString() << endl;
+
+   //leveldb::Iterator* iter = dbptr->NewIterator(leveldb::ReadOptions());
+   uint32_t i=0;
+   uint32_t nblk=0;
+   uint64_t lastWrite=0;
+   uint64_t writeBytes=0;
+   string fname = BtcUtils::getBlkFilename("/home/alan/.bitcoin/blocks", i);
+   
+   BinaryData magic(4), nbytes(4);
+   BinaryData expectedMagicBytes = READHEX(MAINNET_MAGIC_BYTES);
+
+   leveldb::WriteBatch* writebatch = new leveldb::WriteBatch;
+   
+   while(BtcUtils::GetFileSize(fname) != FILE_DOES_NOT_EXIST)
+   {
+      cout << "Opening: " << fname.c_str() << "(" << BtcUtils::GetFileSize(fname) << ")" << endl;
+      ifstream is(fname.c_str(), ios::in | ios::binary);
+
+      while(!is.eof())
+      {
+         // Magic bytes
+         is.read((char*)magic.getPtr(), 4);
+         if(magic != expectedMagicBytes)
+            break;         
+
+         // Number of bytes in block
+         is.read((char*)nbytes.getPtr(), 4);
+         uint32_t blkBytes = READ_UINT32_LE(nbytes.getPtr());
+
+         // Reading
+         cout << nblk << " Reading " << blkBytes << " bytes in block; ";
+         BinaryReader br(blkBytes);
+         is.read((char*)br.exposeDataPtr(), blkBytes);
+
+         br.advance(80);
+         uint32_t numTx = (uint32_t)br.get_var_int();
+         cout << "Number of tx in block: " << numTx << endl;
+         for(uint32_t tx=0; tx<numTx; tx++)
+         {
+            uint32_t txSize = BtcUtils::TxCalcLength(br.getCurrPtr());
+            BinaryData rawTx, txHash;
+            br.get_BinaryData(rawTx, txSize);
+            BtcUtils::getHash256(rawTx, txHash);
+            leveldb::Slice ldbKey((char*)txHash.getPtr(), 32);
+            leveldb::Slice ldbVal((char*)rawTx.getPtr(), txSize);
+         
+            writeBytes += (uint64_t)txSize;
+            writebatch->Put(ldbKey, ldbVal);
+
+         }
 
          if(writeBytes - lastWrite > 1024*1024*1024)
          {
-            lastWrite = writeBytes;
-            dbptr->Write(leveldb::WriteOptions(), writebatch);
-            writebatch->Clear();
+            lastWrite = writeBytes;
+            dbptr->Write(leveldb::WriteOptions(), writebatch);
+            writebatch->Clear();
+         }
+         nblk++;
+   
+      }
+
+
+      i++;
+      fname = BtcUtils::getBlkFilename("/home/alan/.bitcoin/blocks", i);
+
+   }
+
+   dbptr->Write(leveldb::WriteOptions(), writebatch);
+   writebatch->Clear();
+   delete writebatch;
+   delete dbptr;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(FullScanTest, ReadSuperRawDB)
+{
+   string dbdir("./rawdbdir");
+   BinaryData scraddr = WRITE_UINT8_LE((uint8_t)TXOUT_SCRIPT_STDHASH160);
+   scraddr = scraddr + READHEX("33da2736b16558c9569cc226d4b349ce1aacf649");
+   
+   leveldb::Options opts;
+   opts.compression = leveldb::kNoCompression;
+   opts.block_cache = leveldb::NewLRUCache(2048 * 1024 * 1024);   
+   opts.block_size = 8*1024*1024;
+   leveldb::DB* dbptr;
+   leveldb::Status stat = leveldb::DB::Open(opts, dbdir, &dbptr);
+   
+   if(!stat.ok())
+      cout << "Error opening DB: " << stat.ToString() << endl;
+   
+   leveldb::ReadOptions readopts;
+   readopts.fill_cache = false;
+   leveldb::Iterator* iter = dbptr->NewIterator(readopts);
+   iter->SeekToFirst();
+
+   vector<uint32_t> txinOffsets, txoutOffsets;
+   while(iter->Valid())
+   {
+      currKey_.setNewData((uint8_t*)iter->key().data(), iter->key().size());
+      currVal_.setNewData((uint8_t*)iter->value().data(), iter->value().size());
+
+      uint8_t const * txPtr = currVal_.exposeDataPtr();
+      BtcUtils::TxCalcLength(txPtr, &txinOffsets, &txoutOffsets);
+
+      for(uint32_t txo=0; txo<txoutOffsets.size()-1; txo++)
+      {
+         uint32_t start = txoutOffsets[txo];
+         uint32_t sz    = txoutOffsets[txo+1] - start;
+         BinaryDataRef txoRef(txPtr+start, sz);
+         TxOut txout;
+         txout.unserialize(txoRef);
+         if(txout.getScrAddressStr() == scraddr)
+         {
+            cout << "Found a txout!" << endl;
          }
-         nblk++;
-   
       }
 
+      iter->Next();
+   }
+   
+   cout << "Done!" << endl;
+
+}
+*/
+
+
+class LoadTestnetBareTest : public ::testing::Test
+{
+protected:
+   BlockDataManager_LevelDB *theBDM;
+   BlockDataViewer          *theBDV;
+
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void TearDown(void)  {}
+
+   virtual void SetUp(void) 
+   {
+//       DBUtils::setArmoryDbType(ARMORY_DB_BARE);
+//       DBUtils::setDbPruneType(DB_PRUNE_NONE);
+
+      blkdir_  = string("/home/alan/.bitcoin/testnet3/blocks");
+      homedir_ = string("/home/alan/.armory/testnet3");
+      ldbdir_  = string("/home/alan/.armory/testnet3/databases");
+
+
+      mkdir(ldbdir_);
+      mkdir(homedir_);
+      
+      BlockDataManagerConfig config;
+      
+      config.armoryDbType = ARMORY_DB_BARE;
+      config.pruneType = DB_PRUNE_NONE;
+      config.blkFileLocation = blkdir_;
+      config.levelDBLocation = ldbdir_;
+      
+      config.selectNetwork("Test");
+      
+      theBDM = new BlockDataManager_LevelDB(config);
+      theBDV = new BlockDataViewer(theBDM);
+      CLEANUP_ALL_TIMERS();
+   }
+
+   void mkdir(string newdir)
+   {
+      char* syscmd = new char[4096];
+      sprintf(syscmd, "mkdir -p %s", newdir.c_str());
+      system(syscmd);
+      delete[] syscmd;
+   }
+
+   LMDBBlockDatabase* iface_;
+   BinaryData magic_;
+   BinaryData ghash_;
+   BinaryData gentx_;
+   BinaryData zeros_;
+
+   string blkdir_;
+   string homedir_;
+   string ldbdir_;
+   string blk0dat_;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(LoadTestnetBareTest, DISABLED_StepThroughDebug_usually_disabled)
+{
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+
+   BtcWallet& wlt = *theBDV->registerWallet(scrAddrVec, "wallet1", false);
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   //TheBDM.scanBlockchainForTx(wlt);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// THESE ARE ARMORY_DB_SUPER tests.  Identical to above except for the mode.
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+class BlockUtilsSuper : public ::testing::Test
+{
+protected:
+   BlockDataManager_LevelDB TheBDM;
+   BlockDataViewer*         theBDV;
+
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void SetUp(void) 
+   {
+      LOGDISABLESTDOUT();
+      magic_ = READHEX(MAINNET_MAGIC_BYTES);
+      ghash_ = READHEX(MAINNET_GENESIS_HASH_HEX);
+      gentx_ = READHEX(MAINNET_GENESIS_TX_HASH_HEX);
+      zeros_ = READHEX("00000000");
+
+      blkdir_  = string("./blkfiletest");
+      homedir_ = string("./fakehomedir");
+      ldbdir_  = string("./ldbtestdir");
+
+      mkdir(blkdir_);
+      mkdir(homedir_);
+
+      // Put the first 5 blocks into the blkdir
+      blk0dat_ = BtcUtils::getBlkFilename(blkdir_, 0);
+      setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+
+      config_.armoryDbType = ARMORY_DB_SUPER;
+      config_.pruneType = DB_PRUNE_NONE;
+      config_.blkFileLocation = blkdir_;
+      config_.levelDBLocation = ldbdir_;
+      
+      config_.genesisBlockHash = ghash_;
+      config_.genesisTxHash = gentx_;
+      config_.magicBytes = magic_;
+      
+      theBDM = new BlockDataManager_LevelDB(config_);
+      theBDM->openDatabase();
+      theBDV = new BlockDataViewer(theBDM);
+
+      iface_ = theBDM->getIFace();
+   }
+
+
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void TearDown(void)
+   {
+      delete theBDM;
+      delete theBDV;
+      
+      theBDM = nullptr;
+      theBDV = nullptr;
+
+      rmdir(blkdir_);
+      rmdir(homedir_);
+
+      #ifdef _MSC_VER
+         rmdir(ldbdir_);
+         mkdir(ldbdir_);
+      #else
+         std::string d = ldbdir_ + "/*";
+         rmdir(d);
+      #endif
+      LOGENABLESTDOUT();
+      CLEANUP_ALL_TIMERS();
+   }
+
+
+   // Run this before registering a BDM.
+   void regWallet(const vector<BinaryData>& scrAddrs, const string& wltName,
+                  BlockDataViewer*& inBDV, BtcWallet** inWlt)
+   {
+      // Register the standalone address wallet. (All registrations should be
+      // done before initializing the BDM. This is critical!)
+      *inWlt = inBDV->registerWallet(scrAddrs, wltName, false);
+   }
+
+
+   // Run this before registering a BDM. (For now, just make the two lockboxes a
+   // package deal. Code can be altered later if needed.)
+   void regLockboxes(BlockDataViewer*& inBDV, BtcWallet** inLB1,
+                     BtcWallet** inLB2)
+   {
+      // Register the two lockboxes. Note that the lockbox data is pulled from
+      // createTestChain.py, the script that built most of the blocks used in
+      // these unit tests. Python, not C++, is where we find the code needed to
+      // generate the data required by C++ lockboxes. If the lockboxes and/or
+      // blocks are redone, this data's automatically redone.
+      // LB1 = AddrB + AddrC
+      // LB2 = AddrD + AddrE
+      const vector<BinaryData> lb1ScrAddrs
+      {
+         TestChain::lb1ScrAddr,
+         TestChain::lb1ScrAddrP2SH
+      };
+      const vector<BinaryData> lb2ScrAddrs
+      {
+         TestChain::lb2ScrAddr,
+         TestChain::lb2ScrAddrP2SH
+      };
+      *inLB1 = inBDV->registerLockbox(lb1ScrAddrs, TestChain::lb1B58ID, false);
+      *inLB2 = inBDV->registerLockbox(lb2ScrAddrs, TestChain::lb2B58ID, false);
+   }
+
+
+#if ! defined(_MSC_VER) && ! defined(__MINGW32__)
+   /////////////////////////////////////////////////////////////////////////////
+   void rmdir(string src)
+   {
+      char* syscmd = new char[4096];
+      sprintf(syscmd, "rm -rf %s", src.c_str());
+      system(syscmd);
+      delete[] syscmd;
+   }
+
+   /////////////////////////////////////////////////////////////////////////////
+   void mkdir(string newdir)
+   {
+      char* syscmd = new char[4096];
+      sprintf(syscmd, "mkdir -p %s", newdir.c_str());
+      system(syscmd);
+      delete[] syscmd;
+   }
+#endif
+
+   LMDBBlockDatabase* iface_;
+   BinaryData magic_;
+   BinaryData ghash_;
+   BinaryData gentx_;
+   BinaryData zeros_;
+   BlockDataManagerConfig config_;
 
-      i++;
-      fname = BtcUtils::getBlkFilename("/home/alan/.bitcoin/blocks", i);
+   string blkdir_;
+   string homedir_;
+   string ldbdir_;
+   string blk0dat_;
 
-   }
+   NullProgressReporter nullProg_;
+};
 
-   dbptr->Write(leveldb::WriteOptions(), writebatch);
-   writebatch->Clear();
-   delete writebatch;
-   delete dbptr;
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsSuper, HeadersOnly)
+{
+   EXPECT_EQ(&TheBDM.blockchain().top(), &TheBDM.blockchain().getGenesisBlock());
+   TheBDM.readBlkFileUpdate();
+
+   EXPECT_EQ(TheBDM.blockchain().allHeaders().size(), 6);
+   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
+   EXPECT_EQ(TheBDM.blockchain().top().getThisHash(), TestChain::blkHash5);
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
+   //iface_->printAllDatabaseEntries(HEADERS);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(FullScanTest, ReadSuperRawDB)
+TEST_F(BlockUtilsSuper, HeadersOnly_Reorg)
 {
-   string dbdir("./rawdbdir");
-   BinaryData scraddr = WRITE_UINT8_LE((uint8_t)TXOUT_SCRIPT_STDHASH160);
-   scraddr = scraddr + READHEX("33da2736b16558c9569cc226d4b349ce1aacf649");
-   
-   leveldb::Options opts;
-   opts.compression = leveldb::kNoCompression;
-   opts.block_cache = leveldb::NewLRUCache(2048 * 1024 * 1024);   
-   opts.block_size = 8*1024*1024;
-   leveldb::DB* dbptr;
-   leveldb::Status stat = leveldb::DB::Open(opts, dbdir, &dbptr);
-   
-   if(!stat.ok())
-      cout << "Error opening DB: " << stat.ToString() << endl;
-   
-   leveldb::ReadOptions readopts;
-   readopts.fill_cache = false;
-   leveldb::Iterator* iter = dbptr->NewIterator(readopts);
-   iter->SeekToFirst();
+   // this test is presently of dubious value. I think
+   // at some point the alternate blocks (4A and 5A) had a higher difficulty
+   setBlocks({ "0", "1", "2", "3", "4" }, blk0dat_);
+   SETLOGLEVEL(LogLvlError);
+   EXPECT_EQ(&TheBDM.blockchain().top(), &TheBDM.blockchain().getGenesisBlock());
+   TheBDM.readBlkFileUpdate();
 
-   vector<uint32_t> txinOffsets, txoutOffsets;
-   while(iter->Valid())
-   {
-      currKey_.setNewData((uint8_t*)iter->key().data(), iter->key().size());
-      currVal_.setNewData((uint8_t*)iter->value().data(), iter->value().size());
+   EXPECT_EQ(TheBDM.blockchain().allHeaders().size(), 5);
+   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 4);
 
-      uint8_t const * txPtr = currVal_.exposeDataPtr();
-      BtcUtils::TxCalcLength(txPtr, &txinOffsets, &txoutOffsets);
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 4);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash4);
 
-      for(uint32_t txo=0; txo<txoutOffsets.size()-1; txo++)
-      {
-         uint32_t start = txoutOffsets[txo];
-         uint32_t sz    = txoutOffsets[txo+1] - start;
-         BinaryDataRef txoRef(txPtr+start, sz);
-         TxOut txout;
-         txout.unserialize(txoRef);
-         if(txout.getScrAddressStr() == scraddr)
-         {
-            cout << "Found a txout!" << endl;
-         }
-      }
+   appendBlocks({ "4A" }, blk0dat_);
+   TheBDM.readBlkFileUpdate();
+   EXPECT_EQ(TheBDM.blockchain().allHeaders().size(), 6);
+   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 4);
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 4);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash4);
+   EXPECT_FALSE( TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4A).isMainBranch());
+   EXPECT_TRUE( TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4 ).isMainBranch());
 
-      iter->Next();
-   }
-   
-   cout << "Done!" << endl;
+   appendBlocks( {"5A"}, blk0dat_);
+   TheBDM.readBlkFileUpdate();
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5A);
+   EXPECT_FALSE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4 ).isMainBranch());
+   EXPECT_TRUE( TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4A).isMainBranch());
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5A ).isMainBranch());
 
+   SETLOGLEVEL(LogLvlDebug2);
 }
-*/
 
 
-class LoadTestnetBareTest : public ::testing::Test
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsSuper, Load5Blocks)
 {
-protected:
-   BlockDataManager_LevelDB *theBDM;
-   BlockDataViewer          *theBDV;
+   TheBDM.doInitialSyncOnLoad(nullProgress);
 
-   /////////////////////////////////////////////////////////////////////////////
-   virtual void TearDown(void)  {}
+   StoredScriptHistory ssh;
 
-   virtual void SetUp(void) 
-   {
-//       DBUtils::setArmoryDbType(ARMORY_DB_BARE);
-//       DBUtils::setDbPruneType(DB_PRUNE_NONE);
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
+   EXPECT_EQ(ssh.getScriptBalance(),  50*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 50*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      1);
 
-      blkdir_  = string("/home/alan/.bitcoin/testnet3/blocks");
-      homedir_ = string("/home/alan/.armory/testnet3");
-      ldbdir_  = string("/home/alan/.armory/testnet3/databases");
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
+   EXPECT_EQ(ssh.getScriptBalance(),   70*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 230*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      14);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
+   EXPECT_EQ(ssh.getScriptBalance(),   20*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(),  75*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,       8);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
+   EXPECT_EQ(ssh.getScriptBalance(),  65*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 65*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      7);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
+   EXPECT_EQ(ssh.getScriptBalance(),  30*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 30*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      5);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
+   EXPECT_EQ(ssh.getScriptBalance(),   5*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 45*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      7);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(),   5*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 15*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      3);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(),  25*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 40*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      3);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(),  30*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 40*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      4);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(),   0*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(),  5*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsSuper, Load5Blocks_ReloadBDM)
+{
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   StoredScriptHistory ssh;
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
+   EXPECT_EQ(ssh.getScriptBalance(), 50 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 50 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 1);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
+   EXPECT_EQ(ssh.getScriptBalance(), 70 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 230 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 14);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
+   EXPECT_EQ(ssh.getScriptBalance(), 20 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 75 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 8);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
+   EXPECT_EQ(ssh.getScriptBalance(), 65 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 65 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 7);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
+   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 30 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 5);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
+   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 45 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 7);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 3);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(), 25 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 3);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 4);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 5 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 2);
+
+   delete theBDM;
+   theBDM = new BlockDataManager_LevelDB(config_);
+   
+   theBDM->openDatabase();
+   iface_ = theBDM->getIFace();
+
+   theBDM->doInitialSyncOnLoad(nullProgress);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
+   EXPECT_EQ(ssh.getScriptBalance(), 50 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 50 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 1);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
+   EXPECT_EQ(ssh.getScriptBalance(), 70 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 230 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 14);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
+   EXPECT_EQ(ssh.getScriptBalance(), 20 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 75 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 8);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
+   EXPECT_EQ(ssh.getScriptBalance(), 65 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 65 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 7);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
+   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 30 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 5);
 
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
+   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 45 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 7);
 
-      mkdir(ldbdir_);
-      mkdir(homedir_);
-      
-      BlockDataManagerConfig config;
-      
-      config.armoryDbType = ARMORY_DB_BARE;
-      config.pruneType = DB_PRUNE_NONE;
-      config.blkFileLocation = blkdir_;
-      config.levelDBLocation = ldbdir_;
-      
-      config.selectNetwork("Test");
-      
-      theBDM = new BlockDataManager_LevelDB(config);
-      theBDV = new BlockDataViewer(theBDM);
-      CLEANUP_ALL_TIMERS();
-   }
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 3);
 
-   void mkdir(string newdir)
-   {
-      char* syscmd = new char[4096];
-      sprintf(syscmd, "mkdir -p %s", newdir.c_str());
-      system(syscmd);
-      delete[] syscmd;
-   }
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(), 25 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 3);
 
-   LMDBBlockDatabase* iface_;
-   BinaryData magic_;
-   BinaryData ghash_;
-   BinaryData gentx_;
-   BinaryData zeros_;
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 4);
 
-   string blkdir_;
-   string homedir_;
-   string ldbdir_;
-   string blk0dat_;
-};
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 5 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 2);
+}
 
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(LoadTestnetBareTest, DISABLED_StepThroughDebug_usually_disabled)
+TEST_F(BlockUtilsSuper, Load3BlocksPlus3)
 {
-   vector<BinaryData> scrAddrVec;
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
+   // Copy only the first four blocks.  Will copy the full file next to test
+   // readBlkFileUpdate method on non-reorg blocks.
+   setBlocks({ "0", "1", "2"}, blk0dat_);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 2);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash2);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash2).isMainBranch());
 
-   BtcWallet& wlt = *theBDV->registerWallet(scrAddrVec, "wallet1", false);
+   appendBlocks({ "3"}, blk0dat_);
+   TheBDM.readBlkFileUpdate();
 
-   TheBDM.doInitialSyncOnLoad(nullProgress);
-   //TheBDM.scanBlockchainForTx(wlt);
-}
+   appendBlocks({ "5"}, blk0dat_);
+   TheBDM.readBlkFileUpdate();
 
+   delete theBDM;
+   theBDM = new BlockDataManager_LevelDB(config_);
 
-////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
-// THESE ARE ARMORY_DB_SUPER tests.  Identical to above except for the mode.
-////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
-class BlockUtilsSuper : public ::testing::Test
-{
-protected:
-   BlockDataManager_LevelDB TheBDM;
-   BlockDataViewer*         theBDV;
+   theBDM->openDatabase();
+   iface_ = theBDM->getIFace();
 
-   /////////////////////////////////////////////////////////////////////////////
-   virtual void SetUp(void) 
-   {
-      LOGDISABLESTDOUT();
-      magic_ = READHEX(MAINNET_MAGIC_BYTES);
-      ghash_ = READHEX(MAINNET_GENESIS_HASH_HEX);
-      gentx_ = READHEX(MAINNET_GENESIS_TX_HASH_HEX);
-      zeros_ = READHEX("00000000");
+   theBDM->doInitialSyncOnLoad(nullProgress);
 
-      blkdir_  = string("./blkfiletest");
-      homedir_ = string("./fakehomedir");
-      ldbdir_  = string("./ldbtestdir");
+   appendBlocks({ "4" }, blk0dat_);
 
-      mkdir(blkdir_);
-      mkdir(homedir_);
+   TheBDM.readBlkFileUpdate();
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5).isMainBranch());
 
-      // Put the first 5 blocks into the blkdir
-      blk0dat_ = BtcUtils::getBlkFilename(blkdir_, 0);
-      setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+   StoredScriptHistory ssh;
 
-      config_.armoryDbType = ARMORY_DB_SUPER;
-      config_.pruneType = DB_PRUNE_NONE;
-      config_.blkFileLocation = blkdir_;
-      config_.levelDBLocation = ldbdir_;
-      
-      config_.genesisBlockHash = ghash_;
-      config_.genesisTxHash = gentx_;
-      config_.magicBytes = magic_;
-      
-      theBDM = new BlockDataManager_LevelDB(config_);
-      theBDM->openDatabase();
-      theBDV = new BlockDataViewer(theBDM);
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
+   EXPECT_EQ(ssh.getScriptBalance(), 50 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 50 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 1);
 
-      iface_ = theBDM->getIFace();
-   }
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
+   EXPECT_EQ(ssh.getScriptBalance(), 70 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 230 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 14);
 
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
+   EXPECT_EQ(ssh.getScriptBalance(), 20 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 75 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 8);
 
-   /////////////////////////////////////////////////////////////////////////////
-   virtual void TearDown(void)
-   {
-      delete theBDM;
-      delete theBDV;
-      
-      theBDM = nullptr;
-      theBDV = nullptr;
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
+   EXPECT_EQ(ssh.getScriptBalance(), 65 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 65 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 7);
 
-      rmdir(blkdir_);
-      rmdir(homedir_);
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
+   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 30 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 5);
 
-      #ifdef _MSC_VER
-         rmdir(ldbdir_);
-         mkdir(ldbdir_);
-      #else
-         std::string d = ldbdir_ + "/*";
-         rmdir(d);
-      #endif
-      LOGENABLESTDOUT();
-      CLEANUP_ALL_TIMERS();
-   }
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
+   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 45 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 7);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 3);
 
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(), 25 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 3);
 
-   // Run this before registering a BDM.
-   void regWallet(const vector<BinaryData>& scrAddrs, const string& wltName,
-                  BlockDataViewer*& inBDV, BtcWallet** inWlt)
-   {
-      // Register the standalone address wallet. (All registrations should be
-      // done before initializing the BDM. This is critical!)
-      *inWlt = inBDV->registerWallet(scrAddrs, wltName, false);
-   }
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 4);
 
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 5 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 2);
 
-   // Run this before registering a BDM. (For now, just make the two lockboxes a
-   // package deal. Code can be altered later if needed.)
-   void regLockboxes(BlockDataViewer*& inBDV, BtcWallet** inLB1,
-                     BtcWallet** inLB2)
-   {
-      // Register the two lockboxes. Note that the lockbox data is pulled from
-      // createTestChain.py, the script that built most of the blocks used in
-      // these unit tests. Python, not C++, is where we find the code needed to
-      // generate the data required by C++ lockboxes. If the lockboxes and/or
-      // blocks are redone, this data's automatically redone.
-      // LB1 = AddrB + AddrC
-      // LB2 = AddrD + AddrE
-      const vector<BinaryData> lb1ScrAddrs
-      {
-         TestChain::lb1ScrAddr,
-         TestChain::lb1ScrAddrP2SH
-      };
-      const vector<BinaryData> lb2ScrAddrs
-      {
-         TestChain::lb2ScrAddr,
-         TestChain::lb2ScrAddrP2SH
-      };
-      *inLB1 = inBDV->registerLockbox(lb1ScrAddrs, TestChain::lb1B58ID, false);
-      *inLB2 = inBDV->registerLockbox(lb2ScrAddrs, TestChain::lb2B58ID, false);
-   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsSuper, RepaidMissingTxio)
+{
+   // Copy only the first four blocks.  Will copy the full file next to test
+   // readBlkFileUpdate method on non-reorg blocks.
+   setBlocks({ "0", "1", "2" }, blk0dat_);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 2);
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash2);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash2).isMainBranch());
 
+   appendBlocks({ "3" }, blk0dat_);
+   TheBDM.readBlkFileUpdate();
 
-#if ! defined(_MSC_VER) && ! defined(__MINGW32__)
-   /////////////////////////////////////////////////////////////////////////////
-   void rmdir(string src)
-   {
-      char* syscmd = new char[4096];
-      sprintf(syscmd, "rm -rf %s", src.c_str());
-      system(syscmd);
-      delete[] syscmd;
-   }
+   //grab a ssh and delete some utxos
+   StoredScriptHistory ssh;
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
 
-   /////////////////////////////////////////////////////////////////////////////
-   void mkdir(string newdir)
+   for (auto& subssh : ssh.subHistMap_)
    {
-      char* syscmd = new char[4096];
-      sprintf(syscmd, "mkdir -p %s", newdir.c_str());
-      system(syscmd);
-      delete[] syscmd;
+      auto txioIter = subssh.second.txioMap_.begin();
+
+      while (txioIter != subssh.second.txioMap_.end())
+      {
+         if (txioIter->second.isUTXO() && 
+             !txioIter->second.isMultisig())
+         {
+            ssh.totalTxioCount_--;
+            ssh.totalUnspent_ -= txioIter->second.getValue();
+            subssh.second.txioMap_.erase(txioIter++);
+         }
+         else
+            ++txioIter;
+      }
    }
-#endif
 
-   LMDBBlockDatabase* iface_;
-   BinaryData magic_;
-   BinaryData ghash_;
-   BinaryData gentx_;
-   BinaryData zeros_;
-   BlockDataManagerConfig config_;
+   //delete the keys
+   auto& delKeysThread = [&ssh, this](void)->void
+   { 
+      LMDBEnv::Transaction tx(iface_->dbEnv_[BLKDATA].get(), LMDB::ReadWrite);
 
-   string blkdir_;
-   string homedir_;
-   string ldbdir_;
-   string blk0dat_;
+      iface_->putStoredScriptHistory(ssh);
+   };
 
-   NullProgressReporter nullProg_;
-};
+   thread delKeysTID(delKeysThread);
+   delKeysTID.join();
 
+   appendBlocks({ "5" }, blk0dat_);
+   TheBDM.readBlkFileUpdate();
 
-////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, HeadersOnly)
-{
-   EXPECT_EQ(&TheBDM.blockchain().top(), &TheBDM.blockchain().getGenesisBlock());
+   appendBlocks({ "4" }, blk0dat_);
    TheBDM.readBlkFileUpdate();
 
-   EXPECT_EQ(TheBDM.blockchain().allHeaders().size(), 6);
-   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
-   EXPECT_EQ(TheBDM.blockchain().top().getThisHash(), TestChain::blkHash5);
    EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
-   //iface_->printAllDatabaseEntries(HEADERS);
-}
+   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5).isMainBranch());
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
+   EXPECT_EQ(ssh.getScriptBalance(), 50 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 50 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 1);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
+   EXPECT_EQ(ssh.getScriptBalance(), 70 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 230 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 14);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
+   EXPECT_EQ(ssh.getScriptBalance(), 20 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 75 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 8);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
+   EXPECT_EQ(ssh.getScriptBalance(), 65 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 65 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 7);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
+   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 30 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 5);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
+   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 45 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 7);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 3);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(), 25 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 3);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 4);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 5 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 2);
 
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, HeadersOnly_Reorg)
+TEST_F(BlockUtilsSuper, Load5Blocks_Plus2NoReorg)
 {
-   // this test is presently of dubious value. I think
-   // at some point the alternate blocks (4A and 5A) had a higher difficulty
-   setBlocks({ "0", "1", "2", "3", "4" }, blk0dat_);
-   SETLOGLEVEL(LogLvlError);
-   EXPECT_EQ(&TheBDM.blockchain().top(), &TheBDM.blockchain().getGenesisBlock());
-   TheBDM.readBlkFileUpdate();
-
-   EXPECT_EQ(TheBDM.blockchain().allHeaders().size(), 5);
-   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 4);
+//    DBUtils::setArmoryDbType(ARMORY_DB_SUPER);
+//    DBUtils::setDbPruneType(DB_PRUNE_NONE);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
 
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 4);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash4);
 
-   appendBlocks({ "4A" }, blk0dat_);
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A" }, blk0dat_);
+   BtcUtils::copyFile("../reorgTest/blk_4A.dat", blk0dat_);
    TheBDM.readBlkFileUpdate();
-   EXPECT_EQ(TheBDM.blockchain().allHeaders().size(), 6);
-   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 4);
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 4);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash4);
-   EXPECT_FALSE( TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4A).isMainBranch());
-   EXPECT_TRUE( TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4 ).isMainBranch());
+   EXPECT_EQ(TheBDM.blockchain().top().getThisHash(),   TestChain::blkHash5);
+   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
 
    appendBlocks( {"5A"}, blk0dat_);
    TheBDM.readBlkFileUpdate();
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5A);
-   EXPECT_FALSE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4 ).isMainBranch());
-   EXPECT_TRUE( TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4A).isMainBranch());
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5A ).isMainBranch());
+   EXPECT_EQ(TheBDM.blockchain().top().getThisHash(),   TestChain::blkHash5);
+   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
 
-   SETLOGLEVEL(LogLvlDebug2);
+   //BtcUtils::copyFile("../reorgTest/blk_5A.dat", blk0dat_);
+   //iface_->pprintBlkDataDB(BLKDATA);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, Load5Blocks)
+TEST_F(BlockUtilsSuper, Load5Blocks_FullReorg)
 {
    TheBDM.doInitialSyncOnLoad(nullProgress);
 
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A" }, blk0dat_);
+   TheBDM.readBlkFileUpdate();
+   appendBlocks( {"5A"}, blk0dat_);
+   TheBDM.readBlkFileUpdate();
+
    StoredScriptHistory ssh;
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
@@ -9665,28 +13030,28 @@ TEST_F(BlockUtilsSuper, Load5Blocks)
    EXPECT_EQ(ssh.totalTxioCount_,      1);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
-   EXPECT_EQ(ssh.getScriptBalance(),   70*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 230*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      14);
+   EXPECT_EQ(ssh.getScriptBalance(),   30*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 160*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      11);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
-   EXPECT_EQ(ssh.getScriptBalance(),   20*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(),  75*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,       8);
+   EXPECT_EQ(ssh.getScriptBalance(),   55*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(),  55*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,       4);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
-   EXPECT_EQ(ssh.getScriptBalance(),  65*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 65*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      7);
+   EXPECT_EQ(ssh.getScriptBalance(),  60*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 60*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      5);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
    EXPECT_EQ(ssh.getScriptBalance(),  30*COIN);
    EXPECT_EQ(ssh.getScriptReceived(), 30*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      5);
+   EXPECT_EQ(ssh.totalTxioCount_,      4);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
-   EXPECT_EQ(ssh.getScriptBalance(),   5*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 45*COIN);
+   EXPECT_EQ(ssh.getScriptBalance(),  60*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 95*COIN);
    EXPECT_EQ(ssh.totalTxioCount_,      7);
 
    iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
@@ -9695,14 +13060,14 @@ TEST_F(BlockUtilsSuper, Load5Blocks)
    EXPECT_EQ(ssh.totalTxioCount_,      3);
 
    iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(),  25*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 40*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      3);
+   EXPECT_EQ(ssh.getScriptBalance(),   0*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 15*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      2);
 
    iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(),  30*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 40*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      4);
+   EXPECT_EQ(ssh.getScriptBalance(),  10*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 20*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,      3);
 
    iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
    EXPECT_EQ(ssh.getScriptBalance(),   0*COIN);
@@ -9711,10 +13076,21 @@ TEST_F(BlockUtilsSuper, Load5Blocks)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, Load5Blocks_ReloadBDM)
+TEST_F(BlockUtilsSuper, Load5Blocks_ReloadBDM_Reorg)
 {
    TheBDM.doInitialSyncOnLoad(nullProgress);
 
+   //reload BDM
+   delete theBDM;
+   theBDM = new BlockDataManager_LevelDB(config_);
+   theBDM->openDatabase();
+   iface_ = theBDM->getIFace();
+
+   setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
+
    StoredScriptHistory ssh;
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
@@ -9722,6 +13098,70 @@ TEST_F(BlockUtilsSuper, Load5Blocks_ReloadBDM)
    EXPECT_EQ(ssh.getScriptReceived(), 50 * COIN);
    EXPECT_EQ(ssh.totalTxioCount_, 1);
 
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
+   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 160 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 11);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
+   EXPECT_EQ(ssh.getScriptBalance(), 55 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 55 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 4);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
+   EXPECT_EQ(ssh.getScriptBalance(), 60 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 60 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 5);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
+   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 30 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 4);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
+   EXPECT_EQ(ssh.getScriptBalance(), 60 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 95 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 7);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 3);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 2);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
+   EXPECT_EQ(ssh.getScriptBalance(), 10 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 20 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 3);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
+   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 5 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsSuper, Load5Blocks_DoubleReorg)
+{
+   StoredScriptHistory ssh;
+
+   setBlocks({ "0", "1", "2", "3", "4A" }, blk0dat_);
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+
+   //first reorg: up to 5
+   setBlocks({ "0", "1", "2", "3", "4A", "4", "5" }, blk0dat_);
+   uint32_t prevBlock = TheBDM.readBlkFileUpdate();
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
+   EXPECT_EQ(ssh.getScriptBalance(), 50 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 50 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 1);
+
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
    EXPECT_EQ(ssh.getScriptBalance(), 70 * COIN);
    EXPECT_EQ(ssh.getScriptReceived(), 230 * COIN);
@@ -9767,13 +13207,9 @@ TEST_F(BlockUtilsSuper, Load5Blocks_ReloadBDM)
    EXPECT_EQ(ssh.getScriptReceived(), 5 * COIN);
    EXPECT_EQ(ssh.totalTxioCount_, 2);
 
-   delete theBDM;
-   theBDM = new BlockDataManager_LevelDB(config_);
-   
-   theBDM->openDatabase();
-   iface_ = theBDM->getIFace();
-
-   theBDM->doInitialSyncOnLoad(nullProgress);
+   //second reorg: up to 5A
+   setBlocks({ "0", "1", "2", "3", "4A", "4", "5", "5A" }, blk0dat_);
+   prevBlock = TheBDM.readBlkFileUpdate();
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
    EXPECT_EQ(ssh.getScriptBalance(), 50 * COIN);
@@ -9781,28 +13217,28 @@ TEST_F(BlockUtilsSuper, Load5Blocks_ReloadBDM)
    EXPECT_EQ(ssh.totalTxioCount_, 1);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
-   EXPECT_EQ(ssh.getScriptBalance(), 70 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 230 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 14);
+   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 160 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 11);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
-   EXPECT_EQ(ssh.getScriptBalance(), 20 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 75 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 8);
+   EXPECT_EQ(ssh.getScriptBalance(), 55 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 55 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 4);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
-   EXPECT_EQ(ssh.getScriptBalance(), 65 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 65 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 7);
+   EXPECT_EQ(ssh.getScriptBalance(), 60 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 60 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 5);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
    EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
    EXPECT_EQ(ssh.getScriptReceived(), 30 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 5);
+   EXPECT_EQ(ssh.totalTxioCount_, 4);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
-   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 45 * COIN);
+   EXPECT_EQ(ssh.getScriptBalance(), 60 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 95 * COIN);
    EXPECT_EQ(ssh.totalTxioCount_, 7);
 
    iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
@@ -9811,14 +13247,14 @@ TEST_F(BlockUtilsSuper, Load5Blocks_ReloadBDM)
    EXPECT_EQ(ssh.totalTxioCount_, 3);
 
    iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(), 25 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 3);
+   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 2);
 
    iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 4);
+   EXPECT_EQ(ssh.getScriptBalance(), 10 * COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 20 * COIN);
+   EXPECT_EQ(ssh.totalTxioCount_, 3);
 
    iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
    EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
@@ -9826,1108 +13262,1653 @@ TEST_F(BlockUtilsSuper, Load5Blocks_ReloadBDM)
    EXPECT_EQ(ssh.totalTxioCount_, 2);
 }
 
-
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, Load3BlocksPlus3)
+// These next two tests disabled because they broke after ARMORY_DB_BARE impl
+TEST_F(BlockUtilsSuper, DISABLED_RestartDBAfterBuild)
 {
    // Copy only the first four blocks.  Will copy the full file next to test
    // readBlkFileUpdate method on non-reorg blocks.
-   setBlocks({ "0", "1", "2"}, blk0dat_);
+   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
    TheBDM.doInitialSyncOnLoad(nullProgress);
    EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 2);
    EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash2);
    EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash2).isMainBranch());
 
-   appendBlocks({ "3"}, blk0dat_);
-   TheBDM.readBlkFileUpdate();
-
-   appendBlocks({ "5"}, blk0dat_);
-   TheBDM.readBlkFileUpdate();
-
-   delete theBDM;
-   theBDM = new BlockDataManager_LevelDB(config_);
-
-   theBDM->openDatabase();
-   iface_ = theBDM->getIFace();
-
-   theBDM->doInitialSyncOnLoad(nullProgress);
+   // Add two more blocks
+   appendBlocks({ "4", "5" }, blk0dat_);
 
-   appendBlocks({ "4" }, blk0dat_);
+   // Now reinitialize the DB and hopefully detect the new blocks and update
 
-   TheBDM.readBlkFileUpdate();
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5).isMainBranch());
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   
+   EXPECT_EQ(getTopBlockHeightInDB(TheBDM, HEADERS), 4);
+   EXPECT_EQ(getTopBlockHeightInDB(TheBDM, BLKDATA), 4);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4).isMainBranch());
 
    StoredScriptHistory ssh;
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
-   EXPECT_EQ(ssh.getScriptBalance(), 50 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 50 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 1);
+   EXPECT_EQ(ssh.getScriptBalance(),  100*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 100*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,       2);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
-   EXPECT_EQ(ssh.getScriptBalance(), 70 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 230 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 14);
+   EXPECT_EQ(ssh.getScriptBalance(),    0*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 140*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,       3);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
-   EXPECT_EQ(ssh.getScriptBalance(), 20 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 75 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 8);
+   EXPECT_EQ(ssh.getScriptBalance(),   50*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(),  60*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,       2);
 
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
-   EXPECT_EQ(ssh.getScriptBalance(), 65 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 65 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 7);
-
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
-   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 30 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 5);
-
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
-   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 45 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 7);
-
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 3);
-
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(), 25 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 3);
-
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 4);
-
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 5 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 2);
-
+   EXPECT_EQ(ssh.getScriptBalance(),  100*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 100*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,       3);
 }
 
+
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, RepaidMissingTxio)
+TEST_F(BlockUtilsSuper, DISABLED_RestartDBAfterBuild_withReplay)
 {
    // Copy only the first four blocks.  Will copy the full file next to test
    // readBlkFileUpdate method on non-reorg blocks.
-   setBlocks({ "0", "1", "2" }, blk0dat_);
+   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
    TheBDM.doInitialSyncOnLoad(nullProgress);
    EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 2);
    EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash2);
    EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash2).isMainBranch());
 
-   appendBlocks({ "3" }, blk0dat_);
-   TheBDM.readBlkFileUpdate();
+   // Add two more blocks
+   appendBlocks({ "4", "5" }, blk0dat_);
+
+   // Now reinitialize the DB and hopefully detect the new blocks and update
+
+   uint32_t replayRewind = 700;
+
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   
+   EXPECT_EQ(getTopBlockHeightInDB(TheBDM, HEADERS), 4);
+   EXPECT_EQ(getTopBlockHeightInDB(TheBDM, BLKDATA), 4);
+   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4).isMainBranch());
 
-   //grab a ssh and delete some utxos
    StoredScriptHistory ssh;
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
+   EXPECT_EQ(ssh.getScriptBalance(),  100*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 100*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,       2);
+
    iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
+   EXPECT_EQ(ssh.getScriptBalance(),    0*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 140*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,       3);
 
-   for (auto& subssh : ssh.subHistMap_)
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
+   EXPECT_EQ(ssh.getScriptBalance(),   50*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(),  60*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,       2);
+
+   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
+   EXPECT_EQ(ssh.getScriptBalance(),  100*COIN);
+   EXPECT_EQ(ssh.getScriptReceived(), 100*COIN);
+   EXPECT_EQ(ssh.totalTxioCount_,       3);
+
+   // Random note (since I just spent 2 hours trying to figure out why
+   // I wasn't getting warnings about re-marking TxOuts spent that were
+   // already marked spent):   We get three warnings about TxOuts that
+   // already marked unspent in the SSH objects when we replay blocks 
+   // 1 and 2 (but not 0). This is expected.  But, I also expected a 
+   // warning about a TxOut already marked spent.  Turns out that 
+   // we are replaying the previous block first which calls "markUnspent" 
+   // before we hit this mark-spent logic.  So when we started the
+   // method, we actually did have a already-marked-spent TxOut, but 
+   // it was marked unspent before we got the point of trying to mark
+   // it spent again.   In other words, all expected behavior.
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsSuper, DISABLED_TimeAndSpaceTest_usuallydisabled)
+{
+//    DBUtils::setArmoryDbType(ARMORY_DB_SUPER);
+//    DBUtils::setDbPruneType(DB_PRUNE_NONE);
+
+   string oldblkdir = blkdir_;
+   //blkdir_  = string("/home/alan/.bitcoin/blks3");
+   //blkdir_  = string("/home/alan/.bitcoin/blocks");
+   //TheBDM.SelectNetwork("Main");
+   blkdir_  = string("/home/alan/.bitcoin/testnet3/blocks");
+
+   StoredScriptHistory ssh;
+   TheBDM.doInitialSyncOnLoad(nullProgress);
+   BinaryData scrAddr  = READHEX("11b366edfc0a8b66feebae5c2e25a7b6a5d1cf31");
+   BinaryData scrAddr2 = READHEX("39aa3d569e06a1d7926dc4be1193c99bf2eb9ee0");
+   BinaryData scrAddr3 = READHEX("758e51b5e398a32c6abd091b3fde383291267cfa");
+   BinaryData scrAddr4 = READHEX("6c22eb00e3f93acac5ae5d81a9db78a645dfc9c7");
+   EXPECT_EQ(getDBBalanceForHash160(TheBDM, scrAddr), 18*COIN);
+   /*TheBDM.pprintSSHInfoAboutHash160(scrAddr);
+   TheBDM.pprintSSHInfoAboutHash160(scrAddr2);
+   TheBDM.pprintSSHInfoAboutHash160(scrAddr3);
+   TheBDM.pprintSSHInfoAboutHash160(scrAddr4);*/
+   blkdir_ = oldblkdir;
+   LOGINFO << "waiting... (please copy the DB dir...)";
+   int pause;
+   cin >> pause;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// I thought I was going to do something different with this set of tests,
+// but I ended up with an exact copy of the BlockUtilsSuper fixture.  Oh well.
+class BlockUtilsWithWalletTest: public ::testing::Test
+{
+protected:
+   BlockDataManager_LevelDB *theBDM;
+   BlockDataViewer*          theBDV;
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void SetUp(void) 
    {
-      auto txioIter = subssh.second.txioMap_.begin();
+      LOGDISABLESTDOUT();
+      magic_ = READHEX(MAINNET_MAGIC_BYTES);
+      ghash_ = READHEX(MAINNET_GENESIS_HASH_HEX);
+      gentx_ = READHEX(MAINNET_GENESIS_TX_HASH_HEX);
+      zeros_ = READHEX("00000000");
 
-      while (txioIter != subssh.second.txioMap_.end())
-      {
-         if (txioIter->second.isUTXO() && 
-             !txioIter->second.isMultisig())
-         {
-            ssh.totalTxioCount_--;
-            ssh.totalUnspent_ -= txioIter->second.getValue();
-            subssh.second.txioMap_.erase(txioIter++);
-         }
-         else
-            ++txioIter;
-      }
-   }
+      blkdir_  = string("./blkfiletest");
+      homedir_ = string("./fakehomedir");
+      ldbdir_  = string("./ldbtestdir");
+
+      mkdir(blkdir_);
+      mkdir(homedir_);
+
+      // Put the first 5 blocks into the blkdir
+      blk0dat_ = BtcUtils::getBlkFilename(blkdir_, 0);
+      setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+      
+      BlockDataManagerConfig config;
+      config.armoryDbType = ARMORY_DB_SUPER;
+      config.pruneType = DB_PRUNE_NONE;
+      config.blkFileLocation = blkdir_;
+      config.levelDBLocation = ldbdir_;
 
-   //delete the keys
-   auto& delKeysThread = [&ssh, this](void)->void
-   { 
-      LMDBEnv::Transaction tx(iface_->dbEnv_[BLKDATA].get(), LMDB::ReadWrite);
+      config.genesisBlockHash = ghash_;
+      config.genesisTxHash = gentx_;
+      config.magicBytes = magic_;
+      
+      theBDM = new BlockDataManager_LevelDB(config);
+      theBDM->openDatabase();
+      theBDV = new BlockDataViewer(theBDM);
+      iface_ = theBDM->getIFace();
 
-      iface_->putStoredScriptHistory(ssh);
-   };
+   }
 
-   thread delKeysTID(delKeysThread);
-   delKeysTID.join();
 
-   appendBlocks({ "5" }, blk0dat_);
-   TheBDM.readBlkFileUpdate();
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void TearDown(void)
+   {
+      delete theBDM;
+      delete theBDV;
 
-   appendBlocks({ "4" }, blk0dat_);
-   TheBDM.readBlkFileUpdate();
+      theBDM = nullptr;
+      theBDV = nullptr;
 
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 5);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash5);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash5).isMainBranch());
+      rmdir(blkdir_);
+      rmdir(homedir_);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
-   EXPECT_EQ(ssh.getScriptBalance(), 50 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 50 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 1);
+      #ifdef _MSC_VER
+         rmdir(ldbdir_);
+         mkdir(ldbdir_);
+      #else
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
-   EXPECT_EQ(ssh.getScriptBalance(), 70 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 230 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 14);
+      char* delstr = new char[4096];
+      sprintf(delstr, "%s/*", ldbdir_.c_str());
+      rmdir(delstr);
+      delete[] delstr;
+      #endif
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
-   EXPECT_EQ(ssh.getScriptBalance(), 20 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 75 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 8);
+      LOGENABLESTDOUT();
+      CLEANUP_ALL_TIMERS();
+   }
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
-   EXPECT_EQ(ssh.getScriptBalance(), 65 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 65 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 7);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
-   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 30 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 5);
+#if ! defined(_MSC_VER) && ! defined(__MINGW32__)
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
-   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 45 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 7);
+   /////////////////////////////////////////////////////////////////////////////
+   void rmdir(string src)
+   {
+      char* syscmd = new char[4096];
+      sprintf(syscmd, "rm -rf %s", src.c_str());
+      system(syscmd);
+      delete[] syscmd;
+   }
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 3);
+   /////////////////////////////////////////////////////////////////////////////
+   void mkdir(string newdir)
+   {
+      char* syscmd = new char[4096];
+      sprintf(syscmd, "mkdir -p %s", newdir.c_str());
+      system(syscmd);
+      delete[] syscmd;
+   }
+#endif
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(), 25 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 3);
+   LMDBBlockDatabase* iface_;
+   BinaryData magic_;
+   BinaryData ghash_;
+   BinaryData gentx_;
+   BinaryData zeros_;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 4);
+   string blkdir_;
+   string homedir_;
+   string ldbdir_;
+   string blk0dat_;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 5 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 2);
+};
 
-}
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, Load5Blocks_Plus2NoReorg)
+TEST_F(BlockUtilsWithWalletTest, PreRegisterScrAddrs)
 {
-//    DBUtils::setArmoryDbType(ARMORY_DB_SUPER);
-//    DBUtils::setDbPruneType(DB_PRUNE_NONE);
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
+
+   BtcWallet& wlt = *theBDV->registerWallet(scrAddrVec, "wallet1", false);
+   wlt.addScrAddress(TestChain::scrAddrD);
+
+   setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+
    TheBDM.doInitialSyncOnLoad(nullProgress);
 
+   theBDV->scanWallets();
 
-   setBlocks({ "0", "1", "2", "3", "4", "5", "4A" }, blk0dat_);
-   BtcUtils::copyFile("../reorgTest/blk_4A.dat", blk0dat_);
-   TheBDM.readBlkFileUpdate();
-   EXPECT_EQ(TheBDM.blockchain().top().getThisHash(),   TestChain::blkHash5);
-   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
+   uint64_t balanceWlt;
+   uint64_t balanceDB;
 
-   appendBlocks( {"5A"}, blk0dat_);
-   TheBDM.readBlkFileUpdate();
-   EXPECT_EQ(TheBDM.blockchain().top().getThisHash(),   TestChain::blkHash5);
-   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
+   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrA)->getFullBalance();
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrA);
+   EXPECT_EQ(balanceWlt, 50*COIN);
+   EXPECT_EQ(balanceDB,  50*COIN);
 
-   //BtcUtils::copyFile("../reorgTest/blk_5A.dat", blk0dat_);
-   //iface_->pprintBlkDataDB(BLKDATA);
-}
+   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrB)->getFullBalance();
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrB);
+   EXPECT_EQ(balanceWlt, 70*COIN);
+   EXPECT_EQ(balanceDB,  70*COIN);
+
+   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrC)->getFullBalance();
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrC);
+   EXPECT_EQ(balanceWlt, 20*COIN);
+   EXPECT_EQ(balanceDB,  20*COIN);
 
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrD);
+   EXPECT_EQ(balanceDB,  65*COIN);
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrE);
+   EXPECT_EQ(balanceDB,  30*COIN);
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrF);
+   EXPECT_EQ(balanceDB,   5*COIN);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, Load5Blocks_FullReorg)
+TEST_F(BlockUtilsWithWalletTest, PostRegisterScrAddr)
 {
+   setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
    TheBDM.doInitialSyncOnLoad(nullProgress);
 
-   setBlocks({ "0", "1", "2", "3", "4", "5", "4A" }, blk0dat_);
-   TheBDM.readBlkFileUpdate();
-   appendBlocks( {"5A"}, blk0dat_);
-   TheBDM.readBlkFileUpdate();
+   // We do all the database stuff first, THEN load the addresses
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
 
-   StoredScriptHistory ssh;
+   BtcWallet& wlt = *theBDV->registerWallet(scrAddrVec, "wallet1", false);
+   wlt.addScrAddress(TestChain::scrAddrD);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
-   EXPECT_EQ(ssh.getScriptBalance(),  50*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 50*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      1);
+   theBDV->scanWallets();
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
-   EXPECT_EQ(ssh.getScriptBalance(),   30*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 160*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      11);
+   uint64_t balanceWlt;
+   uint64_t balanceDB;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
-   EXPECT_EQ(ssh.getScriptBalance(),   55*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(),  55*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,       4);
+   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrA)->getFullBalance();
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrA);
+   EXPECT_EQ(balanceWlt, 50*COIN);
+   EXPECT_EQ(balanceDB,  50*COIN);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
-   EXPECT_EQ(ssh.getScriptBalance(),  60*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 60*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      5);
+   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrB)->getFullBalance();
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrB);
+   EXPECT_EQ(balanceWlt, 70*COIN);
+   EXPECT_EQ(balanceDB,  70*COIN);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
-   EXPECT_EQ(ssh.getScriptBalance(),  30*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 30*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      4);
+   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrC)->getFullBalance();
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrC);
+   EXPECT_EQ(balanceWlt, 20*COIN);
+   EXPECT_EQ(balanceDB,  20*COIN);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
-   EXPECT_EQ(ssh.getScriptBalance(),  60*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 95*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      7);
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrD);
+   EXPECT_EQ(balanceDB,  65*COIN);
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrE);
+   EXPECT_EQ(balanceDB,  30*COIN);
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrF);
+   EXPECT_EQ(balanceDB,   5*COIN);
+}
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(),   5*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 15*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      3);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(),   0*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 15*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      2);
+// Comments need to be added....
+// Most of this data is from the BIP32 test vectors.
+class TestCryptoECDSA : public ::testing::Test
+{
+protected:
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void SetUp(void)
+   {
+      verifyX = READHEX("39a36013301597daef41fbe593a02cc513d0b55527ec2df1050e2e8ff49c85c2");
+      verifyY = READHEX("3cbe7ded0e7ce6a594896b8f62888fdbc5c8821305e2ea42bf01e37300116281");
+
+      multScalarA = READHEX("79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
+      multScalarB = READHEX("483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8");
+      multRes = READHEX("805714a252d0c0b58910907e85b5b801fff610a36bdf46847a4bf5d9ae2d10ed");
+
+      multScalar = READHEX("04bfb2dd60fa8921c2a4085ec15507a921f49cdc839f27f0f280e9c1495d44b5");
+      multPointX = READHEX("79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
+      multPointY = READHEX("483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8");
+      multPointRes = READHEX("7f8bd85f90169a606b0b4323c70e5a12e8a89cbc76647b6ed6a39b4b53825214c590a32f111f857573cf8f2c85d969815e4dd35ae0dc9c7e868195c309b8bada");
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(),  10*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 20*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      3);
+      addAX = READHEX("79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
+      addAY = READHEX("483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8");
+      addBX = READHEX("5a784662a4a20a65bf6aab9ae98a6c068a81c52e4b032c0fb5400c706cfccc56");
+      addBY = READHEX("7f717885be239daadce76b568958305183ad616ff74ed4dc219a74c26d35f839");
+      addRes = READHEX("fe2f7c8109d9ae628856d51a02ab25300a8757e088fc336d75cb8dc4cc2ce3339013be71e57c3abeee6ad158646df81d92f8c0778f88100eeb61535f9ff9776d");
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(),   0*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(),  5*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,      2);
-}
+      invAX = READHEX("79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
+      invAY = READHEX("483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8");
+      invRes = READHEX("79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798b7c52588d95c3b9aa25b0403f1eef75702e84bb7597aabe663b82f6f04ef2777");
 
-////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, Load5Blocks_ReloadBDM_Reorg)
-{
-   TheBDM.doInitialSyncOnLoad(nullProgress);
+      compPointPrv1 = READHEX("000f479245fb19a38a1954c5c7c0ebab2f9bdfd96a17563ef28a6a4b1a2a764ef4");
+      compPointPub1 = READHEX("02e8445082a72f29b75ca48748a914df60622a609cacfce8ed0e35804560741d29");
+      uncompPointPub1 = READHEX("04e8445082a72f29b75ca48748a914df60622a609cacfce8ed0e35804560741d292728ad8d58a140050c1016e21f285636a580f4d2711b7fac3957a594ddf416a0");
 
-   //reload BDM
-   delete theBDM;
-   theBDM = new BlockDataManager_LevelDB(config_);
-   theBDM->openDatabase();
-   iface_ = theBDM->getIFace();
+      compPointPrv2 = READHEX("00e8f32e723decf4051aefac8e2c93c9c5b214313817cdb01a1494b917c8436b35");
+      compPointPub2 = READHEX("0339a36013301597daef41fbe593a02cc513d0b55527ec2df1050e2e8ff49c85c2");
+      uncompPointPub2 = READHEX("0439a36013301597daef41fbe593a02cc513d0b55527ec2df1050e2e8ff49c85c23cbe7ded0e7ce6a594896b8f62888fdbc5c8821305e2ea42bf01e37300116281");
 
-   setBlocks({ "0", "1", "2", "3", "4", "5", "4A", "5A" }, blk0dat_);
-   TheBDM.doInitialSyncOnLoad(nullProgress);
+      invModRes = READHEX("000000000000000000000000000000000000000000000000000000000000006b");
 
-   EXPECT_EQ(TheBDM.blockchain().top().getBlockHeight(), 5);
+      LOGDISABLESTDOUT();
+   }
 
-   StoredScriptHistory ssh;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
-   EXPECT_EQ(ssh.getScriptBalance(), 50 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 50 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 1);
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void TearDown(void)
+   {
+      CLEANUP_ALL_TIMERS();
+   }
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
-   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 160 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 11);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
-   EXPECT_EQ(ssh.getScriptBalance(), 55 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 55 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 4);
+   SecureBinaryData verifyX;
+   SecureBinaryData verifyY;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
-   EXPECT_EQ(ssh.getScriptBalance(), 60 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 60 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 5);
+   SecureBinaryData multScalarA;
+   SecureBinaryData multScalarB;
+   SecureBinaryData multRes;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
-   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 30 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 4);
+   SecureBinaryData multScalar;
+   SecureBinaryData multPointX;
+   SecureBinaryData multPointY;
+   SecureBinaryData multPointRes;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
-   EXPECT_EQ(ssh.getScriptBalance(), 60 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 95 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 7);
+   SecureBinaryData addAX;
+   SecureBinaryData addAY;
+   SecureBinaryData addBX;
+   SecureBinaryData addBY;
+   SecureBinaryData addRes;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 3);
+   SecureBinaryData invAX;
+   SecureBinaryData invAY;
+   SecureBinaryData invRes;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 2);
+   SecureBinaryData compPointPrv1;
+   SecureBinaryData uncompPointPub1;
+   SecureBinaryData compPointPub1;
+   SecureBinaryData compPointPrv2;
+   SecureBinaryData uncompPointPub2;
+   SecureBinaryData compPointPub2;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(), 10 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 20 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 3);
+   SecureBinaryData invModRes;
+};
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 5 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 2);
+// Verify that a point known to be on the secp256k1 curve is recognized as such.
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(TestCryptoECDSA, VerifySECP256K1Point)
+{
+   EXPECT_TRUE(CryptoECDSA().ECVerifyPoint(verifyX, verifyY));
 }
 
+// Multiply two scalars and check the result.
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, Load5Blocks_DoubleReorg)
+TEST_F(TestCryptoECDSA, SECP256K1MultScalars)
 {
-   StoredScriptHistory ssh;
-
-   setBlocks({ "0", "1", "2", "3", "4A" }, blk0dat_);
-
-   TheBDM.doInitialSyncOnLoad(nullProgress);
-
-   //first reorg: up to 5
-   setBlocks({ "0", "1", "2", "3", "4A", "4", "5" }, blk0dat_);
-   uint32_t prevBlock = TheBDM.readBlkFileUpdate();
-
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
-   EXPECT_EQ(ssh.getScriptBalance(), 50 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 50 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 1);
-
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
-   EXPECT_EQ(ssh.getScriptBalance(), 70 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 230 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 14);
-
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
-   EXPECT_EQ(ssh.getScriptBalance(), 20 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 75 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 8);
+   SecureBinaryData testRes = CryptoECDSA().ECMultiplyScalars(multScalarA,
+                                                              multScalarB);
+   EXPECT_EQ(multRes, testRes);
+}
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
-   EXPECT_EQ(ssh.getScriptBalance(), 65 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 65 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 7);
+// Verify that some public keys (compressed and uncompressed) are valid.
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(TestCryptoECDSA, VerifyPubKeyValidity)
+{
+   EXPECT_TRUE(CryptoECDSA().VerifyPublicKeyValid(compPointPub1));
+   EXPECT_TRUE(CryptoECDSA().VerifyPublicKeyValid(compPointPub2));
+   EXPECT_TRUE(CryptoECDSA().VerifyPublicKeyValid(uncompPointPub1));
+   EXPECT_TRUE(CryptoECDSA().VerifyPublicKeyValid(uncompPointPub2));
+}
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
-   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 30 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 5);
+////////////////////////////////////////////////////////////////////////////////
+/* Never got around to finishing this...
+class TestMainnetBlkchain: public ::testing::Test
+{
+protected:
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void SetUp(void) 
+   {
+      iface_ = LSMWrapper::GetInterfacePtr();
+      magic_ = READHEX(MAINNET_MAGIC_BYTES);
+      ghash_ = READHEX(MAINNET_GENESIS_HASH_HEX);
+      gentx_ = READHEX(MAINNET_GENESIS_TX_HASH_HEX);
+      zeros_ = READHEX("00000000");
+      DBUtils::setArmoryDbType(ARMORY_DB_FULL);
+      DBUtils::setDbPruneType(DB_PRUNE_NONE);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
-   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 45 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 7);
+      blkdir_  = string("/home/alan/.bitcoin");
+      homedir_ = string("./fakehomedir");
+      ldbdir_  = string("/home/alan/ARMORY_DB_257k_BLKS");
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 3);
+      iface_->openDatabases( ldbdir_, ghash_, gentx_, magic_, 
+                             ARMORY_DB_SUPER, DB_PRUNE_NONE);
+      if(!iface_->databasesAreOpen())
+         LOGERR << "ERROR OPENING DATABASES FOR TESTING!";
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(), 25 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 3);
+      mkdir(homedir_);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 40 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 4);
+      TheBDM.SelectNetwork("Main");
+      TheBDM.SetBlkFileLocation(blkdir_);
+      TheBDM.SetLevelDBLocation(ldbdir_);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 5 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 2);
+      TestChain::addrA = READHEX("b077a2b5e8a53f1d3ef4100117125de6a5b15f6b");
+      TestChain::addrB = READHEX("4c765bca17f9881ad6d4336a1d4ec34a091e5a6f");
 
-   //second reorg: up to 5A
-   setBlocks({ "0", "1", "2", "3", "4A", "4", "5", "5A" }, blk0dat_);
-   prevBlock = TheBDM.readBlkFileUpdate();
+      TestChain::scrAddrA = HASH160PREFIX + TestChain::addrA;
+      TestChain::scrAddrB = HASH160PREFIX + TestChain::addrB;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
-   EXPECT_EQ(ssh.getScriptBalance(), 50 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 50 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 1);
+      LOGDISABLESTDOUT();
+   }
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
-   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 160 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 11);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
-   EXPECT_EQ(ssh.getScriptBalance(), 55 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 55 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 4);
+   /////////////////////////////////////////////////////////////////////////////
+   virtual void TearDown(void)
+   {
+      rmdir(homedir_);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
-   EXPECT_EQ(ssh.getScriptBalance(), 60 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 60 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 5);
+      BlockDataManager_LevelDB::DestroyInstance();
+      LOGENABLESTDOUT();
+   }
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrE);
-   EXPECT_EQ(ssh.getScriptBalance(), 30 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 30 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 4);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrF);
-   EXPECT_EQ(ssh.getScriptBalance(), 60 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 95 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 7);
+   /////////////////////////////////////////////////////////////////////////////
+   void rmdir(string src)
+   {
+      char* syscmd = new char[4096];
+      sprintf(syscmd, "rm -rf %s", src.c_str());
+      system(syscmd);
+      delete[] syscmd;
+   }
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(), 5 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 3);
+   /////////////////////////////////////////////////////////////////////////////
+   void mkdir(string newdir)
+   {
+      char* syscmd = new char[4096];
+      sprintf(syscmd, "mkdir -p %s", newdir.c_str());
+      system(syscmd);
+      delete[] syscmd;
+   }
+#endif
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb1ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 15 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 2);
+   LMDBBlockDatabase* iface_;
+   BinaryData magic_;
+   BinaryData ghash_;
+   BinaryData gentx_;
+   BinaryData zeros_;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddr);
-   EXPECT_EQ(ssh.getScriptBalance(), 10 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 20 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 3);
+   string blkdir_;
+   string homedir_;
+   string ldbdir_;
+   string blk0dat_;
 
-   iface_->getStoredScriptHistory(ssh, TestChain::lb2ScrAddrP2SH);
-   EXPECT_EQ(ssh.getScriptBalance(), 0 * COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 5 * COIN);
-   EXPECT_EQ(ssh.totalTxioCount_, 2);
-}
+};
 
 ////////////////////////////////////////////////////////////////////////////////
-// These next two tests disabled because they broke after ARMORY_DB_BARE impl
-TEST_F(BlockUtilsSuper, DISABLED_RestartDBAfterBuild)
+TEST_F(BlockUtilsWithWalletTest, TestBalanceMainnet_usuallydisabled)
 {
-   // Copy only the first four blocks.  Will copy the full file next to test
-   // readBlkFileUpdate method on non-reorg blocks.
-   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
-   TheBDM.doInitialSyncOnLoad(nullProgress);
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 2);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash2);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash2).isMainBranch());
-
-   // Add two more blocks
-   appendBlocks({ "4", "5" }, blk0dat_);
+   TheBDM.doInitialSyncOnLoad([] (double,unsigned) {});
 
-   // Now reinitialize the DB and hopefully detect the new blocks and update
+   // We do all the database stuff first, THEN load the addresses
+   BtcWallet wlt(theBDM);
+   wlt.addScrAddress(TestChain::scrAddrA);
+   wlt.addScrAddress(TestChain::scrAddrB);
+   TheBDM.registerWallet(&wlt);
+   TheBDM.registerNewScrAddr(TestChain::scrAddrD);
+   TheBDM.fetchAllRegisteredScrAddrData();
+   TheBDM.scanRegisteredTxForWallet(wlt);
 
-   TheBDM.doInitialSyncOnLoad(nullProgress);
+   uint64_t balanceWlt;
+   uint64_t balanceDB;
    
-   EXPECT_EQ(getTopBlockHeightInDB(TheBDM, HEADERS), 4);
-   EXPECT_EQ(getTopBlockHeightInDB(TheBDM, BLKDATA), 4);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4).isMainBranch());
-
-   StoredScriptHistory ssh;
-
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
-   EXPECT_EQ(ssh.getScriptBalance(),  100*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 100*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,       2);
-
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
-   EXPECT_EQ(ssh.getScriptBalance(),    0*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 140*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,       3);
+   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrA).getFullBalance();
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrA);
+   EXPECT_EQ(balanceWlt,  100*COIN);
+   EXPECT_EQ(balanceDB,   100*COIN);
+   
+   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrB).getFullBalance();
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrB);
+   EXPECT_EQ(balanceWlt,    0*COIN);
+   EXPECT_EQ(balanceDB,     0*COIN);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
-   EXPECT_EQ(ssh.getScriptBalance(),   50*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(),  60*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,       2);
+   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrC).getFullBalance();
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrC);
+   EXPECT_EQ(balanceWlt,   50*COIN);
+   EXPECT_EQ(balanceDB,    50*COIN);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
-   EXPECT_EQ(ssh.getScriptBalance(),  100*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 100*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,       3);
+   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrD).getFullBalance();
+   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrD);
+   EXPECT_EQ(balanceWlt,    0*COIN);  // D is not part of the wallet
+   EXPECT_EQ(balanceDB,   100*COIN);
 }
-
+*/
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, DISABLED_RestartDBAfterBuild_withReplay)
+TEST_F(BlockUtilsWithWalletTest, ZeroConfUpdate)
 {
-   // Copy only the first four blocks.  Will copy the full file next to test
-   // readBlkFileUpdate method on non-reorg blocks.
-   setBlocks({ "0", "1", "2", "3" }, blk0dat_);
-   TheBDM.doInitialSyncOnLoad(nullProgress);
-   EXPECT_EQ(iface_->getTopBlockHeight(HEADERS), 2);
-   EXPECT_EQ(iface_->getTopBlockHash(HEADERS), TestChain::blkHash2);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash2).isMainBranch());
-
-   // Add two more blocks
-   appendBlocks({ "4", "5" }, blk0dat_);
+   // Copy only the first two blocks
+   setBlocks({"0", "1"}, blk0dat_);
 
-   // Now reinitialize the DB and hopefully detect the new blocks and update
+   vector<BinaryData> scrAddrVec;
+   scrAddrVec.push_back(TestChain::scrAddrA);
+   scrAddrVec.push_back(TestChain::scrAddrB);
+   scrAddrVec.push_back(TestChain::scrAddrC);
 
-   uint32_t replayRewind = 700;
+   BtcWallet& wlt = *theBDV->registerWallet(scrAddrVec, "wallet1", false);
+   wlt.addScrAddress(TestChain::scrAddrD);
 
    TheBDM.doInitialSyncOnLoad(nullProgress);
-   
-   EXPECT_EQ(getTopBlockHeightInDB(TheBDM, HEADERS), 4);
-   EXPECT_EQ(getTopBlockHeightInDB(TheBDM, BLKDATA), 4);
-   EXPECT_TRUE(TheBDM.blockchain().getHeaderByHash(TestChain::blkHash4).isMainBranch());
+   theBDV->enableZeroConf();
+   theBDV->scanWallets();
 
-   StoredScriptHistory ssh;
+   BinaryData ZChash = READHEX("b6b6f145742a9072fd85f96772e63a00eb4101709aa34ec5dd59e8fc904191a7");
+   BinaryData rawZC(259);
+   FILE *ff = fopen("../reorgTest/ZCtx.tx", "rb");
+   fread(rawZC.getPtr(), 259, 1, ff);
+   fclose(ff);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrA);
-   EXPECT_EQ(ssh.getScriptBalance(),  100*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 100*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,       2);
+   theBDV->addNewZeroConfTx(rawZC, 1300000000, false);
+   theBDV->parseNewZeroConfTx();
+   theBDV->scanWallets();
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrB);
-   EXPECT_EQ(ssh.getScriptBalance(),    0*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 140*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,       3);
+   EXPECT_EQ(wlt.getScrAddrObjByKey(TestChain::scrAddrA)->getFullBalance(),  50*COIN);
+   EXPECT_EQ(wlt.getScrAddrObjByKey(TestChain::scrAddrB)->getFullBalance(),  70*COIN);
+   EXPECT_EQ(wlt.getScrAddrObjByKey(TestChain::scrAddrC)->getFullBalance(),  10*COIN);
+   EXPECT_EQ(wlt.getScrAddrObjByKey(TestChain::scrAddrD)->getFullBalance(),   0*COIN);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrC);
-   EXPECT_EQ(ssh.getScriptBalance(),   50*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(),  60*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,       2);
+   //test ledger entry
+   LedgerEntry le = wlt.getLedgerEntryForTx(ZChash);
 
-   iface_->getStoredScriptHistory(ssh, TestChain::scrAddrD);
-   EXPECT_EQ(ssh.getScriptBalance(),  100*COIN);
-   EXPECT_EQ(ssh.getScriptReceived(), 100*COIN);
-   EXPECT_EQ(ssh.totalTxioCount_,       3);
+   EXPECT_EQ(le.getTxTime(), 1300000000);
+   EXPECT_EQ(le.isSentToSelf(), false);
+   EXPECT_EQ(le.getValue(), 30*COIN);
 
-   // Random note (since I just spent 2 hours trying to figure out why
-   // I wasn't getting warnings about re-marking TxOuts spent that were
-   // already marked spent):   We get three warnings about TxOuts that
-   // already marked unspent in the SSH objects when we replay blocks 
-   // 1 and 2 (but not 0). This is expected.  But, I also expected a 
-   // warning about a TxOut already marked spent.  Turns out that 
-   // we are replaying the previous block first which calls "markUnspent" 
-   // before we hit this mark-spent logic.  So when we started the
-   // method, we actually did have a already-marked-spent TxOut, but 
-   // it was marked unspent before we got the point of trying to mark
-   // it spent again.   In other words, all expected behavior.
+   //check ZChash in DB
+   BinaryData zcKey = WRITE_UINT16_BE(0xFFFF);
+   zcKey.append(WRITE_UINT32_LE(0));
+   EXPECT_EQ(iface_->getTxHashForLdbKey(zcKey), ZChash);
 }
 
-
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsSuper, DISABLED_TimeAndSpaceTest_usuallydisabled)
+TEST(BDM_WorkScheduler, PriorityAndCoalescing)
 {
-//    DBUtils::setArmoryDbType(ARMORY_DB_SUPER);
-//    DBUtils::setDbPruneType(DB_PRUNE_NONE);
+   BDM_WorkScheduler scheduler;
+   BDMWork work;
 
-   string oldblkdir = blkdir_;
-   //blkdir_  = string("/home/alan/.bitcoin/blks3");
-   //blkdir_  = string("/home/alan/.bitcoin/blocks");
-   //TheBDM.SelectNetwork("Main");
-   blkdir_  = string("/home/alan/.bitcoin/testnet3/blocks");
+   EXPECT_FALSE(scheduler.next(work, 0));
 
-   StoredScriptHistory ssh;
-   TheBDM.doInitialSyncOnLoad(nullProgress);
-   BinaryData scrAddr  = READHEX("11b366edfc0a8b66feebae5c2e25a7b6a5d1cf31");
-   BinaryData scrAddr2 = READHEX("39aa3d569e06a1d7926dc4be1193c99bf2eb9ee0");
-   BinaryData scrAddr3 = READHEX("758e51b5e398a32c6abd091b3fde383291267cfa");
-   BinaryData scrAddr4 = READHEX("6c22eb00e3f93acac5ae5d81a9db78a645dfc9c7");
-   EXPECT_EQ(getDBBalanceForHash160(TheBDM, scrAddr), 18*COIN);
-   /*TheBDM.pprintSSHInfoAboutHash160(scrAddr);
-   TheBDM.pprintSSHInfoAboutHash160(scrAddr2);
-   TheBDM.pprintSSHInfoAboutHash160(scrAddr3);
-   TheBDM.pprintSSHInfoAboutHash160(scrAddr4);*/
-   blkdir_ = oldblkdir;
-   LOGINFO << "waiting... (please copy the DB dir...)";
-   int pause;
-   cin >> pause;
-}
+   EXPECT_TRUE(scheduler.post(BDMWork_Refresh, 1000));
+   EXPECT_TRUE(scheduler.post(BDMWork_ZC, 2000));
+   EXPECT_FALSE(scheduler.post(BDMWork_ZC, 3000));
+   EXPECT_FALSE(scheduler.post(BDMWork_ZC, 4000));
+   EXPECT_TRUE(scheduler.post(BDMWork_NewBlock, 5000));
+   EXPECT_FALSE(scheduler.post(BDMWork_Refresh, 6000));
+
+   EXPECT_TRUE(scheduler.isPending(BDMWork_ZC));
+   EXPECT_FALSE(scheduler.isPending(BDMWork_Merge));
 
+   //highest priority first, one dispatch per pending type
+   ASSERT_TRUE(scheduler.next(work, 10000));
+   EXPECT_EQ(work, BDMWork_NewBlock);
+   ASSERT_TRUE(scheduler.next(work, 10000));
+   EXPECT_EQ(work, BDMWork_ZC);
+   ASSERT_TRUE(scheduler.next(work, 10000));
+   EXPECT_EQ(work, BDMWork_Refresh);
+   EXPECT_FALSE(scheduler.next(work, 10000));
+   EXPECT_FALSE(scheduler.hasPendingWork());
+
+   //coalesced posts keep the time of the first one
+   auto zcLatency = scheduler.getLatency(BDMWork_ZC);
+   EXPECT_EQ(zcLatency.posted_, 3);
+   EXPECT_EQ(zcLatency.coalesced_, 2);
+   EXPECT_EQ(zcLatency.dispatched_, 1);
+   EXPECT_DOUBLE_EQ(zcLatency.max_, 8.0);
+
+   auto refreshLatency = scheduler.getLatency(BDMWork_Refresh);
+   EXPECT_EQ(refreshLatency.coalesced_, 1);
+   EXPECT_DOUBLE_EQ(refreshLatency.p50_, 9.0);
+
+   scheduler.resetLatency();
+   EXPECT_EQ(scheduler.getLatency(BDMWork_ZC).posted_, 0);
+   EXPECT_DOUBLE_EQ(scheduler.getLatency(BDMWork_ZC).max_, 0.0);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-// I thought I was going to do something different with this set of tests,
-// but I ended up with an exact copy of the BlockUtilsSuper fixture.  Oh well.
-class BlockUtilsWithWalletTest: public ::testing::Test
+TEST(BDM_WorkScheduler, ReplayMixedLoad)
 {
-protected:
-   BlockDataManager_LevelDB *theBDM;
-   BlockDataViewer*          theBDV;
-   /////////////////////////////////////////////////////////////////////////////
-   virtual void SetUp(void) 
+   //Replays an hour of mixed events on a simulated clock, on a single 
+   //worker like the BDM thread. Times are in ms, converted to the 
+   //scheduler's microseconds
+   struct Event
    {
-      LOGDISABLESTDOUT();
-      magic_ = READHEX(MAINNET_MAGIC_BYTES);
-      ghash_ = READHEX(MAINNET_GENESIS_HASH_HEX);
-      gentx_ = READHEX(MAINNET_GENESIS_TX_HASH_HEX);
-      zeros_ = READHEX("00000000");
-
-      blkdir_  = string("./blkfiletest");
-      homedir_ = string("./fakehomedir");
-      ldbdir_  = string("./ldbtestdir");
+      uint64_t at_;
+      BDMWork type_;
 
-      mkdir(blkdir_);
-      mkdir(homedir_);
+      bool operator<(const Event& rhs) const 
+      { return at_ < rhs.at_ || (at_ == rhs.at_ && type_ < rhs.type_); }
+   };
 
-      // Put the first 5 blocks into the blkdir
-      blk0dat_ = BtcUtils::getBlkFilename(blkdir_, 0);
-      setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
-      
-      BlockDataManagerConfig config;
-      config.armoryDbType = ARMORY_DB_SUPER;
-      config.pruneType = DB_PRUNE_NONE;
-      config.blkFileLocation = blkdir_;
-      config.levelDBLocation = ldbdir_;
+   const uint64_t cost[BDMWork_Count] = { 100, 20, 200, 800 };
+   const uint64_t duration = 3600 * 1000;
 
-      config.genesisBlockHash = ghash_;
-      config.genesisTxHash = gentx_;
-      config.magicBytes = magic_;
-      
-      theBDM = new BlockDataManager_LevelDB(config);
-      theBDM->openDatabase();
-      theBDV = new BlockDataViewer(theBDM);
-      iface_ = theBDM->getIFace();
+   auto replay = [&](uint64_t refreshInterval)->BDM_WorkScheduler*
+   {
+      vector<Event> events;
+      for (uint64_t t = 0; t < duration; t += 150 * 1000)
+         events.push_back({ t + 7, BDMWork_NewBlock });
+      for (uint64_t t = 0; t < duration; t += 2000)
+      {
+         //bursts of ZC
+         for (unsigned i = 0; i < 5; i++)
+            events.push_back({ t + i * 3, BDMWork_ZC });
+      }
+      for (uint64_t t = 0; t < duration; t += 30 * 1000)
+         events.push_back({ t + 11, BDMWork_Merge });
+      for (uint64_t t = 0; t < duration; t += refreshInterval)
+         events.push_back({ t + 5, BDMWork_Refresh });
+      sort(events.begin(), events.end());
+
+      auto scheduler = new BDM_WorkScheduler;
+      uint64_t now = 0;
+      size_t nextEvent = 0;
+      BDMWork work;
+
+      while (nextEvent < events.size() || scheduler->hasPendingWork())
+      {
+         while (nextEvent < events.size() && events[nextEvent].at_ <= now)
+         {
+            scheduler->post(
+               events[nextEvent].type_, events[nextEvent].at_ * 1000);
+            nextEvent++;
+         }
 
-   }
+         if (scheduler->next(work, now * 1000))
+            now += cost[work];
+         else if (nextEvent < events.size())
+            now = events[nextEvent].at_;
+      }
 
+      return scheduler;
+   };
 
-   /////////////////////////////////////////////////////////////////////////////
-   virtual void TearDown(void)
+   //light refresh load, then refresh requests outpacing the refresh cost
+   for (uint64_t refreshInterval : { 3000, 500 })
    {
-      delete theBDM;
-      delete theBDV;
+      unique_ptr<BDM_WorkScheduler> scheduler(replay(refreshInterval));
 
-      theBDM = nullptr;
-      theBDV = nullptr;
+      auto blockLatency = scheduler->getLatency(BDMWork_NewBlock);
+      auto zcLatency = scheduler->getLatency(BDMWork_ZC);
+      auto refreshLatency = scheduler->getLatency(BDMWork_Refresh);
 
-      rmdir(blkdir_);
-      rmdir(homedir_);
+      EXPECT_EQ(blockLatency.dispatched_, 24);
+      EXPECT_EQ(blockLatency.coalesced_, 0);
 
-      #ifdef _MSC_VER
-         rmdir(ldbdir_);
-         mkdir(ldbdir_);
-      #else
+      //a new block only ever waits on the job in flight
+      EXPECT_LE(blockLatency.max_, (double)cost[BDMWork_Refresh]);
+      EXPECT_LE(blockLatency.p99_, (double)cost[BDMWork_Refresh]);
 
-      char* delstr = new char[4096];
-      sprintf(delstr, "%s/*", ldbdir_.c_str());
-      rmdir(delstr);
-      delete[] delstr;
-      #endif
+      //ZC bursts collapse into a single pass, and ZC is not starved
+      EXPECT_GT(zcLatency.coalesced_, zcLatency.dispatched_);
+      EXPECT_LE(zcLatency.max_, 
+         (double)(cost[BDMWork_Refresh] + cost[BDMWork_NewBlock]));
 
-      LOGENABLESTDOUT();
-      CLEANUP_ALL_TIMERS();
+      //refreshes still get through
+      EXPECT_GT(refreshLatency.dispatched_, 0);
+      if (refreshInterval < cost[BDMWork_Refresh])
+         EXPECT_GT(refreshLatency.coalesced_, 0);
+
+      EXPECT_LE(refreshLatency.p50_, refreshLatency.p90_);
+      EXPECT_LE(refreshLatency.p90_, refreshLatency.p99_);
+      EXPECT_LE(refreshLatency.p99_, refreshLatency.max_);
    }
+}
 
+////////////////////////////////////////////////////////////////////////////////
+TEST(ScanTelemetry, WindowedRatesAndStalls)
+{
+   //1 second window, timestamps in microseconds
+   ScanTelemetry telemetry(1000);
+   
+   vector<ScanStageStats> reported;
+   telemetry.setCallback(
+      [&reported](const ScanStageStats& stats)->void
+      { reported.push_back(stats); }, 500);
 
-#if ! defined(_MSC_VER) && ! defined(__MINGW32__)
+   const uint64_t start = 1000000;
+   telemetry.beginStage(ScanStage_Scan, start);
 
-   /////////////////////////////////////////////////////////////////////////////
-   void rmdir(string src)
+   //10 blocks/s for 2 seconds, then 100 blocks/s for 1 second
+   uint64_t at = start;
+   for (int i = 0; i < 20; i++)
    {
-      char* syscmd = new char[4096];
-      sprintf(syscmd, "rm -rf %s", src.c_str());
-      system(syscmd);
-      delete[] syscmd;
+      at += 100000;
+      telemetry.record(ScanStage_Scan, 1, 10, 1000, 40, at);
    }
-
-   /////////////////////////////////////////////////////////////////////////////
-   void mkdir(string newdir)
+   
+   auto stats = telemetry.getStats(ScanStage_Scan, at);
+   EXPECT_TRUE(stats.active_);
+   EXPECT_EQ(stats.blocks_, 20);
+   EXPECT_NEAR(stats.blocksPerSec_, 10.0, 0.5);
+   EXPECT_NEAR(stats.txPerSec_, 100.0, 5.0);
+   EXPECT_NEAR(stats.bytesPerSec_, 10000.0, 500.0);
+   EXPECT_NEAR(stats.txiosPerSec_, 400.0, 20.0);
+
+   for (int i = 0; i < 100; i++)
    {
-      char* syscmd = new char[4096];
-      sprintf(syscmd, "mkdir -p %s", newdir.c_str());
-      system(syscmd);
-      delete[] syscmd;
+      at += 10000;
+      telemetry.record(ScanStage_Scan, 1, 10, 1000, 40, at);
    }
-#endif
-
-   LMDBBlockDatabase* iface_;
-   BinaryData magic_;
-   BinaryData ghash_;
-   BinaryData gentx_;
-   BinaryData zeros_;
-
-   string blkdir_;
-   string homedir_;
-   string ldbdir_;
-   string blk0dat_;
-
-};
+   
+   //the window only sees the faster rate
+   stats = telemetry.getStats(ScanStage_Scan, at);
+   EXPECT_EQ(stats.blocks_, 120);
+   EXPECT_NEAR(stats.blocksPerSec_, 100.0, 10.0);
+   EXPECT_EQ(stats.elapsedUs_, 3000000);
+
+   //rates decay while the stage is stalled
+   telemetry.recordStall(ScanStage_Scan, 500000);
+   stats = telemetry.getStats(ScanStage_Scan, at + 500000);
+   EXPECT_LT(stats.blocksPerSec_, 60.0);
+   EXPECT_EQ(stats.stallUs_, 500000);
+   EXPECT_EQ(stats.stalls_, 1);
+
+   telemetry.endStage(ScanStage_Scan, at + 500000);
+   stats = telemetry.getStats(ScanStage_Scan, at + 5000000);
+   EXPECT_FALSE(stats.active_);
+   EXPECT_EQ(stats.runs_, 1);
+   EXPECT_EQ(stats.elapsedUs_, 3500000);
+
+   //one callback per 500ms while running, plus the final one
+   ASSERT_EQ(reported.size(), 7);
+   EXPECT_FALSE(reported.back().active_);
+   EXPECT_EQ(reported.back().blocks_, 120);
+   
+   //other stages are untouched
+   EXPECT_EQ(telemetry.getStats(ScanStage_SideScan).runs_, 0);
+   EXPECT_NE(telemetry.dump().find("scan: runs 1"), string::npos);
+   EXPECT_EQ(telemetry.dump().find("side scan"), string::npos);
 
+   //sub second samples move the ETA
+   ProgressCalculator calc(1000, 100);
+   calc.advance(10, start);
+   calc.advance(110, start + 200000);
+   EXPECT_GT(calc.unitsPerSecond(), 0.0);
+   EXPECT_NEAR(calc.fractionCompleted(), 0.11, 0.001);
+}
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsWithWalletTest, PreRegisterScrAddrs)
+TEST(ScanTelemetry, ReportedLines)
 {
-   vector<BinaryData> scrAddrVec;
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
+   //what the BDM thread forwards to BDMAction_ScanStats
+   ScanTelemetry telemetry(1000);
 
-   BtcWallet& wlt = *theBDV->registerWallet(scrAddrVec, "wallet1", false);
-   wlt.addScrAddress(TestChain::scrAddrD);
+   vector<string> reported;
+   telemetry.setCallback(
+      [&reported](const ScanStageStats& stats)->void
+      { reported.push_back(ScanTelemetry::format(stats)); }, 500);
 
-   setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
+   const uint64_t start = 1000000;
+   telemetry.beginStage(ScanStage_SideScan, start);
+   for (int i = 1; i <= 10; i++)
+      telemetry.record(ScanStage_SideScan, 1, 2, 300, 4, start + i * 100000);
+   telemetry.endStage(ScanStage_SideScan, start + 1000000);
 
-   TheBDM.doInitialSyncOnLoad(nullProgress);
+   ASSERT_EQ(reported.size(), 3);
+   EXPECT_EQ(reported[0].find("side scan (running): runs 1"), 0);
 
-   theBDV->scanWallets();
+   //same line as dump() prints
+   EXPECT_EQ(telemetry.dump().find("side scan: runs 1, elapsed 1000ms, "
+      "blocks 10"), 0);
+   EXPECT_EQ(reported.back().find("side scan: runs 1, elapsed 1000ms, "
+      "blocks 10"), 0);
+}
 
-   uint64_t balanceWlt;
-   uint64_t balanceDB;
+////////////////////////////////////////////////////////////////////////////////
+TEST(FlushController, AdaptiveThresholds)
+{
+   const uint64_t MB = 1024 * 1024;
 
-   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrA)->getFullBalance();
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrA);
-   EXPECT_EQ(balanceWlt, 50*COIN);
-   EXPECT_EQ(balanceDB,  50*COIN);
+   //the fixed policy never moves
+   FlushController fixed(false, 0, 0, 0, 0);
+   const uint64_t fixedBytes = fixed.getBytesThreshold();
+   const uint32_t fixedUtxos = fixed.getUtxoThreshold();
+   fixed.recordCommit(fixedBytes, 10, 10);
+   fixed.recordCommit(fixedBytes, 10000000, 10000000);
+   EXPECT_EQ(fixed.getBytesThreshold(), fixedBytes);
+   EXPECT_EQ(fixed.getUtxoThreshold(), fixedUtxos);
+   EXPECT_EQ(fixed.getStats().commits_, 2);
+   EXPECT_FALSE(fixed.getStats().adaptive_);
 
-   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrB)->getFullBalance();
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrB);
-   EXPECT_EQ(balanceWlt, 70*COIN);
-   EXPECT_EQ(balanceDB,  70*COIN);
+   //1MB to 64MB, 100ms commits, no memory pressure
+   FlushController adaptive(true, MB, 64 * MB, 100, 1024 * MB);
+   uint64_t threshold = adaptive.getBytesThreshold();
+   EXPECT_GE(threshold, MB);
+   EXPECT_LE(threshold, 64 * MB);
 
-   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrC)->getFullBalance();
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrC);
-   EXPECT_EQ(balanceWlt, 20*COIN);
-   EXPECT_EQ(balanceDB,  20*COIN);
+   //a disk writing 1GB/s: grows by at most 2x a commit, up to the bound
+   for (int i = 0; i < 10; i++)
+   {
+      uint64_t bytes = adaptive.getBytesThreshold();
+      adaptive.recordCommit(bytes, bytes / 4096, bytes / 2048);
+      EXPECT_LE(adaptive.getBytesThreshold(), bytes * 2);
+   }
+   EXPECT_EQ(adaptive.getBytesThreshold(), 64 * MB);
+   EXPECT_GT(adaptive.getStats().raised_, 0);
+   const uint32_t maxUtxos = adaptive.getUtxoThreshold();
 
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrD);
-   EXPECT_EQ(balanceDB,  65*COIN);
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrE);
-   EXPECT_EQ(balanceDB,  30*COIN);
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrF);
-   EXPECT_EQ(balanceDB,   5*COIN);
+   //a partial batch doesn't steer
+   adaptive.recordCommit(MB, 1000000, 1000000);
+   EXPECT_EQ(adaptive.getBytesThreshold(), 64 * MB);
+
+   //a disk writing 10MB/s settles around 1MB per 100ms commit
+   for (int i = 0; i < 20; i++)
+   {
+      uint64_t bytes = adaptive.getBytesThreshold();
+      adaptive.recordCommit(bytes, bytes / 100, bytes / 20);
+   }
+   EXPECT_LE(adaptive.getBytesThreshold(), 2 * MB);
+   EXPECT_GT(adaptive.getStats().lowered_, 0);
+   EXPECT_LT(adaptive.getUtxoThreshold(), maxUtxos);
+
+   auto stats = adaptive.getStats();
+   EXPECT_TRUE(stats.adaptive_);
+   EXPECT_EQ(stats.commits_, 31);
+   EXPECT_EQ(stats.bytesThreshold_, adaptive.getBytesThreshold());
+   EXPECT_EQ(stats.lastCommitUs_, 
+      stats.lastBytes_ / 100 + stats.lastBytes_ / 20);
+   EXPECT_GT(stats.serializeUs_, 0);
+   EXPECT_GT(stats.writeUs_, stats.serializeUs_);
+
+   //the memory cap wins over the lower bound
+   FlushController capped(true, 4 * MB, 64 * MB, 100, 3 * MB);
+   EXPECT_EQ(capped.getBytesThreshold(), MB);
+   for (int i = 0; i < 5; i++)
+      capped.recordCommit(MB, 100, 100);
+   EXPECT_EQ(capped.getBytesThreshold(), MB);
+   EXPECT_EQ(capped.getStats().capped_, 5);
+   EXPECT_EQ(capped.getStats().memoryCap_, 3 * MB);
+
+#ifndef _WIN32
+   EXPECT_GT(FlushController::getAvailableMemory(), 0);
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsWithWalletTest, PostRegisterScrAddr)
+TEST(ThreadPool, PrioritiesFuturesAndMetrics)
 {
-   setBlocks({ "0", "1", "2", "3", "4", "5" }, blk0dat_);
-   TheBDM.doInitialSyncOnLoad(nullProgress);
+   {
+      ThreadPool pool(1);
+
+      //hold the only worker so the rest queues up
+      promise<void> started, release;
+      shared_future<void> released = release.get_future().share();
+      auto blocker = pool.submit([&started, released](void)->void 
+      { started.set_value(); released.wait(); });
+      started.get_future().wait();
+
+      mutex orderMu;
+      vector<int> order;
+      auto push = [&](int val)->void
+      { unique_lock<mutex> lock(orderMu); order.push_back(val); };
+
+      auto low = pool.submit([&](void)->void { push(3); }, TaskPriority_Low);
+      auto normal1 = pool.submit([&](void)->void { push(1); });
+      auto high = pool.submit([&](void)->void { push(0); }, TaskPriority_High);
+      auto normal2 = pool.submit([&](void)->void { push(2); });
+      auto value = pool.submit([](void)->int { return 42; }, TaskPriority_Low);
+      auto failing = pool.submit(
+         [](void)->int { throw runtime_error("task failed"); return 0; });
+
+      auto stats = pool.getStats();
+      EXPECT_EQ(stats.threads_, 1);
+      EXPECT_EQ(stats.queueDepth_, 6);
+      EXPECT_EQ(stats.queueDepthByPriority_[TaskPriority_High], 1);
+      EXPECT_EQ(stats.queueDepthByPriority_[TaskPriority_Normal], 3);
+      EXPECT_EQ(stats.queueDepthByPriority_[TaskPriority_Low], 2);
+
+      release.set_value();
+      blocker.get();
+      EXPECT_EQ(value.get(), 42);
+      EXPECT_THROW(failing.get(), runtime_error);
+      low.get(); normal1.get(); high.get(); normal2.get();
+
+      //high first, FIFO within a priority
+      vector<int> expected = { 0, 1, 2, 3 };
+      EXPECT_EQ(order, expected);
+
+      //futures are ready before the worker books the task
+      for (int i = 0; i < 100 && pool.getStats().tasksRun_ < 7; i++)
+         this_thread::sleep_for(chrono::milliseconds(10));
+
+      stats = pool.getStats();
+      EXPECT_EQ(stats.threadsCreated_, 1);
+      EXPECT_EQ(stats.tasksRun_, 7);
+      EXPECT_EQ(stats.queueDepth_, 0);
+      EXPECT_EQ(stats.peakQueueDepth_, 6);
+      EXPECT_GT(stats.utilization_, 0.0);
+      EXPECT_LE(stats.utilization_, 1.0);
+   }
 
-   // We do all the database stuff first, THEN load the addresses
-   vector<BinaryData> scrAddrVec;
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
+   {
+      //tasks waiting on one another get their own workers, up to the cap
+      ThreadPool pool(3);
+      promise<void> release;
+      shared_future<void> released = release.get_future().share();
+
+      vector<future<void>> waiting;
+      for (int i = 0; i < 4; i++)
+         waiting.push_back(
+            pool.submit([released](void)->void { released.wait(); }));
+
+      auto stats = pool.getStats();
+      EXPECT_EQ(stats.threadsCreated_, 3);
+      EXPECT_EQ(stats.threads_, 3);
+
+      //raising the cap picks up the queued task
+      pool.setMaxThreads(4);
+      EXPECT_EQ(pool.getStats().threadsCreated_, 4);
+
+      release.set_value();
+      for (auto& fut : waiting)
+         fut.get();
+
+      EXPECT_NE(pool.dump().find("created 4"), string::npos);
+
+      //released workers exit, the next task starts a new one
+      pool.releaseWorkers();
+      EXPECT_EQ(pool.getStats().threads_, 0);
+      auto next = pool.submit([](void)->int { return 7; });
+      EXPECT_EQ(next.get(), 7);
+      EXPECT_EQ(pool.getStats().threadsCreated_, 5);
+   }
+}
 
-   BtcWallet& wlt = *theBDV->registerWallet(scrAddrVec, "wallet1", false);
-   wlt.addScrAddress(TestChain::scrAddrD);
+////////////////////////////////////////////////////////////////////////////////
+// entryCount entries over 20 wallets, each with one or two of 2000 
+// scrAddrs, built through unserialize since nothing else sets the scrAddr list
+static map<BinaryData, LedgerEntry> makeLedgerTableEntries(
+   unsigned entryCount)
+{
+   vector<BinaryData> walletIDs;
+   for (unsigned i = 0; i < 20; i++)
+      walletIDs.push_back(BinaryData(string("wallet") + to_string(i)));
 
-   theBDV->scanWallets();
+   vector<BinaryData> scrAddrs;
+   for (unsigned i = 0; i < 2000; i++)
+   {
+      BinaryData scrAddr(21);
+      memset(scrAddr.getPtr(), i % 251, 21);
+      scrAddr[0] = SCRIPT_PREFIX_HASH160;
+      memcpy(scrAddr.getPtr() + 1, &i, 4);
+      scrAddrs.push_back(scrAddr);
+   }
 
-   uint64_t balanceWlt;
-   uint64_t balanceDB;
+   map<BinaryData, LedgerEntry> leMap;
+   for (unsigned i = 0; i < entryCount; i++)
+   {
+      uint32_t height = 1000 + i / 4;
+      uint16_t txIndex = (i % 4) * 3;
 
-   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrA)->getFullBalance();
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrA);
-   EXPECT_EQ(balanceWlt, 50*COIN);
-   EXPECT_EQ(balanceDB,  50*COIN);
+      BinaryWriter keyWriter;
+      keyWriter.put_BinaryData(DBUtils::heightAndDupToHgtx(height, 0));
+      keyWriter.put_uint16_t(txIndex, BE);
 
-   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrB)->getFullBalance();
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrB);
-   EXPECT_EQ(balanceWlt, 70*COIN);
-   EXPECT_EQ(balanceDB,  70*COIN);
+      BinaryWriter bw;
+      bw.put_uint64_t(uint64_t(int64_t(i % 7 == 0 ? -1 : 1) * (i + 1) * 1000));
+      bw.put_uint32_t(height);
+      bw.put_BinaryData(BtcUtils::getHash256(keyWriter.getData()));
+      bw.put_uint32_t(txIndex);
+      bw.put_uint32_t(1400000000 + i);
+      bw.put_uint8_t(i % 5);
+      bw.put_var_int(1 + i % 2);
+      for (unsigned y = 0; y <= i % 2; y++)
+      {
+         bw.put_var_int(21);
+         bw.put_BinaryData(scrAddrs[(i * 7 + y) % scrAddrs.size()]);
+      }
 
-   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrC)->getFullBalance();
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrC);
-   EXPECT_EQ(balanceWlt, 20*COIN);
-   EXPECT_EQ(balanceDB,  20*COIN);
+      BinaryRefReader brr(bw.getDataRef());
+      LedgerEntry& le = leMap[keyWriter.getData()];
+      le.unserialize(brr);
+      le.setWalletID(walletIDs[i % walletIDs.size()]);
+   }
 
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrD);
-   EXPECT_EQ(balanceDB,  65*COIN);
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrE);
-   EXPECT_EQ(balanceDB,  30*COIN);
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrF);
-   EXPECT_EQ(balanceDB,   5*COIN);
+   return leMap;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// memory, roughly: map nodes, heap copies of the key, ID and hash, set nodes
+// and their scrAddrs
+static size_t estimateLedgerMapBytes(const map<BinaryData, LedgerEntry>& leMap)
+{
+   size_t mapBytes = 0;
+   for (auto& lePair : leMap)
+   {
+      mapBytes += sizeof(pair<const BinaryData, LedgerEntry>) + 
+         4 * sizeof(void*) + lePair.first.getSize() + 
+         lePair.second.getWalletID().size() + 32;
+      for (auto& scrAddr : lePair.second.getScrAddrList())
+         mapBytes += sizeof(BinaryData) + 4 * sizeof(void*) + scrAddr.getSize();
+   }
+
+   return mapBytes;
+}
 
-// Comments need to be added....
-// Most of this data is from the BIP32 test vectors.
-class TestCryptoECDSA : public ::testing::Test
+////////////////////////////////////////////////////////////////////////////////
+TEST(LedgerTable, Columns)
 {
-protected:
-   /////////////////////////////////////////////////////////////////////////////
-   virtual void SetUp(void)
+   auto leMap = makeLedgerTableEntries(2000);
+
+   auto expectSameEntry = [](const LedgerEntry& le, const LedgerEntry& le2)
    {
-      verifyX = READHEX("39a36013301597daef41fbe593a02cc513d0b55527ec2df1050e2e8ff49c85c2");
-      verifyY = READHEX("3cbe7ded0e7ce6a594896b8f62888fdbc5c8821305e2ea42bf01e37300116281");
+      EXPECT_EQ(le.getWalletID(), le2.getWalletID());
+      EXPECT_EQ(le.getValue(), le2.getValue());
+      EXPECT_EQ(le.getBlockNum(), le2.getBlockNum());
+      EXPECT_EQ(le.getTxHash(), le2.getTxHash());
+      EXPECT_EQ(le.getIndex(), le2.getIndex());
+      EXPECT_EQ(le.getTxTime(), le2.getTxTime());
+      EXPECT_EQ(le.isCoinbase(), le2.isCoinbase());
+      EXPECT_EQ(le.isSentToSelf(), le2.isSentToSelf());
+      EXPECT_EQ(le.isChangeBack(), le2.isChangeBack());
+      EXPECT_EQ(le.getScrAddrList(), le2.getScrAddrList());
+   };
 
-      multScalarA = READHEX("79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
-      multScalarB = READHEX("483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8");
-      multRes = READHEX("805714a252d0c0b58910907e85b5b801fff610a36bdf46847a4bf5d9ae2d10ed");
+   LedgerTable table(leMap);
+   ASSERT_EQ(table.size(), leMap.size());
 
-      multScalar = READHEX("04bfb2dd60fa8921c2a4085ec15507a921f49cdc839f27f0f280e9c1495d44b5");
-      multPointX = READHEX("79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
-      multPointY = READHEX("483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8");
-      multPointRes = READHEX("7f8bd85f90169a606b0b4323c70e5a12e8a89cbc76647b6ed6a39b4b53825214c590a32f111f857573cf8f2c85d969815e4dd35ae0dc9c7e868195c309b8bada");
+   //rows in map order, through the view and as LedgerEntry objects
+   size_t row = 0;
+   for (auto& lePair : leMap)
+   {
+      auto view = table[row];
+      EXPECT_EQ(view.getKey(), lePair.first);
+      EXPECT_EQ(view.getTxHash(), lePair.second.getTxHash());
+      EXPECT_EQ(view.getValue(), lePair.second.getValue());
+      EXPECT_EQ(view.isSentToSelf(), lePair.second.isSentToSelf());
+      expectSameEntry(table.getEntry(row), lePair.second);
+
+      if (row % 1000 == 0)
+         EXPECT_EQ(table.find(lePair.first), row);
+      row++;
+   }
+   EXPECT_EQ(table.find(READHEX("ffffffffffff")), table.size());
 
-      addAX = READHEX("79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
-      addAY = READHEX("483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8");
-      addBX = READHEX("5a784662a4a20a65bf6aab9ae98a6c068a81c52e4b032c0fb5400c706cfccc56");
-      addBY = READHEX("7f717885be239daadce76b568958305183ad616ff74ed4dc219a74c26d35f839");
-      addRes = READHEX("fe2f7c8109d9ae628856d51a02ab25300a8757e088fc336d75cb8dc4cc2ce3339013be71e57c3abeee6ad158646df81d92f8c0778f88100eeb61535f9ff9776d");
+   //the global ledger's sort
+   vector<LedgerEntry> leVec;
+   for (auto& lePair : leMap)
+      leVec.push_back(lePair.second);
+   LedgerEntry_DescendingOrder desc;
+   sort(leVec.begin(), leVec.end(), desc);
 
-      invAX = READHEX("79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
-      invAY = READHEX("483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8");
-      invRes = READHEX("79be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798b7c52588d95c3b9aa25b0403f1eef75702e84bb7597aabe663b82f6f04ef2777");
+   table.sortByEntry(true);
+   auto sortedVec = table.toVector();
+   ASSERT_EQ(sortedVec.size(), leVec.size());
+   for (size_t i = 0; i < leVec.size(); i += 97)
+      expectSameEntry(sortedVec[i], leVec[i]);
 
-      compPointPrv1 = READHEX("000f479245fb19a38a1954c5c7c0ebab2f9bdfd96a17563ef28a6a4b1a2a764ef4");
-      compPointPub1 = READHEX("02e8445082a72f29b75ca48748a914df60622a609cacfce8ed0e35804560741d29");
-      uncompPointPub1 = READHEX("04e8445082a72f29b75ca48748a914df60622a609cacfce8ed0e35804560741d292728ad8d58a140050c1016e21f285636a580f4d2711b7fac3957a594ddf416a0");
+   table.sortByKey();
+   EXPECT_EQ(table[0].getKey(), leMap.begin()->first);
+   EXPECT_EQ(table.find(leMap.rbegin()->first), table.size() - 1);
 
-      compPointPrv2 = READHEX("00e8f32e723decf4051aefac8e2c93c9c5b214313817cdb01a1494b917c8436b35");
-      compPointPub2 = READHEX("0339a36013301597daef41fbe593a02cc513d0b55527ec2df1050e2e8ff49c85c2");
-      uncompPointPub2 = READHEX("0439a36013301597daef41fbe593a02cc513d0b55527ec2df1050e2e8ff49c85c23cbe7ded0e7ce6a594896b8f62888fdbc5c8821305e2ea42bf01e37300116281");
+   //smaller than the map, and iterates to the same values
+   EXPECT_LT(table.getMemoryUsage(), estimateLedgerMapBytes(leMap));
 
-      invModRes = READHEX("000000000000000000000000000000000000000000000000000000000000006b");
+   int64_t mapSum = 0, tableSum = 0;
+   for (auto& lePair : leMap)
+      mapSum += lePair.second.getValue() + lePair.second.getTxTime();
+   for (auto view : table)
+      tableSum += view.getValue() + view.getTxTime();
+   EXPECT_EQ(mapSum, tableSum);
+}
 
-      LOGDISABLESTDOUT();
-   }
+// This was really just to time the logging to determine how much impact it 
+// has.  It looks like writing to file is about 1,000,000 logs/sec, while 
+// writing to the null stream (below the threshold log level) is about 
+// 2,200,000/sec.    As long as we use log messages sparingly (and timer
+// calls which call the logger), there will be no problem leaving them
+// on even in production code.
+/*
+TEST(TimeDebugging, WriteToLogNoStdOut)
+{
+   LOGDISABLESTDOUT();
+   for(uint32_t i=0; i<1000000; i++)
+      LOGERR << "Testing writing out " << 3 << " diff things";
+   LOGENABLESTDOUT();
+}
 
+TEST(TimeDebugging, WriteNull)
+{
+   for(uint32_t i=0; i<1000000; i++)
+      LOGDEBUG4 << "Testing writing out " << 3 << " diff things";
+}
+*/
 
-   /////////////////////////////////////////////////////////////////////////////
-   virtual void TearDown(void)
-   {
-      CLEANUP_ALL_TIMERS();
-   }
 
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+// Benchmarks. Timings depend on the machine and its load, so they are only
+// logged and stay out of the unit tests: these are disabled, run them with
+//    make bench
+// or --gtest_also_run_disabled_tests --gtest_filter=*Bench*
+////////////////////////////////////////////////////////////////////////////////
+class CryptoPPBench : public CryptoPPTest
+{};
 
-   SecureBinaryData verifyX;
-   SecureBinaryData verifyY;
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(CryptoPPBench, DISABLED_SecureMemoryPool)
+{
+    SecureMemoryPool& pool = SecureMemoryPool::getGlobal();
+    const unsigned keyCount = 20000;
 
-   SecureBinaryData multScalarA;
-   SecureBinaryData multScalarB;
-   SecureBinaryData multRes;
+    vector<SecureBinaryData> pooledKeys, unpooledKeys;
+    pool.setEnabled(false);
+    uint64_t unpooledUs = deriveChainedKeys(keyCount, unpooledKeys);
+    pool.setEnabled(true);
+    uint64_t pooledUs = deriveChainedKeys(keyCount, pooledKeys);
 
-   SecureBinaryData multScalar;
-   SecureBinaryData multPointX;
-   SecureBinaryData multPointY;
-   SecureBinaryData multPointRes;
+    LOGINFO << "chained key derivation: " 
+        << keyCount * 1000000ULL / (unpooledUs + 1) << " keys/s unpooled, "
+        << keyCount * 1000000ULL / (pooledUs + 1) << " keys/s pooled";
+    LOGINFO << "secure pool: " << pool.getStats().arenas_ << " arenas, "
+        << pool.getStats().peakBytesInUse_ << " peak bytes in use, "
+        << pool.getStats().lockFailures_ << " lock failures";
+}
 
-   SecureBinaryData addAX;
-   SecureBinaryData addAY;
-   SecureBinaryData addBX;
-   SecureBinaryData addBY;
-   SecureBinaryData addRes;
+////////////////////////////////////////////////////////////////////////////////
+class BtcUtilsBench : public BtcUtilsTest
+{};
 
-   SecureBinaryData invAX;
-   SecureBinaryData invAY;
-   SecureBinaryData invRes;
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BtcUtilsBench, DISABLED_NoCopyScriptAnalysis)
+{
+   vector<BinaryData> txOutScripts;
+   vector<pair<BinaryData, BinaryData>> txInScripts;
+   ASSERT_TRUE(loadAnalysisScripts(txOutScripts, txInScripts));
 
-   SecureBinaryData compPointPrv1;
-   SecureBinaryData uncompPointPub1;
-   SecureBinaryData compPointPub1;
-   SecureBinaryData compPointPrv2;
-   SecureBinaryData uncompPointPub2;
-   SecureBinaryData compPointPub2;
+   const unsigned rounds = 2000;
+   auto nsPerScript = [rounds](size_t count, function<void(void)> run)->double
+   {
+      auto start = chrono::steady_clock::now();
+      for (unsigned i = 0; i < rounds; i++)
+         run();
+      auto ns = chrono::duration_cast<chrono::nanoseconds>(
+         chrono::steady_clock::now() - start).count();
+      return double(ns) / double(rounds * count);
+   };
+
+   size_t sink = 0;
+   double legacyTxOut = nsPerScript(txOutScripts.size(), [&](void)->void
+   {
+      for (const auto& script : txOutScripts)
+         sink += legacyScrAddr(script.getRef()).getSize();
+   });
+   double noCopyTxOut = nsPerScript(txOutScripts.size(), [&](void)->void
+   {
+      uint8_t scrAddr[21];
+      for (const auto& script : txOutScripts)
+      {
+         if (BtcUtils::getTxOutScrAddrNoCopy(script.getRef(), scrAddr))
+            sink += scrAddr[20];
+         else
+            sink += BtcUtils::getTxOutScrAddr(script.getRef()).getSize();
+      }
+   });
+   Hash160Cache benchCache;
+   double cachedTxOut = nsPerScript(txOutScripts.size(), [&](void)->void
+   {
+      uint8_t scrAddr[21];
+      for (const auto& script : txOutScripts)
+      {
+         if (BtcUtils::getTxOutScrAddrNoCopy(script.getRef(), scrAddr,
+            TXOUT_SCRIPT_NONSTANDARD, &benchCache))
+            sink += scrAddr[20];
+         else
+            sink += BtcUtils::getTxOutScrAddr(script.getRef()).getSize();
+      }
+   });
+   double legacyTxIn = nsPerScript(txInScripts.size(), [&](void)->void
+   {
+      for (const auto& txin : txInScripts)
+         sink += legacyTxInType(txin.first.getRef(), txin.second.getRef());
+   });
+   double noCopyTxIn = nsPerScript(txInScripts.size(), [&](void)->void
+   {
+      for (const auto& txin : txInScripts)
+         sink += BtcUtils::getTxInScriptType(
+            txin.first.getRef(), txin.second.getRef());
+   });
+   EXPECT_GT(sink, 0U);
 
-   SecureBinaryData invModRes;
-};
+   LOGINFO << "TxOut scrAddr, ns/script: " << legacyTxOut << " with copies, "
+      << noCopyTxOut << " without, " << cachedTxOut
+      << " with the hash160 cache (" << txOutScripts.size() << " scripts)";
+   LOGINFO << "TxIn script type, ns/script: " << legacyTxIn
+      << " with copies, " << noCopyTxIn << " without ("
+      << txInScripts.size() << " scripts)";
+}
 
-// Verify that a point known to be on the secp256k1 curve is recognized as such.
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(TestCryptoECDSA, VerifySECP256K1Point)
+TEST_F(BtcUtilsBench, DISABLED_ScryptProofOfWork)
 {
-   EXPECT_TRUE(CryptoECDSA().ECVerifyPoint(verifyX, verifyY));
+   ScryptPoW scrypt;
+   auto headers = makeNonceHeaders(64);
+   vector<BinaryDataRef> benchHeaders;
+   for (auto& header : headers)
+      benchHeaders.push_back(header.getRef());
+   for (auto& header : headers)
+      benchHeaders.push_back(header.getRef());
+
+   auto headersPerSec = [&benchHeaders](
+      function<void(BinaryDataRef)> check)->double
+   {
+      auto start = chrono::steady_clock::now();
+      for (auto& header : benchHeaders)
+         check(header);
+      double secs = chrono::duration<double>(
+         chrono::steady_clock::now() - start).count();
+      return double(benchHeaders.size()) / max(secs, 1e-9);
+   };
+
+   uint8_t out[32];
+   double scalarRate = headersPerSec([&](BinaryDataRef header)->void
+      { scrypt.hashScalar(header.getPtr(), out); });
+   double simdRate = headersPerSec([&](BinaryDataRef header)->void
+      { scrypt.hash(header.getPtr(), out); });
+
+   auto start = chrono::steady_clock::now();
+   ScryptPoW::checkHeaders(benchHeaders, ThreadPool::getGlobal());
+   double batchSecs = chrono::duration<double>(
+      chrono::steady_clock::now() - start).count();
+   double batchRate = double(benchHeaders.size()) / max(batchSecs, 1e-9);
+
+   LOGINFO << "scrypt PoW, headers/s: " << scalarRate << " portable, "
+      << simdRate << (ScryptPoW::hasSIMD() ? " SSE2" : " portable")
+      << ", " << batchRate << " batched over "
+      << thread::hardware_concurrency() << " cores";
 }
 
-// Multiply two scalars and check the result.
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(TestCryptoECDSA, SECP256K1MultScalars)
-{
-   SecureBinaryData testRes = CryptoECDSA().ECMultiplyScalars(multScalarA,
-                                                              multScalarB);
-   EXPECT_EQ(multRes, testRes);
-}
+class LMDBBench : public LMDBTest
+{};
 
-// Verify that some public keys (compressed and uncompressed) are valid.
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(TestCryptoECDSA, VerifyPubKeyValidity)
+TEST_F(LMDBBench, DISABLED_ReusedReadTxnsPointLookups)
 {
-   EXPECT_TRUE(CryptoECDSA().VerifyPublicKeyValid(compPointPub1));
-   EXPECT_TRUE(CryptoECDSA().VerifyPublicKeyValid(compPointPub2));
-   EXPECT_TRUE(CryptoECDSA().VerifyPublicKeyValid(uncompPointPub1));
-   EXPECT_TRUE(CryptoECDSA().VerifyPublicKeyValid(uncompPointPub2));
+   ASSERT_TRUE(standardOpenDBs());
+   LMDBEnv* env = iface_->dbEnv_[TXHINTS].get();
+
+   const uint32_t count = 10000;
+   putTxHints(count);
+
+   auto lookupsPerSec = [&](unsigned threadCount, bool reuse)->uint64_t
+   {
+      env->setReuseReadTxns(reuse);
+
+      atomic<bool> stop(false);
+      atomic<uint64_t> total(0);
+
+      vector<thread> threads;
+      for (unsigned t = 0; t < threadCount; t++)
+      {
+         threads.push_back(thread([&, t](void)->void
+         {
+            uint64_t lookups = 0;
+            uint32_t i = t;
+            while (!stop.load(memory_order_relaxed))
+            {
+               i = (i * 2654435761U + 1) % count;
+               readTxHint(i);
+               lookups++;
+            }
+            total += lookups;
+         }));
+      }
+
+      this_thread::sleep_for(chrono::milliseconds(250));
+      stop.store(true);
+      for (auto& thr : threads)
+         thr.join();
+
+      return total.load() * 4;
+   };
+
+   for (unsigned threadCount = 1; threadCount <= 4; threadCount *= 2)
+   {
+      uint64_t fresh = lookupsPerSec(threadCount, false);
+      uint64_t reused = lookupsPerSec(threadCount, true);
+
+      LOGINFO << threadCount << " reader threads: " << fresh 
+         << " lookups/s with a new read txn per lookup, " << reused
+         << " with reused read txns";
+   }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/* Never got around to finishing this...
-class TestMainnetBlkchain: public ::testing::Test
+TEST(LedgerTableBench, DISABLED_Columns)
 {
-protected:
-   /////////////////////////////////////////////////////////////////////////////
-   virtual void SetUp(void) 
-   {
-      iface_ = LSMWrapper::GetInterfacePtr();
-      magic_ = READHEX(MAINNET_MAGIC_BYTES);
-      ghash_ = READHEX(MAINNET_GENESIS_HASH_HEX);
-      gentx_ = READHEX(MAINNET_GENESIS_TX_HASH_HEX);
-      zeros_ = READHEX("00000000");
-      DBUtils::setArmoryDbType(ARMORY_DB_FULL);
-      DBUtils::setDbPruneType(DB_PRUNE_NONE);
+   auto leMap = makeLedgerTableEntries(20000);
+   LedgerTable table(leMap);
+   LedgerEntry_DescendingOrder desc;
 
-      blkdir_  = string("/home/alan/.bitcoin");
-      homedir_ = string("./fakehomedir");
-      ldbdir_  = string("/home/alan/ARMORY_DB_257k_BLKS");
+   auto timeMs = [](function<void(void)> run)->double
+   {
+      auto start = chrono::steady_clock::now();
+      run();
+      return chrono::duration<double, milli>(
+         chrono::steady_clock::now() - start).count();
+   };
 
-      iface_->openDatabases( ldbdir_, ghash_, gentx_, magic_, 
-                             ARMORY_DB_SUPER, DB_PRUNE_NONE);
-      if(!iface_->databasesAreOpen())
-         LOGERR << "ERROR OPENING DATABASES FOR TESTING!";
+   const unsigned rounds = 20;
+   int64_t mapSum = 0, tableSum = 0;
+   double mapIterMs = timeMs([&](void)->void
+   {
+      for (unsigned i = 0; i < rounds; i++)
+         for (auto& lePair : leMap)
+            mapSum += lePair.second.getValue() + lePair.second.getTxTime();
+   });
+   double tableIterMs = timeMs([&](void)->void
+   {
+      for (unsigned i = 0; i < rounds; i++)
+         for (auto view : table)
+            tableSum += view.getValue() + view.getTxTime();
+   });
+   EXPECT_EQ(mapSum, tableSum);
+
+   size_t copied = 0;
+   double mapCopyMs = timeMs([&](void)->void
+   {
+      vector<LedgerEntry> copy;
+      for (auto& lePair : leMap)
+         copy.push_back(lePair.second);
+      sort(copy.begin(), copy.end(), desc);
+      copied += copy.size();
+   });
+   double tableCopyMs = timeMs([&](void)->void
+   {
+      LedgerTable sortTable(leMap);
+      sortTable.sortByEntry(true);
+      copied += sortTable.toVector().size();
+   });
+   EXPECT_EQ(copied, 2 * leMap.size());
 
-      mkdir(homedir_);
+   LOGINFO << "LedgerTable, " << leMap.size() << " entries: ~" 
+      << estimateLedgerMapBytes(leMap) / 1024 << "kB as a map, " 
+      << table.getMemoryUsage() / 1024 << "kB by column";
+   LOGINFO << "LedgerTable, iteration: " << mapIterMs / rounds 
+      << "ms over the map, " << tableIterMs / rounds << "ms over the table";
+   LOGINFO << "LedgerTable, sorted page vector: " << mapCopyMs 
+      << "ms from LedgerEntry objects, " << tableCopyMs 
+      << "ms through the table";
+}
 
-      TheBDM.SelectNetwork("Main");
-      TheBDM.SetBlkFileLocation(blkdir_);
-      TheBDM.SetLevelDBLocation(ldbdir_);
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(LMDBBench, DISABLED_RangeBoundedSubHistories)
+{
+   ASSERT_TRUE(standardOpenDBs());
+   LMDBEnv::Transaction tx(iface_->dbEnv_[HISTORY].get(), LMDB::ReadWrite);
 
-      TestChain::addrA = READHEX("b077a2b5e8a53f1d3ef4100117125de6a5b15f6b");
-      TestChain::addrB = READHEX("4c765bca17f9881ad6d4336a1d4ec34a091e5a6f");
+   //UTXOs over a deep history, full load versus unspent only
+   const uint32_t depth = 2000;
+   BinaryData uniq = READHEX("00""0000ffff0000ffff0000ffff0000ffff0000ffff");
+   putDeepSubHistories(uniq, depth);
 
-      TestChain::scrAddrA = HASH160PREFIX + TestChain::addrA;
-      TestChain::scrAddrB = HASH160PREFIX + TestChain::addrB;
+   const unsigned rounds = 20;
+   set<BinaryData> fullUtxos, rangeUtxos;
 
-      LOGDISABLESTDOUT();
+   auto start = chrono::steady_clock::now();
+   for (unsigned i = 0; i < rounds; i++)
+   {
+      StoredScriptHistory fullssh;
+      iface_->getStoredScriptHistory(fullssh, uniq);
+      for (auto& subPair : fullssh.subHistMap_)
+      {
+         for (auto& txioPair : subPair.second.txioMap_)
+         {
+            if (txioPair.second.isUTXO())
+               fullUtxos.insert(txioPair.first);
+         }
+      }
    }
+   auto fullTime = chrono::steady_clock::now() - start;
 
+   auto addUTXOs = [&rangeUtxos](StoredSubHistory& subssh)->bool
+   {
+      for (auto& txioPair : subssh.txioMap_)
+      {
+         if (txioPair.second.isUTXO())
+            rangeUtxos.insert(txioPair.first);
+      }
+      return true;
+   };
 
-   /////////////////////////////////////////////////////////////////////////////
-   virtual void TearDown(void)
+   start = chrono::steady_clock::now();
+   for (unsigned i = 0; i < rounds; i++)
+      iface_->readSubHistories(uniq, 0, UINT32_MAX, true, addUTXOs);
+   auto rangeTime = chrono::steady_clock::now() - start;
+
+   auto perRound = [rounds](chrono::steady_clock::duration d)->uint32_t
    {
-      rmdir(homedir_);
+      return (uint32_t)(
+         chrono::duration_cast<chrono::microseconds>(d).count() / rounds);
+   };
 
-      BlockDataManager_LevelDB::DestroyInstance();
-      LOGENABLESTDOUT();
-   }
+   LOGINFO << "UTXOs over " << depth << " sub-histories, full load: "
+      << perRound(fullTime) << "us, unspent only: " 
+      << perRound(rangeTime) << "us";
+}
 
+////////////////////////////////////////////////////////////////////////////////
+class BlockUtilsBench : public BlockUtilsBare
+{};
 
-   /////////////////////////////////////////////////////////////////////////////
-   void rmdir(string src)
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBench, DISABLED_FlushPolicies)
+{
+   struct PolicyRun
    {
-      char* syscmd = new char[4096];
-      sprintf(syscmd, "rm -rf %s", src.c_str());
-      system(syscmd);
-      delete[] syscmd;
-   }
+      string name_;
+      bool adaptive_;
+      uint64_t memoryCap_;
+   };
 
-   /////////////////////////////////////////////////////////////////////////////
-   void mkdir(string newdir)
+   const vector<PolicyRun> runs =
    {
-      char* syscmd = new char[4096];
-      sprintf(syscmd, "mkdir -p %s", newdir.c_str());
-      system(syscmd);
-      delete[] syscmd;
+      { "fixed", false, 0 },
+      { "adaptive", true, 0 },
+      { "adaptive, 64kB cap", true, 64 * 1024 },
+      { "adaptive, 8kB cap", true, 8 * 1024 },
+   };
+
+   for (auto& run : runs)
+   {
+      config.adaptiveFlush = run.adaptive_;
+      config.flushMemoryCap = run.memoryCap_;
+      restartBDM();
+
+      BtcWallet* wlt;
+      regWallet({ TestChain::scrAddrA, TestChain::scrAddrB, 
+         TestChain::scrAddrC, TestChain::scrAddrD, TestChain::scrAddrE,
+         TestChain::scrAddrF }, "wallet1", theBDV, &wlt);
+
+      auto start = ScanTelemetry::now();
+      TheBDM.doInitialSyncOnLoad(nullProgress);
+      theBDV->scanWallets();
+      uint64_t elapsedUs = ScanTelemetry::now() - start;
+      auto flush = TheBDM.getScanTelemetry().getStats(ScanStage_Scan).flush_;
+
+      LOGINFO << "flush policy " << run.name_ << ": " 
+         << elapsedUs / 1000 << "ms, " << flush.commits_ 
+         << " commits, " << flush.bytes_ << " bytes, threshold "
+         << flush.bytesThreshold_ << ", serialize " 
+         << flush.serializeUs_ << "us, write " 
+         << flush.writeUs_ << "us";
    }
-#endif
+}
 
-   LMDBBlockDatabase* iface_;
-   BinaryData magic_;
-   BinaryData ghash_;
-   BinaryData gentx_;
-   BinaryData zeros_;
 
-   string blkdir_;
-   string homedir_;
-   string ldbdir_;
-   string blk0dat_;
+#ifndef _WIN32
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockUtilsBench, DISABLED_ReadOnlyAttach_QueryThroughput)
+{
+   TheBDM.doInitialSyncOnLoad(nullProgress);
 
-};
+   for (unsigned nProcs : { 1, 2, 4 })
+   {
+      uint64_t queries = runReadOnlyReaders(config, nProcs, UINT64_MAX, 
+         chrono::milliseconds(250));
+      LOGINFO << nProcs << " read-only processes: " 
+         << queries * 4 << " queries/s";
+   }
+}
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsWithWalletTest, TestBalanceMainnet_usuallydisabled)
+TEST_F(BlockUtilsBench, DISABLED_ScanWatermark)
 {
-   TheBDM.doInitialSyncOnLoad([] (double,unsigned) {});
-
-   // We do all the database stuff first, THEN load the addresses
-   BtcWallet wlt(theBDM);
-   wlt.addScrAddress(TestChain::scrAddrA);
-   wlt.addScrAddress(TestChain::scrAddrB);
-   TheBDM.registerWallet(&wlt);
-   TheBDM.registerNewScrAddr(TestChain::scrAddrD);
-   TheBDM.fetchAllRegisteredScrAddrData();
-   TheBDM.scanRegisteredTxForWallet(wlt);
+   //10k idle scrAddrs next to the test chain wallet, SSH rewrite versus the
+   //scan watermark
+   vector<BinaryData> scrAddrVec =
+   {
+      TestChain::scrAddrA, TestChain::scrAddrB, TestChain::scrAddrC,
+      TestChain::scrAddrD, TestChain::scrAddrE, TestChain::scrAddrF
+   };
 
-   uint64_t balanceWlt;
-   uint64_t balanceDB;
-   
-   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrA).getFullBalance();
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrA);
-   EXPECT_EQ(balanceWlt,  100*COIN);
-   EXPECT_EQ(balanceDB,   100*COIN);
-   
-   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrB).getFullBalance();
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrB);
-   EXPECT_EQ(balanceWlt,    0*COIN);
-   EXPECT_EQ(balanceDB,     0*COIN);
+   auto idleScrAddrs = makeIdleScrAddrs(10000);
+   scrAddrVec.insert(scrAddrVec.end(), 
+      idleScrAddrs.begin(), idleScrAddrs.end());
 
-   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrC).getFullBalance();
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrC);
-   EXPECT_EQ(balanceWlt,   50*COIN);
-   EXPECT_EQ(balanceDB,    50*COIN);
+   for (bool useWatermark : { false, true })
+   {
+      auto flush = scanWithWatermark(useWatermark, scrAddrVec);
 
-   balanceWlt = wlt.getScrAddrObjByKey(TestChain::scrAddrD).getFullBalance();
-   balanceDB  = iface_->getBalanceForScrAddr(TestChain::scrAddrD);
-   EXPECT_EQ(balanceWlt,    0*COIN);  // D is not part of the wallet
-   EXPECT_EQ(balanceDB,   100*COIN);
+      LOGINFO << (useWatermark ? "scan watermark" : "ssh rewrite")
+         << ": " << flush.sshWritten_ / 3 << " ssh, " << flush.sshBytes_ / 3 
+         << " bytes, " << (flush.serializeUs_ + flush.writeUs_) / 3 
+         << "us per block";
+   }
 }
-*/
 
 ////////////////////////////////////////////////////////////////////////////////
-TEST_F(BlockUtilsWithWalletTest, ZeroConfUpdate)
+TEST_F(BlockUtilsBench, DISABLED_UtxoSet)
 {
-   // Copy only the first two blocks
-   setBlocks({"0", "1"}, blk0dat_);
-
-   vector<BinaryData> scrAddrVec;
-   scrAddrVec.push_back(TestChain::scrAddrA);
-   scrAddrVec.push_back(TestChain::scrAddrB);
-   scrAddrVec.push_back(TestChain::scrAddrC);
+   //100k UTxOs on idle scrAddrs, rebuilt by each batcher versus kept in the
+   //BDM's UTxO set
+   const uint32_t utxosPerScrAddr = 10;
+   auto idleScrAddrs = makeIdleScrAddrs(10000);
+   vector<uint64_t> blockUs;
 
-   BtcWallet& wlt = *theBDV->registerWallet(scrAddrVec, "wallet1", false);
-   wlt.addScrAddress(TestChain::scrAddrD);
+   for (bool useSet : { false, true })
+   {
+      scanIdleUtxos(useSet, idleScrAddrs, utxosPerScrAddr, blockUs);
 
-   TheBDM.doInitialSyncOnLoad(nullProgress);
-   theBDV->enableZeroConf();
-   theBDV->scanWallets();
+      LOGINFO << (useSet ? "utxo set" : "utxo rebuild")
+         << ": first block " << blockUs[0] << "us, then " 
+         << (blockUs[1] + blockUs[2]) / 2 << "us per block";
+   }
+}
 
-   BinaryData ZChash = READHEX("b6b6f145742a9072fd85f96772e63a00eb4101709aa34ec5dd59e8fc904191a7");
-   BinaryData rawZC(259);
-   FILE *ff = fopen("../reorgTest/ZCtx.tx", "rb");
-   fread(rawZC.getPtr(), 259, 1, ff);
-   fclose(ff);
+////////////////////////////////////////////////////////////////////////////////
+class BlockDirBench : public BlockDir
+{};
 
-   theBDV->addNewZeroConfTx(rawZC, 1300000000, false);
-   theBDV->parseNewZeroConfTx();
-   theBDV->scanWallets();
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(BlockDirBench, DISABLED_HeaderResume)
+{
+   BlockDataManagerConfig config;
+   config.armoryDbType = ARMORY_DB_BARE;
+   config.pruneType = DB_PRUNE_NONE;
+   config.blkFileLocation = blkdir_;
+   config.levelDBLocation = ldbdir_;
+   
+   config.genesisBlockHash = READHEX(MAINNET_GENESIS_HASH_HEX);
+   config.genesisTxHash = READHEX(MAINNET_GENESIS_TX_HASH_HEX);
+   config.magicBytes = READHEX(MAINNET_MAGIC_BYTES);
 
-   EXPECT_EQ(wlt.getScrAddrObjByKey(TestChain::scrAddrA)->getFullBalance(),  50*COIN);
-   EXPECT_EQ(wlt.getScrAddrObjByKey(TestChain::scrAddrB)->getFullBalance(),  70*COIN);
-   EXPECT_EQ(wlt.getScrAddrObjByKey(TestChain::scrAddrC)->getFullBalance(),  10*COIN);
-   EXPECT_EQ(wlt.getScrAddrObjByKey(TestChain::scrAddrD)->getFullBalance(),   0*COIN);
+   std::string blk1dat = BtcUtils::getBlkFilename(blkdir_, 1);
+   std::string blk2dat = BtcUtils::getBlkFilename(blkdir_, 2);
+   setBlocks({ "0", "1" }, blk0dat_);
+   setBlocks({ "2", "3" }, blk1dat);
+   setBlocks({ "4", "5" }, blk2dat);
 
-   //test ledger entry
-   LedgerEntry le = wlt.getLedgerEntryForTx(ZChash);
+   BlockDataManager_LevelDB bdm(config);
+   bdm.openDatabase();
+   bdm.doInitialSyncOnLoad(nullProgress);
 
-   EXPECT_EQ(le.getTxTime(), 1300000000);
-   EXPECT_EQ(le.isSentToSelf(), false);
-   EXPECT_EQ(le.getValue(), 30*COIN);
+   auto shiftWatermark = [&](int shift)->void
+   {
+      LMDBBlockDatabase* iface = bdm.getIFace();
+      LMDBEnv::Transaction tx;
+      iface->beginDBTransaction(&tx, HEADERS, LMDB::ReadWrite);
+
+      uint32_t fileNum;
+      uint64_t offset;
+      StoredBlockFilePos lastHeader;
+      ASSERT_TRUE(iface->getBlockFileWatermark(fileNum, offset, lastHeader));
+      lastHeader.offset_ += shift;
+      iface->putBlockFileWatermark(fileNum, offset, lastHeader);
+   };
 
-   //check ZChash in DB
-   BinaryData zcKey = WRITE_UINT16_BE(0xFFFF);
-   zcKey.append(WRITE_UINT32_LE(0));
-   EXPECT_EQ(iface_->getTxHashForLdbKey(zcKey), ZChash);
-}
+   const uint32_t rounds = 100;
+   auto timeRounds = [&](void)->uint64_t
+   {
+      auto start = ScanTelemetry::now();
+      for (uint32_t i = 0; i < rounds; i++)
+         bdm.findHeaderResumePosition();
+      return ScanTelemetry::now() - start;
+   };
 
-// This was really just to time the logging to determine how much impact it 
-// has.  It looks like writing to file is about 1,000,000 logs/sec, while 
-// writing to the null stream (below the threshold log level) is about 
-// 2,200,000/sec.    As long as we use log messages sparingly (and timer
-// calls which call the logger), there will be no problem leaving them
-// on even in production code.
-/*
-TEST(TimeDebugging, WriteToLogNoStdOut)
-{
-   LOGDISABLESTDOUT();
-   for(uint32_t i=0; i<1000000; i++)
-      LOGERR << "Testing writing out " << 3 << " diff things";
-   LOGENABLESTDOUT();
-}
+   uint64_t watermarkUs = timeRounds();
+   shiftWatermark(1);
+   uint64_t searchUs = timeRounds();
+   shiftWatermark(-1);
 
-TEST(TimeDebugging, WriteNull)
-{
-   for(uint32_t i=0; i<1000000; i++)
-      LOGDEBUG4 << "Testing writing out " << 3 << " diff things";
+   LOGINFO << "resume point over 3 blk files: watermark " 
+      << watermarkUs * 1000 / rounds << "ns, header search " 
+      << searchUs * 1000 / rounds << "ns";
 }
-*/
-
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -21,6 +21,60 @@
 
 struct MDB_val;
 
+////////////////////////////////////////////////////////////////////////////////
+// PREFIX_SCRIPT + scrAddr + hgtX keys for SSH lookups. Regular scrAddrs fit 
+// the stack buffer, only oversized ones go to the heap
+class SubSSHKey
+{
+   uint8_t stack_[64];
+   vector<uint8_t> heap_;
+   uint8_t* ptr_;
+   const size_t sshKeySize_;
+
+public:
+   SubSSHKey(BinaryDataRef scrAddr)
+      : sshKeySize_(scrAddr.getSize() + 1)
+   {
+      ptr_ = stack_;
+      if (sshKeySize_ + 4 > sizeof(stack_))
+      {
+         heap_.resize(sshKeySize_ + 4);
+         ptr_ = &heap_[0];
+      }
+
+      ptr_[0] = (uint8_t)DB_PREFIX_SCRIPT;
+      memcpy(ptr_ + 1, scrAddr.getPtr(), scrAddr.getSize());
+      memset(ptr_ + sshKeySize_, 0, 4);
+   }
+
+   SubSSHKey(const SubSSHKey&) = delete;
+   SubSSHKey& operator=(const SubSSHKey&) = delete;
+
+   void setHeight(uint32_t height, uint8_t dup = 0)
+   {
+      //hgtX is the 3 byte big endian height followed by the dupID
+      if (height > 0x00FFFFFF)
+         height = 0x00FFFFFF;
+
+      uint8_t* hgtX = ptr_ + sshKeySize_;
+      hgtX[0] = (uint8_t)(height >> 16);
+      hgtX[1] = (uint8_t)(height >> 8);
+      hgtX[2] = (uint8_t)height;
+      hgtX[3] = dup;
+   }
+
+   void setHgtX(BinaryDataRef hgtX)
+   {
+      memcpy(ptr_ + sshKeySize_, hgtX.getPtr(), 4);
+   }
+
+   BinaryDataRef getSSHKey(void) const 
+   { return BinaryDataRef(ptr_, sshKeySize_); }
+   
+   BinaryDataRef getSubKey(void) const 
+   { return BinaryDataRef(ptr_, sshKeySize_ + 4); }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 LDBIter::LDBIter(LMDB::Iterator&& mv)
    : iter_(std::move(mv))
@@ -497,13 +551,14 @@ void LMDBBlockDatabase::openDatabases(
    for (int i = 0; i < COUNT; i++)
       dbEnv_[DB_SELECT(i)].reset(new LMDBEnv());
 
-   dbEnv_[BLKDATA]->open(dbBlkdataFilename());
+   dbEnv_[BLKDATA]->open(dbBlkdataFilename(), readOnly_);
 
    //make sure it's a fullnode DB
    {
       LMDB checkDBType;
       const char* dataPtr = nullptr;
 
+      try
       {
          LMDBEnv::Transaction tx(dbEnv_[BLKDATA].get(), LMDB::ReadWrite);
          checkDBType.open(dbEnv_[BLKDATA].get(), "blkdata");
@@ -513,6 +568,13 @@ void LMDBBlockDatabase::openDatabases(
 
          dataPtr = data.data;
       }
+      catch (LMDBException&)
+      {
+         //read only envs can't create the supernode db to check it, 
+         //so it not being there is the answer
+         if (!readOnly_)
+            throw;
+      }
 
       checkDBType.close();
 
@@ -527,9 +589,9 @@ void LMDBBlockDatabase::openDatabases(
 
 
 
-   dbEnv_[HEADERS]->open(dbHeadersFilename());
-   dbEnv_[HISTORY]->open(dbHistoryFilename());
-   dbEnv_[TXHINTS]->open(dbTxhintsFilename());
+   dbEnv_[HEADERS]->open(dbHeadersFilename(), readOnly_);
+   dbEnv_[HISTORY]->open(dbHistoryFilename(), readOnly_);
+   dbEnv_[TXHINTS]->open(dbTxhintsFilename(), readOnly_);
 
    map<DB_SELECT, string> DB_NAMES;
    DB_NAMES[HEADERS] = "headers";
@@ -552,7 +614,11 @@ void LMDBBlockDatabase::openDatabases(
 
          StoredDBInfo sdbi;
          getStoredDBInfo(CURRDB, sdbi, false);
-         if (!sdbi.isInitialized())
+         if (!sdbi.isInitialized() && readOnly_)
+         {
+            throw runtime_error("No database to attach to");
+         }
+         else if (!sdbi.isInitialized())
          {
             // If DB didn't exist yet (dbinfo key is empty), seed it
             // A new database has the maximum flag settings
@@ -642,7 +708,7 @@ void LMDBBlockDatabase::openDatabasesSupernode(
    closeDatabasesSupernode();
    
    dbEnv_[BLKDATA].reset(new LMDBEnv());
-   dbEnv_[BLKDATA]->open(dbBlkdataFilename());
+   dbEnv_[BLKDATA]->open(dbBlkdataFilename(), readOnly_);
    
    map<DB_SELECT, string> DB_NAMES;
    DB_NAMES[HEADERS] = "headers";
@@ -659,7 +725,11 @@ void LMDBBlockDatabase::openDatabasesSupernode(
 
          StoredDBInfo sdbi;
          getStoredDBInfo(CURRDB, sdbi, false); 
-         if(!sdbi.isInitialized())
+         if (!sdbi.isInitialized() && readOnly_)
+         {
+            throw runtime_error("No database to attach to");
+         }
+         else if(!sdbi.isInitialized())
          {
             // If DB didn't exist yet (dbinfo key is empty), seed it
             // A new database has the maximum flag settings
@@ -1137,10 +1207,10 @@ bool LMDBBlockDatabase::readStoredScriptHistoryAtIter(LDBIter & ldbIter,
 
    if (startBlock != 0)
    {
-      BinaryData dbkey_withHgtX(sshKey);
-      dbkey_withHgtX.append(DBUtils::heightAndDupToHgtx(startBlock, 0));
+      SubSSHKey dbkey_withHgtX(scrAddr);
+      dbkey_withHgtX.setHeight(startBlock);
       
-      if (!ldbIter.seekTo(dbkey_withHgtX))
+      if (!ldbIter.seekTo(dbkey_withHgtX.getSubKey()))
          return false;
    }
    else
@@ -1290,15 +1360,14 @@ bool LMDBBlockDatabase::getStoredScriptHistory( StoredScriptHistory & ssh,
 bool LMDBBlockDatabase::getStoredSubHistoryAtHgtX(StoredSubHistory& subssh,
    const BinaryData& scrAddrStr, const BinaryData& hgtX) const
 {
-   BinaryWriter bw(scrAddrStr.getSize() + hgtX.getSize());
-   bw.put_BinaryData(scrAddrStr);
-   bw.put_BinaryData(hgtX);
+   SubSSHKey subKey(scrAddrStr);
+   subKey.setHgtX(hgtX);
 
    LMDBEnv::Transaction tx;
    beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
    LDBIter ldbIter = getIterator(getDbSelect(HISTORY));
 
-   if (!ldbIter.seekToExact(DB_PREFIX_SCRIPT, bw.getDataRef()))
+   if (!ldbIter.seekToExact(subKey.getSubKey()))
       return false;
 
    subssh.hgtX_ = hgtX;
@@ -1331,8 +1400,9 @@ bool LMDBBlockDatabase::fetchStoredSubHistory( StoredScriptHistory & ssh,
       return true;
    }
 
-   BinaryData key = ssh.uniqueKey_ + hgtX; 
-   BinaryRefReader brr = getValueReader(BLKDATA, DB_PREFIX_SCRIPT, key);
+   SubSSHKey subKey(ssh.uniqueKey_);
+   subKey.setHgtX(hgtX);
+   BinaryRefReader brr = getValueReader(BLKDATA, subKey.getSubKey());
 
    StoredSubHistory subssh;
    subssh.uniqueKey_ = ssh.uniqueKey_;
@@ -1349,27 +1419,117 @@ bool LMDBBlockDatabase::fetchStoredSubHistory( StoredScriptHistory & ssh,
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+uint32_t LMDBBlockDatabase::readSubHistories(BinaryDataRef scrAddrStr,
+   uint32_t startBlock, uint32_t endBlock, bool unspentOnly,
+   const function<bool(StoredSubHistory&)>& callback) const
+{
+   SubSSHKey subKey(scrAddrStr);
+   subKey.setHeight(startBlock);
+   BinaryDataRef sshKey = subKey.getSSHKey();
+   const size_t subKeySize = sshKey.getSize() + 4;
+
+   LMDBEnv::Transaction tx;
+   beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+   LDBIter ldbIter = getIterator(getDbSelect(HISTORY));
+
+   //straight to the first hgtX in range, past the SSH summary
+   if (!ldbIter.seekTo(subKey.getSubKey()))
+      return 0;
+
+   uint32_t count = 0;
+   do
+   {
+      BinaryDataRef key = ldbIter.getKeyRef();
+      if (!key.startsWith(sshKey))
+         break;
+
+      //longer scrAddrs sharing our bytes sort in between
+      if (key.getSize() != subKeySize)
+         continue;
+
+      BinaryDataRef hgtX = key.getSliceRef(sshKey.getSize(), 4);
+      if (DBUtils::hgtxToHeight(hgtX) > endBlock)
+         break;
+
+      if (unspentOnly &&
+          StoredSubHistory::peekUTXOCount(ldbIter.getValueRef()) == 0)
+         continue;
+
+      StoredSubHistory subssh;
+      subssh.unserializeDBKey(key);
+      subssh.unserializeDBValue(ldbIter.getValueReader());
+
+      count++;
+      if (!callback(subssh))
+         break;
+   } 
+   while (ldbIter.advanceAndRead(DB_PREFIX_SCRIPT));
+
+   return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::getUTXOMapForScrAddr(BinaryDataRef scrAddrStr,
+   map<BinaryData, UnspentTxOut> & mapToFill, bool withMultisig,
+   uint32_t startBlock, uint32_t endBlock)
+{
+   LMDBEnv::Transaction tx;
+   beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+
+   auto addUTXOs = [&](StoredSubHistory& subssh)->bool
+   {
+      for (const auto& txioPair : subssh.txioMap_)
+      {
+         const TxIOPair & txio = txioPair.second;
+         if (!txio.isUTXO())
+            continue;
+
+         if (txio.isMultisig() && !withMultisig)
+            continue;
+
+         BinaryData txoKey = txio.getDBKeyOfOutput();
+         StoredTxOut stxo;
+         getStoredTxOut(stxo, txoKey);
+         BinaryData txHash = getTxHashForLdbKey(txoKey.getSliceRef(0, 6));
+
+         mapToFill[txoKey] = UnspentTxOut(
+            txHash,
+            txio.getIndexOfOutput(),
+            stxo.blockHeight_,
+            txio.getValue(),
+            stxo.getScriptRef());
+      }
+
+      return true;
+   };
+
+   readSubHistories(scrAddrStr, startBlock, endBlock, true, addUTXOs);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 uint64_t LMDBBlockDatabase::getBalanceForScrAddr(BinaryDataRef scrAddr, bool withMulti)
 {
    StoredScriptHistory ssh;
+   getStoredScriptHistorySummary(ssh, scrAddr); 
    if(!withMulti)
-   {
-      getStoredScriptHistorySummary(ssh, scrAddr); 
       return ssh.totalUnspent_;
-   }
-   else
+
+   //multisig references are not part of the summary balance
+   uint64_t total = ssh.totalUnspent_;
+   auto addMultisig = [&total](StoredSubHistory& subssh)->bool
    {
-      getStoredScriptHistory(ssh, scrAddr);
-      uint64_t total = ssh.totalUnspent_;
-      map<BinaryData, UnspentTxOut> utxoList;
-      map<BinaryData, UnspentTxOut>::iterator iter;
-      getFullUTXOMapForSSH(ssh, utxoList, true);
-      for(iter = utxoList.begin(); iter != utxoList.end(); iter++)
-         if(iter->second.isMultisigRef())
-            total += iter->second.getValue();
-      return total;
-   }
+      for (const auto& txioPair : subssh.txioMap_)
+      {
+         if (txioPair.second.isUTXO() && txioPair.second.isMultisig())
+            total += txioPair.second.getValue();
+      }
+
+      return true;
+   };
+
+   readSubHistories(scrAddr, 0, UINT32_MAX, true, addMultisig);
+   return total;
 }
 
 
@@ -1509,6 +1669,42 @@ void LMDBBlockDatabase::readAllHeaders(
    } while(ldbIter.advanceAndRead(DB_PREFIX_HEADHASH));
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::readHeadersFromHeight(uint32_t fromHeight,
+   const function<void(const BlockHeader&, uint32_t, uint8_t)> &callback
+)
+{
+   LMDBEnv::Transaction tx;
+   beginDBTransaction(&tx, HEADERS, LMDB::ReadOnly);
+
+   LDBIter ldbIter = getIterator(HEADERS);
+   if (!ldbIter.seekTo(DB_PREFIX_HEADHGT, WRITE_UINT32_BE(fromHeight)))
+      return;
+
+   StoredHeader sbh;
+   BlockHeader  regHead;
+   do
+   {
+      ldbIter.resetReaders();
+      if (!ldbIter.verifyPrefix(DB_PREFIX_HEADHGT))
+         break;
+
+      StoredHeadHgtList hhl;
+      hhl.unserializeDBValue(ldbIter.getValueReader());
+
+      for (const auto& dupAndHash : hhl.dupAndHashList_)
+      {
+         if (!getBareHeader(sbh, dupAndHash.second))
+            continue;
+
+         regHead.unserialize(sbh.dataCopy_);
+         regHead.setBlockSize(sbh.numBytes_);
+         callback(regHead, sbh.blockHeight_, sbh.duplicateID_);
+      }
+
+   } while (ldbIter.advanceAndRead(DB_PREFIX_HEADHGT));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 uint8_t LMDBBlockDatabase::getValidDupIDForHeight(uint32_t blockHgt) const
 {
@@ -3183,6 +3379,377 @@ bool LMDBBlockDatabase::getStoredHeadHgtList(StoredHeadHgtList & hhl, uint32_t h
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::putStoredBlockFilter(StoredBlockFilter const & sbf)
+{
+   if (sbf.isNull())
+   {
+      LOGERR << "Block filter has no height and dup to be put into DB";
+      return false;
+   }
+
+   putValue(BLKDATA, sbf.getDBKey(), sbf.serializeDBValue());
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getStoredBlockFilter(StoredBlockFilter & sbf,
+   uint32_t height, uint8_t dup) const
+{
+   sbf.height_ = height;
+   sbf.duplicateID_ = dup;
+
+   BinaryDataRef bdr = getValueRef(BLKDATA, sbf.getDBKey());
+   if (bdr.getSize() == 0)
+      return false;
+
+   sbf.unserializeDBValue(bdr);
+   return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putScanCheckpoint(StoredScanCheckpoint const & sscp)
+{
+   if (sscp.isNull())
+   {
+      LOGERR << "Tried to put an uninitialized scan checkpoint into DB";
+      return;
+   }
+
+   LMDBEnv::Transaction tx;
+   beginDBTransaction(&tx, HISTORY, LMDB::ReadWrite);
+   putValue(getDbSelect(HISTORY), StoredScanCheckpoint::getDBKey(), 
+      sscp.serializeDBValue());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getScanCheckpoint(StoredScanCheckpoint & sscp)
+{
+   LMDBEnv::Transaction tx;
+   beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+
+   BinaryDataRef bdr = getValueRef(
+      getDbSelect(HISTORY), StoredScanCheckpoint::getDBKey());
+   if (bdr.getSize() == 0)
+      return false;
+
+   sscp.unserializeDBValue(bdr);
+   return sscp.isInitialized();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::deleteScanCheckpoint(void)
+{
+   LMDBEnv::Transaction tx;
+   beginDBTransaction(&tx, HISTORY, LMDB::ReadWrite);
+   deleteValue(getDbSelect(HISTORY), StoredScanCheckpoint::getDBKey());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putStoredLedgerCache(StoredLedgerCache const & slc)
+{
+   if (slc.isNull())
+   {
+      LOGERR << "Tried to put an uninitialized ledger cache entry into DB";
+      return;
+   }
+
+   putValue(getDbSelect(HISTORY), slc.getDBKey(), slc.serializeDBValue());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getStoredLedgerCache(StoredLedgerCache & slc,
+   BinaryDataRef walletID, BinaryDataRef fingerprint, uint32_t height) const
+{
+   slc.walletID_ = walletID;
+   slc.scrAddrFingerprint_ = fingerprint;
+   slc.height_ = height;
+
+   BinaryDataRef bdr = getValueRef(getDbSelect(HISTORY), slc.getDBKey());
+   if (bdr.getSize() == 0)
+   {
+      slc.height_ = UINT32_MAX;
+      return false;
+   }
+
+   slc.unserializeDBValue(bdr);
+   return slc.isInitialized();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+BinaryData LMDBBlockDatabase::getLedgerCacheFingerprint(
+   BinaryDataRef walletID) const
+{
+   LMDBEnv::Transaction tx;
+   beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+
+   return BinaryData(getValueRef(getDbSelect(HISTORY), 
+      StoredLedgerCache::getDBKeyPrefix(walletID)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::resetLedgerCache(BinaryDataRef walletID,
+   BinaryDataRef fingerprint)
+{
+   auto dbs = getDbSelect(HISTORY);
+   BinaryData prefix = StoredLedgerCache::getDBKeyPrefix(walletID);
+
+   vector<BinaryData> keysToDelete;
+   {
+      LMDBEnv::Transaction tx;
+      beginDBTransaction(&tx, HISTORY, LMDB::ReadOnly);
+      LDBIter dbIter(getIterator(dbs));
+
+      if (dbIter.seekToStartsWith(prefix))
+      {
+         do
+         {
+            keysToDelete.push_back(dbIter.getKey());
+         } while (dbIter.advance() && dbIter.checkKeyStartsWith(prefix));
+      }
+   }
+
+   LMDBEnv::Transaction tx;
+   beginDBTransaction(&tx, HISTORY, LMDB::ReadWrite);
+
+   for (auto& key : keysToDelete)
+      deleteValue(dbs, key);
+
+   putValue(dbs, prefix.getRef(), fingerprint);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t LMDBBlockDatabase::getScanWatermark(void) const
+{
+   BinaryDataRef bdr = 
+      getValueRef(HISTORY, StoredDBInfo::getScanWatermarkKey());
+   if (bdr.getSize() < 4)
+      return UINT32_MAX;
+
+   return READ_UINT32_LE(bdr.getPtr());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t LMDBBlockDatabase::getScanGeneration(void) const
+{
+   BinaryDataRef bdr = 
+      getValueRef(HISTORY, StoredDBInfo::getScanWatermarkKey());
+   if (bdr.getSize() != 8)
+      return 0;
+
+   return READ_UINT32_LE(bdr.getPtr() + 4);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putScanWatermark(uint32_t height, uint32_t generation)
+{
+   BinaryWriter bw(8);
+   bw.put_uint32_t(height);
+   bw.put_uint32_t(generation);
+   putValue(HISTORY, StoredDBInfo::getScanWatermarkKey(), bw.getData());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putStoredAddrSummary(StoredAddrSummary const & sas)
+{
+   if (sas.isNull())
+   {
+      deleteValue(BLKDATA, sas.getDBKey());
+      return;
+   }
+
+   putValue(BLKDATA, sas.getDBKey(), sas.serializeDBValue());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getStoredAddrSummary(StoredAddrSummary & sas,
+   BinaryDataRef scrAddr) const
+{
+   sas = StoredAddrSummary();
+   sas.scrAddr_ = scrAddr;
+
+   BinaryDataRef bdr = getValueRef(BLKDATA, StoredAddrSummary::getDBKey(scrAddr));
+   if (bdr.getSize() == 0)
+      return false;
+
+   sas.unserializeDBValue(bdr);
+   return sas.isInitialized();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t LMDBBlockDatabase::getAddrSummaryStartHeight(void) const
+{
+   BinaryDataRef bdr = 
+      getValueRef(BLKDATA, StoredAddrSummary::getStartHeightDBKey());
+   if (bdr.getSize() != 4)
+      return UINT32_MAX;
+
+   return READ_UINT32_LE(bdr.getPtr());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putAddrSummaryStartHeight(uint32_t height)
+{
+   putValue(BLKDATA, StoredAddrSummary::getStartHeightDBKey(),
+      WRITE_UINT32_LE(height));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putStoredUtxo(StoredUtxo const & stu)
+{
+   if (stu.isNull())
+   {
+      deleteValue(HISTORY, stu.getDBKey());
+      return;
+   }
+
+   putValue(HISTORY, stu.getDBKey(), stu.serializeDBValue());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getStoredUtxo(StoredUtxo & stu,
+   BinaryDataRef hashAndId) const
+{
+   stu = StoredUtxo();
+   stu.hashAndId_ = hashAndId;
+
+   BinaryDataRef bdr = getValueRef(HISTORY, StoredUtxo::getDBKey(hashAndId));
+   if (bdr.getSize() == 0)
+      return false;
+
+   stu.unserializeDBValue(bdr);
+   return stu.isInitialized();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+uint32_t LMDBBlockDatabase::getUtxoTableStartHeight(void) const
+{
+   BinaryDataRef bdr = 
+      getValueRef(HISTORY, StoredUtxo::getStartHeightDBKey());
+   if (bdr.getSize() != 4)
+      return UINT32_MAX;
+
+   return READ_UINT32_LE(bdr.getPtr());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putUtxoTableStartHeight(uint32_t height)
+{
+   putValue(HISTORY, StoredUtxo::getStartHeightDBKey(),
+      WRITE_UINT32_LE(height));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putBlockFilePos(StoredBlockFilePos const & sbfp)
+{
+   putValue(HEADERS, sbfp.getDBKey(), sbfp.serializeDBValue());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getBlockFilePos(StoredBlockFilePos & sbfp,
+   BinaryDataRef hash) const
+{
+   sbfp = StoredBlockFilePos();
+   sbfp.hash_ = hash;
+
+   BinaryDataRef bdr = getValueRef(HEADERS, StoredBlockFilePos::getDBKey(hash));
+   if (bdr.getSize() == 0)
+      return false;
+
+   sbfp.unserializeDBValue(bdr);
+   return sbfp.isInitialized();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getBlockFileWatermark(uint32_t& fileNum, 
+   uint64_t& offset, StoredBlockFilePos & lastHeader) const
+{
+   lastHeader = StoredBlockFilePos();
+
+   BinaryDataRef bdr = 
+      getValueRef(HEADERS, StoredBlockFilePos::getWatermarkDBKey());
+   if (bdr.getSize() != 12 + 32 + 16)
+      return false;
+
+   BinaryRefReader brr(bdr);
+   fileNum = brr.get_uint32_t();
+   offset = brr.get_uint64_t();
+   lastHeader.hash_ = brr.get_BinaryData(32);
+   lastHeader.unserializeDBValue(brr);
+
+   return lastHeader.isInitialized();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::putBlockFileWatermark(uint32_t fileNum, 
+   uint64_t offset, StoredBlockFilePos const & lastHeader)
+{
+   BinaryWriter bw;
+   bw.put_uint32_t(fileNum);
+   bw.put_uint64_t(offset);
+   bw.put_BinaryData(lastHeader.hash_);
+   lastHeader.serializeDBValue(bw);
+
+   putValue(HEADERS, StoredBlockFilePos::getWatermarkDBKey(), bw.getData());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool LMDBBlockDatabase::getSubHistoryHeightRange(BinaryDataRef scrAddr,
+   uint32_t& first, uint32_t& last) const
+{
+   first = UINT32_MAX;
+   last = 0;
+
+   BinaryWriter bwKey(scrAddr.getSize() + 1);
+   bwKey.put_uint8_t((uint8_t)DB_PREFIX_SCRIPT);
+   bwKey.put_BinaryData(scrAddr);
+   const size_t subKeySize = bwKey.getSize() + 4;
+
+   LDBIter dbIter(getIterator(BLKDATA));
+   if (!dbIter.seekToStartsWith(bwKey.getDataRef()))
+      return false;
+
+   do
+   {
+      BinaryDataRef key = dbIter.getKeyRef();
+      if (key.getSize() != subKeySize)
+         continue;
+
+      uint32_t height = DBUtils::hgtxToHeight(key.getSliceCopy(-4, 4));
+      first = min(first, height);
+      last = max(last, height);
+   } while (dbIter.advance() && dbIter.checkKeyStartsWith(bwKey.getDataRef()));
+
+   return first != UINT32_MAX;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void LMDBBlockDatabase::deleteAddrSummaries(void)
+{
+   BinaryData prefix = WRITE_UINT8_LE((uint8_t)DB_PREFIX_ADDRSUMMARY);
+
+   vector<BinaryData> keysToDelete;
+   {
+      LMDBEnv::Transaction tx;
+      beginDBTransaction(&tx, BLKDATA, LMDB::ReadOnly);
+      LDBIter dbIter(getIterator(BLKDATA));
+
+      if (dbIter.seekToStartsWith(prefix))
+      {
+         do
+         {
+            keysToDelete.push_back(dbIter.getKey());
+         } while (dbIter.advance() && dbIter.checkKeyStartsWith(prefix));
+      }
+   }
+
+   LMDBEnv::Transaction tx;
+   beginDBTransaction(&tx, BLKDATA, LMDB::ReadWrite);
+
+   for (auto& key : keysToDelete)
+      deleteValue(BLKDATA, key);
+}
+
 
 
 
@@ -3648,6 +4215,25 @@ uint8_t LMDBBlockDatabase::putRawBlockData(BinaryRefReader& brr,
          LMDBEnv::Transaction tx(dbEnv_[BLKDATA].get(), LMDB::ReadWrite);
          BinaryData dbKey(sbh.getDBKey(true));
          putValue(BLKDATA, BinaryDataRef(dbKey), brr.getRawRef());
+
+         if (buildBlockFilters_)
+         {
+            StoredBlockFilter sbf;
+            sbf.height_ = sbh.blockHeight_;
+            sbf.duplicateID_ = sbh.duplicateID_;
+
+            try
+            {
+               sbf.createFromRawBlock(brr.getRawRef());
+               putStoredBlockFilter(sbf);
+            }
+            catch (BlockDeserializingException&)
+            {
+               //no filter means scans will always pull this block
+               LOGWARN << "Could not compute filter for block at height "
+                  << sbh.blockHeight_;
+            }
+         }
       }
       catch (std::range_error&)
       {
@@ -366,6 +366,11 @@ public:
       const function<void(const BlockHeader&, uint32_t, uint8_t)> &callback
    );
 
+   //the headers at fromHeight and above, through the height lists
+   void readHeadersFromHeight(uint32_t fromHeight,
+      const function<void(const BlockHeader&, uint32_t, uint8_t)> &callback
+   );
+
    /////////////////////////////////////////////////////////////////////////////
    // When we're not in supernode mode, we're going to need to track only 
    // specific addresses.  We will keep a list of those addresses here.
@@ -547,6 +552,21 @@ public:
       map<BinaryData, UnspentTxOut> & mapToFill,
       bool withMultisig = false);
 
+   // Range bounded walk over the sub-histories of a scrAddr: seeks to the 
+   // first hgtX at or past startBlock and stops past endBlock. unspentOnly 
+   // skips sub-histories without UTXOs before unserializing them. Return 
+   // false from the callback to stop. Returns how many were passed to it
+   uint32_t readSubHistories(BinaryDataRef scrAddrStr,
+      uint32_t startBlock, uint32_t endBlock, bool unspentOnly,
+      const function<bool(StoredSubHistory&)>& callback) const;
+
+   // Only loads the sub-histories holding UTXOs, unlike getFullUTXOMapForSSH
+   void getUTXOMapForScrAddr(BinaryDataRef scrAddrStr,
+      map<BinaryData, UnspentTxOut> & mapToFill,
+      bool withMultisig = false,
+      uint32_t startBlock = 0,
+      uint32_t endBlock = UINT32_MAX);
+
    uint64_t getBalanceForScrAddr(BinaryDataRef scrAddr, bool withMulti = false);
 
    // TODO: We should probably implement some kind of method for accessing or 
@@ -568,6 +588,74 @@ public:
    bool putStoredHeadHgtList(StoredHeadHgtList const & hhl);
    bool getStoredHeadHgtList(StoredHeadHgtList & hhl, uint32_t height);
 
+   //Fullnode only, lives in BLKDATA next to the raw block
+   bool putStoredBlockFilter(StoredBlockFilter const & sbf);
+   bool getStoredBlockFilter(StoredBlockFilter & sbf, 
+      uint32_t height, uint8_t dup) const;
+
+   //scan checkpoints live next to the SDBI, see StoredScanCheckpoint
+   void putScanCheckpoint(StoredScanCheckpoint const & sscp);
+   bool getScanCheckpoint(StoredScanCheckpoint & sscp);
+   void deleteScanCheckpoint(void);
+
+   //wallet ledger cache, in HISTORY. put/get run in the caller's tx, reset 
+   //opens its own RW tx
+   void putStoredLedgerCache(StoredLedgerCache const & slc);
+   bool getStoredLedgerCache(StoredLedgerCache & slc, BinaryDataRef walletID,
+      BinaryDataRef fingerprint, uint32_t height) const;
+   BinaryData getLedgerCacheFingerprint(BinaryDataRef walletID) const;
+   
+   //drops all of the wallet's cached ledgers, then records the fingerprint 
+   //the next ones will be written with
+   void resetLedgerCache(BinaryDataRef walletID, BinaryDataRef fingerprint);
+
+   //the main scrAddr filter's scan watermark and its generation, see 
+   //StoredScriptHistory. In HISTORY, UINT32_MAX and 0 if there is none. All
+   //run in the caller's tx
+   uint32_t getScanWatermark(void) const;
+   uint32_t getScanGeneration(void) const;
+   void putScanWatermark(uint32_t height, uint32_t generation);
+
+   //supernode scrAddr summaries, in BLKDATA, see StoredAddrSummary. put/get
+   //run in the caller's tx
+   void putStoredAddrSummary(StoredAddrSummary const & sas);
+   bool getStoredAddrSummary(StoredAddrSummary & sas, 
+      BinaryDataRef scrAddr) const;
+
+   //UINT32_MAX if no summary was ever written
+   uint32_t getAddrSummaryStartHeight(void) const;
+   void putAddrSummaryStartHeight(uint32_t height);
+
+   //first and last heights with a sub-history for this scrAddr, false if 
+   //there is none. Walks the SSH keys, for when a summary can't be updated
+   //incrementally
+   bool getSubHistoryHeightRange(BinaryDataRef scrAddr,
+      uint32_t& first, uint32_t& last) const;
+
+   //drops all summaries and the start height, opens its own RW tx
+   void deleteAddrSummaries(void);
+
+   //fullnode outpoint table, in HISTORY, see StoredUtxo. All run in the 
+   //caller's tx. A null entry is deleted
+   void putStoredUtxo(StoredUtxo const & stu);
+   bool getStoredUtxo(StoredUtxo & stu, BinaryDataRef hashAndId) const;
+
+   //UINT32_MAX if no entry was ever written
+   uint32_t getUtxoTableStartHeight(void) const;
+   void putUtxoTableStartHeight(uint32_t height);
+
+   //block positions in the blk files, in HEADERS, see StoredBlockFilePos.
+   //All run in the caller's tx
+   void putBlockFilePos(StoredBlockFilePos const & sbfp);
+   bool getBlockFilePos(StoredBlockFilePos & sbfp, BinaryDataRef hash) const;
+
+   //header reading resumes at fileNum/offset, lastHeader is the last header
+   //read before it. False if there is no watermark
+   bool getBlockFileWatermark(uint32_t& fileNum, uint64_t& offset,
+      StoredBlockFilePos & lastHeader) const;
+   void putBlockFileWatermark(uint32_t fileNum, uint64_t offset,
+      StoredBlockFilePos const & lastHeader);
+
    ////////////////////////////////////////////////////////////////////////////
    // Some methods to grab data at the current iterator location.  Return
    // false if reading fails (maybe because we were expecting to find the
@@ -644,6 +732,14 @@ public:
    bool isReady(void) { return isDBReady_(); }
    ARMORY_DB_TYPE armoryDbType(void) { return armoryDbType_; }
 
+   void setBuildBlockFilters(bool build) { buildBlockFilters_ = build; }
+   bool buildBlockFilters(void) const { return buildBlockFilters_; }
+
+   //attach to the DB of another process: envs are opened read only and 
+   //nothing gets seeded
+   void setReadOnly(bool readOnly) { readOnly_ = readOnly; }
+   bool isReadOnly(void) const { return readOnly_; }
+
 private:
    string               baseDir_;
    string dbBlkdataFilename() const { return baseDir_ + "/blocks";  }
@@ -658,6 +754,11 @@ private:
    ARMORY_DB_TYPE armoryDbType_;
    DB_PRUNE_TYPE dbPruneType_;
 
+   //fullnode: compute a StoredBlockFilter for each raw block put in BLKDATA
+   bool buildBlockFilters_ = true;
+
+   bool readOnly_ = false;
+
 public:
 
    mutable map<DB_SELECT, shared_ptr<LMDBEnv> > dbEnv_;
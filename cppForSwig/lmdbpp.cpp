@@ -7,6 +7,7 @@
 #include <cstring>
 #include <algorithm>
 #include <iostream>
+#include <thread>
 
 #ifndef _WIN32_
 #include <sys/types.h>
@@ -20,6 +21,52 @@ static std::string errorString(int rc)
    return mdb_strerror(rc);
 }
 
+namespace
+{
+   // what a thread knows of the envs it has used. A handful at most, a
+   // linear scan beats hashing
+   struct ThreadTxEntry
+   {
+      const LMDBEnv *env_;
+      uint64_t envId_;
+      std::shared_ptr<LMDBThreadTxInfo> info_;
+   };
+   typedef std::vector<ThreadTxEntry> ThreadTxCache;
+
+   pthread_key_t threadTxKey;
+   pthread_once_t threadTxKeyOnce = PTHREAD_ONCE_INIT;
+   
+   std::atomic<uint64_t> envIdCounter(0);
+
+   void releaseThreadTxCache(void *ptr)
+   {
+      auto cache = static_cast<ThreadTxCache*>(ptr);
+      for (auto& entry : *cache)
+         entry.info_->threadExited_.store(true, std::memory_order_release);
+      delete cache;
+   }
+
+   void createThreadTxKey()
+   {
+      pthread_key_create(&threadTxKey, releaseThreadTxCache);
+   }
+
+   ThreadTxCache& getThreadTxCache()
+   {
+      pthread_once(&threadTxKeyOnce, createThreadTxKey);
+
+      auto cache = static_cast<ThreadTxCache*>(
+         pthread_getspecific(threadTxKey));
+      if (cache == nullptr)
+      {
+         cache = new ThreadTxCache();
+         pthread_setspecific(threadTxKey, cache);
+      }
+
+      return *cache;
+   }
+}
+
 inline void LMDB::Iterator::checkHasDb() const
 {
    if (!db_)
@@ -54,20 +101,8 @@ inline void LMDB::Iterator::checkOk() const
 
 void LMDB::Iterator::openCursor()
 {
-   const pthread_t tID = pthread_self();
-   LMDBEnv *const env = db_->env;
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-   
-   auto txnIter = env->txForThreads_.find(tID);
-   if (txnIter == env->txForThreads_.end())
-      throw std::runtime_error("Iterator must be created within Transaction");
-   
-   lock.unlock();
-   
-   if (txnIter->second.transactionLevel_ == 0)
-      throw std::runtime_error("Iterator must be created within Transaction");
-   
-   txnPtr_ = &txnIter->second;
+   txnPtr_ = &db_->env->getOpenThreadTx(
+      "Iterator must be created within Transaction");
   
    int rc = mdb_cursor_open(txnPtr_->txn_, db_->dbi, &csr_);
    if (rc != MDB_SUCCESS)
@@ -313,12 +348,157 @@ LMDBEnv::~LMDBEnv()
    close();
 }
 
-void LMDBEnv::open(const char *filename)
+LMDBEnv::TxnCallScope::TxnCallScope(LMDBEnv *env)
+   : env_(env->readOnly_ ? env : nullptr)
+{
+   //the writer grows its own map, only read-only envs are ever remapped
+   if (env_ == nullptr)
+      return;
+
+   while (true)
+   {
+      env_->txnCallsInFlight_.fetch_add(1, std::memory_order_seq_cst);
+      if (!env_->remapping_.load(std::memory_order_seq_cst))
+         return;
+
+      //back off and wait the remap out
+      env_->txnCallsInFlight_.fetch_sub(1, std::memory_order_seq_cst);
+      std::unique_lock<std::mutex> remapLock(env_->remapMutex_);
+   }
+}
+
+LMDBEnv::TxnCallScope::~TxnCallScope()
+{
+   if (env_ != nullptr)
+      env_->txnCallsInFlight_.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+int LMDBEnv::remap()
+{
+   std::unique_lock<std::mutex> remapLock(remapMutex_);
+
+   //another thread may have remapped already, setting the size again is
+   //harmless
+   remapping_.store(true, std::memory_order_seq_cst);
+   while (txnCallsInFlight_.load(std::memory_order_seq_cst) != 0)
+      std::this_thread::yield();
+
+   int rc = mdb_env_set_mapsize(dbenv, 0);
+   remapping_.store(false, std::memory_order_seq_cst);
+   return rc;
+}
+
+int LMDBEnv::startTxn(unsigned modef, MDB_txn *&txn, bool renew)
+{
+   int rc;
+   {
+      TxnCallScope callScope(this);
+      rc = renew ? mdb_txn_renew(txn) : 
+         mdb_txn_begin(dbenv, nullptr, modef, &txn);
+   }
+   
+   if (rc != MDB_MAP_RESIZED || !readOnly_)
+      return rc;
+
+   //only begin and end calls are waited on, never open txns: a thread
+   //holding one may well be waiting on this one
+   rc = remap();
+   if (rc != MDB_SUCCESS)
+      return rc;
+
+   TxnCallScope callScope(this);
+   return renew ? mdb_txn_renew(txn) :
+      mdb_txn_begin(dbenv, nullptr, modef, &txn);
+}
+
+LMDBThreadTxInfo* LMDBEnv::findThreadTx()
+{
+   for (auto& entry : getThreadTxCache())
+   {
+      if (entry.env_ == this && entry.envId_ == envId_)
+         return entry.info_.get();
+   }
+
+   return nullptr;
+}
+
+LMDBThreadTxInfo& LMDBEnv::getThreadTx()
+{
+   LMDBThreadTxInfo* found = findThreadTx();
+   if (found != nullptr)
+      return *found;
+
+   //first use of this env by this thread
+   auto& cache = getThreadTxCache();
+   cache.erase(std::remove_if(cache.begin(), cache.end(),
+      [](const ThreadTxEntry& entry)->bool
+      { return entry.info_->envClosed_.load(std::memory_order_acquire); }),
+      cache.end());
+   
+   auto info = std::make_shared<LMDBThreadTxInfo>();
+
+   {
+      std::unique_lock<std::mutex> lock(threadTxMutex_);
+
+      //free what exited threads left behind
+      auto iter = threadTxs_.begin();
+      while (iter != threadTxs_.end())
+      {
+         if (!(*iter)->threadExited_.load(std::memory_order_acquire))
+         {
+            ++iter;
+            continue;
+         }
+
+         if ((*iter)->parkedTxn_ != nullptr)
+         {
+            TxnCallScope callScope(this);
+            mdb_txn_abort((*iter)->parkedTxn_);
+         }
+         iter = threadTxs_.erase(iter);
+      }
+
+      threadTxs_.push_back(info);
+   }
+
+   ThreadTxEntry entry = { this, envId_, info };
+   cache.push_back(entry);
+   return *info;
+}
+
+LMDBThreadTxInfo& LMDBEnv::getOpenThreadTx(const char *what)
+{
+   LMDBThreadTxInfo* thTx = findThreadTx();
+   if (thTx == nullptr || thTx->transactionLevel_ == 0)
+      throw LMDBException(what);
+
+   return *thTx;
+}
+
+void LMDBEnv::releaseThreadTxs()
+{
+   std::unique_lock<std::mutex> lock(threadTxMutex_);
+   for (auto& info : threadTxs_)
+   {
+      if (info->parkedTxn_ != nullptr)
+      {
+         mdb_txn_abort(info->parkedTxn_);
+         info->parkedTxn_ = nullptr;
+      }
+
+      info->envClosed_.store(true, std::memory_order_release);
+   }
+
+   threadTxs_.clear();
+   envId_ = ++envIdCounter;
+}
+
+void LMDBEnv::open(const char *filename, bool readOnly)
 {
    if (dbenv)
       throw std::logic_error("Database environment already open (close it first)");
 
-   txForThreads_.clear();
+   releaseThreadTxs();
    
    int rc;
 
@@ -330,7 +510,12 @@ void LMDBEnv::open(const char *filename)
    if (rc != MDB_SUCCESS)
       throw LMDBException("Failed to set max dbs (" + errorString(rc) + ")");
    
-   rc = mdb_env_open(dbenv, filename, MDB_NOSYNC|MDB_NOSUBDIR, 0600);
+   readOnly_ = readOnly;
+   unsigned int flags = MDB_NOSYNC|MDB_NOSUBDIR;
+   if (readOnly_)
+      flags |= MDB_RDONLY;
+
+   rc = mdb_env_open(dbenv, filename, flags, 0600);
    if (rc != MDB_SUCCESS)
       throw LMDBException("Failed to open db " + std::string(filename) + " (" + errorString(rc) + ")");
 }
@@ -339,6 +524,8 @@ void LMDBEnv::close()
 {
    if (dbenv)
    {
+      //parked read txns go first, they belong to the env
+      releaseThreadTxs();
       mdb_env_close(dbenv);
       dbenv = nullptr;
    }
@@ -376,36 +563,56 @@ void LMDBEnv::Transaction::begin()
    
    began = true;
 
-   const pthread_t tID = pthread_self();
+   LMDBThreadTxInfo& thTx = env->getThreadTx();
    
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-   LMDBThreadTxInfo& thTx = env->txForThreads_[tID];
-   lock.unlock();
-   
-   if (thTx.transactionLevel_ != 0 && mode_ == LMDB::ReadWrite && thTx.mode_ == LMDB::ReadOnly)
+   if (thTx.transactionLevel_ != 0 && mode_ == LMDB::ReadWrite && 
+       thTx.mode_ == LMDB::ReadOnly && !env->readOnly_)
       throw LMDBException("Cannot access ReadOnly Transaction in ReadWrite mode");
    
    if (thTx.transactionLevel_++ != 0)
       return;
       
    if (!env->dbenv)
+   {
+      thTx.transactionLevel_ = 0;
+      began = false;
       throw LMDBException("Cannot start transaction without db env");
+   }
       
    int modef = MDB_RDONLY;
    thTx.mode_ = LMDB::ReadOnly;
    
-   if (mode_ == LMDB::ReadWrite)
+   if (mode_ == LMDB::ReadWrite && !env->readOnly_)
    {
       modef = 0;
       thTx.mode_ = LMDB::ReadWrite;
    }
 
-   int rc = mdb_txn_begin(env->dbenv, nullptr, modef, &thTx.txn_);
+   int rc = MDB_SUCCESS;
+   thTx.txn_ = nullptr;
+
+   if (thTx.mode_ == LMDB::ReadOnly && thTx.parkedTxn_ != nullptr)
+   {
+      //revive the read txn parked by the last commit
+      thTx.txn_ = thTx.parkedTxn_;
+      thTx.parkedTxn_ = nullptr;
+
+      rc = env->startTxn(modef, thTx.txn_, true);
+      if (rc != MDB_SUCCESS)
+      {
+         TxnCallScope callScope(env);
+         mdb_txn_abort(thTx.txn_);
+         thTx.txn_ = nullptr;
+      }
+   }
+
+   if (thTx.txn_ == nullptr)
+      rc = env->startTxn(modef, thTx.txn_, false);
+
    if (rc != MDB_SUCCESS)
    {
-      lock.lock();
-      env->txForThreads_.erase(tID);
-      lock.unlock();
+      thTx.txn_ = nullptr;
+      thTx.transactionLevel_ = 0;
       
       began = false;
       throw LMDBException("Failed to create transaction (" + errorString(rc) +")");
@@ -431,33 +638,41 @@ void LMDBEnv::Transaction::commit()
    began=false;
 
    //look for an existing transaction in this thread
-   const pthread_t tID = pthread_self();
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-   auto txnIter = env->txForThreads_.find(tID);
-
-   if (txnIter == env->txForThreads_.end())
-      throw LMDBException("Transaction bound to unknown thread");
-   lock.unlock();
-
-   LMDBThreadTxInfo& thTx = txnIter->second;
+   LMDBThreadTxInfo& thTx = 
+      env->getOpenThreadTx("Transaction bound to unknown thread");
 
    if (thTx.transactionLevel_-- == 1)
    {
-      int rc = mdb_txn_commit(thTx.txn_);
+      MDB_txn *txn = thTx.txn_;
+      thTx.txn_ = nullptr;
+
+      int rc = MDB_SUCCESS;
+      {
+         TxnCallScope callScope(env);
+         if (thTx.mode_ == LMDB::ReadOnly && env->reuseReadTxns_ &&
+             !thTx.commitReadTxn_ && thTx.parkedTxn_ == nullptr)
+         {
+            //release the snapshot but keep the txn for the next read
+            mdb_txn_reset(txn);
+            thTx.parkedTxn_ = txn;
+         }
+         else
+            rc = mdb_txn_commit(txn);
+      }
+
+      thTx.commitReadTxn_ = false;
       
       for (LMDB::Iterator *i : thTx.iterators_)
       {
          i->hasTx=false;
          i->csr_=nullptr;
       }
+      thTx.iterators_.clear();
       
       if (rc != MDB_SUCCESS)
       {
          throw LMDBException("Failed to close env tx (" + errorString(rc) +")");
       }
-      
-      lock.lock();
-      env->txForThreads_.erase(txnIter);
    }
 }
 
@@ -486,8 +701,11 @@ void LMDB::close()
    {
       {
          std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-         if (!env->txForThreads_.empty())
-            throw std::runtime_error("Tried to close database with open txes");
+         for (auto& thTx : env->threadTxs_)
+         {
+            if (thTx->transactionLevel_ != 0)
+               throw std::runtime_error("Tried to close database with open txes");
+         }
       }
       mdb_dbi_close(env->dbenv, dbi);
       dbi=0;
@@ -505,15 +723,16 @@ void LMDB::open(LMDBEnv *env, const std::string &name)
    this->env = env;
    
    LMDBEnv::Transaction tx(env);
-   const pthread_t tID = pthread_self();
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-   auto txnIter = env->txForThreads_.find(tID);
+   LMDBThreadTxInfo& thTx = 
+      env->getOpenThreadTx("Failed to insert: need transaction");
 
-   if (txnIter == env->txForThreads_.end())
-      throw LMDBException("Failed to insert: need transaction");
-   lock.unlock();
+   //the handle is lost unless this txn is committed
+   if (thTx.mode_ == LMDB::ReadOnly)
+      thTx.commitReadTxn_ = true;
       
-   int rc = mdb_open(txnIter->second.txn_, name.c_str(), MDB_CREATE, &dbi);
+   //read only envs can only open existing dbs
+   int rc = mdb_open(thTx.txn_, name.c_str(), 
+      env->readOnly_ ? 0 : MDB_CREATE, &dbi);
    if (rc != MDB_SUCCESS)
    {
       // cleanup here
@@ -529,17 +748,10 @@ void LMDB::insert(
    MDB_val mkey = { key.len, const_cast<char*>(key.data) };
    MDB_val mval = { value.len, const_cast<char*>(value.data) };
    
-   const pthread_t tID = pthread_self();
-   
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
+   LMDBThreadTxInfo& thTx = 
+      env->getOpenThreadTx("Failed to insert: need transaction");
    
-   auto txnIter = env->txForThreads_.find(tID);
-
-   if (txnIter == env->txForThreads_.end())
-      throw LMDBException("Failed to insert: need transaction");
-   lock.unlock();
-   
-   int rc = mdb_put(txnIter->second.txn_, dbi, &mkey, &mval, 0);
+   int rc = mdb_put(thTx.txn_, dbi, &mkey, &mval, 0);
    if (rc != MDB_SUCCESS)
    {
       std::cout << "failed to insert data, returned following error string: " << errorString(rc) << std::endl;
@@ -549,16 +761,11 @@ void LMDB::insert(
 
 void LMDB::erase(const CharacterArrayRef& key)
 {
-   const pthread_t tID = pthread_self();
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-   auto txnIter = env->txForThreads_.find(tID);
-
-   if (txnIter == env->txForThreads_.end())
-      throw LMDBException("Failed to insert: need transaction");
-   lock.unlock();
+   LMDBThreadTxInfo& thTx = 
+      env->getOpenThreadTx("Failed to insert: need transaction");
       
    MDB_val mkey = { key.len, const_cast<char*>(key.data) };
-   int rc = mdb_del(txnIter->second.txn_, dbi, &mkey, 0);
+   int rc = mdb_del(thTx.txn_, dbi, &mkey, 0);
    if (rc != MDB_SUCCESS && rc != MDB_NOTFOUND)
    {
       std::cout << "failed to erase data, returned following error string: " << errorString(rc) << std::endl;
@@ -579,19 +786,13 @@ CharacterArrayRef LMDB::get_NoCopy(const CharacterArrayRef& key) const
 {
    //simple get without the use of iterators
 
-   const pthread_t tID = pthread_self();
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-   
-   auto txnIter = env->txForThreads_.find(tID);
-   if (txnIter == env->txForThreads_.end())
-      throw std::runtime_error("Need transaction to get data");
-   
-   lock.unlock();
+   LMDBThreadTxInfo& thTx = 
+      env->getOpenThreadTx("Need transaction to get data");
 
    MDB_val mkey = { key.len, const_cast<char*>(key.data) };
    MDB_val mdata = { 0, 0 };
 
-   int rc = mdb_get(txnIter->second.txn_, dbi, &mkey, &mdata);
+   int rc = mdb_get(thTx.txn_, dbi, &mkey, &mdata);
    if (rc == MDB_NOTFOUND)
       return CharacterArrayRef(0, (char*)nullptr);
    
@@ -604,16 +805,10 @@ CharacterArrayRef LMDB::get_NoCopy(const CharacterArrayRef& key) const
 
 void LMDB::drop(void)
 {
-   const pthread_t tID = pthread_self();
-   std::unique_lock<std::mutex> lock(env->threadTxMutex_);
-
-   auto txnIter = env->txForThreads_.find(tID);
-   if (txnIter == env->txForThreads_.end())
-      throw std::runtime_error("Need transaction to get data");
-
-   lock.unlock();
+   LMDBThreadTxInfo& thTx = 
+      env->getOpenThreadTx("Need transaction to get data");
 
-   if (mdb_drop(txnIter->second.txn_, dbi, 0) != MDB_SUCCESS)
+   if (mdb_drop(thTx.txn_, dbi, 0) != MDB_SUCCESS)
       throw std::runtime_error("Failed to drop DB!");
 }
 
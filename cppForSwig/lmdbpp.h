@@ -7,6 +7,8 @@
 #include <unordered_map>
 #include <pthread.h>
 #include <mutex>
+#include <memory>
+#include <atomic>
 
 struct MDB_env;
 struct MDB_txn;
@@ -229,13 +231,30 @@ private:
    LMDB(const LMDB &nocopy);
 };
 
+// A thread's transaction state in one env. It is owned by the env, the
+// thread finds it through thread local storage without locking. Between
+// read transactions the MDB_txn is parked with mdb_txn_reset and revived 
+// with mdb_txn_renew rather than torn down and created again
 struct LMDBThreadTxInfo
 {
    MDB_txn *txn_=nullptr;
+   MDB_txn *parkedTxn_=nullptr;
 
    std::vector<LMDB::Iterator*> iterators_;
    unsigned transactionLevel_=0;
    LMDB::Mode mode_;
+
+   //dbis opened in a read txn only outlive it if it's committed
+   bool commitReadTxn_=false;
+
+   //set by the owning thread on exit, the env frees the info on its next
+   //registration
+   std::atomic<bool> threadExited_;
+
+   //set by the env on close, the thread drops the info on its next lookup
+   std::atomic<bool> envClosed_;
+
+   LMDBThreadTxInfo() : threadExited_(false), envClosed_(false) {}
 };
 
 
@@ -246,12 +265,53 @@ public:
 
 private:
    MDB_env *dbenv=nullptr;
+   bool readOnly_=false;
+   bool reuseReadTxns_=true;
 
+   //changes on every open and close, so that thread local entries keyed
+   //on a previous env at the same address are never matched
+   uint64_t envId_=0;
+
+   //guards threadTxs_, only taken the first time a thread uses the env
+   //and on close
    std::mutex threadTxMutex_;
-   std::unordered_map<pthread_t, LMDBThreadTxInfo> txForThreads_;
+   std::vector<std::shared_ptr<LMDBThreadTxInfo>> threadTxs_;
+   
+   //another process grew the file past our map, which only happens to 
+   //read-only envs attached to a writer. Remapping swaps the env's current
+   //map, which txn begin and end calls read and refcount, so it can't run
+   //alongside any of them on this env: it holds new calls off and waits for
+   //those in flight to drain. Open txns keep reading through the map they
+   //started on, it is unmapped with the last of them
+   std::mutex remapMutex_;
+   std::atomic<bool> remapping_;
+   std::atomic<unsigned> txnCallsInFlight_;
+
+   // held across every mdb_txn_* call that begins or ends a txn on the env,
+   // does nothing on envs that aren't read-only
+   class TxnCallScope
+   {
+      LMDBEnv *env_;
+   public:
+      TxnCallScope(LMDBEnv *env);
+      ~TxnCallScope();
+   };
+
+   // begin or renew a txn, mapping the new size if the writer grew the file
+   int startTxn(unsigned modef, MDB_txn *&txn, bool renew);
+   int remap();
    
    friend class LMDB;
 
+   // this thread's transaction state, registered on first use
+   LMDBThreadTxInfo& getThreadTx();
+   // same without registering, nullptr if this thread never used the env
+   LMDBThreadTxInfo* findThreadTx();
+   // this thread's state if it has a transaction open, throws otherwise
+   LMDBThreadTxInfo& getOpenThreadTx(const char *what);
+   
+   void releaseThreadTxs();
+
 public:
    class Transaction
    {
@@ -288,13 +348,22 @@ public:
       Transaction(const Transaction&); // no copies
    };
 
-   LMDBEnv() { }
+   LMDBEnv() : remapping_(false), txnCallsInFlight_(0) { }
    ~LMDBEnv();
    
-   // open a database by filename
-   void open(const char *filename);
-   void open(const std::string &filename)
-      { open(filename.c_str()); }
+   // open a database by filename. A read only env can be shared with a 
+   // writer in another process: each new transaction sees the latest commit.
+   // ReadWrite transactions on a read only env are opened ReadOnly, and 
+   // writes will fail
+   void open(const char *filename, bool readOnly=false);
+   void open(const std::string &filename, bool readOnly=false)
+      { open(filename.c_str(), readOnly); }
+   
+   bool isReadOnly() const { return readOnly_; }
+
+   // park read transactions between uses (the default). Off, every read
+   // transaction is created and torn down again
+   void setReuseReadTxns(bool reuse) { reuseReadTxns_ = reuse; }
 
    // close a database, doing nothing if one is presently not open
    void close();
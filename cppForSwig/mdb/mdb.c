@@ -2862,6 +2862,9 @@ mdb_txn_reset0(MDB_txn *txn, const char *act)
 void
 mdb_txn_reset(MDB_txn *txn)
 {
+   MDB_env *env;
+   MDB_mapinfo *mi;
+
 	if (txn == NULL)
 		return;
 
@@ -2869,7 +2872,24 @@ mdb_txn_reset(MDB_txn *txn)
 	if (!(txn->mt_flags & MDB_TXN_RDONLY))
 		return;
 
+   /* already reset */
+   if (!txn->mt_dbxs)
+      return;
+
+   env = txn->mt_env;
+   mi = txn->mt_map.current_map;
 	mdb_txn_reset0(txn, "reset");
+
+   /* release the map as commit does, renew takes the current one */
+   if (env->me_txns && mi) {
+      txn->mt_map.current_map = NULL;
+      mi->sema--;
+      if (mi->sema == 0 && mi != &env->me_maps[env->me_currentmap])
+      {
+         munmap(mi->me_map, mi->me_mapsize);
+         mi->me_map = 0;
+      }
+   }
 }
 
 void
@@ -136,6 +136,9 @@ bool TxIOPair::setTxIn(TxRef  txref, uint32_t index)
    txRefOfInput_ = txref;
    indexOfInput_ = index;
 
+   spentInMain_ = false;
+   spentInMainResolved_ = !txref.isInitialized();
+
    return true;
 }
 
@@ -328,6 +331,8 @@ TxIOPair& TxIOPair::operator=(const TxIOPair &rhs)
    this->txtime_ = rhs.txtime_;
 
    this->isUTXO_ = rhs.isUTXO_;
+   this->spentInMain_ = rhs.spentInMain_;
+   this->spentInMainResolved_ = rhs.spentInMainResolved_;
 
    return *this;
 }
@@ -351,6 +356,8 @@ TxIOPair& TxIOPair::operator=(TxIOPair&& toMove)
    this->txtime_ = toMove.txtime_;
 
    this->isUTXO_ = toMove.isUTXO_;
+   this->spentInMain_ = toMove.spentInMain_;
+   this->spentInMainResolved_ = toMove.spentInMainResolved_;
 
    return *this;
 }
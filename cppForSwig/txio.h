@@ -122,6 +122,17 @@ public:
    bool isUTXO(void) const { return isUTXO_; }
    void setUTXO(bool val) { isUTXO_ = val; }
 
+   //Main branch spentness, resolved by whoever sets the TxIn so that 
+   //serializing the txio doesn't have to look up the TxIn's block. Setting
+   //the TxIn again clears it
+   void setSpentInMain(bool isSpent)
+   {
+      spentInMain_ = isSpent;
+      spentInMainResolved_ = true;
+   }
+   bool isSpentInMainResolved(void) const { return spentInMainResolved_; }
+   bool isSpentInMain(void) const { return spentInMain_; }
+
    void setScrAddrLambda(function < const BinaryData&(void) > func)
    {
       getScrAddr_ = func;
@@ -167,6 +178,10 @@ private:
    ***/
    bool isUTXO_ = false;
 
+   //without a TxIn, a txio is resolved as unspent
+   bool spentInMain_ = false;
+   bool spentInMainResolved_ = true;
+
    //used to get a relevant scrAddr from a txio
    function<const BinaryData& (void)> getScrAddr_ = 
       [](void)->const BinaryData&
@@ -0,0 +1,190 @@
+'''
+Checks that the long running calls into CppBlockUtils let other Python
+threads run. A heartbeat thread wakes up every HEARTBEAT_INTERVAL and records
+the longest gap between two wake ups while a native call is in flight. If the
+call held the GIL, that gap would be as long as the call itself.
+
+See the GIL policy at the top of cppForSwig/CppBlockUtils.i
+'''
+import sys
+sys.path.append('..')
+from pytest.Tiab import TiabTest, FIRST_WLT_NAME
+import os
+import time
+import threading
+import unittest
+
+from CppBlockUtils import KdfRomix, CryptoECDSA, SecureBinaryData
+from armoryengine.ArmoryUtils import Hash160ToScrAddr, IGNOREZC
+from armoryengine.BDM import TheBDM
+from armoryengine.PyBtcWallet import PyBtcWallet
+
+sys.argv.append('--nologging')
+
+HEARTBEAT_INTERVAL = 0.002
+
+# A Python thread may have to wait a few switch intervals (5ms by default in
+# Python 3, 100 ticks in Python 2) to get the GIL back, never the length of a
+# native call
+MAX_HEARTBEAT_STALL = 0.05
+
+# Large enough for DeriveKey to run for a good fraction of a second
+KDF_MEMORY_BYTES = 32*1024*1024
+KDF_ITERATIONS = 4
+
+class Heartbeat(object):
+   def __init__(self, interval=HEARTBEAT_INTERVAL):
+      self.interval = interval
+      self.maxGap = 0
+      self.beats = 0
+      self.running = False
+      self.thread = None
+
+   def beat(self):
+      last = time.time()
+      while self.running:
+         time.sleep(self.interval)
+         now = time.time()
+         self.maxGap = max(self.maxGap, now - last)
+         self.beats += 1
+         last = now
+
+   def __enter__(self):
+      self.running = True
+      self.thread = threading.Thread(target=self.beat)
+      self.thread.daemon = True
+      self.thread.start()
+
+      # let the heartbeat get going before the measured call
+      time.sleep(self.interval*5)
+      self.maxGap = 0
+      self.beats = 0
+      self.startTime = time.time()
+      return self
+
+   def __exit__(self, *args):
+      self.duration = time.time() - self.startTime
+      self.running = False
+      self.thread.join()
+
+   def stall(self):
+      return max(0, self.maxGap - self.interval)
+
+
+def measureStall(call):
+   '''returns the heartbeat stall, the call duration and its result'''
+   with Heartbeat() as hb:
+      result = call()
+   return hb.stall(), hb.duration, result
+
+
+class StallAssertions(object):
+
+   def assertNoStall(self, name, stall, duration):
+      print '%s: ran %0.3fs, heartbeat stalled %0.4fs' % \
+         (name, duration, stall)
+      self.assertLess(stall, MAX_HEARTBEAT_STALL)
+
+
+class GILReleaseTest(StallAssertions, unittest.TestCase):
+
+   def testDeriveKey(self):
+      kdf = KdfRomix(KDF_MEMORY_BYTES, KDF_ITERATIONS,
+                     SecureBinaryData('\x31'*32))
+      password = SecureBinaryData('This is a passphrase')
+
+      stall, duration, key = measureStall(lambda: kdf.DeriveKey(password))
+      self.assertNoStall('KdfRomix::DeriveKey', stall, duration)
+
+      # the call is only meaningful if it outlasts the stall threshold
+      self.assertGreater(duration, MAX_HEARTBEAT_STALL)
+
+      # the same KdfRomix is used from several threads at once
+      keys = []
+      def derive():
+         keys.append(kdf.DeriveKey(password).toHexStr())
+      threads = [threading.Thread(target=derive) for i in range(4)]
+      for t in threads:
+         t.start()
+      for t in threads:
+         t.join()
+      self.assertEqual(keys, [key.toHexStr()]*4)
+
+   def testComputeChainedPublicKey(self):
+      privKey = SecureBinaryData('\xaa'*32)
+      chaincode = SecureBinaryData('\xee'*32)
+      pubKey = CryptoECDSA().ComputePublicKey(privKey)
+
+      def chain():
+         ecdsa = CryptoECDSA()
+         key = pubKey
+         for i in range(200):
+            key = ecdsa.ComputeChainedPublicKey(key, chaincode)
+         return key
+
+      stall, duration, key = measureStall(chain)
+      self.assertNoStall('CryptoECDSA::ComputeChainedPublicKey', stall,
+         duration)
+
+
+# These tests need to be run in the TiaB
+class GILReleaseTiabTest(StallAssertions, TiabTest):
+
+   def setUp(self):
+      self.verifyBlockHeight()
+      self.fileA = os.path.join(self.tiab.tiabDirectory, 'tiab', 'armory', \
+                                'armory_%s_.wallet' % FIRST_WLT_NAME)
+      self.wlt = PyBtcWallet().readWalletFile(self.fileA)
+      self.wlt.registerWallet(isNew=False)
+
+      i = 0
+      while not self.wlt.isRegistered():
+         time.sleep(0.5)
+         i += 1
+         if i >= 40:
+            raise RuntimeError("Timeout waiting for the wallet to register.")
+
+   def tearDown(self):
+      self.wlt.unregisterWallet()
+
+   def testGetHistoryPage(self):
+      cppWallet = self.wlt.cppWallet
+      stall, duration, ledger = measureStall(
+         lambda: cppWallet.getHistoryPageAsVector(0))
+      self.assertNoStall('BtcWallet::getHistoryPageAsVector', stall, duration)
+      self.assertGreater(len(ledger), 0)
+
+   def testGetSpendableTxOutList(self):
+      cppWallet = self.wlt.cppWallet
+      stall, duration, utxos = measureStall(
+         lambda: cppWallet.getSpendableTxOutListForValue(2**64-1,
+                                                         IGNOREZC))
+      self.assertNoStall('BtcWallet::getSpendableTxOutListForValue', stall,
+         duration)
+      self.assertGreater(len(utxos), 0)
+
+   def testGetUnspentTxoutsForAddr160List(self):
+      scrAddrs = [Hash160ToScrAddr(addr.getAddr160()) \
+                  for addr in self.wlt.getLinearAddrList()]
+
+      stall, duration, utxos = measureStall(
+         lambda: TheBDM.bdv().getUnspentTxoutsForAddr160List(scrAddrs,
+                                                              IGNOREZC))
+      self.assertNoStall('BlockDataViewer::getUnspentTxoutsForAddr160List',
+         stall, duration)
+      self.assertGreater(len(utxos), 0)
+
+   def testGetTxByHash(self):
+      ledger = self.wlt.cppWallet.getHistoryPageAsVector(0)
+      txHashes = [le.getTxHash() for le in ledger]
+
+      def lookup():
+         return [TheBDM.bdv().getTxByHash(txHash) for txHash in txHashes]
+
+      stall, duration, txs = measureStall(lookup)
+      self.assertNoStall('BlockDataViewer::getTxByHash', stall, duration)
+      self.assertTrue(all(tx.isInitialized() for tx in txs))
+
+
+if __name__ == "__main__":
+   unittest.main()